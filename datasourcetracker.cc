@@ -353,7 +353,8 @@ Datasourcetracker::Datasourcetracker() :
                     return iv;
                 });
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route("/datasource/add_source");
+    Bind_Httpd_Route("/datasource/by-uuid/:uuid/:action");
 }
 
 Datasourcetracker::~Datasourcetracker() {
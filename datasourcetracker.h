@@ -433,6 +433,10 @@ public:
 
     virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) override;
 
+    // Posts wait for the source to answer commands, such as opening it or setting the
+    // channel, so they don't run on the shared generator pool
+    virtual bool Httpd_GeneratorBlocks() override { return true; }
+
     // Operate on all data sources currently defined.  The datasource tracker is locked
     // during this operation, making it thread safe.
     void iterate_datasources(DST_Worker *in_worker);
@@ -25,6 +25,7 @@
 #include <list>
 #include <map>
 #include <vector>
+#include <unistd.h>
 
 #include "kismet_algorithm.h"
 
@@ -46,6 +47,7 @@
 #include "devicetracker_component.h"
 #include "devicetracker_view.h"
 #include "json_adapter.h"
+#include "kbin_adapter.h"
 #include "structured.h"
 #include "kismet_json.h"
 #include "storageloader.h"
@@ -59,6 +61,10 @@ int Devicetracker_packethook_commontracker(CHAINCALL_PARMS) {
 	return ((Devicetracker *) auxdata)->CommonTracker(in_pack);
 }
 
+int Devicetracker_packethook_indextracker(CHAINCALL_PARMS) {
+	return ((Devicetracker *) auxdata)->IndexTracker(in_pack);
+}
+
 Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
     Kis_Net_Httpd_Chain_Stream_Handler(),
     KisDatabase(in_globalreg, "devicetracker") {
@@ -67,8 +73,27 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 
     next_phy_id = 0;
 
-    // create a vector
-    immutable_tracked_vec = std::make_shared<TrackerElementVector>();
+    device_id_limit = 0;
+
+    device_snapshot = std::make_shared<const device_snapshot_t>();
+    device_list_generation = 0;
+    device_snapshot_generation = 0;
+
+    removed_lost_generation = 0;
+
+    // Split the device index into a power-of-two number of shards
+    unsigned int num_shards =
+        globalreg->kismet_config->FetchOptUInt("tracker_device_shards", 16);
+
+    if (num_shards < 1)
+        num_shards = 1;
+
+    unsigned int shard_sz = 1;
+    while (shard_sz < num_shards)
+        shard_sz <<= 1;
+
+    for (unsigned int i = 0; i < shard_sz; i++)
+        device_shards.push_back(std::unique_ptr<device_shard>(new device_shard()));
 
     // Create the pcap httpd
     httpd_pcap = std::make_shared<Devicetracker_Httpd_Pcap>();
@@ -156,6 +181,10 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 	packetchain->RegisterHandler(&Devicetracker_packethook_commontracker,
 											this, CHAINPOS_TRACKER, -100);
 
+    // Index tracker, after every phy tracker has updated the devices
+	packetchain->RegisterHandler(&Devicetracker_packethook_indextracker,
+											this, CHAINPOS_TRACKER, 100000);
+
     std::shared_ptr<Timetracker> timetracker = 
         Globalreg::FetchMandatoryGlobalAs<Timetracker>(globalreg, "TIMETRACKER");
 
@@ -225,9 +254,10 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 
                             devices_storing = true;
 
-                            // Run the device storage in its own thread
+                            // Run the device storage in its own thread, only writing
+                            // the devices changed since the last checkpoint
                             std::thread t([this] {
-                                store_devices(immutable_tracked_vec);
+                                store_devices();
 
                                 {
                                     local_locker l(&storing_mutex);
@@ -284,6 +314,13 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
         map_phy_views = true;
     }
 
+    if (!globalreg->kismet_config->FetchOptBoolean("track_device_indices", true)) {
+        _MSG("Not building secondary device indices to save RAM", MSGFLAG_INFO);
+        map_device_indices = false;
+    } else {
+        map_device_indices = true;
+    }
+
     if (globalreg->kismet_config->FetchOptBoolean("kis_log_devices", true)) {
         unsigned int lograte = 
             globalreg->kismet_config->FetchOptUInt("kis_log_device_rate", 30);
@@ -330,13 +367,28 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 
     last_devicelist_saved = 0;
     last_database_logged = 0;
+    storage_checkpoint_generation = 0;
+
+    restore_threads = 
+        globalreg->kismet_config->FetchOptUInt("persistent_load_threads", 
+                std::min(std::thread::hardware_concurrency(), 4U));
+    if (restore_threads == 0)
+        restore_threads = 1;
+    devices_restoring = false;
+    restore_cancelled = false;
+    restore_total = 0;
+    restore_loaded = 0;
 
     // Preload the vector for speed
     unsigned int preload_sz = 
         globalreg->kismet_config->FetchOptUInt("tracker_device_presize", 1000);
 
     tracked_vec.reserve(preload_sz);
-    immutable_tracked_vec->reserve(preload_sz);
+
+    for (auto& shard : device_shards) {
+        shard->tracked_map.reserve(preload_sz / device_shards.size());
+        shard->tracked_mac_multimap.reserve(preload_sz / device_shards.size());
+    }
 
     // Set up the device timeout
     device_idle_expiration =
@@ -376,6 +428,25 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 		max_devices_timer = -1;
 	}
 
+    // Publish new device list snapshots for readers at most once per timeslice
+    device_snapshot_timer =
+        timetracker->RegisterTimer(1, NULL, 1, this);
+
+    // Advance the change generation on a timer, shared by every delta client and the
+    // storage checkpoint; changes within a generation share one entry in the change 
+    // history of a device, no matter how many clients are polling.  Devices remember
+    // four generations, so the period sets how long a delta client can go between 
+    // polls before it is sent complete devices.
+    change_generation_period =
+        globalreg->kismet_config->FetchOptUInt("tracker_delta_generation_period", 5);
+
+    if (change_generation_period < 1)
+        change_generation_period = 1;
+
+    change_generation_timer =
+        timetracker->RegisterTimer(SERVER_TIMESLICES_SEC * change_generation_period, 
+                NULL, 1, this);
+
     full_refresh_time = globalreg->timestamp.tv_sec;
 
     track_history_cloud =
@@ -387,6 +458,87 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
                 "keep_datasource_signal_history=true", MSGFLAG_INFO);
     }
 
+    memory_budget =
+        entrytracker->RegisterAndGetFieldAs<tracked_memory_budget>("kismet.system.memory_budget",
+            TrackerElementFactory<tracked_memory_budget>(), "Devicetracker memory budget");
+
+    memory_budget_kb =
+        globalreg->kismet_config->FetchOptULong("tracker_memory_budget", 0) * 1024;
+    memory_min_overhead_kb = 0;
+
+    memory_budget->set_budget_kb(memory_budget_kb);
+
+    if (memory_budget_kb > 0) {
+        unsigned int budget_rate =
+            globalreg->kismet_config->FetchOptUInt("tracker_memory_budget_interval", 30);
+
+        if (budget_rate < 1)
+            budget_rate = 1;
+
+        _MSG_INFO("Limiting device memory to a budget of {}MB; optional device data will "
+                "be discarded, then older devices removed, when the budget is exceeded.",
+                memory_budget_kb / 1024);
+
+        memory_budget_timer =
+            timetracker->RegisterTimer(SERVER_TIMESLICES_SEC * budget_rate, NULL, 1, this);
+    } else {
+        memory_budget_timer = -1;
+    }
+
+    cold_storage =
+        entrytracker->RegisterAndGetFieldAs<tracked_cold_storage>("kismet.system.cold_storage",
+            TrackerElementFactory<tracked_cold_storage>(), "Devicetracker cold storage");
+
+    coldstore = NULL;
+    cold_tiered_count = 0;
+    cold_rehydrated_count = 0;
+    cold_rehydrated_reported = 0;
+    cold_storage_timer = -1;
+
+    cold_idle_threshold =
+        globalreg->kismet_config->FetchOptULong("tracker_cold_storage_idle", 0);
+    cold_timeout =
+        globalreg->kismet_config->FetchOptULong("tracker_cold_storage_timeout", 0);
+
+    cold_storage->set_idle_threshold(cold_idle_threshold);
+
+    if (cold_idle_threshold > 0) {
+        coldstore = new DevicetrackerColdStore(globalreg, this, 
+                globalreg->kismet_config->FetchOpt("tracker_cold_storage_path"));
+
+        if (!coldstore->Database_Valid()) {
+            _MSG_ERROR("Unable to open the device cold storage, idle devices will not be "
+                    "moved to cold storage.");
+            delete(coldstore);
+            coldstore = NULL;
+        } else {
+            // Restore the stubs of devices already in cold storage, so they're still
+            // known after a restart
+            size_t num_stubs = 0;
+
+            coldstore->load_stubs([this, &num_stubs](const device_key& k, const mac_addr& m,
+                        time_t first_time, time_t last_time) {
+                    auto shard = fetch_device_shard(k);
+                    shard->cold_map[k] = 
+                        device_shard::cold_stub{m, first_time, last_time, false, nullptr};
+                    num_stubs++;
+                    });
+
+            // Devices seen again are restored on their own thread, so that packets never
+            // wait on the disk
+            cold_restore_pool = std::make_shared<kis_thread_pool>(1);
+
+            cold_storage->set_cold_devices(num_stubs);
+            cold_storage->set_store_size(coldstore->store_size());
+
+            _MSG_INFO("Devices idle for more than {} seconds will be moved to cold storage; "
+                    "{} devices are already in cold storage.", cold_idle_threshold, num_stubs);
+
+            cold_storage_timer =
+                timetracker->RegisterTimer(SERVER_TIMESLICES_SEC * 60, NULL, 1, this);
+        }
+    }
+
     track_persource_history =
         globalreg->kismet_config->FetchOptBoolean("keep_datasource_signal_history", true);
 
@@ -442,11 +594,80 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
                 },
                 &devicelist_mutex);
 
+    field_population_endp =
+        std::make_shared<Kis_Net_Httpd_Simple_Tracked_Endpoint>(
+                "/devices/field_population", true,
+                [this]() -> std::shared_ptr<TrackerElement> {
+                    return field_population_endp_handler();
+                });
+
+    delta_generation_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.generation",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "change generation to request the next delta from");
+
+    delta_devices_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.devices",
+                TrackerElementFactory<TrackerElementVector>(),
+                "devices changed since the requested generation");
+
+    delta_device_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.device",
+                TrackerElementFactory<TrackerElementMap>(),
+                "changed fields of a device");
+
+    delta_full_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.full",
+                TrackerElementFactory<TrackerElementUInt8>(),
+                "delta holds the complete device record");
+
+    delta_removed_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.removed",
+                TrackerElementFactory<TrackerElementVector>(),
+                "keys of devices removed since the requested generation");
+
+    delta_removed_key_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.removed_key",
+                TrackerElementFactory<TrackerElementDeviceKey>(),
+                "key of a removed device");
+
+    delta_removed_complete_id =
+        entrytracker->RegisterField("kismet.devicetracker.delta.removed_complete",
+                TrackerElementFactory<TrackerElementUInt8>(),
+                "removed list covers every removal since the requested generation; "
+                "when 0, removals were forgotten and the client must re-fetch all devices");
+
+    delta_endp =
+        std::make_shared<Kis_Net_Httpd_Path_Tracked_Endpoint>(
+                "/devices/delta/:generation/devices",
+                [this](const std::vector<std::string>& path) -> bool {
+                    return delta_endp_path(path);
+                }, false,
+                [this](const std::vector<std::string>& path) -> std::shared_ptr<TrackerElement> {
+                    return delta_endp_handler(path);
+                });
+
+    index_endp =
+        std::make_shared<Kis_Net_Httpd_Path_Tracked_Endpoint>(
+                "/devices/index/:attribute/:value/devices",
+                [this](const std::vector<std::string>& path) -> bool {
+                    return index_endp_path(path);
+                }, false,
+                [this](const std::vector<std::string>& path) -> std::shared_ptr<TrackerElement> {
+                    return index_endp_handler(path);
+                });
+
     // Open and upgrade the DB, default path
     Database_Open("");
     Database_UpgradeDB();
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route("/devices/all_devices");
+    Bind_Httpd_Route("/devices/by-key/:key/:target");
+    Bind_Httpd_Route("/devices/by-key/:key/:target/*field");
+    Bind_Httpd_Route("/devices/by-mac/:mac/:target");
+    Bind_Httpd_Route("/devices/by-phy/:phy/:target");
+    Bind_Httpd_Route("/devices/last-time/:timestamp/:target");
+    Bind_Httpd_Route("/devices/summary/:target");
 
     new_datasource_evt_id = 
         eventbus->register_listener("NEW_DATASOURCE",
@@ -456,12 +677,24 @@ Devicetracker::Devicetracker(GlobalRegistry *in_globalreg) :
 }
 
 Devicetracker::~Devicetracker() {
+    // Restored devices are added under the device list lock, so the restore has to
+    // finish before we take it
+    stop_restore();
+
+    // Likewise for devices being restored from cold storage
+    cold_restore_pool.reset();
+
     local_locker lock(&devicelist_mutex);
 
     if (eventbus != nullptr) {
         eventbus->remove_listener(new_datasource_evt_id);
     }
 
+    if (coldstore != NULL) {
+        delete(coldstore);
+        coldstore = NULL;
+    }
+
     if (statestore != NULL) {
         delete(statestore);
         statestore = NULL;
@@ -475,6 +708,8 @@ Devicetracker::~Devicetracker() {
     if (packetchain != NULL) {
         packetchain->RemoveHandler(&Devicetracker_packethook_commontracker,
                 CHAINPOS_TRACKER);
+        packetchain->RemoveHandler(&Devicetracker_packethook_indextracker,
+                CHAINPOS_TRACKER);
     }
 
     std::shared_ptr<Timetracker> timetracker = 
@@ -482,6 +717,10 @@ Devicetracker::~Devicetracker() {
     if (timetracker != NULL) {
         timetracker->RemoveTimer(device_idle_timer);
         timetracker->RemoveTimer(max_devices_timer);
+        timetracker->RemoveTimer(memory_budget_timer);
+        timetracker->RemoveTimer(cold_storage_timer);
+        timetracker->RemoveTimer(device_snapshot_timer);
+        timetracker->RemoveTimer(change_generation_timer);
         timetracker->RemoveTimer(device_storage_timer);
     }
 
@@ -496,8 +735,23 @@ Devicetracker::~Devicetracker() {
     }
 
     tracked_vec.clear();
-    immutable_tracked_vec->clear();
-    tracked_mac_multimap.clear();
+    free_device_ids.clear();
+    device_id_limit = 0;
+    device_indices.clear();
+
+    for (auto& shard : device_shards) {
+        local_locker shardlock(&shard->mutex);
+        shard->tracked_map.clear();
+        shard->tracked_mac_multimap.clear();
+
+        for (auto d : shard->lastseen_list)
+            d->lastseen_owner = nullptr;
+        for (auto d : shard->retained_list)
+            d->lastseen_owner = nullptr;
+
+        shard->lastseen_list.clear();
+        shard->retained_list.clear();
+    }
 }
 
 Kis_Phy_Handler *Devicetracker::FetchPhyHandler(int in_phy) {
@@ -533,9 +787,24 @@ std::string Devicetracker::FetchPhyName(int in_phy) {
 }
 
 int Devicetracker::FetchNumDevices() {
-    local_shared_locker lock(&devicelist_mutex);
+    size_t num = 0;
+
+    for (auto& shard : device_shards) {
+        local_shared_locker shardlock(&shard->mutex);
+        num += shard->tracked_map.size();
+    }
+
+    return num;
+}
+
+size_t Devicetracker::FetchNumDeviceSlots() {
+    local_shared_locker lock(&device_vec_mutex);
+    return device_id_limit;
+}
 
-    return tracked_map.size();
+size_t Devicetracker::FetchNumDeviceHoles() {
+    local_shared_locker lock(&device_vec_mutex);
+    return free_device_ids.size();
 }
 
 int Devicetracker::FetchNumPackets() {
@@ -555,6 +824,33 @@ int Devicetracker::RegisterPhyHandler(Kis_Phy_Handler *in_weak_handler) {
 	phy_errorpackets[num] = 0;
 	phy_filterpackets[num] = 0;
 
+    phy_budget_degraded[num] = false;
+    memory_budget->add_phy(strongphy->FetchPhyName());
+
+    // Reserve the records of the new phy in its devices, the records phys registered
+    // before it attach to its devices, and the records it attaches to theirs
+    auto& record_ids = phy_record_ids[num];
+
+    record_ids.insert(record_ids.end(), strongphy->FetchDeviceRecordIds().begin(),
+            strongphy->FetchDeviceRecordIds().end());
+
+    for (auto p : phy_handler_map) {
+        if (p.first == num)
+            continue;
+
+        for (auto f : p.second->FetchForeignRecordIds()) {
+            if (f.first == strongphy->FetchPhyName())
+                record_ids.push_back(f.second);
+        }
+    }
+
+    for (auto f : strongphy->FetchForeignRecordIds()) {
+        for (auto p : phy_handler_map) {
+            if (p.first != num && p.second->FetchPhyName() == f.first)
+                phy_record_ids[p.first].push_back(f.second);
+        }
+    }
+
     if (map_phy_views) {
         auto phy_id = strongphy->FetchPhyId();
 
@@ -588,20 +884,30 @@ void Devicetracker::UpdateFullRefresh() {
     full_refresh_time = globalreg->timestamp.tv_sec;
 }
 
-std::shared_ptr<kis_tracked_device_base> Devicetracker::FetchDevice(device_key in_key) {
-    local_shared_locker lock(&devicelist_mutex);
+std::shared_ptr<kis_tracked_device_base> Devicetracker::FetchDevice(device_key in_key,
+        bool in_restore) {
+    auto shard = fetch_device_shard(in_key);
+    local_shared_locker lock(&shard->mutex);
 
-	device_itr i = tracked_map.find(in_key);
+	auto i = shard->tracked_map.find(in_key);
 
-	if (i != tracked_map.end())
+	if (i != shard->tracked_map.end())
 		return i->second;
 
-	return NULL;
+    if (!in_restore || coldstore == NULL || 
+            shard->cold_map.find(in_key) == shard->cold_map.end())
+        return NULL;
+
+    lock.unlock();
+
+    // Restore it now rather than waiting for a queued restore; whichever finishes first
+    // publishes the device, and both return it.  The record collecting packets until
+    // then is never handed out, since anything written to it after the restore is lost.
+    return rehydrate_cold_device(in_key);
 }
 
 int Devicetracker::CommonTracker(kis_packet *in_pack) {
-    local_locker lock(&devicelist_mutex);
-
+    // Only counters are touched here, so this doesn't take the device list lock
 	if (in_pack->error) {
 		// and bail
 		num_errorpackets++;
@@ -611,8 +917,10 @@ int Devicetracker::CommonTracker(kis_packet *in_pack) {
 	kis_common_info *pack_common =
         (kis_common_info *) in_pack->fetch(pack_comp_common);
 
-    if (!ram_no_rrd)
+    if (!ram_no_rrd) {
+        local_locker lock(&packets_rrd_mutex);
         packets_rrd->add_sample(1, globalreg->timestamp.tv_sec);
+    }
 
     num_packets++;
 
@@ -674,13 +982,10 @@ std::shared_ptr<kis_tracked_device_base>
             mac_addr in_mac, Kis_Phy_Handler *in_phy, kis_packet *in_pack, 
             unsigned int in_flags, std::string in_basic_type) {
 
-    // The device list has to be locked for the duration of the device assignment and
-    // update since devices only get added at the end
-    local_locker list_locker(&devicelist_mutex);
-
     std::stringstream sstr;
 
     bool new_device = false;
+    device_shard::cold_stub *cold_stub = nullptr;
 
 	kis_layer1_packinfo *pack_l1info =
 		(kis_layer1_packinfo *) in_pack->fetch(pack_comp_radiodata);
@@ -694,21 +999,40 @@ std::shared_ptr<kis_tracked_device_base>
 
     key = device_key(in_phy->FetchPhynameHash(), in_mac);
 
-	if ((device = FetchDevice(key)) == NULL) {
-        if (in_flags & UCD_UPDATE_EXISTING_ONLY)
+    // The shard holding this device has to be locked for the duration of the device 
+    // assignment and update since devices only get added to the index at the end
+    auto shard = fetch_device_shard(key);
+    local_demand_locker shard_locker(&shard->mutex);
+    shard_locker.lock();
+
+    auto di = shard->tracked_map.find(key);
+
+    if (di != shard->tracked_map.end()) {
+        device = di->second;
+    } else {
+        // Devices in cold storage are restored in the background rather than read here;
+        // until the stored record is back, a record kept in the stub collects the 
+        // packets and is folded into it
+        if (coldstore != NULL)
+            cold_stub = queue_cold_rehydration(shard, key);
+
+        if (cold_stub != nullptr && cold_stub->pending != nullptr)
+            device = cold_stub->pending;
+        else if (in_flags & UCD_UPDATE_EXISTING_ONLY)
             return NULL;
+    }
 
+    if (device == NULL) {
         device =
             std::make_shared<kis_tracked_device_base>(device_base_id);
-        // Device ID is the size of the vector so a new device always gets put
-        // in it's numbered slot
-        device->set_kis_internal_id(immutable_tracked_vec->size());
 
         device->set_key(key);
         device->set_macaddr(in_mac);
         device->set_phyname(in_phy->FetchPhyName());
 		device->set_phyid(in_phy->FetchPhyId());
 
+        reserve_phy_records(device);
+
         device->set_server_uuid(globalreg->server_uuid);
 
         device->set_first_time(in_pack->ts.tv_sec);
@@ -727,7 +1051,8 @@ std::shared_ptr<kis_tracked_device_base>
     }
 
     // Lock the device itself for updating, now that it exists
-    local_locker devlocker(&(device->device_mutex));
+    local_demand_locker devlocker(&(device->device_mutex));
+    devlocker.lock();
 
     // Tag the packet with the base device
 	kis_tracked_device_info *devinfo =
@@ -743,14 +1068,23 @@ std::shared_ptr<kis_tracked_device_base>
     // Update the mod data
     device->update_modtime();
 
-    if (device->get_last_time() < in_pack->ts.tv_sec)
+    bool track_rrd = phy_tracks_rrd(device->get_phyid());
+
+    if (device->get_last_time() < in_pack->ts.tv_sec || new_device) {
         device->set_last_time(in_pack->ts.tv_sec);
 
+        // A record waiting on a restore is indexed once it has been folded in
+        if (cold_stub == nullptr)
+            touch_device_lastseen(shard, device);
+    }
+
     if (in_flags & UCD_UPDATE_PACKETS) {
         device->inc_packets();
 
-        if (!ram_no_rrd)
+        if (track_rrd) {
             device->get_packets_rrd()->add_sample(1, globalreg->timestamp.tv_sec);
+            device->mark_field_dirty(device->get_tracker_packets_rrd());
+        }
 
         if (pack_common != NULL) {
             if (pack_common->error)
@@ -761,25 +1095,26 @@ std::shared_ptr<kis_tracked_device_base>
                 device->inc_data_packets();
                 device->inc_datasize(pack_common->datasize);
 
-                if (!ram_no_rrd) {
+                if (track_rrd) {
                     device->get_data_rrd()->add_sample(pack_common->datasize,
                             globalreg->timestamp.tv_sec);
+                    device->mark_field_dirty(device->get_tracker_data_rrd());
+
+                    std::shared_ptr<kis_tracked_device_base::mrrdt> bin;
 
                     if (pack_common->datasize <= 250)
-                        device->get_packet_rrd_bin_250()->add_sample(1, 
-                                globalreg->timestamp.tv_sec);
+                        bin = device->get_packet_rrd_bin_250();
                     else if (pack_common->datasize <= 500)
-                        device->get_packet_rrd_bin_500()->add_sample(1, 
-                                globalreg->timestamp.tv_sec);
+                        bin = device->get_packet_rrd_bin_500();
                     else if (pack_common->datasize <= 1000)
-                        device->get_packet_rrd_bin_1000()->add_sample(1, 
-                                globalreg->timestamp.tv_sec);
+                        bin = device->get_packet_rrd_bin_1000();
                     else if (pack_common->datasize <= 1500)
-                        device->get_packet_rrd_bin_1500()->add_sample(1, 
-                                globalreg->timestamp.tv_sec);
+                        bin = device->get_packet_rrd_bin_1500();
                     else 
-                        device->get_packet_rrd_bin_jumbo()->add_sample(1, 
-                                globalreg->timestamp.tv_sec);
+                        bin = device->get_packet_rrd_bin_jumbo();
+
+                    bin->add_sample(1, globalreg->timestamp.tv_sec);
+                    device->mark_field_dirty(bin);
                 }
 
             } else if (pack_common->type == packet_basic_mgmt ||
@@ -799,7 +1134,8 @@ std::shared_ptr<kis_tracked_device_base>
                 device->set_frequency(pack_l1info->freq_khz);
 
             Packinfo_Sig_Combo *sc = new Packinfo_Sig_Combo(pack_l1info, pack_gpsinfo);
-            device->get_signal_data()->append_signal(*sc, !ram_no_rrd);
+            device->get_signal_data()->append_signal(*sc, track_rrd);
+            device->mark_field_dirty(device->get_tracker_signal_data());
 
             delete(sc);
 
@@ -820,10 +1156,11 @@ std::shared_ptr<kis_tracked_device_base>
             pack_gpsinfo != NULL) {
         device->get_location()->add_loc(pack_gpsinfo->lat, pack_gpsinfo->lon,
                 pack_gpsinfo->alt, pack_gpsinfo->fix);
+        device->mark_field_dirty(device->get_tracker_location());
 
         // Throttle history cloud to one update per second to prevent floods of
         // data from swamping the cloud
-        if (track_history_cloud && pack_gpsinfo->fix >= 2 &&
+        if (phy_tracks_history_cloud(device->get_phyid()) && pack_gpsinfo->fix >= 2 &&
                 in_pack->ts.tv_sec - device->get_location_cloud()->get_last_sample_ts() >= 1) {
             auto histloc = std::make_shared<kis_historic_location>();
 
@@ -844,6 +1181,7 @@ std::shared_ptr<kis_tracked_device_base>
             }
 
             device->get_location_cloud()->add_sample(histloc);
+            device->mark_field_dirty(device->get_tracker_location_cloud());
         }
     }
 
@@ -861,9 +1199,9 @@ std::shared_ptr<kis_tracked_device_base>
             sc = new Packinfo_Sig_Combo(pack_l1info, pack_gpsinfo);
         }
 
-        device->inc_seenby_count(pack_datasrc->ref_source, in_pack->ts.tv_sec, f, sc, !ram_no_rrd);
+        device->inc_seenby_count(pack_datasrc->ref_source, in_pack->ts.tv_sec, f, sc, track_rrd);
 
-        if (map_seenby_views)
+        if (map_seenby_views && cold_stub == nullptr)
             update_view_device(device);
 
         if (sc != NULL)
@@ -873,18 +1211,21 @@ std::shared_ptr<kis_tracked_device_base>
     if (pack_common != NULL)
         device->add_basic_crypt(pack_common->basic_crypt_set);
 
-    // Add the new device at the end once we've populated it
-    if (new_device) {
-        tracked_map[key] = device;
+    // Add the new device at the end once we've populated it; a device being restored
+    // from cold storage is published by the restore, which folds this record into the
+    // stored one
+    if (new_device && cold_stub != nullptr) {
+        cold_stub->pending = device;
+    } else if (new_device) {
+        add_device_vecs(device);
 
-        tracked_vec.push_back(device);
-        immutable_tracked_vec->push_back(device);
+        shard->tracked_map.insert_unique(key, device);
+        shard->tracked_mac_multimap.insert_multi(in_mac, device);
 
-        auto mm_pair = std::make_pair(in_mac, device);
-        tracked_mac_multimap.insert(mm_pair);
+        // Release the device and shard before taking the view lock
+        devlocker.unlock();
+        shard_locker.unlock();
 
-        // Unlock the device list before adding it to the device views
-        list_locker.unlock();
         new_view_device(device);
     }
 
@@ -897,31 +1238,30 @@ bool devicetracker_sort_internal_id(std::shared_ptr<kis_tracked_device_base> a,
 	return a->get_kis_internal_id() < b->get_kis_internal_id();
 }
 
-void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, 
-        std::shared_ptr<TrackerElementVector> vec, bool batch) {
+// Copy a caller's device vector into an immutable snapshot.  The source vectors are
+// filter results owned by the caller, not the device list, so the device list lock
+// doesn't protect them and isn't taken.
+static Devicetracker::device_snapshot_t devicetracker_snapshot_vec(std::shared_ptr<TrackerElementVector> vec) {
+    Devicetracker::device_snapshot_t snapshot;
 
-    // Make a copy of the vector
-    std::shared_ptr<TrackerElementVector> immutable_copy;
-    {
-        local_shared_locker locker(&devicelist_mutex);
-        immutable_copy = std::make_shared<TrackerElementVector>(vec);
+    snapshot.reserve(vec->size());
+
+    for (auto d : *vec) {
+        if (d != nullptr)
+            snapshot.push_back(std::static_pointer_cast<kis_tracked_device_base>(d));
     }
 
-    MatchOnDevicesRaw(worker, immutable_copy, batch);
+    return snapshot;
 }
 
-void Devicetracker::MatchOnReadonlyDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, 
+void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, 
         std::shared_ptr<TrackerElementVector> vec, bool batch) {
+    MatchOnDevicesRaw(worker, devicetracker_snapshot_vec(vec), batch);
+}
 
-    // Make a copy of the vector
-    std::shared_ptr<TrackerElementVector> immutable_copy;
-    {
-        local_shared_locker locker(&devicelist_mutex);
-        immutable_copy = std::make_shared<TrackerElementVector>(vec);
-    }
-
-    MatchOnReadonlyDevicesRaw(worker, immutable_copy, batch);
-
+void Devicetracker::MatchOnReadonlyDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, 
+        std::shared_ptr<TrackerElementVector> vec, bool batch) {
+    MatchOnReadonlyDevicesRaw(worker, devicetracker_snapshot_vec(vec), batch);
 }
 
 void Devicetracker::MatchOnDevicesRaw(std::shared_ptr<DevicetrackerFilterWorker> worker, 
@@ -976,28 +1316,16 @@ void Devicetracker::MatchOnReadonlyDevicesRaw(std::shared_ptr<DevicetrackerFilte
 
 void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker,
         const std::vector<std::shared_ptr<kis_tracked_device_base>>& vec, bool batch) {
-
-    // Make a copy of the vector
-    std::vector<std::shared_ptr<kis_tracked_device_base>> copy_vec;
-    {
-        local_shared_locker locker(&devicelist_mutex);
-        copy_vec = vec;
-    }
-
-    MatchOnDevicesRaw(worker, copy_vec, batch);
+    // The source is the caller's, not the device list; copy it without the list lock
+    const device_snapshot_t snapshot(vec);
+    MatchOnDevicesRaw(worker, snapshot, batch);
 }
 
 void Devicetracker::MatchOnReadonlyDevices(std::shared_ptr<DevicetrackerFilterWorker> worker,
         const std::vector<std::shared_ptr<kis_tracked_device_base>>& vec, bool batch) {
-
-    // Make a copy of the vector
-    std::vector<std::shared_ptr<kis_tracked_device_base>> copy_vec;
-    {
-        local_shared_locker locker(&devicelist_mutex);
-        copy_vec = vec;
-    }
-
-    MatchOnReadonlyDevicesRaw(worker, copy_vec, batch);
+    // The source is the caller's, not the device list; copy it without the list lock
+    const device_snapshot_t snapshot(vec);
+    MatchOnReadonlyDevicesRaw(worker, snapshot, batch);
 }
 
 void Devicetracker::MatchOnDevicesRaw(std::shared_ptr<DevicetrackerFilterWorker> worker,
@@ -1047,124 +1375,364 @@ void Devicetracker::MatchOnReadonlyDevicesRaw(std::shared_ptr<DevicetrackerFilte
 }
 
 void Devicetracker::MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch) {
-    MatchOnDevices(worker, immutable_tracked_vec, batch);
+    // Workers which can only match one indexed value only need to look at the devices
+    // filed under it
+    if (worker->get_index_attribute().length() != 0) {
+        std::vector<std::shared_ptr<kis_tracked_device_base>> indexed;
+
+        if (FetchIndexedDevices(worker->get_index_attribute(), worker->get_index_value(), indexed)) {
+            MatchOnDevicesRaw(worker, indexed, batch);
+            return;
+        }
+    }
+
+    // The snapshot is immutable, so it needs no copy or lock
+    auto snapshot = fetch_device_snapshot();
+    MatchOnDevicesRaw(worker, *snapshot, batch);
 }
 
 void Devicetracker::MatchOnReadonlyDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch) {
-    MatchOnReadonlyDevices(worker, immutable_tracked_vec, batch);
-}
+    if (worker->get_index_attribute().length() != 0) {
+        std::vector<std::shared_ptr<kis_tracked_device_base>> indexed;
 
-// Simple std::sort comparison function to order by the least frequently
-// seen devices
-bool devicetracker_sort_lastseen(std::shared_ptr<kis_tracked_device_base> a,
-	std::shared_ptr<kis_tracked_device_base> b) {
+        if (FetchIndexedDevices(worker->get_index_attribute(), worker->get_index_value(), indexed)) {
+            MatchOnReadonlyDevicesRaw(worker, indexed, batch);
+            return;
+        }
+    }
 
-	return a->get_last_time() < b->get_last_time();
+    auto snapshot = fetch_device_snapshot();
+    MatchOnReadonlyDevicesRaw(worker, *snapshot, batch);
 }
 
 int Devicetracker::timetracker_event(int eventid) {
     if (eventid == device_idle_timer) {
-        local_locker lock(&devicelist_mutex);
-
         time_t ts_now = globalreg->timestamp.tv_sec;
-        bool purged = false;
+        std::vector<std::shared_ptr<kis_tracked_device_base>> purged;
+
+        // Find all eligible devices one shard at a time, so that packet processing
+        // only ever waits on a single shard
+        for (auto& shard : device_shards) {
+            local_locker shardlock(&shard->mutex);
+
+            std::vector<std::shared_ptr<kis_tracked_device_base>> shard_purged;
+
+            // The last-seen index is ordered oldest first, so only the devices which
+            // have gone idle need to be examined
+            auto i = shard->lastseen_list.begin();
+
+            while (i != shard->lastseen_list.end()) {
+                auto d = *i;
+                auto next = std::next(i);
+
+                // Lock the device itself
+                local_shared_locker devlocker(&(d->device_mutex));
+
+                if (ts_now - d->get_last_time() <= device_idle_expiration)
+                    break;
+
+                if (d->get_packets() < device_idle_min_packets || 
+                        device_idle_min_packets <= 0) {
+                    shard_purged.push_back(d);
+                } else {
+                    // The device has seen enough packets to be kept; it can't become 
+                    // eligible again until it is seen again, which puts it back in the
+                    // last-seen list
+                    shard->retained_list.splice(shard->retained_list.end(), 
+                            shard->lastseen_list, i);
+                    d->lastseen_owner = &shard->retained_list;
+                }
+
+                i = next;
+            }
 
-        // Find all eligible devices, remove them from the tracked vec
-        tracked_vec.erase(std::remove_if(tracked_vec.begin(), tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    // Lock the device itself
-                    local_locker devlocker(&(d->device_mutex));
+            for (auto d : shard_purged) {
+                if (remove_device_index(d))
+                    purged.push_back(d);
+            }
+        }
 
-                    if (ts_now - d->get_last_time() > device_idle_expiration &&
-                            (d->get_packets() < device_idle_min_packets || 
-                             device_idle_min_packets <= 0)) {
-                        device_itr mi = tracked_map.find(d->get_key());
+        if (purged.size() == 0)
+            return 1;
 
-                        if (mi != tracked_map.end())
-                            tracked_map.erase(mi);
+        remove_device_vecs(purged);
 
-                        // Erase it from the multimap
-                        auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        // Forget them from any views
+        for (auto d : purged)
+            remove_view_device(d);
 
-                        for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                            if (mmpi->second->get_key() == d->get_key()) {
-                                tracked_mac_multimap.erase(mmpi);
-                                break;
-                            }
-                        }
+        UpdateFullRefresh();
+
+    } else if (eventid == max_devices_timer) {
+		// Do nothing if we don't care
+		if (max_num_devices <= 0)
+			return 1;
+
+        // Do nothing if the number of devices is less than the max
+        size_t num_devices = FetchNumDevices();
+
+        if (num_devices <= max_num_devices)
+            return 1;
+
+        trim_oldest_devices(num_devices - max_num_devices);
+    } else if (eventid == memory_budget_timer) {
+        enforce_memory_budget();
+    } else if (eventid == cold_storage_timer) {
+        tier_cold_devices();
+    } else if (eventid == device_snapshot_timer) {
+        publish_device_snapshot();
+    } else if (eventid == change_generation_timer) {
+        kis_tracked_device_base::advance_generation();
+	}
+
+    // Loop
+    return 1;
+}
+
+size_t Devicetracker::trim_oldest_devices(size_t in_num) {
+    if (in_num == 0)
+        return 0;
 
-                        // Forget it from any views
-                        remove_view_device(d);
+    // Do an update since we're trimming something
+    UpdateFullRefresh();
 
-                        // Forget it from the immutable vec, but keep its 
-                        // position; we need to have vecpos = devid
-                        auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                        (*iti).reset();
+    // The oldest devices overall are always among the oldest in_num devices of each
+    // shard's last-seen and retained lists, so only those need to be compared.  Last
+    // times are captured under the shard lock so they can't change mid-sort.
+    std::vector<std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>> candidates;
 
-                        purged = true;
+    for (auto& shard : device_shards) {
+        local_shared_locker shardlock(&shard->mutex);
 
-                        return true;
-                    }
+        for (auto l : {&shard->lastseen_list, &shard->retained_list}) {
+            size_t n = 0;
+
+            for (auto i = l->begin(); i != l->end() && n < in_num; ++i, ++n)
+                candidates.push_back(std::make_pair((*i)->get_last_time(), *i));
+        }
+    }
+
+    in_num = std::min(in_num, candidates.size());
+
+    kismet__partial_sort(candidates.begin(), candidates.begin() + in_num, 
+            candidates.end(), 
+            [](const std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>& a,
+                const std::pair<time_t, std::shared_ptr<kis_tracked_device_base>>& b) -> bool {
+                return a.first < b.first;
+            });
+
+    std::vector<std::shared_ptr<kis_tracked_device_base>> purged;
+
+    for (auto i = candidates.begin(); i != candidates.begin() + in_num; ++i) {
+        if (remove_device_index(i->second))
+            purged.push_back(i->second);
+    }
+
+    remove_device_vecs(purged);
+
+    for (auto d : purged)
+        remove_view_device(d);
+
+    return purged.size();
+}
+
+// Resident memory of the server in kB, or 0 if it can't be determined on this platform
+static uint64_t devicetracker_fetch_rss_kb() {
+#ifdef SYS_LINUX
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm == NULL)
+        return 0;
+
+    unsigned long vsize, resident;
+    int r = fscanf(statm, "%lu %lu", &vsize, &resident);
+
+    fclose(statm);
+
+    if (r != 2)
+        return 0;
+
+    return (uint64_t) resident * sysconf(_SC_PAGESIZE) / 1024;
+#else
+    return 0;
+#endif
+}
+
+void Devicetracker::enforce_memory_budget() {
+    // Account the estimated memory of every device, per phy
+    std::map<int, std::pair<uint64_t, uint64_t>> phy_usage;
+    uint64_t device_bytes = 0;
+    uint64_t num_devices = 0;
+    kis_recursive_timed_mutex usage_mutex;
+
+    auto worker = 
+        std::make_shared<devicetracker_function_worker>(
+                [&](Devicetracker *, std::shared_ptr<kis_tracked_device_base> dev) -> bool {
+                    auto sz = EstimateTrackerElementSize(dev);
+
+                    local_locker l(&usage_mutex);
+                    auto& u = phy_usage[dev->get_phyid()];
+                    u.first++;
+                    u.second += sz;
+
+                    num_devices++;
+                    device_bytes += sz;
 
                     return false;
-         
-                    }), tracked_vec.end());
+                }, nullptr);
 
-        if (purged)
-            UpdateFullRefresh();
+    MatchOnReadonlyDevices(worker);
 
-    } else if (eventid == max_devices_timer) {
-		local_locker lock(&devicelist_mutex);
+    uint64_t device_kb = device_bytes / 1024;
+    uint64_t rss_kb = devicetracker_fetch_rss_kb();
 
-		// Do nothing if we don't care
-		if (max_num_devices <= 0)
-			return 1;
+    // Without the RSS, only the devices themselves can be held to the budget
+    if (rss_kb == 0)
+        rss_kb = device_kb;
 
-		// Do nothing if the number of devices is less than the max
-		if (tracked_vec.size() <= max_num_devices)
-			return 1;
+    uint64_t overhead_kb = rss_kb > device_kb ? rss_kb - device_kb : 0;
 
-        // Do an update since we're trimming something
-        UpdateFullRefresh();
+    if (rss_kb > memory_budget_kb && 
+            (memory_min_overhead_kb == 0 || overhead_kb < memory_min_overhead_kb))
+        memory_min_overhead_kb = overhead_kb;
 
-		// Now things start getting expensive.  Start by sorting the
-		// vector of devices - anything else that has to sort the entire list
-        // has to sort it themselves
-		kismet__stable_sort(tracked_vec.begin(), tracked_vec.end(), 
-                devicetracker_sort_lastseen);
+    if (memory_min_overhead_kb != 0)
+        overhead_kb = memory_min_overhead_kb;
 
-        tracked_vec.erase(std::remove_if(tracked_vec.begin() + max_num_devices, tracked_vec.end(),
-                [&](std::shared_ptr<kis_tracked_device_base> d) {
-                    // Lock the device itself
-                    local_locker devlocker(&(d->device_mutex));
+    uint64_t allowance_kb = memory_budget_kb > overhead_kb ? memory_budget_kb - overhead_kb : 0;
 
-                    device_itr mi = tracked_map.find(d->get_key());
+    memory_budget->set_rss_kb(rss_kb);
+    memory_budget->set_device_allowance_kb(allowance_kb);
+    memory_budget->set_device_estimate_kb(device_kb);
 
-                    if (mi != tracked_map.end())
-                        tracked_map.erase(mi);
+    for (auto p : phy_handler_map) {
+        auto phy_budget = memory_budget->get_phy(p.second->FetchPhyName());
 
-                    // Erase it from the multimap
-                    auto mmp = tracked_mac_multimap.equal_range(d->get_macaddr());
+        if (phy_budget == nullptr)
+            continue;
 
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                        if (mmpi->second->get_key() == d->get_key()) {
-                            tracked_mac_multimap.erase(mmpi);
-                            break;
-                        }
-                    }
+        auto u = phy_usage[p.first];
 
-                    // Forget it from the immutable vec, but keep its 
-                    // position; we need to have vecpos = devid
-                    auto iti = immutable_tracked_vec->begin() + d->get_kis_internal_id();
-                    (*iti).reset();
+        phy_budget->set_devices(u.first);
+        phy_budget->set_estimate_kb(u.second / 1024);
 
-                    return true;
-         
-                    }), tracked_vec.end());
-	}
+        if (allowance_kb > 0)
+            phy_budget->set_budget_share((double) (u.second / 1024) / allowance_kb);
+        else
+            phy_budget->set_budget_share(0);
+    }
 
-    // Loop
-    return 1;
+    // Once device memory is well under the allowance, collect everything again; the gap
+    // between this and the allowance keeps a phy from being degraded and restored on
+    // alternate passes
+    if (memory_budget->get_degraded() && device_kb < allowance_kb * 7 / 10) {
+        _MSG_INFO("Estimated device memory ({}kB) is below 70% of the memory budget "
+                "allowance ({}kB); resuming device packet and signal history and location "
+                "history.", device_kb, allowance_kb);
+
+        for (auto& d : phy_budget_degraded) {
+            d.second = false;
+
+            auto phyh = FetchPhyHandler(d.first);
+            if (phyh == nullptr)
+                continue;
+
+            auto phy_budget = memory_budget->get_phy(phyh->FetchPhyName());
+            if (phy_budget != nullptr)
+                phy_budget->set_degraded(false);
+        }
+
+        memory_budget->set_degraded(false);
+
+        return;
+    }
+
+    if (device_kb <= allowance_kb || num_devices == 0)
+        return;
+
+    // First discard the optional data from the devices of the phy using the most memory 
+    // and stop collecting it for that phy, one phy per pass; the savings are accounted 
+    // on the next pass
+    int degrade_phyid = -1;
+    uint64_t degrade_bytes = 0;
+
+    for (auto u : phy_usage) {
+        auto d = phy_budget_degraded.find(u.first);
+
+        if (d == phy_budget_degraded.end() || d->second)
+            continue;
+
+        if (u.second.second > degrade_bytes) {
+            degrade_phyid = u.first;
+            degrade_bytes = u.second.second;
+        }
+    }
+
+    auto degrade_phyh = FetchPhyHandler(degrade_phyid);
+
+    if (degrade_phyh != nullptr) {
+        _MSG_INFO("Estimated device memory ({}kB) exceeds the memory budget allowance "
+                "({}kB); discarding packet and signal history and location history "
+                "of {} devices ({}kB) to save memory.", device_kb, allowance_kb,
+                degrade_phyh->FetchPhyName(), degrade_bytes / 1024);
+
+        phy_budget_degraded[degrade_phyid] = true;
+
+        auto phy_budget = memory_budget->get_phy(degrade_phyh->FetchPhyName());
+        if (phy_budget != nullptr)
+            phy_budget->set_degraded(true);
+
+        memory_budget->set_degraded(true);
+
+        auto shrink_worker =
+            std::make_shared<devicetracker_function_worker>(
+                    [degrade_phyid, degrade_phyh](Devicetracker *, 
+                        std::shared_ptr<kis_tracked_device_base> dev) -> bool {
+                        if (dev->get_phyid() != degrade_phyid)
+                            return false;
+
+                        dev->drop_optional_data();
+                        degrade_phyh->ShrinkDevice(dev);
+
+                        return false;
+                    }, nullptr);
+        shrink_worker->set_index_hint("phy", degrade_phyh->FetchPhyName());
+
+        MatchOnDevices(shrink_worker);
+
+        return;
+    }
+
+    // Then remove the oldest devices, freeing enough to get back under 90% of the 
+    // allowance so that we're not removing devices on every pass
+    uint64_t excess_bytes = (device_kb - (allowance_kb * 9 / 10)) * 1024;
+    uint64_t avg_bytes = std::max(device_bytes / num_devices, (uint64_t) 1);
+    size_t num_remove = std::min(excess_bytes / avg_bytes + 1, num_devices);
+
+    auto removed = trim_oldest_devices(num_remove);
+
+    memory_budget->set_evicted_devices(memory_budget->get_evicted_devices() + removed);
+
+    _MSG_INFO("Estimated device memory ({}kB) exceeds the memory budget allowance ({}kB); "
+            "removed {} of the oldest devices.", device_kb, allowance_kb, removed);
+}
+
+bool Devicetracker::phy_tracks_rrd(int in_phyid) {
+    if (ram_no_rrd)
+        return false;
+
+    auto d = phy_budget_degraded.find(in_phyid);
+
+    return d == phy_budget_degraded.end() || !d->second;
+}
+
+bool Devicetracker::phy_tracks_history_cloud(int in_phyid) {
+    if (!track_history_cloud)
+        return false;
+
+    auto d = phy_budget_degraded.find(in_phyid);
+
+    return d == phy_budget_degraded.end() || !d->second;
 }
 
 void Devicetracker::usage(const char *name __attribute__((unused))) {
@@ -1268,387 +1836,1661 @@ int Devicetracker::Database_UpgradeDB() {
 }
 
 void Devicetracker::AddDevice(std::shared_ptr<kis_tracked_device_base> device) {
-    local_locker lock(&devicelist_mutex);
-
-    if (FetchDevice(device->get_key()) != NULL) {
+    if (!insert_device(device)) {
         _MSG("Devicetracker tried to add device " + device->get_macaddr().Mac2String() + 
                 " which already exists", MSGFLAG_ERROR);
-        return;
     }
+}
 
-    // Device ID is the size of the vector so a new device always gets put
-    // in it's numbered slot
-    device->set_kis_internal_id(immutable_tracked_vec->size());
+void Devicetracker::reserve_phy_records(std::shared_ptr<kis_tracked_device_base> in_device) {
+    auto ri = phy_record_ids.find(in_device->get_phyid());
 
-    tracked_map[device->get_key()] = device;
-    tracked_vec.push_back(device);
-    immutable_tracked_vec->push_back(device);
+    if (ri == phy_record_ids.end())
+        return;
 
-    auto mm_pair = std::make_pair(device->get_macaddr(), device);
-    tracked_mac_multimap.emplace(mm_pair);
+    for (auto rid : ri->second) {
+        if (in_device->find(rid) == in_device->end())
+            in_device->insert(rid, SharedTrackerElement());
+    }
 }
 
-bool Devicetracker::add_view(std::shared_ptr<DevicetrackerView> in_view) {
-    local_locker l(&view_mutex);
+bool Devicetracker::insert_device(std::shared_ptr<kis_tracked_device_base> device) {
+    auto shard = fetch_device_shard(device->get_key());
 
-    for (auto i : *view_vec) {
-        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
-        if (vi->get_view_id() == in_view->get_view_id()) 
+    reserve_phy_records(device);
+
+    {
+        local_locker shardlock(&shard->mutex);
+
+        if (shard->tracked_map.find(device->get_key()) != shard->tracked_map.end())
             return false;
-    }
 
-    view_vec->push_back(in_view);
+        add_device_vecs(device);
 
-    for (auto i : *immutable_tracked_vec) {
-        auto di = std::static_pointer_cast<kis_tracked_device_base>(i);
-        in_view->newDevice(di);
+        shard->tracked_map.insert_unique(device->get_key(), device);
+        shard->tracked_mac_multimap.insert_multi(device->get_macaddr(), device);
+        touch_device_lastseen(shard, device);
+        refresh_device_indices(device);
     }
 
     return true;
 }
 
-void Devicetracker::remove_view(const std::string& in_id) {
-    local_locker l(&view_mutex);
-        
-    for (auto i = view_vec->begin(); i != view_vec->end(); ++i) {
-        auto vi = std::static_pointer_cast<DevicetrackerView>(*i);
-        if (vi->get_view_id() == in_id) {
-            view_vec->erase(i);
-            return;
-        }
-    }
-}
+void Devicetracker::add_device_vecs(std::shared_ptr<kis_tracked_device_base> in_device) {
+    local_locker lock(&device_vec_mutex);
 
-void Devicetracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    local_shared_locker l(&view_mutex);
+    in_device->tracked_vec_pos = tracked_vec.size();
+    tracked_vec.push_back(in_device);
+    device_list_generation++;
 
-    for (auto i : *view_vec) {
-        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
-        vi->newDevice(in_device);
+    in_device->set_kis_internal_id(allocate_device_id());
+}
+
+uint64_t Devicetracker::allocate_device_id() {
+    // Fill the lowest hole left by a removed device before raising the limit
+    if (free_device_ids.size() > 0) {
+        auto id = *(free_device_ids.begin());
+        free_device_ids.erase(free_device_ids.begin());
+        return id;
     }
+
+    return device_id_limit++;
 }
 
-void Devicetracker::update_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    local_shared_locker l(&view_mutex);
+void Devicetracker::release_device_id(uint64_t in_id) {
+    free_device_ids.insert(in_id);
 
-    for (auto i : *view_vec) {
-        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
-        vi->updateDevice(in_device);
+    // Lower the limit past trailing free IDs, so it drops back after a burst of devices
+    // expires
+    while (device_id_limit > 0 && free_device_ids.size() > 0 &&
+            *(free_device_ids.rbegin()) == device_id_limit - 1) {
+        free_device_ids.erase(std::prev(free_device_ids.end()));
+        device_id_limit--;
     }
 }
 
-void Devicetracker::remove_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
-    local_shared_locker l(&view_mutex);
+bool Devicetracker::remove_device_index(std::shared_ptr<kis_tracked_device_base> in_device) {
+    auto key = in_device->get_key();
+    auto shard = fetch_device_shard(key);
 
-    for (auto i : *view_vec) {
-        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
-        vi->removeDevice(in_device);
+    local_locker shardlock(&shard->mutex);
+
+    if (shard->tracked_map.erase(key) == 0)
+        return false;
+
+    shard->tracked_mac_multimap.erase_if(in_device->get_macaddr(),
+            [&key](const std::shared_ptr<kis_tracked_device_base>& d) -> bool {
+                return d->get_key() == key;
+            });
+
+    if (in_device->lastseen_owner != nullptr) {
+        in_device->lastseen_owner->erase(in_device->lastseen_pos);
+        in_device->lastseen_owner = nullptr;
     }
+
+    return true;
 }
 
-int Devicetracker::store_devices() {
-    auto devs = std::make_shared<TrackerElementVector>();
-    auto immutable_copy = std::make_shared<TrackerElementVector>(immutable_tracked_vec);
+void Devicetracker::tier_cold_devices() {
+    if (coldstore == NULL)
+        return;
 
-    // Find anything that has changed
-    for (auto v : *immutable_copy) {
-        if (v == NULL)
+    time_t ts_now = globalreg->timestamp.tv_sec;
+    std::vector<std::shared_ptr<kis_tracked_device_base>> tiered;
+
+    for (auto& shard : device_shards) {
+        // Idle devices are picked under the shard lock, but serialized and written 
+        // without it, so that packets for the shard never wait on the disk
+        std::vector<std::shared_ptr<kis_tracked_device_base>> candidates;
+
+        {
+            local_shared_locker shardlock(&shard->mutex);
+
+            // Both last-seen lists are ordered oldest first
+            for (auto l : {&shard->lastseen_list, &shard->retained_list}) {
+                for (auto d : *l) {
+                    local_shared_locker devlocker(&(d->device_mutex));
+
+                    if (ts_now - d->get_last_time() <= cold_idle_threshold)
+                        break;
+
+                    candidates.push_back(d);
+                }
+            }
+        }
+
+        if (candidates.size() == 0)
+            continue;
+
+        std::vector<DevicetrackerColdStore::cold_record> records;
+
+        // Change count of each device as it was written, taken under the same lock
+        std::vector<uint64_t> written_changes;
+
+        for (auto d : candidates) {
+            local_shared_locker devlocker(&(d->device_mutex));
+
+            written_changes.push_back(d->get_change_count());
+
+            std::stringbuf sbuf;
+
+            {
+                zstr::ostreambuf zobuf(&sbuf, 1 << 16, true);
+                std::ostream zstream(&zobuf);
+
+                KbinAdapter::Pack(zstream, d, NULL);
+
+                zobuf.pubsync();
+            }
+
+            records.push_back(DevicetrackerColdStore::cold_record{d->get_key(), 
+                    d->get_macaddr(), d->get_first_time(), d->get_last_time(), 
+                    sbuf.str()});
+        }
+
+        // The records have to be on disk before the devices are dropped, since a packet
+        // for a device restores it as soon as it has a stub; if they can't be written, 
+        // the devices stay in memory
+        if (coldstore->store_devices(records) < 0)
             continue;
 
-        auto kdb = std::static_pointer_cast<kis_tracked_device_base>(v);
-        if (kdb->get_mod_time() > last_database_logged)
-            devs->push_back(v);
+        // Devices changed since they were written stay in memory, and their records
+        // are dropped so a stale copy is never restored.  Every packet for a device
+        // changes it in UpdateCommonDevice under the shard lock first, so none can reach
+        // it between this check and its removal.
+        std::vector<device_key> stale;
+
+        {
+            local_locker shardlock(&shard->mutex);
+
+            for (size_t ci = 0; ci < candidates.size(); ci++) {
+                auto d = candidates[ci];
+                auto di = shard->tracked_map.find(d->get_key());
+
+                bool seen = (di == shard->tracked_map.end() || di->second != d);
+
+                if (!seen) {
+                    local_shared_locker devlocker(&(d->device_mutex));
+                    seen = d->get_change_count() != written_changes[ci];
+                }
+
+                if (seen || !remove_device_index(d)) {
+                    stale.push_back(d->get_key());
+                    continue;
+                }
+
+                shard->cold_map[d->get_key()] = 
+                    device_shard::cold_stub{d->get_macaddr(), d->get_first_time(), 
+                        d->get_last_time(), false, nullptr};
+
+                tiered.push_back(d);
+            }
+        }
+
+        if (stale.size() > 0)
+            coldstore->remove_devices(stale);
     }
 
-    last_devicelist_saved = time(0);
+    if (tiered.size() > 0) {
+        remove_device_vecs(tiered);
+
+        for (auto d : tiered)
+            remove_view_device(d);
+
+        UpdateFullRefresh();
+    }
+
+    // Forget the oldest devices entirely
+    if (cold_timeout > 0) {
+        std::vector<device_key> expired;
+
+        coldstore->expire_devices(ts_now - cold_timeout, expired);
+
+        for (auto k : expired) {
+            auto shard = fetch_device_shard(k);
+            local_locker shardlock(&shard->mutex);
+            shard->cold_map.erase(k);
+        }
+    }
+
+    size_t num_cold = 0;
 
-    return store_devices(devs);
+    for (auto& shard : device_shards) {
+        local_shared_locker shardlock(&shard->mutex);
+        num_cold += shard->cold_map.size();
+    }
+
+    cold_tiered_count += tiered.size();
+
+    uint64_t rehydrated = cold_rehydrated_count;
+
+    cold_storage->set_cold_devices(num_cold);
+    cold_storage->set_tiered_devices(cold_tiered_count);
+    cold_storage->set_rehydrated_devices(rehydrated);
+    cold_storage->set_store_size(coldstore->store_size());
+    cold_storage->get_tiered_rrd()->add_sample(tiered.size(), ts_now);
+    cold_storage->get_rehydrated_rrd()->add_sample(rehydrated - cold_rehydrated_reported, ts_now);
+
+    cold_rehydrated_reported = rehydrated;
 }
 
-int Devicetracker::store_all_devices() {
-    auto immutable_copy = std::make_shared<TrackerElementVector>(immutable_tracked_vec);
-    last_devicelist_saved = time(0);
+Devicetracker::device_shard::cold_stub *
+    Devicetracker::queue_cold_rehydration(device_shard *shard, const device_key& in_key) {
+    auto ci = shard->cold_map.find(in_key);
 
-    return store_devices(immutable_copy);
+    if (ci == shard->cold_map.end())
+        return nullptr;
+
+    if (!ci->second.restoring) {
+        ci->second.restoring = true;
+
+        cold_restore_pool->submit([this, in_key]() {
+                rehydrate_cold_device(in_key);
+                });
+    }
+
+    return &(ci->second);
 }
 
-int Devicetracker::store_devices(std::shared_ptr<TrackerElementVector> devices) {
-    if (!persistent_storage)
-        return 0;
+std::shared_ptr<kis_tracked_device_base> 
+    Devicetracker::rehydrate_cold_device(const device_key& in_key) {
+    if (coldstore == NULL)
+        return NULL;
 
-    if (statestore == NULL)
-        return 0;
+    auto shard = fetch_device_shard(in_key);
 
-    int r = statestore->store_devices(devices);
+    local_demand_locker shardlock(&shard->mutex);
+    shardlock.lock();
 
-    return r;
+    // Someone else may have restored it first
+    if (shard->cold_map.find(in_key) == shard->cold_map.end()) {
+        auto i = shard->tracked_map.find(in_key);
+
+        if (i != shard->tracked_map.end())
+            return i->second;
+
+        return NULL;
+    }
+
+    // Read the record without the shard; packets from the device may create a new 
+    // record for it in the meantime
+    shardlock.unlock();
+
+    auto device = coldstore->load_device(in_key);
+
+    shardlock.lock();
+
+    // Either way the stub is spent; a record which can't be restored is gone.  If the
+    // stub was already gone, another restore got here first and has published the device
+    auto ci = shard->cold_map.find(in_key);
+
+    if (ci == shard->cold_map.end()) {
+        auto i = shard->tracked_map.find(in_key);
+
+        if (i != shard->tracked_map.end())
+            return i->second;
+
+        return NULL;
+    }
+
+    // A record created by packets while the stub was in place has only been seen by the
+    // packet path; if the stored record is lost it takes its place
+    auto pending = ci->second.pending;
+    shard->cold_map.erase(ci);
+
+    if (device == NULL) {
+        device = pending;
+        pending.reset();
+    } else {
+        cold_rehydrated_count++;
+    }
+
+    if (device == NULL)
+        return NULL;
+
+    // Otherwise carry everything it recorded over to the restored record; the restored
+    // record isn't visible to anyone else yet.  Packets updating the pending record hold
+    // the shard, so none are part way through an update.
+    if (pending != nullptr) {
+        local_locker devlocker(&(pending->device_mutex));
+
+        device->merge_pending(pending);
+
+        auto phy = FetchPhyHandler(device->get_phyid());
+
+        if (phy != NULL)
+            phy->MergeRestoredDevice(device, pending);
+    }
+
+    reserve_phy_records(device);
+
+    add_device_vecs(device);
+
+    shard->tracked_map.insert_unique(in_key, device);
+    shard->tracked_mac_multimap.insert_multi(device->get_macaddr(), device);
+    touch_device_lastseen(shard, device);
+    refresh_device_indices(device);
+
+    // Release the shard before taking the view lock
+    shardlock.unlock();
+
+    new_view_device(device);
+
+    return device;
 }
 
-void Devicetracker::databaselog_write_devices() {
-    auto devs = std::make_shared<TrackerElementVector>();
+void Devicetracker::touch_device_lastseen(device_shard *shard,
+        std::shared_ptr<kis_tracked_device_base> in_device) {
+    auto& lsl = shard->lastseen_list;
 
-    // Find anything that has changed
-    auto fw = std::make_shared<devicetracker_function_worker>(
-            [this, devs] 
-                (Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
+    // Find where the device belongs; packets arrive nearly in time order so this is 
+    // almost always the end of the list, but restored devices can be older
+    auto last_time = in_device->get_last_time();
+    auto pos = lsl.end();
 
-                if (d->get_mod_time() > last_database_logged) {
-                    return true;
-                }
+    while (pos != lsl.begin()) {
+        auto prev = std::prev(pos);
 
-                return false;
-        }, nullptr);
+        if (*prev == in_device || (*prev)->get_last_time() <= last_time)
+            break;
 
-    MatchOnReadonlyDevices(fw);
+        pos = prev;
+    }
 
-    last_database_logged = time(0);
+    if (in_device->lastseen_owner != nullptr) {
+        // Already in place
+        if (in_device->lastseen_owner == &lsl && std::next(in_device->lastseen_pos) == pos)
+            return;
 
-    databaselog_write_devices(fw->GetMatchedDevices());
+        lsl.splice(pos, *(in_device->lastseen_owner), in_device->lastseen_pos);
+    } else {
+        in_device->lastseen_pos = lsl.insert(pos, in_device);
+    }
+
+    in_device->lastseen_owner = &lsl;
 }
 
-void Devicetracker::databaselog_write_devices(std::shared_ptr<TrackerElementVector> vec) {
-    auto dbf = Globalreg::FetchMandatoryGlobalAs<KisDatabaseLogfile>();
-    
-    if (dbf == NULL)
+void Devicetracker::remove_device_vecs(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices) {
+    if (in_devices.size() == 0)
         return;
 
-    // Fire off a database log
-    dbf->log_devices(vec);
+    // Un-index the devices before taking the device vector, because un-indexing takes 
+    // the device locks
+    for (auto d : in_devices)
+        remove_device_indices(d);
+
+    {
+        local_locker lock(&device_vec_mutex);
+
+        // Swap each device with the last one in the vector, so removal only touches the
+        // devices being removed; the order of the vector is never relied on.  Only 
+        // devices still in the vector hold an ID, which is re-used by the next new device.
+        for (auto d : in_devices) {
+            auto pos = d->tracked_vec_pos;
+
+            if (pos >= tracked_vec.size() || tracked_vec[pos] != d)
+                continue;
+
+            release_device_id(d->get_kis_internal_id());
+
+            if (pos != tracked_vec.size() - 1) {
+                tracked_vec[pos] = std::move(tracked_vec.back());
+                tracked_vec[pos]->tracked_vec_pos = pos;
+            }
+
+            tracked_vec.pop_back();
+        }
+
+        device_list_generation++;
+    }
+
+    record_removed_devices(in_devices);
 }
 
-int Devicetracker::load_devices() {
-    // Deliberately don't lock the db and device list - adding to the device list should
-    // always be safe and handled by the add device locking, and the database should
-    // be quiet during startup; we don't want a long load process to break the
-    // mutex timers
+void Devicetracker::record_removed_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices) {
+    local_locker lock(&devicelist_mutex);
 
-    if (!persistent_storage || persistent_mode != MODE_ONSTART || statestore == NULL)
+    auto generation = kis_tracked_device_base::current_generation();
+
+    for (auto d : in_devices)
+        removed_devices.push_back(std::make_pair(generation, d->get_key()));
+
+    // Remember removals for an hour of generations, and at most 100,000 of them
+    uint64_t keep_generations = 3600 / change_generation_period;
+
+    while (removed_devices.size() > 0 &&
+            (removed_devices.size() > 100000 ||
+             removed_devices.front().first + keep_generations < generation)) {
+        removed_lost_generation = 
+            std::max(removed_lost_generation, removed_devices.front().first);
+        removed_devices.pop_front();
+    }
+}
+
+int Devicetracker::IndexTracker(kis_packet *in_pack) {
+    if (!map_device_indices)
         return 0;
 
-    if (!Database_Valid())
+    kis_tracked_device_info *devinfo =
+        (kis_tracked_device_info *) in_pack->fetch(pack_comp_device);
+
+    if (devinfo == NULL)
         return 0;
 
-    int r;
-    
-    r = statestore->load_devices();
+    for (auto d : devinfo->devrefs) {
+        // Almost every packet leaves the indexed values as they were; skip the device
+        // without building its keys or taking any locks
+        if (d.second->get_index_changes() == d.second->indexed_changes)
+            continue;
 
-    if (r < 0)
-        return r;
+        auto shard = fetch_device_shard(d.second->get_key());
+        local_shared_locker shardlock(&shard->mutex);
 
-    r = statestore->clear_old_devices();
+        // Don't re-file a device which was removed while the packet was in flight
+        auto i = shard->tracked_map.find(d.second->get_key());
+        if (i == shard->tracked_map.end() || i->second != d.second)
+            continue;
 
-    return r;
+        refresh_device_indices(d.second);
+    }
+
+    return 1;
 }
 
-// Attempt to load a single device from the database, return NULL if it wasn't found
-// or if there was an error
-std::shared_ptr<kis_tracked_device_base> Devicetracker::load_device(Kis_Phy_Handler *in_phy,
-        mac_addr in_mac) {
+std::shared_ptr<Devicetracker::device_index> 
+    Devicetracker::fetch_device_index(const std::string& in_attribute, bool in_create) {
+    local_locker lock(&device_index_mutex);
 
-    if (!persistent_storage || persistent_mode != MODE_ONDEMAND || statestore == NULL)
-        return NULL;
+    auto index = device_indices.find(in_attribute);
 
-    if (!statestore->Database_Valid())
-        return NULL;
+    if (index != device_indices.end())
+        return index->second;
 
-    return statestore->load_device(in_phy, in_mac);
+    if (!in_create)
+        return nullptr;
+
+    auto ret = std::make_shared<device_index>();
+    device_indices[in_attribute] = ret;
+
+    return ret;
 }
 
-std::shared_ptr<kis_tracked_device_base> 
-Devicetracker::convert_stored_device(mac_addr macaddr,
-        const unsigned char *raw_stored_data, unsigned long stored_len) {
+void Devicetracker::refresh_device_indices(std::shared_ptr<kis_tracked_device_base> in_device) {
+    if (!map_device_indices)
+        return;
 
-    try {
-        // Decompress the record if necessary
-        std::stringbuf ibuf;
+    // The device lock protects the keys the device is filed under, so only one thread
+    // re-files a device at a time
+    local_locker devlock(&in_device->device_mutex);
 
-        // Decompression buffer, autodetect compression
-        zstr::istreambuf izbuf(&ibuf, 1 << 16, true);
+    auto changes = in_device->get_index_changes();
 
-        // Link an istream to the compression buffer
-        std::istream istream(&izbuf);
+    if (changes == in_device->indexed_changes)
+        return;
 
-        // Flag exceptions on decompression errors
-        istream.exceptions(std::ios_base::badbit);
+    std::vector<kis_tracked_device_base::index_key_t> keys;
 
-        // Assign the row string to the strbuf behind the decompression system
-        ibuf.sputn((const char *) raw_stored_data, stored_len);
-        ibuf.pubsync();
+    keys.emplace_back("phy", in_device->get_phyname());
+    keys.emplace_back("type", in_device->get_type_string());
+    keys.emplace_back("manuf", in_device->get_manuf()->get());
+    keys.emplace_back("channel", in_device->get_channel());
 
-        // Get the decompressed record
-        std::string uzbuf(std::istreambuf_iterator<char>(istream), {});
+    for (auto s : *(in_device->get_seenby_map())) {
+        auto sb = std::static_pointer_cast<kis_tracked_seenby_data>(s.second);
+        keys.emplace_back("seenby", sb->get_src_uuid().UUID2String());
+    }
 
-        // Read out the structured json
-        SharedStructured sjson(new StructuredJson(uzbuf));
+    auto phy = FetchPhyHandler(in_device->get_phyid());
+    if (phy != NULL)
+        phy->DeviceIndexKeys(in_device, keys);
 
-        // Process structured object into a shared element
-        SharedTrackerElement e = 
-            StorageLoader::storage_to_tracker(sjson);
+    keys.erase(std::remove_if(keys.begin(), keys.end(),
+                [](const kis_tracked_device_base::index_key_t& k) -> bool {
+                    return k.second.length() == 0;
+                }), keys.end());
 
-        if (e->get_type() != TrackerType::TrackerMap) 
-            throw StructuredDataException(fmt::format("Expected a TrackerMap from loading the storage "
-                    "element, but got {}", e->type_to_typestring(e->get_type())));
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
 
-        // Adopt it into a device
-        auto kdb = std::make_shared<kis_tracked_device_base>(device_base_id, 
-                std::static_pointer_cast<TrackerElementMap>(e));
+    in_device->indexed_changes = changes;
 
-        // Give all the phys a shot at it
-        for (auto p : phy_handler_map)
-            p.second->LoadPhyStorage(e, kdb);
+    if (keys == in_device->index_keys)
+        return;
+
+    std::vector<kis_tracked_device_base::index_key_t> stale, added;
+
+    std::set_difference(in_device->index_keys.begin(), in_device->index_keys.end(),
+            keys.begin(), keys.end(), std::back_inserter(stale));
+    std::set_difference(keys.begin(), keys.end(),
+            in_device->index_keys.begin(), in_device->index_keys.end(), 
+            std::back_inserter(added));
+
+    for (auto k : stale) {
+        auto index = fetch_device_index(k.first, false);
+
+        if (index == nullptr)
+            continue;
+
+        local_locker indexlock(&index->mutex);
+
+        auto v = index->values.find(k.second);
+
+        if (v == index->values.end())
+            continue;
+
+        v->second.erase(in_device);
+
+        if (v->second.size() == 0)
+            index->values.erase(v);
+    }
+
+    for (auto k : added) {
+        auto index = fetch_device_index(k.first, true);
+
+        local_locker indexlock(&index->mutex);
+        index->values[k.second].insert(in_device);
+    }
+
+    in_device->index_keys = std::move(keys);
+}
+
+void Devicetracker::remove_device_indices(std::shared_ptr<kis_tracked_device_base> in_device) {
+    local_locker devlock(&in_device->device_mutex);
+
+    for (auto k : in_device->index_keys) {
+        auto index = fetch_device_index(k.first, false);
+
+        if (index == nullptr)
+            continue;
+
+        local_locker indexlock(&index->mutex);
+
+        auto v = index->values.find(k.second);
+
+        if (v == index->values.end())
+            continue;
+
+        v->second.erase(in_device);
+
+        if (v->second.size() == 0)
+            index->values.erase(v);
+    }
+
+    in_device->index_keys.clear();
+
+    // Re-file the device from scratch if it comes back
+    in_device->indexed_changes = 0;
+}
+
+bool Devicetracker::FetchIndexedDevices(const std::string& in_attribute, 
+        const std::string& in_value,
+        std::vector<std::shared_ptr<kis_tracked_device_base>>& ret) {
+    if (!map_device_indices)
+        return false;
+
+    auto index = fetch_device_index(in_attribute, false);
+
+    if (index == nullptr) {
+        // The common attributes are always indexed, even before any device has them
+        return in_attribute == "phy" || in_attribute == "type" || in_attribute == "manuf" ||
+            in_attribute == "channel" || in_attribute == "seenby";
+    }
+
+    local_locker indexlock(&index->mutex);
+
+    auto v = index->values.find(in_value);
+
+    if (v != index->values.end())
+        ret.insert(ret.end(), v->second.begin(), v->second.end());
+
+    return true;
+}
+
+
+std::vector<std::shared_ptr<kis_tracked_device_base>> 
+    Devicetracker::find_devices_by_mac(const mac_addr& in_mac) {
+
+    std::vector<std::shared_ptr<kis_tracked_device_base>> ret;
+
+    // Full addresses can use the hash index, but devices are sharded by key so the same
+    // mac may be in any shard; masked addresses have to be compared against every device
+    if ((in_mac.longmask & 0xFFFFFFFFFFFFULL) == 0xFFFFFFFFFFFFULL) {
+        for (auto& shard : device_shards) {
+            local_shared_locker shardlock(&shard->mutex);
+
+            shard->tracked_mac_multimap.for_each_equal(in_mac,
+                    [&ret](std::shared_ptr<kis_tracked_device_base>& d) {
+                        ret.push_back(d);
+                    });
+        }
+
+        // Devices in cold storage are keyed by phy and mac, so each phy can be checked
+        // directly
+        if (coldstore != NULL) {
+            for (auto p : phy_handler_map) {
+                device_key k(p.second->FetchPhynameHash(), in_mac);
+                auto shard = fetch_device_shard(k);
+
+                {
+                    local_shared_locker shardlock(&shard->mutex);
+                    if (shard->cold_map.find(k) == shard->cold_map.end())
+                        continue;
+                }
+
+                auto d = rehydrate_cold_device(k);
+
+                if (d != NULL)
+                    ret.push_back(d);
+            }
+        }
+    } else {
+        for (auto d : *fetch_device_snapshot()) {
+            if (d->get_macaddr() == in_mac)
+                ret.push_back(d);
+        }
+    }
+
+    return ret;
+}
+
+bool Devicetracker::device_key_known(const device_key& in_key) {
+    auto shard = fetch_device_shard(in_key);
+    local_shared_locker lock(&shard->mutex);
+
+    return shard->tracked_map.find(in_key) != shard->tracked_map.end() ||
+        shard->cold_map.find(in_key) != shard->cold_map.end();
+}
+
+bool Devicetracker::device_mac_known(const mac_addr& in_mac) {
+    // Covers the same devices as find_devices_by_mac
+    if ((in_mac.longmask & 0xFFFFFFFFFFFFULL) == 0xFFFFFFFFFFFFULL) {
+        for (auto& shard : device_shards) {
+            local_shared_locker shardlock(&shard->mutex);
+
+            if (shard->tracked_mac_multimap.count(in_mac) > 0)
+                return true;
+        }
+
+        if (coldstore != NULL) {
+            for (auto p : phy_handler_map) {
+                device_key k(p.second->FetchPhynameHash(), in_mac);
+                auto shard = fetch_device_shard(k);
+
+                local_shared_locker shardlock(&shard->mutex);
+
+                if (shard->cold_map.find(k) != shard->cold_map.end())
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    for (auto d : *fetch_device_snapshot()) {
+        if (d->get_macaddr() == in_mac)
+            return true;
+    }
+
+    return false;
+}
+
+void Devicetracker::publish_device_snapshot() {
+    // Published from the timer and on demand by add_view and store_all_devices, so the
+    // generation is only compared under the lock
+    local_locker lock(&device_vec_mutex);
+
+    if (device_list_generation == device_snapshot_generation)
+        return;
+
+    device_snapshot_generation = device_list_generation;
+    std::atomic_store(&device_snapshot, 
+            std::shared_ptr<const device_snapshot_t>(std::make_shared<device_snapshot_t>(tracked_vec)));
+}
+
+bool Devicetracker::add_view(std::shared_ptr<DevicetrackerView> in_view) {
+    local_locker l(&view_mutex);
+
+    for (auto i : *view_vec) {
+        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
+        if (vi->get_view_id() == in_view->get_view_id()) 
+            return false;
+    }
+
+    view_vec->push_back(in_view);
+
+    // Seed from a current snapshot rather than waiting for the timer to publish one;
+    // devices added from here on reach the view through new_view_device once the view
+    // lock is released, and the view ignores devices it already holds
+    publish_device_snapshot();
+
+    for (auto d : *fetch_device_snapshot())
+        in_view->newDevice(d);
+
+    return true;
+}
+
+void Devicetracker::remove_view(const std::string& in_id) {
+    local_locker l(&view_mutex);
+        
+    for (auto i = view_vec->begin(); i != view_vec->end(); ++i) {
+        auto vi = std::static_pointer_cast<DevicetrackerView>(*i);
+        if (vi->get_view_id() == in_id) {
+            view_vec->erase(i);
+            return;
+        }
+    }
+}
+
+void Devicetracker::new_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    local_shared_locker l(&view_mutex);
+
+    for (auto i : *view_vec) {
+        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
+        vi->newDevice(in_device);
+    }
+}
+
+void Devicetracker::update_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    local_shared_locker l(&view_mutex);
+
+    for (auto i : *view_vec) {
+        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
+        vi->updateDevice(in_device);
+    }
+}
+
+void Devicetracker::remove_view_device(std::shared_ptr<kis_tracked_device_base> in_device) {
+    local_shared_locker l(&view_mutex);
+
+    for (auto i : *view_vec) {
+        auto vi = std::static_pointer_cast<DevicetrackerView>(i);
+        vi->removeDevice(in_device);
+    }
+}
+
+int Devicetracker::store_devices() {
+    if (!persistent_storage || statestore == NULL)
+        return 0;
+
+    // Don't checkpoint a partial restore; devices not restored yet are still in the
+    // store, and restored devices are written by the next checkpoint
+    if (devices_restoring)
+        return 0;
+
+    std::lock_guard<std::mutex> lk(storage_checkpoint_mutex);
+
+    // Anything changed in or after the generation of the last checkpoint is dirty; 
+    // changes later in the current generation, racing with this checkpoint, are 
+    // written again next time rather than lost
+    auto generation = kis_tracked_device_base::current_generation();
+
+    auto devs = std::make_shared<TrackerElementVector>();
+
+    for (auto kdb : *fetch_device_snapshot()) {
+        local_shared_locker devlocker(&(kdb->device_mutex));
+
+        if (kdb->get_change_generation() >= storage_checkpoint_generation)
+            devs->push_back(kdb);
+    }
+
+    last_devicelist_saved = time(0);
+
+    int r = store_devices(devs);
+
+    if (r >= 0)
+        storage_checkpoint_generation = generation;
+
+    return r;
+}
+
+int Devicetracker::store_restore_checkpoint(time_t in_restore_start) {
+    std::lock_guard<std::mutex> lk(storage_checkpoint_mutex);
+
+    // Restored records are exactly what's stored; only devices modified since the
+    // restore started, live or by a restored device being seen again, need writing
+    auto generation = kis_tracked_device_base::current_generation();
+
+    auto devs = std::make_shared<TrackerElementVector>();
+
+    for (auto kdb : *fetch_device_snapshot()) {
+        local_shared_locker devlocker(&(kdb->device_mutex));
+
+        if (kdb->get_mod_time() >= in_restore_start)
+            devs->push_back(kdb);
+    }
+
+    last_devicelist_saved = time(0);
+
+    int r = store_devices(devs);
+
+    if (r >= 0)
+        storage_checkpoint_generation = generation;
+
+    return r;
+}
+
+int Devicetracker::store_all_devices() {
+    std::lock_guard<std::mutex> lk(storage_checkpoint_mutex);
+
+    // Make sure the most recent devices are included
+    publish_device_snapshot();
+
+    auto snapshot = fetch_device_snapshot();
+    auto immutable_copy = std::make_shared<TrackerElementVector>();
+
+    immutable_copy->reserve(snapshot->size());
+    for (auto d : *snapshot)
+        immutable_copy->push_back(d);
+
+    last_devicelist_saved = time(0);
+
+    return store_devices(immutable_copy);
+}
+
+int Devicetracker::store_devices(std::shared_ptr<TrackerElementVector> devices) {
+    if (!persistent_storage)
+        return 0;
+
+    if (statestore == NULL)
+        return 0;
+
+    int r = statestore->store_devices(devices);
+
+    return r;
+}
+
+void Devicetracker::databaselog_write_devices() {
+    auto devs = std::make_shared<TrackerElementVector>();
+
+    // Find anything that has changed
+    auto fw = std::make_shared<devicetracker_function_worker>(
+            [this, devs] 
+                (Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
+
+                if (d->get_mod_time() > last_database_logged) {
+                    return true;
+                }
+
+                return false;
+        }, nullptr);
+
+    MatchOnReadonlyDevices(fw);
+
+    last_database_logged = time(0);
+
+    databaselog_write_devices(fw->GetMatchedDevices());
+}
+
+void Devicetracker::databaselog_write_devices(std::shared_ptr<TrackerElementVector> vec) {
+    auto dbf = Globalreg::FetchMandatoryGlobalAs<KisDatabaseLogfile>();
+    
+    if (dbf == NULL)
+        return;
+
+    // Fire off a database log
+    dbf->log_devices(vec);
+}
+
+int Devicetracker::load_devices() {
+    // Don't lock the device list - adding to the device list is handled by the add 
+    // device locking.  The state store holds its own database lock while restoring, 
+    // and checkpoints are skipped until the restore is done.
+
+    if (!persistent_storage || persistent_mode != MODE_ONSTART || statestore == NULL)
+        return 0;
+
+    if (!Database_Valid())
+        return 0;
+
+    if (devices_restoring)
+        return 0;
+
+    devices_restoring = true;
+    restore_cancelled = false;
+    restore_total = 0;
+    restore_loaded = 0;
+
+    // Restore in the background so the server is usable while devices are loaded; 
+    // devices seen live before their stored record is restored keep the live record
+    device_restore_thread = std::thread([this] {
+        auto start = time(0);
+
+        if (statestore->load_devices() >= 0 && !restore_cancelled)
+            statestore->clear_old_devices();
+
+        _MSG_INFO("Restored {} stored devices in {} seconds", 
+                (uint64_t) restore_loaded, time(0) - start);
+
+        // A cancelled restore is followed by the checkpoint on exit, which writes 
+        // everything
+        if (!restore_cancelled)
+            store_restore_checkpoint(start);
+
+        devices_restoring = false;
+    });
+
+    thread_set_process_name("kismet [restore]", device_restore_thread);
+
+    return 1;
+}
+
+void Devicetracker::stop_restore() {
+    restore_cancelled = true;
+
+    if (device_restore_thread.joinable())
+        device_restore_thread.join();
+}
+
+// Attempt to load a single device from the database, return NULL if it wasn't found
+// or if there was an error
+std::shared_ptr<kis_tracked_device_base> Devicetracker::load_device(Kis_Phy_Handler *in_phy,
+        mac_addr in_mac) {
+
+    if (!persistent_storage || persistent_mode != MODE_ONDEMAND || statestore == NULL)
+        return NULL;
+
+    if (!statestore->Database_Valid())
+        return NULL;
+
+    return statestore->load_device(in_phy, in_mac);
+}
+
+std::shared_ptr<kis_tracked_device_base> 
+Devicetracker::convert_stored_device(mac_addr macaddr,
+        const unsigned char *raw_stored_data, unsigned long stored_len) {
+
+    try {
+        // Decompress the record if necessary
+        std::stringbuf ibuf;
+
+        // Decompression buffer, autodetect compression
+        zstr::istreambuf izbuf(&ibuf, 1 << 16, true);
+
+        // Link an istream to the compression buffer
+        std::istream istream(&izbuf);
+
+        // Flag exceptions on decompression errors
+        istream.exceptions(std::ios_base::badbit);
+
+        // Assign the row string to the strbuf behind the decompression system
+        ibuf.sputn((const char *) raw_stored_data, stored_len);
+        ibuf.pubsync();
+
+        // Get the decompressed record
+        std::string uzbuf(std::istreambuf_iterator<char>(istream), {});
+
+        SharedTrackerElement e;
+
+        if (KbinAdapter::IsKbin(uzbuf)) {
+            e = KbinAdapter::Unpack(uzbuf);
+        } else {
+            // Older records are stored as structured json
+            SharedStructured sjson(new StructuredJson(uzbuf));
+
+            // Process structured object into a shared element
+            e = StorageLoader::storage_to_tracker(sjson);
+        }
+
+        if (e == nullptr)
+            throw std::runtime_error("empty stored device record");
+
+        if (e->get_type() != TrackerType::TrackerMap) 
+            throw StructuredDataException(fmt::format("Expected a TrackerMap from loading the storage "
+                    "element, but got {}", e->type_to_typestring(e->get_type())));
+
+        // Adopt it into a device
+        auto kdb = std::make_shared<kis_tracked_device_base>(device_base_id, 
+                std::static_pointer_cast<TrackerElementMap>(e));
+
+        // Give all the phys a shot at it
+        for (auto p : phy_handler_map)
+            p.second->LoadPhyStorage(e, kdb);
+
+        // Update the server uuid in case we don't have it
+        if (kdb->get_server_uuid().error)
+            kdb->set_server_uuid(globalreg->server_uuid);
+
+        // Update the manuf in case we added a manuf db
+        if (globalreg->manufdb != NULL)
+            kdb->set_manuf(globalreg->manufdb->LookupOUI(kdb->get_macaddr()));
+
+        return kdb;
+    } catch (const zstr::Exception& e) {
+        _MSG("Unable to decompress stored device data (" + macaddr.Mac2String() + "); the "
+                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
+        return NULL;
+    } catch (const StructuredDataException& e) {
+        _MSG("Could not parse stored device data (" + macaddr.Mac2String() + "); the "
+                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
+        return NULL;
+    } catch (const std::runtime_error&e ) {
+        _MSG("Could not parse stored device data (" + macaddr.Mac2String() + "); the "
+                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
+        return NULL;
+    } catch (const std::exception& e) {
+        _MSG("Unable to load a stored device (" + macaddr.Mac2String() + "); the stored "
+                "device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
+        return NULL;
+    }
+
+    return NULL;
+}
+
+void Devicetracker::load_stored_username(std::shared_ptr<kis_tracked_device_base> in_dev) {
+    // Lock the database; we're doing a single query
+    local_locker dblock(&ds_mutex);
+
+    if (!Database_Valid())
+        return;
+
+    // Lock the device itself
+    local_locker devlocker(&(in_dev->device_mutex));
+
+    std::string sql;
+    std::string keystring = in_dev->get_key().as_string();
+
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
+
+    sql = 
+        "SELECT name FROM device_names WHERE key = ? ";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database query for stored devicename in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+
+    while (1) {
+        r = sqlite3_step(stmt);
+
+        if (r == SQLITE_ROW) {
+            const unsigned char *rowstr;
+
+            rowstr = (const unsigned char *) sqlite3_column_text(stmt, 0);
+
+            in_dev->set_username(std::string((const char *) rowstr));
+
+        } else if (r == SQLITE_DONE) {
+            break;
+        } else {
+            _MSG("Devicetracker encountered an error loading stored device username: " + 
+                    std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            break;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+void Devicetracker::load_stored_tags(std::shared_ptr<kis_tracked_device_base> in_dev) {
+    // Lock the database; we're doing a single query
+    local_locker dblock(&ds_mutex);
+
+    if (!Database_Valid())
+        return;
+
+    // Lock the device itself
+    local_locker devlocker(&(in_dev->device_mutex));
+
+    std::string sql;
+    std::string keystring = in_dev->get_key().as_string();
+
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
+
+    sql = 
+        "SELECT tag, content FROM device_tags WHERE key = ?";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database query for stored devicetag in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return;
+    }
+
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+
+    while (1) {
+        r = sqlite3_step(stmt);
+
+        if (r == SQLITE_ROW) {
+            const unsigned char *tagstr;
+            const unsigned char *contentstr;
+
+            tagstr = (const unsigned char *) sqlite3_column_text(stmt, 0);
+            contentstr = (const unsigned char *) sqlite3_column_text(stmt, 1);
+
+            auto tagc = std::make_shared<TrackerElementString>();
+            tagc->set(std::string((const char *) contentstr));
+
+            in_dev->get_tag_map()->insert(std::string((const char *) tagstr), tagc);
+        } else if (r == SQLITE_DONE) {
+            break;
+        } else {
+            _MSG("Devicetracker encountered an error loading stored device username: " + 
+                    std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            break;
+        }
+    }
+
+    sqlite3_finalize(stmt);
+}
+
+void Devicetracker::SetDeviceUserName(std::shared_ptr<kis_tracked_device_base> in_dev,
+        std::string in_username) {
+
+    // Lock the device itself
+    local_locker devlocker(&(in_dev->device_mutex));
+
+    in_dev->set_username(in_username);
+
+    if (!Database_Valid()) {
+        _MSG("Unable to store device name to permanent storage, the database connection "
+                "is not available", MSGFLAG_ERROR);
+        return;
+    }
+
+    std::string sql;
+
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
+
+    std::string keystring = in_dev->get_key().as_string();
+
+    sql = 
+        "INSERT INTO device_names "
+        "(key, name) "
+        "VALUES (?, ?)";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database insert for device name in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return;
+    }
+ 
+    sqlite3_reset(stmt);
+
+    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+    sqlite3_bind_text(stmt, 2, in_username.c_str(), in_username.length(), 0);
+
+    // Only lock the database while we're inserting
+    {
+        local_locker lock(&ds_mutex);
+        sqlite3_step(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+
+    return;
+}
+
+void Devicetracker::SetDeviceTag(std::shared_ptr<kis_tracked_device_base> in_dev,
+        std::string in_tag, std::string in_content) {
+
+    // Lock the device itself
+    local_locker devlocker(&(in_dev->device_mutex));
+
+    auto e = std::make_shared<TrackerElementString>();
+    e->set(in_content);
+
+    auto sm = in_dev->get_tag_map();
+
+    auto t = sm->find(in_tag);
+    if (t != sm->end()) {
+        t->second = e;
+    } else {
+        sm->insert(in_tag, e);
+    }
+
+    in_dev->mark_field_dirty(sm);
+
+    if (!Database_Valid()) {
+        _MSG("Unable to store device name to permanent storage, the database connection "
+                "is not available", MSGFLAG_ERROR);
+        return;
+    }
+
+    std::string sql;
+
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
+
+    std::string keystring = in_dev->get_key().as_string();
+
+    sql = 
+        "INSERT INTO device_tags "
+        "(key, tag, content) "
+        "VALUES (?, ?, ?)";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database insert for device tags in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return;
+    }
+ 
+    sqlite3_reset(stmt);
+
+    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+    sqlite3_bind_text(stmt, 2, in_tag.c_str(), in_tag.length(), 0);
+    sqlite3_bind_text(stmt, 3, in_content.c_str(), in_content.length(), 0);
+
+    // Only lock the database while we're inserting
+    {
+        local_locker lock(&ds_mutex);
+        sqlite3_step(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+
+    return;
+}
+
+void Devicetracker::HandleNewDatasourceEvent(std::shared_ptr<EventbusEvent> evt) {
+    auto ds_evt = std::static_pointer_cast<Datasourcetracker::EventNewDatasource>(evt);
+
+    if (map_seenby_views) {
+        auto source_uuid = ds_evt->datasource->get_source_uuid();
+        auto source_key = ds_evt->datasource->get_source_key();
+
+        auto k = seenby_view_map.find(source_uuid);
+
+        if (k == seenby_view_map.end()) {
+            auto seenby_view =
+                std::make_shared<DevicetrackerView>(fmt::format("seenby-{}", source_uuid), 
+                        fmt::format("Devices seen by datasource {}", source_uuid),
+                        std::vector<std::string>{"seenby-uuid", source_uuid.asString()},
+                        [source_key](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
+                            return dev->get_seenby_map()->find(source_key) != dev->get_seenby_map()->end();
+                        },
+                        [source_key](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
+                            return dev->get_seenby_map()->find(source_key) != dev->get_seenby_map()->end();
+                        });
+            seenby_view_map[source_uuid] = seenby_view;
+            add_view(seenby_view);
+        }
+    }
+}
+
+DevicetrackerStateStore::DevicetrackerStateStore(GlobalRegistry *in_globalreg,
+        Devicetracker *in_devicetracker) :
+    KisDatabase(in_globalreg, "devicestate") {
+
+    devicetracker = in_devicetracker;
+
+    // Open and upgrade the DB, default path
+    Database_Open("");
+    Database_UpgradeDB();
+}
+
+int DevicetrackerStateStore::Database_UpgradeDB() {
+    local_locker dblock(&ds_mutex);
+
+    unsigned int dbv = Database_GetDBVersion();
+    std::string sql;
+    int r;
+    char *sErrMsg = NULL;
+
+    if (dbv < 1) {
+        // We keep the last seen timestamp for automatic culling of the database of
+        // idle device records.
+        //
+        // We need to split out the phyname and device mac because key is linked to 
+        // the phy *number*, which is *variable* based on the order phys are initialized;
+        // we need to rekey the phys.
+        sql = 
+            "CREATE TABLE device_storage ("
+            "first_time INT, "
+            "last_time INT, "
+            "phyname TEXT, "
+            "devmac TEXT, "
+            "storage BLOB, "
+            "UNIQUE(phyname, devmac) ON CONFLICT REPLACE)";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("Devicetracker unable to create device_storage table in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            sqlite3_close(db);
+            db = NULL;
+            return -1;
+        }
+
+    }
+
+    // Hardcode a table check
+    if (dbv == 1) {
+        _MSG("Purging device state, as it cannot be ported forward into the new key "
+                "architecture, sorry.", MSGFLAG_ERROR);
+
+        sql =
+            "DELETE FROM device_storage";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("Devicetracker unable to clear device_storage table in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            sqlite3_close(db);
+            db = NULL;
+            return -1;
+        }
+    }
+
+    // Devices are restored oldest first, so that each lands at the end of the expiry
+    // index of its shard instead of being searched into place
+    if (dbv < 3) {
+        sql = "CREATE INDEX IF NOT EXISTS device_storage_time ON device_storage (last_time)";
+
+        r = sqlite3_exec(db, sql.c_str(),
+                [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
+
+        if (r != SQLITE_OK) {
+            _MSG("Devicetracker unable to create device_storage index in " + ds_dbfile + ": " +
+                    std::string(sErrMsg), MSGFLAG_ERROR);
+            sqlite3_close(db);
+            db = NULL;
+            return -1;
+        }
+    }
+
+    Database_SetDBVersion(3);
+
+    return 0;
+}
+
+int DevicetrackerStateStore::clear_old_devices() {
+    local_locker dblock(&ds_mutex);
+
+    std::string sql;
+    std::stringstream sqlss;
+    int r;
+    char *sErrMsg = NULL;
+
+    if (!Database_Valid())
+        return 0;
+
+    if (devicetracker->persistent_storage_timeout == 0)
+        return 0;
+
+    sqlss << 
+        "DELETE FROM device_storage WHERE (last_time < " <<
+        time(0) - devicetracker->persistent_storage_timeout << ")";
+    sql = sqlss.str();
+
+
+    r = sqlite3_exec(db, sql.c_str(), NULL, NULL, &sErrMsg);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to delete timed out devices in " + ds_dbfile + ": " +
+                std::string(sErrMsg), MSGFLAG_ERROR);
+        sqlite3_close(db);
+        db = NULL;
+        return -1;
+    }
+
+    return 1;
+}
+
+int DevicetrackerStateStore::clear_all_devices() {
+    local_locker dblock(&ds_mutex);
+
+    std::string sql;
+    std::stringstream sqlss;
+    int r;
+    char *sErrMsg = NULL;
+
+    if (!Database_Valid())
+        return 0;
 
-        // Update the server uuid in case we don't have it
-        if (kdb->get_server_uuid().error)
-            kdb->set_server_uuid(globalreg->server_uuid);
+    if (devicetracker->persistent_storage_timeout == 0)
+        return 0;
 
-        // Update the manuf in case we added a manuf db
-        if (globalreg->manufdb != NULL)
-            kdb->set_manuf(globalreg->manufdb->LookupOUI(kdb->get_macaddr()));
+    sql = "DELETE FROM device_storage";
 
-        return kdb;
-    } catch (const zstr::Exception& e) {
-        _MSG("Unable to decompress stored device data (" + macaddr.Mac2String() + "); the "
-                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
-        return NULL;
-    } catch (const StructuredDataException& e) {
-        _MSG("Could not parse stored device data (" + macaddr.Mac2String() + "); the "
-                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
-        return NULL;
-    } catch (const std::runtime_error&e ) {
-        _MSG("Could not parse stored device data (" + macaddr.Mac2String() + "); the "
-                "stored device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
-        return NULL;
-    } catch (const std::exception& e) {
-        _MSG("Unable to load a stored device (" + macaddr.Mac2String() + "); the stored "
-                "device will be skipped: " + std::string(e.what()), MSGFLAG_ERROR);
-        return NULL;
+    r = sqlite3_exec(db, sql.c_str(), NULL, NULL, &sErrMsg);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to delete timed out devices in " + ds_dbfile + ": " +
+                std::string(sErrMsg), MSGFLAG_ERROR);
+        sqlite3_close(db);
+        db = NULL;
+        return -1;
     }
 
-    return NULL;
+    return 1;
 }
 
-void Devicetracker::load_stored_username(std::shared_ptr<kis_tracked_device_base> in_dev) {
-    // Lock the database; we're doing a single query
-    local_locker dblock(&ds_mutex);
 
+int DevicetrackerStateStore::load_devices() {
     if (!Database_Valid())
-        return;
+        return 0;
 
-    // Lock the device itself
-    local_locker devlocker(&(in_dev->device_mutex));
+    // Hold the database for the duration of the restore; checkpoints are skipped 
+    // while restoring so nothing else should be waiting on it
+    local_locker dblock(&ds_mutex);
 
+    std::string where;
     std::string sql;
-    std::string keystring = in_dev->get_key().as_string();
 
     int r;
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
-    sql = 
-        "SELECT name FROM device_names WHERE key = ? ";
+    // If we have a timeout, apply that
+    if (devicetracker->persistent_storage_timeout != 0) 
+        where = fmt::format(" WHERE (last_time > {})", 
+                time(0) - devicetracker->persistent_storage_timeout);
+
+    // Count the records first so restore progress can be reported
+    sql = "SELECT COUNT(*) FROM device_storage" + where;
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            devicetracker->restore_total = sqlite3_column_int64(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    // Oldest first; the expiry index of each shard is kept in last-seen order, and 
+    // appending in order keeps every insert at the end of it
+    sql = "SELECT devmac, storage FROM device_storage" + where + " ORDER BY last_time";
 
     r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database query for stored devicename in " +
+        _MSG("Devicetracker unable to prepare database query for stored devices in " +
                 ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return;
+        return -1;
     }
 
+    _MSG_INFO("Restoring {} stored devices in the background using {} threads.  This "
+            "may take some time, depending on the speed of your system and the number "
+            "of stored devices.", (uint64_t) devicetracker->restore_total,
+            devicetracker->restore_threads);
+
+    // Records are read in batches on this thread, and the expensive part - 
+    // decompressing and rebuilding the tracked device - is split across the workers
+    struct stored_record {
+        mac_addr macaddr;
+        std::string storage;
+    };
+
+    unsigned int num_threads = devicetracker->restore_threads;
+    size_t batch_sz = 1024 * num_threads;
+
+    std::vector<stored_record> batch;
+    batch.reserve(batch_sz);
+
+    // The workers live for the whole restore, and each batch waits for all of them to
+    // finish with it before the next is read
+    kis_thread_pool workers(num_threads);
+
+    std::mutex batch_mutex;
+    std::condition_variable batch_cv;
+    unsigned int batch_running = 0;
+
+    auto restore_batch = [this, &batch, num_threads, &workers, &batch_mutex, &batch_cv, 
+         &batch_running]() {
+        batch_running = num_threads;
+
+        for (unsigned int t = 0; t < num_threads; t++) {
+            workers.submit([this, &batch, num_threads, t, &batch_mutex, &batch_cv, 
+                    &batch_running]() {
+                for (size_t i = t; i < batch.size(); i += num_threads) {
+                    auto kdb = devicetracker->convert_stored_device(batch[i].macaddr,
+                            (const unsigned char *) batch[i].storage.data(), 
+                            batch[i].storage.length());
+
+                    // Devices already seen live keep their live record
+                    if (kdb != nullptr)
+                        devicetracker->insert_device(kdb);
+
+                    devicetracker->restore_loaded++;
+                }
+
+                std::lock_guard<std::mutex> lk(batch_mutex);
+
+                if (--batch_running == 0)
+                    batch_cv.notify_one();
+            });
+        }
+
+        std::unique_lock<std::mutex> lk(batch_mutex);
+        batch_cv.wait(lk, [&batch_running]() { return batch_running == 0; });
+
+        batch.clear();
+    };
+
     sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
 
-    while (1) {
+    while (!devicetracker->restore_cancelled) {
         r = sqlite3_step(stmt);
 
         if (r == SQLITE_ROW) {
             const unsigned char *rowstr;
+            unsigned long rowlen;
 
-            rowstr = (const unsigned char *) sqlite3_column_text(stmt, 0);
+            mac_addr m;
 
-            in_dev->set_username(std::string((const char *) rowstr));
+            rowstr = sqlite3_column_text(stmt, 0);
+            m = mac_addr((const char *) rowstr);
+
+            if (m.error) {
+                _MSG("Encountered an error loading a stored device, "
+                        "unable to process mac address; skipping device.",
+                        MSGFLAG_ERROR);
+                devicetracker->restore_loaded++;
+                continue;
+            }
+
+            rowstr = (const unsigned char *) sqlite3_column_blob(stmt, 1);
+            rowlen = sqlite3_column_bytes(stmt, 1);
+
+            batch.push_back(stored_record{m, std::string((const char *) rowstr, rowlen)});
 
+            if (batch.size() >= batch_sz)
+                restore_batch();
         } else if (r == SQLITE_DONE) {
             break;
         } else {
-            _MSG("Devicetracker encountered an error loading stored device username: " + 
+            _MSG("Encountered an error loading stored devices: " + 
                     std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
             break;
         }
     }
 
+    if (batch.size() > 0 && !devicetracker->restore_cancelled)
+        restore_batch();
+
     sqlite3_finalize(stmt);
-}
 
-void Devicetracker::load_stored_tags(std::shared_ptr<kis_tracked_device_base> in_dev) {
-    // Lock the database; we're doing a single query
-    local_locker dblock(&ds_mutex);
+    return 1;
+}
 
+// Attempt to load a single device from the database, return NULL if it wasn't found
+// or if there was an error
+std::shared_ptr<kis_tracked_device_base> 
+DevicetrackerStateStore::load_device(Kis_Phy_Handler *in_phy, mac_addr in_mac) {
     if (!Database_Valid())
-        return;
+        return NULL;
 
-    // Lock the device itself
-    local_locker devlocker(&(in_dev->device_mutex));
+    // Lock the database; we're doing a single query
+    local_locker dblock(&ds_mutex);
 
     std::string sql;
-    std::string keystring = in_dev->get_key().as_string();
+    std::string macstring = in_mac.Mac2String();
+    std::string phystring = in_phy->FetchPhyName();
 
     int r;
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
     sql = 
-        "SELECT tag, content FROM device_tags WHERE key = ?";
+        "SELECT storage FROM device_storage WHERE phyname = ? AND "
+        "devmac = ?";
 
     r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database query for stored devicetag in " +
+        _MSG("Devicetracker unable to prepare database query for stored device in " +
                 ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return;
+        return NULL;
     }
 
     sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+    sqlite3_bind_text(stmt, 1, phystring.c_str(), phystring.length(), 0);
+    sqlite3_bind_text(stmt, 2, macstring.c_str(), macstring.length(), 0);
 
     while (1) {
         r = sqlite3_step(stmt);
 
         if (r == SQLITE_ROW) {
-            const unsigned char *tagstr;
-            const unsigned char *contentstr;
-
-            tagstr = (const unsigned char *) sqlite3_column_text(stmt, 0);
-            contentstr = (const unsigned char *) sqlite3_column_text(stmt, 1);
+            const unsigned char *rowstr;
+            unsigned long rowlen;
 
-            auto tagc = std::make_shared<TrackerElementString>();
-            tagc->set(std::string((const char *) contentstr));
+            rowstr = (const unsigned char *) sqlite3_column_blob(stmt, 0);
+            rowlen = sqlite3_column_bytes(stmt, 0);
 
-            in_dev->get_tag_map()->insert(std::string((const char *) tagstr), tagc);
+            return devicetracker->convert_stored_device(in_mac, rowstr, rowlen);
         } else if (r == SQLITE_DONE) {
             break;
         } else {
-            _MSG("Devicetracker encountered an error loading stored device username: " + 
+            _MSG("Encountered an error loading stored device: " + 
                     std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
             break;
         }
     }
 
     sqlite3_finalize(stmt);
-}
-
-void Devicetracker::SetDeviceUserName(std::shared_ptr<kis_tracked_device_base> in_dev,
-        std::string in_username) {
-
-    // Lock the device itself
-    local_locker devlocker(&(in_dev->device_mutex));
 
-    in_dev->set_username(in_username);
+    return NULL;
+}
 
+int DevicetrackerStateStore::store_devices(std::shared_ptr<TrackerElementVector> devices) {
     if (!Database_Valid()) {
-        _MSG("Unable to store device name to permanent storage, the database connection "
-                "is not available", MSGFLAG_ERROR);
-        return;
+        _MSG("Unable to snapshot device records!  The database connection to " +
+                ds_dbfile + " is invalid...", MSGFLAG_ERROR);
+        return 0;
     }
 
     std::string sql;
@@ -1657,186 +3499,156 @@ void Devicetracker::SetDeviceUserName(std::shared_ptr<kis_tracked_device_base> i
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
-    std::string keystring = in_dev->get_key().as_string();
-
     sql = 
-        "INSERT INTO device_names "
-        "(key, name) "
-        "VALUES (?, ?)";
-
-    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
-
-    if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database insert for device name in " +
-                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return;
-    }
- 
-    sqlite3_reset(stmt);
-
-    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
-    sqlite3_bind_text(stmt, 2, in_username.c_str(), in_username.length(), 0);
+        "INSERT INTO device_storage "
+        "(first_time, last_time, phyname, devmac, storage) "
+        "VALUES (?, ?, ?, ?, ?)";
 
-    // Only lock the database while we're inserting
     {
         local_locker lock(&ds_mutex);
-        sqlite3_step(stmt);
-    }
-
-    sqlite3_finalize(stmt);
 
-    return;
-}
-
-void Devicetracker::SetDeviceTag(std::shared_ptr<kis_tracked_device_base> in_dev,
-        std::string in_tag, std::string in_content) {
-
-    // Lock the device itself
-    local_locker devlocker(&(in_dev->device_mutex));
+        r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
-    auto e = std::make_shared<TrackerElementString>();
-    e->set(in_content);
-
-    auto sm = in_dev->get_tag_map();
-
-    auto t = sm->find(in_tag);
-    if (t != sm->end()) {
-        t->second = e;
-    } else {
-        sm->insert(in_tag, e);
+        if (r != SQLITE_OK) {
+            _MSG("Devicetracker unable to prepare database insert for devices in " +
+                    ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            return -1;
+        }
     }
 
-    if (!Database_Valid()) {
-        _MSG("Unable to store device name to permanent storage, the database connection "
-                "is not available", MSGFLAG_ERROR);
-        return;
-    }
+    // Devices are written in batches, each in its own transaction, and the database is
+    // released between batches so that on-demand loads aren't stalled behind a large
+    // checkpoint.  Devices are serialized outside of the database lock, holding only the
+    // device itself.
+    const size_t batch_sz = 1000;
 
-    std::string sql;
+    struct stored_record {
+        time_t first_time;
+        time_t last_time;
+        std::string phystring;
+        std::string macstring;
+        std::string serialstring;
+    };
 
-    int r;
-    sqlite3_stmt *stmt = NULL;
-    const char *pz = NULL;
+    std::vector<stored_record> batch;
+    batch.reserve(std::min(batch_sz, devices->size()));
 
-    std::string keystring = in_dev->get_key().as_string();
+    auto write_batch = [this, &stmt, &batch]() {
+        local_locker lock(&ds_mutex);
 
-    sql = 
-        "INSERT INTO device_tags "
-        "(key, tag, content) "
-        "VALUES (?, ?, ?)";
+        sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
-    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+        for (const auto& rec : batch) {
+            sqlite3_reset(stmt);
 
-    if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database insert for device tags in " +
-                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return;
-    }
- 
-    sqlite3_reset(stmt);
+            sqlite3_bind_int64(stmt, 1, rec.first_time);
+            sqlite3_bind_int64(stmt, 2, rec.last_time);
+            sqlite3_bind_text(stmt, 3, rec.phystring.c_str(), rec.phystring.length(), 0);
+            sqlite3_bind_text(stmt, 4, rec.macstring.c_str(), rec.macstring.length(), 0);
+            sqlite3_bind_blob(stmt, 5, rec.serialstring.data(), rec.serialstring.length(), 0);
 
-    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
-    sqlite3_bind_text(stmt, 2, in_tag.c_str(), in_tag.length(), 0);
-    sqlite3_bind_text(stmt, 3, in_content.c_str(), in_content.length(), 0);
+            sqlite3_step(stmt);
+        }
 
-    // Only lock the database while we're inserting
-    {
-        local_locker lock(&ds_mutex);
-        sqlite3_step(stmt);
-    }
+        sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
 
-    sqlite3_finalize(stmt);
+        batch.clear();
+    };
 
-    return;
-}
+    for (auto d : *devices) {
+        auto kdb = std::static_pointer_cast<kis_tracked_device_base>(d);
 
-void Devicetracker::HandleNewDatasourceEvent(std::shared_ptr<EventbusEvent> evt) {
-    auto ds_evt = std::static_pointer_cast<Datasourcetracker::EventNewDatasource>(evt);
+        std::stringbuf sbuf;
 
-    if (map_seenby_views) {
-        auto source_uuid = ds_evt->datasource->get_source_uuid();
-        auto source_key = ds_evt->datasource->get_source_key();
+        stored_record rec;
 
-        auto k = seenby_view_map.find(source_uuid);
+        {
+            local_shared_locker devlocker(&(kdb->device_mutex));
 
-        if (k == seenby_view_map.end()) {
-            auto seenby_view =
-                std::make_shared<DevicetrackerView>(fmt::format("seenby-{}", source_uuid), 
-                        fmt::format("Devices seen by datasource {}", source_uuid),
-                        std::vector<std::string>{"seenby-uuid", source_uuid.asString()},
-                        [source_key](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
-                            return dev->get_seenby_map()->find(source_key) != dev->get_seenby_map()->end();
-                        },
-                        [source_key](std::shared_ptr<kis_tracked_device_base> dev) -> bool {
-                            return dev->get_seenby_map()->find(source_key) != dev->get_seenby_map()->end();
-                        });
-            seenby_view_map[source_uuid] = seenby_view;
-            add_view(seenby_view);
+            if (devicetracker->persistent_compression) {
+                zstr::ostreambuf zobuf(&sbuf, 1 << 16, true);
+                std::ostream zstream(&zobuf);
+                KbinAdapter::Pack(zstream, kdb, NULL);
+                zobuf.pubsync();
+            } else {
+                std::ostream sstream(&sbuf);
+                KbinAdapter::Pack(sstream, kdb, NULL);
+            }
+
+            rec.first_time = kdb->get_first_time();
+            rec.last_time = kdb->get_mod_time();
+            rec.phystring = kdb->get_phyname();
+            rec.macstring = kdb->get_macaddr().Mac2String();
         }
+
+        rec.serialstring = sbuf.str();
+
+        batch.push_back(std::move(rec));
+
+        if (batch.size() >= batch_sz)
+            write_batch();
+    }
+
+    if (batch.size() > 0)
+        write_batch();
+
+    {
+        local_locker lock(&ds_mutex);
+        sqlite3_finalize(stmt);
     }
+
+    return 1;
 }
 
-DevicetrackerStateStore::DevicetrackerStateStore(GlobalRegistry *in_globalreg,
-        Devicetracker *in_devicetracker) :
-    KisDatabase(in_globalreg, "devicestate") {
+DevicetrackerColdStore::DevicetrackerColdStore(GlobalRegistry *in_globalreg,
+        Devicetracker *in_devicetracker, const std::string& in_path) :
+    KisDatabase(in_globalreg, "devicecold") {
 
     devicetracker = in_devicetracker;
 
-    // Open and upgrade the DB, default path
-    Database_Open("");
+    // Open and upgrade the DB; an empty path uses the default
+    Database_Open(in_path);
     Database_UpgradeDB();
 }
 
-int DevicetrackerStateStore::Database_UpgradeDB() {
+int DevicetrackerColdStore::Database_UpgradeDB() {
     local_locker dblock(&ds_mutex);
 
+    if (!Database_Valid())
+        return -1;
+
     unsigned int dbv = Database_GetDBVersion();
     std::string sql;
     int r;
     char *sErrMsg = NULL;
 
     if (dbv < 1) {
-        // We keep the last seen timestamp for automatic culling of the database of
-        // idle device records.
-        //
-        // We need to split out the phyname and device mac because key is linked to 
-        // the phy *number*, which is *variable* based on the order phys are initialized;
-        // we need to rekey the phys.
         sql = 
-            "CREATE TABLE device_storage ("
+            "CREATE TABLE device_cold ("
+            "devkey TEXT PRIMARY KEY ON CONFLICT REPLACE, "
+            "devmac TEXT, "
             "first_time INT, "
             "last_time INT, "
-            "phyname TEXT, "
-            "devmac TEXT, "
-            "storage BLOB, "
-            "UNIQUE(phyname, devmac) ON CONFLICT REPLACE)";
+            "storage BLOB)";
 
         r = sqlite3_exec(db, sql.c_str(),
                 [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
 
         if (r != SQLITE_OK) {
-            _MSG("Devicetracker unable to create device_storage table in " + ds_dbfile + ": " +
+            _MSG("Devicetracker unable to create device_cold table in " + ds_dbfile + ": " +
                     std::string(sErrMsg), MSGFLAG_ERROR);
             sqlite3_close(db);
             db = NULL;
             return -1;
         }
 
-    }
-
-    // Hardcode a table check
-    if (dbv == 1) {
-        _MSG("Purging device state, as it cannot be ported forward into the new key "
-                "architecture, sorry.", MSGFLAG_ERROR);
-
-        sql =
-            "DELETE FROM device_storage";
+        sql = "CREATE INDEX device_cold_time ON device_cold (last_time)";
 
         r = sqlite3_exec(db, sql.c_str(),
                 [] (void *, int, char **, char **) -> int { return 0; }, NULL, &sErrMsg);
 
         if (r != SQLITE_OK) {
-            _MSG("Devicetracker unable to clear device_storage table in " + ds_dbfile + ": " +
+            _MSG("Devicetracker unable to create device_cold index in " + ds_dbfile + ": " +
                     std::string(sErrMsg), MSGFLAG_ERROR);
             sqlite3_close(db);
             db = NULL;
@@ -1844,224 +3656,172 @@ int DevicetrackerStateStore::Database_UpgradeDB() {
         }
     }
 
-    Database_SetDBVersion(2);
+    Database_SetDBVersion(1);
 
     return 0;
 }
 
-int DevicetrackerStateStore::clear_old_devices() {
-    local_locker dblock(&ds_mutex);
-
-    std::string sql;
-    std::stringstream sqlss;
-    int r;
-    char *sErrMsg = NULL;
+int DevicetrackerColdStore::store_devices(const std::vector<cold_record>& in_records) {
+    local_locker lock(&ds_mutex);
 
     if (!Database_Valid())
-        return 0;
+        return -1;
 
-    if (devicetracker->persistent_storage_timeout == 0)
-        return 0;
+    std::string sql;
 
-    sqlss << 
-        "DELETE FROM device_storage WHERE (last_time < " <<
-        time(0) - devicetracker->persistent_storage_timeout << ")";
-    sql = sqlss.str();
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
 
+    sql = 
+        "INSERT INTO device_cold "
+        "(devkey, devmac, first_time, last_time, storage) "
+        "VALUES (?, ?, ?, ?, ?)";
 
-    r = sqlite3_exec(db, sql.c_str(), NULL, NULL, &sErrMsg);
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to delete timed out devices in " + ds_dbfile + ": " +
-                std::string(sErrMsg), MSGFLAG_ERROR);
-        sqlite3_close(db);
-        db = NULL;
+        _MSG("Devicetracker unable to prepare database insert for cold devices in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
         return -1;
     }
 
-    return 1;
-}
-
-int DevicetrackerStateStore::clear_all_devices() {
-    local_locker dblock(&ds_mutex);
+    sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
-    std::string sql;
-    std::stringstream sqlss;
-    int r;
-    char *sErrMsg = NULL;
+    for (const auto& rec : in_records) {
+        std::string keystring = rec.key.as_string();
+        std::string macstring = rec.macaddr.Mac2String();
 
-    if (!Database_Valid())
-        return 0;
+        sqlite3_reset(stmt);
 
-    if (devicetracker->persistent_storage_timeout == 0)
-        return 0;
+        sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+        sqlite3_bind_text(stmt, 2, macstring.c_str(), macstring.length(), 0);
+        sqlite3_bind_int64(stmt, 3, rec.first_time);
+        sqlite3_bind_int64(stmt, 4, rec.last_time);
+        sqlite3_bind_blob(stmt, 5, rec.storage.data(), rec.storage.length(), 0);
 
-    sql = "DELETE FROM device_storage";
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            _MSG("Devicetracker unable to store cold devices in " + ds_dbfile + ": " +
+                    std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+            sqlite3_finalize(stmt);
+            sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+            return -1;
+        }
+    }
 
-    r = sqlite3_exec(db, sql.c_str(), NULL, NULL, &sErrMsg);
+    sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
 
-    if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to delete timed out devices in " + ds_dbfile + ": " +
-                std::string(sErrMsg), MSGFLAG_ERROR);
-        sqlite3_close(db);
-        db = NULL;
-        return -1;
-    }
+    sqlite3_finalize(stmt);
 
     return 1;
 }
 
+std::shared_ptr<kis_tracked_device_base> 
+DevicetrackerColdStore::load_device(const device_key& in_key) {
+    local_locker lock(&ds_mutex);
 
-int DevicetrackerStateStore::load_devices() {
     if (!Database_Valid())
-        return 0;
+        return NULL;
 
     std::string sql;
-    std::string phyname;
+    std::string keystring = in_key.as_string();
 
     int r;
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
-    sql = 
-        "SELECT devmac, storage FROM device_storage";
-
-    // If we have a timeout, apply that
-    if (devicetracker->persistent_storage_timeout != 0) {
-        std::stringstream timess;
-
-        timess << sql << " WHERE (last_time > " <<
-            time(0) - devicetracker->persistent_storage_timeout << ")";
-        sql = timess.str();
-    }
+    std::shared_ptr<kis_tracked_device_base> device;
 
+    sql = "SELECT devmac, storage FROM device_cold WHERE devkey = ?";
 
     r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database query for stored devices in " +
+        _MSG("Devicetracker unable to prepare database query for cold device in " +
                 ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return -1;
+        return NULL;
     }
 
-    _MSG("Loading stored devices.  This may take some time, depending on the speed of "
-            "your system and the number of stored devices.", MSGFLAG_INFO);
-
-    unsigned int num_devices = 0;
-
-    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
 
-    while (1) {
-        r = sqlite3_step(stmt);
+    r = sqlite3_step(stmt);
 
-        if (r == SQLITE_ROW) {
-            const unsigned char *rowstr;
-            unsigned long rowlen;
+    if (r == SQLITE_ROW) {
+        mac_addr m((const char *) sqlite3_column_text(stmt, 0));
 
-            mac_addr m;
+        const unsigned char *rowstr = 
+            (const unsigned char *) sqlite3_column_blob(stmt, 1);
+        unsigned long rowlen = sqlite3_column_bytes(stmt, 1);
 
-            rowstr = sqlite3_column_text(stmt, 0);
-            m = mac_addr((const char *) rowstr);
+        device = devicetracker->convert_stored_device(m, rowstr, rowlen);
+    } else if (r != SQLITE_DONE) {
+        _MSG("Encountered an error loading cold device: " + 
+                std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+    }
 
-            if (m.error) {
-                _MSG("Encountered an error loading a stored device, "
-                        "unable to process mac address; skipping device.",
-                        MSGFLAG_ERROR);
-                continue;
-            }
+    sqlite3_finalize(stmt);
 
-            rowstr = (const unsigned char *) sqlite3_column_blob(stmt, 1);
-            rowlen = sqlite3_column_bytes(stmt, 1);
+    // The device lives in memory again, drop the cold record
+    sql = "DELETE FROM device_cold WHERE devkey = ?";
 
-            // Adopt it into a device
-            std::shared_ptr<kis_tracked_device_base> kdb =
-                devicetracker->convert_stored_device(m, rowstr, rowlen);
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
-            if (kdb != NULL) {
-                devicetracker->AddDevice(kdb);
-                num_devices++;
-            }
-        } else if (r == SQLITE_DONE) {
-            break;
-        } else {
-            _MSG("Encountered an error loading stored devices: " + 
-                    std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-            break;
-        }
+    if (r == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
     }
 
-    sqlite3_finalize(stmt);
-
-    return 1;
+    return device;
 }
 
-// Attempt to load a single device from the database, return NULL if it wasn't found
-// or if there was an error
-std::shared_ptr<kis_tracked_device_base> 
-DevicetrackerStateStore::load_device(Kis_Phy_Handler *in_phy, mac_addr in_mac) {
-    if (!Database_Valid())
-        return NULL;
+int DevicetrackerColdStore::remove_devices(const std::vector<device_key>& in_keys) {
+    local_locker lock(&ds_mutex);
 
-    // Lock the database; we're doing a single query
-    local_locker dblock(&ds_mutex);
+    if (!Database_Valid())
+        return -1;
 
     std::string sql;
-    std::string macstring = in_mac.Mac2String();
-    std::string phystring = in_phy->FetchPhyName();
 
     int r;
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
-    sql = 
-        "SELECT storage FROM device_storage WHERE phyname = ? AND "
-        "devmac = ?";
+    sql = "DELETE FROM device_cold WHERE devkey = ?";
 
     r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database query for stored device in " +
+        _MSG("Devicetracker unable to prepare database delete for cold devices in " +
                 ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-        return NULL;
+        return -1;
     }
 
-    sqlite3_reset(stmt);
-    sqlite3_bind_text(stmt, 1, phystring.c_str(), phystring.length(), 0);
-    sqlite3_bind_text(stmt, 2, macstring.c_str(), macstring.length(), 0);
+    sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
 
-    while (1) {
-        r = sqlite3_step(stmt);
+    for (const auto& k : in_keys) {
+        std::string keystring = k.as_string();
 
-        if (r == SQLITE_ROW) {
-            const unsigned char *rowstr;
-            unsigned long rowlen;
+        sqlite3_reset(stmt);
 
-            rowstr = (const unsigned char *) sqlite3_column_blob(stmt, 0);
-            rowlen = sqlite3_column_bytes(stmt, 0);
+        sqlite3_bind_text(stmt, 1, keystring.c_str(), keystring.length(), 0);
 
-            return devicetracker->convert_stored_device(in_mac, rowstr, rowlen);
-        } else if (r == SQLITE_DONE) {
-            break;
-        } else {
-            _MSG("Encountered an error loading stored device: " + 
-                    std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
-            break;
-        }
+        sqlite3_step(stmt);
     }
 
+    sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
+
     sqlite3_finalize(stmt);
 
-    return NULL;
+    return 1;
 }
 
-int DevicetrackerStateStore::store_devices(std::shared_ptr<TrackerElementVector> devices) {
+int DevicetrackerColdStore::load_stubs(const std::function<void (const device_key&, 
+            const mac_addr&, time_t, time_t)>& in_cb) {
     local_locker lock(&ds_mutex);
 
-    if (!Database_Valid()) {
-        _MSG("Unable to snapshot device records!  The database connection to " +
-                ds_dbfile + " is invalid...", MSGFLAG_ERROR);
+    if (!Database_Valid())
         return 0;
-    }
 
     std::string sql;
 
@@ -2069,81 +3829,107 @@ int DevicetrackerStateStore::store_devices(std::shared_ptr<TrackerElementVector>
     sqlite3_stmt *stmt = NULL;
     const char *pz = NULL;
 
-    sql = 
-        "INSERT INTO device_storage "
-        "(first_time, last_time, phyname, devmac, storage) "
-        "VALUES (?, ?, ?, ?, ?)";
+    sql = "SELECT devkey, devmac, first_time, last_time FROM device_cold";
 
     r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
     if (r != SQLITE_OK) {
-        _MSG("Devicetracker unable to prepare database insert for devices in " +
+        _MSG("Devicetracker unable to prepare database query for cold devices in " +
                 ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
         return -1;
     }
 
-    // Use a function worker to insert it into the db
-    auto fw = std::make_shared<devicetracker_function_worker>(
-            [this, &stmt] 
-                (Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
-                std::shared_ptr<kis_tracked_device_base> kdb =
-                    std::static_pointer_cast<kis_tracked_device_base>(d);
+    while ((r = sqlite3_step(stmt)) == SQLITE_ROW) {
+        device_key k(std::string((const char *) sqlite3_column_text(stmt, 0)));
+        mac_addr m((const char *) sqlite3_column_text(stmt, 1));
 
-                std::string serialstring;
-                std::string macstring;
-                std::string phystring;
+        if (k.get_error() || m.error)
+            continue;
 
-                // Prep the compression buf
-                std::stringbuf sbuf;
-                zstr::ostreambuf zobuf(&sbuf, 1 << 16, true);
-                std::ostream zstream(&zobuf);
+        in_cb(k, m, sqlite3_column_int64(stmt, 2), sqlite3_column_int64(stmt, 3));
+    }
 
-                // Standard noncompression buf
-                std::ostream sstream(&sbuf);
+    if (r != SQLITE_DONE)
+        _MSG("Encountered an error loading cold devices: " + 
+                std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
 
-                std::ostream *serialstream;
+    sqlite3_finalize(stmt);
 
-                if (devicetracker->persistent_compression)
-                serialstream = &zstream;
-                else
-                    serialstream = &sstream;
+    return 1;
+}
 
+int DevicetrackerColdStore::expire_devices(time_t in_time, std::vector<device_key>& ret) {
+    local_locker lock(&ds_mutex);
 
-                sbuf.str("");
-                sqlite3_reset(stmt);
+    if (!Database_Valid())
+        return 0;
 
-                // Pack a storage formatted blob
-                {
-                    local_locker lock(&(devicetracker->devicelist_mutex));
-                    StorageJsonAdapter::Pack(*serialstream, d, NULL);
-                }
+    std::string sql;
 
-                // Sync the buffers
-                zobuf.pubsync();
-                sbuf.pubsync();
+    int r;
+    sqlite3_stmt *stmt = NULL;
+    const char *pz = NULL;
 
-                serialstring = sbuf.str();
+    sql = "SELECT devkey FROM device_cold WHERE last_time < ?";
 
-                macstring = kdb->get_macaddr().Mac2String();
-                phystring = kdb->get_phyname();
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
 
-                sqlite3_bind_int(stmt, 1, kdb->get_first_time());
-                sqlite3_bind_int(stmt, 2, kdb->get_mod_time());
-                sqlite3_bind_text(stmt, 3, phystring.c_str(), phystring.length(), 0);
-                sqlite3_bind_text(stmt, 4, macstring.c_str(), macstring.length(), 0);
-                sqlite3_bind_blob(stmt, 5, serialstring.data(), serialstring.length(), 0);
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database query for cold devices in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return -1;
+    }
 
-                sqlite3_step(stmt);
+    sqlite3_bind_int64(stmt, 1, in_time);
 
-                return false;
-            }, nullptr);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        device_key k(std::string((const char *) sqlite3_column_text(stmt, 0)));
 
-    // Perform the write as a single transaction
-    sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL);
-    devicetracker->MatchOnDevices(fw, devices);
-    sqlite3_exec(db, "END TRANSACTION", NULL, NULL, NULL);
+        if (!k.get_error())
+            ret.push_back(k);
+    }
+
+    sqlite3_finalize(stmt);
+
+    if (ret.size() == 0)
+        return 0;
+
+    sql = "DELETE FROM device_cold WHERE last_time < ?";
+
+    r = sqlite3_prepare(db, sql.c_str(), sql.length(), &stmt, &pz);
+
+    if (r != SQLITE_OK) {
+        _MSG("Devicetracker unable to prepare database delete for cold devices in " +
+                ds_dbfile + ":" + std::string(sqlite3_errmsg(db)), MSGFLAG_ERROR);
+        return -1;
+    }
 
+    sqlite3_bind_int64(stmt, 1, in_time);
+    sqlite3_step(stmt);
     sqlite3_finalize(stmt);
 
     return 1;
 }
+
+uint64_t DevicetrackerColdStore::store_size() {
+    local_locker lock(&ds_mutex);
+
+    if (!Database_Valid())
+        return 0;
+
+    uint64_t page_count = 0, page_size = 0;
+
+    sqlite3_exec(db, "PRAGMA page_count", 
+            [] (void *aux, int, char **argv, char **) -> int { 
+                *((uint64_t *) aux) = StringTo<uint64_t>(argv[0], 0);
+                return 0;
+            }, &page_count, NULL);
+
+    sqlite3_exec(db, "PRAGMA page_size", 
+            [] (void *aux, int, char **argv, char **) -> int { 
+                *((uint64_t *) aux) = StringTo<uint64_t>(argv[0], 0);
+                return 0;
+            }, &page_size, NULL);
+
+    return page_count * page_size;
+}
@@ -22,10 +22,15 @@
 #include "config.h"
 
 #include <atomic>
+#include <memory>
 #include <stdio.h>
 #include <time.h>
+#include <deque>
 #include <list>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -34,6 +39,7 @@
 #include <arpa/inet.h>
 
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
 #include "globalregistry.h"
@@ -57,6 +63,8 @@
 #include "devicetracker_workers.h"
 #include "kis_database.h"
 #include "eventbus.h"
+#include "kis_open_hashmap.h"
+#include "kis_threadpool.h"
 
 #define KIS_PHY_ANY	-1
 #define KIS_PHY_UNKNOWN -2
@@ -92,12 +100,57 @@ protected:
     Devicetracker *devicetracker;
 };
 
+// Cold device store; devices which have been idle for a long time are serialized to
+// disk, keyed by device key, and only a small stub is kept in memory until they are
+// seen again
+class DevicetrackerColdStore : public KisDatabase {
+public:
+    DevicetrackerColdStore(GlobalRegistry *in_globalreg, Devicetracker *in_devicetracker,
+            const std::string& in_path);
+    virtual ~DevicetrackerColdStore() { }
+
+    virtual int Database_UpgradeDB();
+
+    // A serialized cold device
+    struct cold_record {
+        device_key key;
+        mac_addr macaddr;
+        time_t first_time;
+        time_t last_time;
+        std::string storage;
+    };
+
+    // Store a batch of devices in a single transaction
+    int store_devices(const std::vector<cold_record>& in_records);
+
+    // Load a device and remove it from the store; returns null if the device isn't
+    // stored or could not be restored
+    std::shared_ptr<kis_tracked_device_base> load_device(const device_key& in_key);
+
+    // Remove devices from the store without loading them
+    int remove_devices(const std::vector<device_key>& in_keys);
+
+    // Call in_cb for every stored device, without loading the records
+    int load_stubs(const std::function<void (const device_key&, const mac_addr&, 
+                time_t, time_t)>& in_cb);
+
+    // Remove devices last seen before in_time, returning their keys
+    int expire_devices(time_t in_time, std::vector<device_key>& ret);
+
+    // Size of the store, in bytes
+    uint64_t store_size();
+
+protected:
+    Devicetracker *devicetracker;
+};
+
 
 class Devicetracker : public Kis_Net_Httpd_Chain_Stream_Handler,
     public TimetrackerEvent, public LifetimeGlobal, public KisDatabase {
 
 // Allow direct access for the state storing class
 friend class DevicetrackerStateStore;
+friend class DevicetrackerColdStore;
 
 public:
     static std::string global_name() { return "DEVICETRACKER"; }
@@ -137,8 +190,18 @@ public:
     std::string FetchPhyName(int in_phy);
 
 	int FetchNumDevices();
+
+    // Number of device IDs below the highest in use, and how many of them are holes 
+    // left by removed devices
+    size_t FetchNumDeviceSlots();
+    size_t FetchNumDeviceHoles();
 	int FetchNumPackets();
 
+    // Progress of restoring stored devices in the background
+    bool FetchDevicesRestoring() { return devices_restoring; }
+    uint64_t FetchRestoreTotal() { return restore_total; }
+    uint64_t FetchRestoreLoaded() { return restore_loaded; }
+
 	int AddFilter(std::string in_filter);
 	int AddNetCliFilter(std::string in_filter);
 
@@ -147,8 +210,31 @@ public:
     // components due to timeouts / max device cleanup
     void UpdateFullRefresh();
 
-	// Look for an existing device record
-    std::shared_ptr<kis_tracked_device_base> FetchDevice(device_key in_key);
+	// Look for an existing device record; devices in cold storage are restored, unless
+    // in_restore is false
+    std::shared_ptr<kis_tracked_device_base> FetchDevice(device_key in_key, 
+            bool in_restore = true);
+
+    // Is a device with this key tracked or in cold storage?  Devices in cold storage
+    // aren't restored, so it's safe to use when validating a request.
+    bool device_key_known(const device_key& in_key);
+
+    // Describe how a device changed since a change generation, as the delta endpoint 
+    // does:  its key and the fields which changed, or every field, flagged as full, 
+    // when the changes can't be described as a delta.  Returns null if nothing 
+    // changed.  A projection keeps only the fields it selects, adding the renamed ones
+    // to the rename map.  The device must be locked.
+    std::shared_ptr<TrackerElementMap> build_device_delta(std::shared_ptr<kis_tracked_device_base> in_device,
+            uint64_t in_since, std::shared_ptr<TrackerElementProjection> in_projection,
+            std::shared_ptr<TrackerElementSerializer::rename_map> in_rename_map);
+
+    // Keys of the devices removed since a change generation; returns false if removals
+    // that old have been forgotten, so the keys may be incomplete
+    bool fetch_removed_devices(uint64_t in_since, std::vector<device_key>& out_keys);
+
+    // Move devices idle for longer than the cold storage threshold to cold storage; 
+    // normally run by the cold storage timer
+    void tier_cold_devices();
 
     // Perform a device filter.  Pass a subclassed filter instance.
     //
@@ -162,7 +248,8 @@ public:
     void MatchOnReadonlyDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, bool batch = true);
 
     // Perform a device filter as above, but provide a source vec rather than the
-    // list of ALL devices.  The source vector is duplicated under mutex and then processed.
+    // list of ALL devices.  The source vector is copied to an immutable snapshot and then
+    // processed; the device list lock is not taken.
     void MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker, 
             std::shared_ptr<TrackerElementVector> source_vec, bool batch = true);
     // Perform a readonly filter, MUST NOT modify devices
@@ -179,7 +266,8 @@ public:
             std::shared_ptr<TrackerElementVector> source_vec, bool batch = true);
 
     // Perform a device filter as above, but provide a stl vector instead of the list of
-    // ALL devices in the system; the source vector is duplicated under mutex and then processed.
+    // ALL devices in the system; the source vector is copied to an immutable snapshot and then
+    // processed, without taking the device list lock.
     void MatchOnDevices(std::shared_ptr<DevicetrackerFilterWorker> worker,
             const std::vector<std::shared_ptr<kis_tracked_device_base>>& source_vec,
             bool batch = true);
@@ -199,15 +287,35 @@ public:
             const std::vector<std::shared_ptr<kis_tracked_device_base>>& source_vec,
             bool batch = true);
 
-    using device_map_t = std::map<device_key, std::shared_ptr<kis_tracked_device_base>>;
+    using device_map_t = kis_open_hashmap<device_key, std::shared_ptr<kis_tracked_device_base>>;
     using device_itr = device_map_t::iterator;
-    using const_device_itr = device_map_t::const_iterator;
+    using device_mac_multimap_t = 
+        kis_open_hashmap<mac_addr, std::shared_ptr<kis_tracked_device_base>>;
+
+    // Find all devices matching a mac address, which may be masked
+    std::vector<std::shared_ptr<kis_tracked_device_base>> find_devices_by_mac(const mac_addr& in_mac);
+
+    // Is any device matching a mac address known?  Unlike find_devices_by_mac this 
+    // only looks at the stubs of devices in cold storage and never restores them, so
+    // it's safe to use when validating a request.
+    bool device_mac_known(const mac_addr& in_mac);
+
+    // Find all devices filed under a secondary index key.  Devices are indexed by 
+    // "phy", "type", "manuf", "channel", and "seenby" (source UUID), and by any keys
+    // phys add for their own records (such as "ssid" for Wi-Fi).  Returns false if the
+    // attribute isn't indexed, in which case the caller has to match devices itself.
+    bool FetchIndexedDevices(const std::string& in_attribute, const std::string& in_value,
+            std::vector<std::shared_ptr<kis_tracked_device_base>>& ret);
 
 	static void Usage(char *argv);
 
 	// Common classifier for keeping phy counts
 	int CommonTracker(kis_packet *in_packet);
 
+    // Late tracker hook; refreshes the secondary indices of every device the packet
+    // touched, once the phys are done updating them
+    int IndexTracker(kis_packet *in_packet);
+
     // Add common into to a device.  If necessary, create the new device.
     //
     // The specified mac is used to create the device; for phys with multiple devices
@@ -284,10 +392,29 @@ public:
         return packets_rrd;
     }
 
+    std::shared_ptr<tracked_memory_budget> get_memory_budget() {
+        return memory_budget;
+    }
+
+    std::shared_ptr<tracked_cold_storage> get_cold_storage() {
+        return cold_storage;
+    }
+
+    // Immutable snapshot of all live devices.  Snapshots are published by the 
+    // devicetracker when devices are added or removed, coalesced to at most one new
+    // generation per timeslice, so a snapshot may lag the device list by up to one 
+    // timeslice.  Fetching a snapshot never takes the device list lock, and the devices
+    // in it remain valid for as long as the caller holds it.
+    using device_snapshot_t = std::vector<std::shared_ptr<kis_tracked_device_base>>;
+    std::shared_ptr<const device_snapshot_t> fetch_device_snapshot() {
+        return std::atomic_load(&device_snapshot);
+    }
+
     // Database API
     virtual int Database_UpgradeDB();
 
-    // Store all devices to the database
+    // Store the devices changed since the last checkpoint, or all devices, to the
+    // persistent state database
     virtual int store_devices();
     virtual int store_all_devices();
     virtual int store_devices(std::shared_ptr<TrackerElementVector> devices);
@@ -296,9 +423,13 @@ public:
     virtual void databaselog_write_devices();
     virtual void databaselog_write_devices(std::shared_ptr<TrackerElementVector> devices);
 
-    // Iterate over all phys and load from the database
+    // Restore stored devices from the database; devices are restored in a background
+    // thread and added as they are loaded
     virtual int load_devices();
 
+    // Cancel a running restore and wait for it to finish
+    void stop_restore();
+
     // View API
     virtual bool add_view(std::shared_ptr<DevicetrackerView> in_view);
     virtual void remove_view(const std::string& in_view_id);
@@ -323,6 +454,36 @@ protected:
     bool map_phy_views;
     std::map<int, std::shared_ptr<DevicetrackerView>> phy_view_map;
 
+    // Secondary device indices, by attribute and then value.  Each index has its own
+    // lock, so updates to different attributes don't contend; the device_index_mutex 
+    // only protects the map of indices.  Index locks are taken last, after any shard or
+    // device lock, and never more than one at a time.
+    bool map_device_indices;
+    using device_index_set_t = std::unordered_set<std::shared_ptr<kis_tracked_device_base>>;
+
+    struct device_index {
+        kis_recursive_timed_mutex mutex;
+        std::unordered_map<std::string, device_index_set_t> values;
+    };
+
+    kis_recursive_timed_mutex device_index_mutex;
+    std::map<std::string, std::shared_ptr<device_index>> device_indices;
+
+    // Find the index of an attribute, optionally creating it
+    std::shared_ptr<device_index> fetch_device_index(const std::string& in_attribute, bool in_create);
+
+    // Re-file a device under its current index keys, if any of the values it is indexed 
+    // by have changed since it was last filed; the device shard must be locked
+    void refresh_device_indices(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // Remove a device from every index it is filed under
+    void remove_device_indices(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // /devices/index/[attribute]/[value]/devices endpoint
+    std::shared_ptr<Kis_Net_Httpd_Path_Tracked_Endpoint> index_endp;
+    bool index_endp_path(const std::vector<std::string>& path);
+    std::shared_ptr<TrackerElement> index_endp_handler(const std::vector<std::string>& path);
+
     // Base IDs for tracker components
     int device_list_base_id, device_base_id;
     int device_summary_base_id;
@@ -336,14 +497,17 @@ protected:
 	std::atomic<int> num_errorpackets;
 	std::atomic<int> num_filterpackets;
 
-	// Per-phy #s of packets
-    std::map<int, int> phy_packets;
-	std::map<int, int> phy_datapackets;
-	std::map<int, int> phy_errorpackets;
-	std::map<int, int> phy_filterpackets;
+	// Per-phy #s of packets; the maps are only filled in as phys are registered at 
+    // startup, so the packet path counts into them without the device list lock
+    std::map<int, std::atomic<int>> phy_packets;
+	std::map<int, std::atomic<int>> phy_datapackets;
+	std::map<int, std::atomic<int>> phy_errorpackets;
+	std::map<int, std::atomic<int>> phy_filterpackets;
 
-    // Total packet history
+    // Total packet history, under its own lock so that counting packets never waits
+    // on the device list
     std::shared_ptr<kis_tracked_rrd<> > packets_rrd;
+    kis_recursive_timed_mutex packets_rrd_mutex;
 
     // Timeout of idle devices
     int device_idle_expiration;
@@ -357,6 +521,57 @@ protected:
     unsigned int max_num_devices;
     int max_devices_timer;
 
+    // Give a device an empty slot for each record its phy, or another phy, may add to
+    // it, so that adding the record later doesn't move the other fields of the 
+    // published device
+    void reserve_phy_records(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // Ids of the records reserved in the devices of each phy, by phy id:  the records of
+    // the phy itself and those other phys attach to its devices.  Built as phys are
+    // registered.
+    std::map<int, std::vector<int>> phy_record_ids;
+
+    // Remove up to in_num of the least recently seen devices, returning the number
+    // removed
+    size_t trim_oldest_devices(size_t in_num);
+
+    // Memory budget, in kB, and the budget accounting reported in the system status;
+    // when a budget is set, devices are periodically accounted and optional data is
+    // discarded, then old devices removed, to stay within it
+    uint64_t memory_budget_kb;
+    int memory_budget_timer;
+    std::shared_ptr<tracked_memory_budget> memory_budget;
+
+    // Smallest observed memory use not accounted to devices, in kB; the budget minus
+    // this is the allowance for devices.  Using the smallest value keeps memory which
+    // the allocator holds on to after devices are removed from triggering more removals.
+    uint64_t memory_min_overhead_kb;
+
+    // Phys whose optional device data has been discarded by the memory budget; filled
+    // in as phys are registered, so the packet path checks it without the device list
+    // lock.  Collection is restored once device memory drops well under the allowance.
+    std::map<int, std::atomic<bool>> phy_budget_degraded;
+
+    void enforce_memory_budget();
+
+    // Is the optional history of devices of a phy collected?  Off when disabled in the
+    // config, or when the phy has been degraded by the memory budget
+    bool phy_tracks_rrd(int in_phyid);
+    bool phy_tracks_history_cloud(int in_phyid);
+
+    // Cold storage of idle devices; devices idle longer than cold_idle_threshold are 
+    // written to the cold store and replaced by a stub in their shard, and are restored 
+    // when they're seen again or fetched by key.  Stubs older than cold_timeout are 
+    // dropped along with their records.
+    DevicetrackerColdStore *coldstore;
+    std::shared_ptr<kis_thread_pool> cold_restore_pool;
+    time_t cold_idle_threshold;
+    time_t cold_timeout;
+    int cold_storage_timer;
+    std::shared_ptr<tracked_cold_storage> cold_storage;
+    std::atomic<uint64_t> cold_tiered_count, cold_rehydrated_count;
+    uint64_t cold_rehydrated_reported;
+
     // Timer event for storing devices
     int device_storage_timer;
 
@@ -375,19 +590,124 @@ protected:
         pack_comp_radiodata, pack_comp_gps, pack_comp_datasrc,
         pack_comp_mangleframe;
 
-	// Tracked devices
-    device_map_t tracked_map;
-	// Vector of tracked devices so we can iterate them quickly
-    std::vector<std::shared_ptr<kis_tracked_device_base> > tracked_vec;
-    // MAC address lookups are incredibly expensive from the webui if we don't
-    // track by map; in theory multiple objects in different PHYs could have the
-    // same MAC so it's not a simple 1:1 map
-    std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base> > tracked_mac_multimap;
+    // The device key and mac indexes are split into shards, selected by the device key,
+    // each with its own lock, so that packet workers updating different devices don't
+    // serialize on the device list.  
+    //
+    // Lock order is devicelist_mutex, then a shard mutex, then a device_mutex; a shard 
+    // lock must never be held while acquiring the devicelist_mutex.  device_vec_mutex
+    // comes last of all, and nothing else is acquired while holding it.
+    //
+    // A device is given its ID and placed in the tracked vector before it is added to
+    // its shard, and taken out of its shard before it is taken out of the vector, so 
+    // any device which can be found by key is in the vector and has an ID.
+    class device_shard {
+    public:
+        kis_recursive_timed_mutex mutex;
+
+        // Tracked devices, by key
+        device_map_t tracked_map;
+
+        // MAC address lookups are incredibly expensive from the webui if we don't
+        // track by map; in theory multiple objects in different PHYs could have the
+        // same MAC so it's not a simple 1:1 map
+        device_mac_multimap_t tracked_mac_multimap;
+
+        // Last-seen index, oldest first.  Devices are moved to the end when they're
+        // seen, so idle expiry and max-device trimming only need to look at the head
+        // of the list.  Idle devices which are kept because they've seen enough packets
+        // are moved to the retained list, which is also ordered by last time seen,
+        // so that they aren't re-examined on every expiry pass.
+        kis_tracked_device_base::lastseen_list_t lastseen_list;
+        kis_tracked_device_base::lastseen_list_t retained_list;
+
+        // Stubs of devices moved to cold storage, by key
+        struct cold_stub {
+            mac_addr macaddr;
+            time_t first_time;
+            time_t last_time;
+
+            // Has a restore been queued for a packet from the device?
+            bool restoring;
+
+            // Record collecting the packets of the device until the restore completes;
+            // it is never in the device indexes and is never returned by lookups, only
+            // to the packet path, and is folded into the restored record
+            std::shared_ptr<kis_tracked_device_base> pending;
+        };
+
+        std::unordered_map<device_key, cold_stub> cold_map;
+    };
+
+    std::vector<std::unique_ptr<device_shard>> device_shards;
+
+    device_shard *fetch_device_shard(const device_key& in_key) {
+        return device_shards[std::hash<device_key>{}(in_key) & (device_shards.size() - 1)].get();
+    }
 
-    // Immutable vector, one entry per device; may never be sorted.  Devices
-    // which are removed are set to 'null'.  Each position corresponds to the
-    // device ID.
-    std::shared_ptr<TrackerElementVector> immutable_tracked_vec;
+    // Remove a device from the key, mac, and last-seen indexes of its shard, returning 
+    // false if it was already removed
+    bool remove_device_index(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // Place a device in the last-seen index of its shard after its last time has 
+    // changed; shard must be locked
+    void touch_device_lastseen(device_shard *shard, 
+            std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // Add a device to the tracked vector and give it a device ID, before it is added to
+    // its shard index; may be called with the shard and device locked
+    void add_device_vecs(std::shared_ptr<kis_tracked_device_base> in_device);
+
+    // Remove devices from the tracked vector and release their IDs, once they've been 
+    // removed from the shard indexes
+    void remove_device_vecs(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices);
+
+    // Queue a device with a stub to be restored from cold storage in the background,
+    // returning its stub, or null if it has none; the shard must be locked.  A new
+    // record created for the device before the restore completes is kept in the stub
+    // and published by the restore.
+    device_shard::cold_stub *queue_cold_rehydration(device_shard *shard, 
+            const device_key& in_key);
+
+    // Restore a device from cold storage and add it back to the device indexes, 
+    // returning null if it wasn't in cold storage.  The record is read without holding
+    // the shard; if packets from the device created a new record in the meantime, its
+    // counters are folded into the restored device, which is published in its place.
+    std::shared_ptr<kis_tracked_device_base> rehydrate_cold_device(const device_key& in_key);
+
+    // Published device snapshot, only accessed via std::atomic_load and std::atomic_store.
+    // The device list generation is incremented whenever the device vectors change; 
+    // device_snapshot_generation is the generation of the published snapshot, and is
+    // protected by device_vec_mutex.
+    std::shared_ptr<const device_snapshot_t> device_snapshot;
+    std::atomic<uint64_t> device_list_generation;
+    uint64_t device_snapshot_generation;
+    int device_snapshot_timer;
+
+    int change_generation_timer;
+
+    // Seconds per change generation.  Devices remember the last few generations in
+    // which they changed, so a delta client polling less often than that many 
+    // generations receives complete device records instead of deltas.
+    unsigned int change_generation_period;
+
+    // Publish a new snapshot if the device list has changed since the last one
+    void publish_device_snapshot();
+
+    // Device ID allocator.  IDs are assigned when a device is placed in the tracked 
+    // vector and released when it is removed; free IDs below the limit are re-used 
+    // lowest first, so the IDs in use stay dense and the limit falls back as trailing
+    // IDs are released.  Protected by device_vec_mutex.
+    std::set<uint64_t> free_device_ids;
+    uint64_t device_id_limit;
+
+    uint64_t allocate_device_id();
+    void release_device_id(uint64_t in_id);
+
+	// Vector of tracked devices so we can iterate them quickly; protected by 
+    // device_vec_mutex
+    std::vector<std::shared_ptr<kis_tracked_device_base> > tracked_vec;
+    kis_recursive_timed_mutex device_vec_mutex;
 
     // List of views using new API as we transition the rest to the new API
     kis_recursive_timed_mutex view_mutex;
@@ -405,10 +725,33 @@ protected:
     int phy_phyentry_id, phy_phyname_id, phy_devices_count_id, 
         phy_packets_count_id, phy_phyid_id;
 
+    // /devices/field_population endpoint; reports, per tracked component type, how
+    // many instances exist and how many of them have each field populated
+    std::shared_ptr<Kis_Net_Httpd_Simple_Tracked_Endpoint> field_population_endp;
+    std::shared_ptr<TrackerElement> field_population_endp_handler();
+
+    // /devices/delta/[generation]/devices endpoint; returns only the fields of each
+    // device which changed since the generation, the keys of devices removed since 
+    // then, and the generation to ask for next
+    std::shared_ptr<Kis_Net_Httpd_Path_Tracked_Endpoint> delta_endp;
+    bool delta_endp_path(const std::vector<std::string>& path);
+    std::shared_ptr<TrackerElement> delta_endp_handler(const std::vector<std::string>& path);
+    int delta_generation_id, delta_devices_id, delta_device_id, delta_full_id,
+        delta_removed_id, delta_removed_key_id, delta_removed_complete_id;
+
+    // Devices removed from the device list, as (generation, key), oldest first, so that
+    // delta clients learn of expired, trimmed, and cold devices; protected by the 
+    // devicelist_mutex.  Removals are remembered for a limited number of generations,
+    // and removed_lost_generation is the newest generation which has been forgotten.
+    std::deque<std::pair<uint64_t, device_key>> removed_devices;
+    uint64_t removed_lost_generation;
+    void record_removed_devices(const std::vector<std::shared_ptr<kis_tracked_device_base>>& in_devices);
+
 	// Registered PHY types
 	int next_phy_id;
     std::map<int, Kis_Phy_Handler *> phy_handler_map;
 
+    // Protects the device vectors and phy stats; see device_shard for lock ordering
     kis_recursive_timed_mutex devicelist_mutex;
 
     std::shared_ptr<Devicetracker_Httpd_Pcap> httpd_pcap;
@@ -416,9 +759,31 @@ protected:
     // Timestamp of the last time we wrote the device list, if we're storing state
     std::atomic<time_t> last_devicelist_saved;
 
+    // Change generation of the last persistent storage checkpoint; only devices which
+    // changed in or after it are written by the next checkpoint
+    std::atomic<uint64_t> storage_checkpoint_generation;
+
+    // Held for the whole of a checkpoint, so the checkpoint on exit waits for one still
+    // running from the storage timer.  Not a timed lock; a checkpoint of a large device
+    // list can take longer than the deadlock timeout.
+    std::mutex storage_checkpoint_mutex;
+
+    // Write the devices seen live while a restore ran and start checkpointing from the
+    // current generation, so the restored records aren't all written back
+    int store_restore_checkpoint(time_t in_restore_start);
+
     kis_recursive_timed_mutex storing_mutex;
     std::atomic<bool> devices_storing;
 
+    // Background restore of stored devices; records are decoded by restore_threads
+    // workers
+    std::thread device_restore_thread;
+    unsigned int restore_threads;
+    std::atomic<bool> devices_restoring;
+    std::atomic<bool> restore_cancelled;
+    std::atomic<uint64_t> restore_total;
+    std::atomic<uint64_t> restore_loaded;
+
     // Do we store devices?
     bool persistent_storage;
 
@@ -452,6 +817,10 @@ protected:
     // Insert a device directly into the records
     void AddDevice(std::shared_ptr<kis_tracked_device_base> device);
 
+    // Insert a device unless one with the same key is already tracked; returns false
+    // if the device was not added
+    bool insert_device(std::shared_ptr<kis_tracked_device_base> device);
+
     // Load a specific device
     virtual std::shared_ptr<kis_tracked_device_base> load_device(Kis_Phy_Handler *phy, 
             mac_addr mac);
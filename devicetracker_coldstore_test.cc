@@ -0,0 +1,210 @@
+/* test harness for the Kismet device cold storage
+ *
+ * Tracks an 802.11 device seen by a datasource, moves it to cold storage once it
+ * goes idle, feeds it a packet which starts a restore in the background, looks it
+ * up, and feeds it another packet.  The lookup has to return the restored device,
+ * never the record collecting packets until the restore is done; the restored device
+ * has to come back with its dot11 record and its seenby records as the types the
+ * live code expects, and both packets have to land on the restored records.
+ *
+ * # configure kismet, optionally with asan
+ * ./configure --enable-asan
+ *
+ * # build and run every test harness
+ * make check
+ *
+ * # or build this harness alone
+ * make devicetracker_coldstore_test
+ *
+ * ./devicetracker_coldstore_test
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <string>
+
+#include "globalregistry.h"
+#include "configfile.h"
+#include "eventbus.h"
+#include "packetchain.h"
+#include "alertracker.h"
+#include "kis_httpd_registry.h"
+#include "kis_datasource.h"
+#include "devicetracker.h"
+#include "phy_80211.h"
+#include "kis_test_harness.h"
+
+static void fail(const std::string& in_msg) {
+    fprintf(stderr, "%s\n", in_msg.c_str());
+    exit(1);
+}
+
+// Feed one packet from the source to the device, as the phy does for the devices
+// it finds in a frame
+static std::shared_ptr<kis_tracked_device_base> feed_packet(std::shared_ptr<Devicetracker> devicetracker,
+        std::shared_ptr<Packetchain> packetchain, Kis_Phy_Handler *phy,
+        std::shared_ptr<KisDatasource> source, mac_addr in_mac, time_t in_ts) {
+    int pack_comp_datasrc = packetchain->RegisterPacketComponent("KISDATASRC");
+
+    auto pack = packetchain->GeneratePacket();
+    pack->ts.tv_sec = in_ts;
+    pack->ts.tv_usec = 0;
+
+    auto datasrc = new packetchain_comp_datasource();
+    datasrc->ref_source = source.get();
+    pack->insert(pack_comp_datasrc, datasrc);
+
+    auto device = devicetracker->UpdateCommonDevice(NULL, in_mac, phy, pack,
+            (UCD_UPDATE_PACKETS | UCD_UPDATE_SEENBY), "Wi-Fi AP");
+
+    packetchain->DestroyPacket(pack);
+
+    return device;
+}
+
+// Every seenby record has to be a seenby component; the packet path casts them
+// without checking
+static void check_seenby(std::shared_ptr<kis_tracked_device_base> in_device,
+        uint64_t in_packets, const std::string& in_when) {
+    auto seenby = in_device->get_seenby_map();
+
+    if (seenby->size() != 1)
+        fail(fmt::format("Device has {} seenby records {}, expected 1", seenby->size(),
+                    in_when));
+
+    for (auto& s : *seenby) {
+        auto sbd = std::dynamic_pointer_cast<kis_tracked_seenby_data>(s.second);
+
+        if (sbd == nullptr)
+            fail("Seenby record isn't a seenby component " + in_when);
+
+        if (sbd->get_num_packets() != in_packets)
+            fail(fmt::format("Seenby record counted {} packets {}, expected {}",
+                        sbd->get_num_packets(), in_when, in_packets));
+    }
+}
+
+int main(void) {
+    test_harness_init();
+
+    auto dbpath = fmt::format("/tmp/kismet_coldstore_test_{}.db3", getpid());
+    unlink(dbpath.c_str());
+
+    auto config = Globalreg::globalreg->kismet_config;
+    config->SetOpt("tracker_cold_storage_idle", "60", 0);
+    config->SetOpt("tracker_cold_storage_path", dbpath, 0);
+    config->SetOpt("kis_log_devices", "false", 0);
+
+    Eventbus::create_eventbus();
+    Kis_Httpd_Registry::create_http_registry(Globalreg::globalreg);
+    auto packetchain = Packetchain::create_packetchain(Globalreg::globalreg);
+    Alertracker::create_alertracker();
+
+    auto devicetracker = Devicetracker::create_devicetracker(Globalreg::globalreg);
+    devicetracker->RegisterPhyHandler(new Kis_80211_Phy(Globalreg::globalreg));
+
+    auto phy = devicetracker->FetchPhyHandlerByName("IEEE802.11");
+
+    if (phy == NULL)
+        fail("No 802.11 phy");
+
+    auto source = std::make_shared<KisDatasource>(nullptr);
+    source->set_source_uuid(uuid("01234567-89AB-CDEF-0123-456789ABCDEF"));
+    source->set_source_key(0x1234);
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    auto mac = test_mac(0x001122334455ULL);
+    auto key = device_key(phy->FetchPhynameHash(), mac);
+
+    // Last seen well past the idle threshold
+    Globalreg::globalreg->timestamp = now;
+    auto device = feed_packet(devicetracker, packetchain, phy, source, mac, now.tv_sec - 600);
+
+    if (device == nullptr)
+        fail("No device created for the first packet");
+
+    int dot11_id = Globalreg::globalreg->entrytracker->GetFieldId("dot11.device");
+    auto dot11dev = std::make_shared<dot11_tracked_device>(dot11_id);
+    dot11dev->set_last_sequence(1234);
+    device->insert(dot11dev);
+
+    check_seenby(device, 1, "before storing");
+
+    device.reset();
+    dot11dev.reset();
+
+    devicetracker->tier_cold_devices();
+
+    if (devicetracker->FetchDevice(key, false) != nullptr)
+        fail("Idle device wasn't moved to cold storage");
+
+    if (!devicetracker->device_key_known(key))
+        fail("Device in cold storage isn't known");
+
+    printf("Moved idle device to cold storage\n");
+
+    // The packet path doesn't wait on the store; the packet goes to a record which is
+    // folded into the stored one when it has been read
+    auto pending = feed_packet(devicetracker, packetchain, phy, source, mac, now.tv_sec - 300);
+
+    if (pending == nullptr)
+        fail("No device returned for a packet from a device in cold storage");
+
+    device = devicetracker->FetchDevice(key);
+
+    if (device == nullptr)
+        fail("Device wasn't restored from cold storage");
+
+    if (device == pending)
+        fail("Lookup returned the record standing in for the device being restored");
+
+    auto d11i = device->find(dot11_id);
+
+    if (d11i == device->end() || d11i->second == nullptr)
+        fail("Restored device lost its dot11 record");
+
+    dot11dev = std::dynamic_pointer_cast<dot11_tracked_device>(d11i->second);
+
+    if (dot11dev == nullptr)
+        fail("Restored dot11 record isn't a dot11 component");
+
+    if (dot11dev->get_last_sequence() != 1234)
+        fail(fmt::format("Restored dot11 record has sequence {}, expected 1234",
+                    dot11dev->get_last_sequence()));
+
+    check_seenby(device, 2, "after restoring");
+
+    printf("Restored device with its dot11 and seenby records\n");
+
+    // The next packet updates the restored records in place
+    auto updated = feed_packet(devicetracker, packetchain, phy, source, mac, now.tv_sec);
+
+    if (updated != device)
+        fail("Packet for the restored device went to another record");
+
+    if (device->get_packets() != 3)
+        fail(fmt::format("Restored device counted {} packets, expected 3",
+                    device->get_packets()));
+
+    check_seenby(device, 3, "after the next packet");
+
+    printf("Fed a packet to the restored device\n");
+
+    device.reset();
+    pending.reset();
+    updated.reset();
+    dot11dev.reset();
+    source.reset();
+
+    test_harness_shutdown();
+
+    unlink(dbpath.c_str());
+
+    return 0;
+}
@@ -255,6 +255,59 @@ void kis_tracked_signal_data::append_signal(const Packinfo_Sig_Combo& in, bool u
     }
 }
 
+void kis_tracked_signal_data::merge(std::shared_ptr<kis_tracked_signal_data> in_signal) {
+    if (in_signal == nullptr || in_signal->sig_type == 0)
+        return;
+
+    // Devices should not mix rssi and dbm signal reporting
+    if (sig_type != 0 && sig_type != in_signal->sig_type)
+        return;
+
+    if (sig_type == 0) {
+        signal_type->set(in_signal->get_signal_type());
+        sig_type = in_signal->sig_type;
+    }
+
+    if (in_signal->get_last_signal() != 0)
+        last_signal->set(in_signal->get_last_signal());
+
+    if (in_signal->get_min_signal() != 0 && 
+            ((*min_signal) == 0 || (*min_signal) > in_signal->get_min_signal())) {
+        min_signal->set(in_signal->get_min_signal());
+    }
+
+    if (in_signal->get_max_signal() != 0 &&
+            ((*max_signal) == 0 || (*max_signal) < in_signal->get_max_signal())) {
+        max_signal->set(in_signal->get_max_signal());
+
+        if (in_signal->has_peak_loc())
+            set_tracker_peak_loc(in_signal->get_peak_loc());
+    }
+
+    if (in_signal->get_last_noise() != 0)
+        last_noise->set(in_signal->get_last_noise());
+
+    if (in_signal->get_min_noise() != 0 &&
+            ((*min_noise) == 0 || (*min_noise) > in_signal->get_min_noise())) {
+        min_noise->set(in_signal->get_min_noise());
+    }
+
+    if (in_signal->get_max_noise() != 0 &&
+            ((*max_noise) == 0 || (*max_noise) < in_signal->get_max_noise())) {
+        max_noise->set(in_signal->get_max_noise());
+    }
+
+    (*carrierset) |= in_signal->get_carrierset();
+    (*encodingset) |= in_signal->get_encodingset();
+
+    if ((*maxseenrate) < in_signal->get_maxseenrate())
+        maxseenrate->set(in_signal->get_maxseenrate());
+
+    // The newer record holds the most recent minute
+    if (in_signal->has_signal_min_rrd())
+        set_tracker_signal_min_rrd(in_signal->get_signal_min_rrd());
+}
+
 void kis_tracked_signal_data::register_fields() {
     tracker_component::register_fields();
 
@@ -313,6 +366,32 @@ void kis_tracked_seenby_data::inc_frequency_count(int frequency) {
     }
 }
 
+void kis_tracked_seenby_data::merge(std::shared_ptr<kis_tracked_seenby_data> in_seenby) {
+    if (in_seenby->get_first_time() < get_first_time())
+        set_first_time(in_seenby->get_first_time());
+
+    if (in_seenby->get_last_time() > get_last_time())
+        set_last_time(in_seenby->get_last_time());
+
+    inc_num_packets(in_seenby->get_num_packets());
+
+    for (auto f : *(in_seenby->get_freq_khz_map())) {
+        auto i = freq_khz_map->find(f.first);
+
+        if (i == freq_khz_map->end()) 
+            freq_khz_map->insert(f.first, f.second);
+        else
+            i->second += f.second;
+    }
+
+    if (in_seenby->has_signal_data()) {
+        if (has_signal_data())
+            signal_data->merge(in_seenby->get_signal_data());
+        else
+            set_tracker_signal_data(in_seenby->get_signal_data());
+    }
+}
+
 void kis_tracked_seenby_data::register_fields() {
     tracker_component::register_fields();
 
@@ -344,6 +423,8 @@ void kis_tracked_device_base::inc_frequency_count(double frequency) {
     } else {
         i->second += 1;
     }
+
+    mark_field_dirty(freq_khz_map);
 }
 
 void kis_tracked_device_base::inc_seenby_count(KisDatasource *source, 
@@ -370,6 +451,7 @@ void kis_tracked_device_base::inc_seenby_count(KisDatasource *source,
 
         seenby_map->insert(source->get_source_key(), seenby);
 
+        mark_index_dirty();
     } else {
         seenby = std::static_pointer_cast<kis_tracked_seenby_data>(seenby_iter->second);
 
@@ -382,6 +464,194 @@ void kis_tracked_device_base::inc_seenby_count(KisDatasource *source,
         if (siginfo != NULL)
             seenby->get_signal_data()->append_signal(*siginfo, update_rrd);
     }
+
+    mark_field_dirty(seenby_map);
+}
+
+std::atomic<uint64_t> kis_tracked_device_base::change_generation{1};
+std::vector<int8_t> kis_tracked_device_base::dirty_field_bits;
+std::once_flag kis_tracked_device_base::dirty_field_bits_once;
+
+void kis_tracked_device_base::mark_field_dirty(int in_id) {
+    int bit = dirty_bit_phy;
+
+    if (in_id >= 0 && (size_t) in_id < dirty_field_bits.size() && dirty_field_bits[in_id] >= 0)
+        bit = dirty_field_bits[in_id];
+
+    change_count++;
+
+    auto gen = current_generation();
+    auto& cur = dirty_log[dirty_head];
+
+    if (cur.generation == gen) {
+        cur.mask |= (1ULL << bit);
+        return;
+    }
+
+    // Start a new generation, pushing the oldest out of the log
+    dirty_head = (dirty_head + 1) % dirty_history;
+
+    auto& next = dirty_log[dirty_head];
+
+    if (next.mask != 0 && next.generation > dirty_lost_generation)
+        dirty_lost_generation = next.generation;
+
+    next.generation = gen;
+    next.mask = (1ULL << bit);
+}
+
+void kis_tracked_device_base::mark_phy_dirty() {
+    mark_field_dirty(-1);
+}
+
+bool kis_tracked_device_base::get_changed_fields(uint64_t in_generation,
+        std::vector<SharedTrackerElement>& in_fields) {
+    if (in_generation <= created_generation || in_generation <= dirty_lost_generation)
+        return false;
+
+    uint64_t mask = 0;
+
+    for (unsigned int i = 0; i < dirty_history; i++) {
+        if (dirty_log[i].generation >= in_generation)
+            mask |= dirty_log[i].mask;
+    }
+
+    if (mask == 0)
+        return true;
+
+    for (auto f : *this) {
+        if (f.second == nullptr)
+            continue;
+
+        int bit = dirty_bit_phy;
+
+        if ((size_t) f.first < dirty_field_bits.size() && dirty_field_bits[f.first] >= 0)
+            bit = dirty_field_bits[f.first];
+
+        if (mask & (1ULL << bit))
+            in_fields.push_back(f.second);
+    }
+
+    return true;
+}
+
+void kis_tracked_device_base::drop_optional_data() {
+    set_tracker_packets_rrd(nullptr);
+    set_tracker_data_rrd(nullptr);
+    set_tracker_packet_rrd_bin_250(nullptr);
+    set_tracker_packet_rrd_bin_500(nullptr);
+    set_tracker_packet_rrd_bin_1000(nullptr);
+    set_tracker_packet_rrd_bin_1500(nullptr);
+    set_tracker_packet_rrd_bin_jumbo(nullptr);
+    set_tracker_location_cloud(nullptr);
+
+    if (has_signal_data())
+        signal_data->set_tracker_signal_min_rrd(nullptr);
+
+    for (auto s : *seenby_map) {
+        auto seenby = std::static_pointer_cast<kis_tracked_seenby_data>(s.second);
+
+        if (seenby->has_signal_data())
+            seenby->get_signal_data()->set_tracker_signal_min_rrd(nullptr);
+    }
+}
+
+void kis_tracked_device_base::merge_pending(std::shared_ptr<kis_tracked_device_base> in_pending) {
+    if (in_pending->get_last_time() > get_last_time())
+        set_last_time(in_pending->get_last_time());
+
+    inc_packets(in_pending->get_packets());
+    inc_rx_packets(in_pending->get_rx_packets());
+    inc_tx_packets(in_pending->get_tx_packets());
+    inc_llc_packets(in_pending->get_llc_packets());
+    inc_error_packets(in_pending->get_error_packets());
+    inc_data_packets(in_pending->get_data_packets());
+    inc_crypt_packets(in_pending->get_crypt_packets());
+    inc_filter_packets(in_pending->get_filter_packets());
+    inc_datasize(in_pending->get_datasize());
+
+    bitset_basic_type_set(in_pending->get_basic_type_set());
+    add_basic_crypt(in_pending->get_basic_crypt_set());
+
+    // The pending record heard the device most recently
+    if (in_pending->get_channel().length() != 0)
+        set_channel(in_pending->get_channel());
+
+    if (in_pending->get_frequency() != 0)
+        set_frequency(in_pending->get_frequency());
+
+    for (auto f : *(in_pending->get_freq_khz_map())) {
+        auto i = freq_khz_map->find(f.first);
+
+        if (i == freq_khz_map->end())
+            freq_khz_map->insert(f.first, f.second);
+        else
+            i->second += f.second;
+    }
+
+    mark_field_dirty(freq_khz_map);
+
+    for (auto s : *(in_pending->get_seenby_map())) {
+        auto i = seenby_map->find(s.first);
+
+        if (i == seenby_map->end()) {
+            seenby_map->insert(s.first, s.second);
+            mark_index_dirty();
+        } else {
+            std::static_pointer_cast<kis_tracked_seenby_data>(i->second)->merge(
+                    std::static_pointer_cast<kis_tracked_seenby_data>(s.second));
+        }
+    }
+
+    mark_field_dirty(seenby_map);
+
+    if (in_pending->has_signal_data()) {
+        if (has_signal_data())
+            signal_data->merge(in_pending->get_signal_data());
+        else
+            set_tracker_signal_data(in_pending->get_signal_data());
+    }
+
+    if (in_pending->has_location()) {
+        if (has_location())
+            location->merge(in_pending->get_location());
+        else
+            set_tracker_location(in_pending->get_location());
+    }
+
+    if (in_pending->has_location_cloud() && !has_location_cloud())
+        set_tracker_location_cloud(in_pending->get_location_cloud());
+
+    // Add the packets the pending record counted to the long-term history as of the
+    // last time it saw them; the minute bins of the pending record are the current ones
+    if (in_pending->has_packets_rrd() && in_pending->get_packets() != 0)
+        get_packets_rrd()->add_sample(in_pending->get_packets(), in_pending->get_last_time());
+
+    if (in_pending->has_data_rrd() && in_pending->get_datasize() != 0)
+        get_data_rrd()->add_sample(in_pending->get_datasize(), in_pending->get_last_time());
+
+    if (in_pending->has_packet_rrd_bin_250())
+        set_tracker_packet_rrd_bin_250(in_pending->get_packet_rrd_bin_250());
+    if (in_pending->has_packet_rrd_bin_500())
+        set_tracker_packet_rrd_bin_500(in_pending->get_packet_rrd_bin_500());
+    if (in_pending->has_packet_rrd_bin_1000())
+        set_tracker_packet_rrd_bin_1000(in_pending->get_packet_rrd_bin_1000());
+    if (in_pending->has_packet_rrd_bin_1500())
+        set_tracker_packet_rrd_bin_1500(in_pending->get_packet_rrd_bin_1500());
+    if (in_pending->has_packet_rrd_bin_jumbo())
+        set_tracker_packet_rrd_bin_jumbo(in_pending->get_packet_rrd_bin_jumbo());
+
+    // Anything else the pending record carries which we don't have at all is a phy
+    // record; base fields are always present in the map, if only as empty slots
+    for (auto f : *in_pending) {
+        if (f.second == nullptr || find(f.first) != end())
+            continue;
+
+        insert(f.second);
+        mark_phy_dirty();
+    }
+
+    update_modtime();
 }
 
 void kis_tracked_device_base::register_fields() {
@@ -474,10 +744,38 @@ void kis_tracked_device_base::register_fields() {
 void kis_tracked_device_base::reserve_fields(std::shared_ptr<TrackerElementMap> e) {
     tracker_component::reserve_fields(e);
 
+    // The base fields are the same for every device, so the first device to be built
+    // assigns their dirty bits
+    std::call_once(dirty_field_bits_once, [this]() {
+            int max_id = 0;
+            for (auto f : *this)
+                max_id = std::max(max_id, f.first);
+
+            dirty_field_bits.resize(max_id + 1, -1);
+
+            int bit = 0;
+            for (auto f : *this) {
+                if (bit < dirty_bit_phy)
+                    dirty_field_bits[f.first] = bit++;
+            }
+        });
+
+    for (unsigned int i = 0; i < dirty_history; i++)
+        dirty_log[i] = dirty_generation{0, 0};
+
+    dirty_head = 0;
+    created_generation = current_generation();
+    dirty_lost_generation = 0;
+    change_count = 0;
+
+    // New devices always need to be indexed
+    index_changes = 1;
+    indexed_changes = 0;
+
     if (e != NULL) {
         // If we're inheriting, it's our responsibility to kick submaps with
         // complex types as well; since they're not themselves complex objects
-        for (auto s : *seenby_map) {
+        for (auto& s : *seenby_map) {
             // Build a proper seenby record for each item in the list
             auto sbd = 
                 std::make_shared<kis_tracked_seenby_data>(seenby_val_id, 
@@ -28,6 +28,8 @@
 #include <vector>
 #include <algorithm>
 #include <string>
+#include <atomic>
+#include <mutex>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -109,6 +111,11 @@ public:
     void append_signal(const kis_layer1_packinfo& lay1, bool update_rrd = true);
     void append_signal(const Packinfo_Sig_Combo& in, bool update_rrd = true);
 
+    // Fold in signal data recorded more recently for the same device, such as by a 
+    // record which stood in for it while it was being restored.  Signal of a different
+    // type (rssi vs dbm) is ignored.
+    void merge(std::shared_ptr<kis_tracked_signal_data> in_signal);
+
     __ProxyGet(signal_type, std::string, std::string, signal_type);
 
     __ProxyGet(last_signal, int32_t, int, last_signal);
@@ -186,6 +193,9 @@ public:
 
     void inc_frequency_count(int frequency);
 
+    // Fold in a more recent record of the same source
+    void merge(std::shared_ptr<kis_tracked_seenby_data> in_seenby);
+
 protected:
     virtual void register_fields() override;
 
@@ -237,19 +247,25 @@ protected:
 class kis_tracked_device_base : public tracker_component {
 public:
     kis_tracked_device_base() :
-        tracker_component() {
+        tracker_component(),
+        lastseen_owner{nullptr},
+        tracked_vec_pos{0} {
         register_fields();
         reserve_fields(NULL);
     }
 
     kis_tracked_device_base(int in_id) :
-        tracker_component(in_id) {
+        tracker_component(in_id),
+        lastseen_owner{nullptr},
+        tracked_vec_pos{0} {
         register_fields();
         reserve_fields(NULL);
     }
 
     kis_tracked_device_base(int in_id, std::shared_ptr<TrackerElementMap> e) : 
-        tracker_component(in_id) {
+        tracker_component(in_id),
+        lastseen_owner{nullptr},
+        tracked_vec_pos{0} {
         register_fields();
         reserve_fields(e);
     }
@@ -312,7 +328,8 @@ public:
 
     __Proxy(commonname, std::string, std::string, std::string, commonname);
 
-    __Proxy(type_string, std::string, std::string, std::string, type_string);
+    __ProxyChangedL(type_string, std::string, std::string, std::string, type_string,
+            [this](const std::string&) { mark_index_dirty(); });
 
     __Proxy(basic_type_set, uint64_t, uint64_t, uint64_t, basic_type_set);
     __ProxyBitset(basic_type_set, uint64_t, basic_type_set);
@@ -397,11 +414,13 @@ public:
     __ProxyDynamicTrackable(packet_rrd_bin_jumbo, mrrdt, packet_rrd_bin_jumbo,
             packet_rrd_bin_jumbo_id);
 
-    __Proxy(channel, std::string, std::string, std::string, channel);
+    __ProxyChangedL(channel, std::string, std::string, std::string, channel,
+            [this](const std::string&) { mark_index_dirty(); });
     __Proxy(frequency, double, double, double, frequency);
 
     __ProxyTrackable(manuf, TrackerElementString, manuf);
-    __Proxy(manuf, std::string, std::string, std::string, manuf);
+    __ProxyChangedL(manuf, std::string, std::string, std::string, manuf,
+            [this](const std::string&) { mark_index_dirty(); });
 
     __Proxy(num_alerts, uint32_t, unsigned int, unsigned int, alert);
 
@@ -417,11 +436,22 @@ public:
     void inc_seenby_count(KisDatasource *source, time_t tv_sec, int frequency,
             Packinfo_Sig_Combo *siginfo, bool update_rrd);
 
+    // Discard optional historical data (packet and signal RRDs and the location
+    // history cloud) to reduce memory use; the device must be locked
+    void drop_optional_data();
+
+    // Fold in the data of a record which stood in for this device while it was being
+    // restored from the cold store: packet counts, frequencies, seenby sources, signal,
+    // location, and the most recent packet RRDs.  Records only in_pending has, such as
+    // phy records the restored device lacks, are moved over; phy records both have are
+    // left to the phy to merge.  in_pending must be locked, and is discarded after.
+    void merge_pending(std::shared_ptr<kis_tracked_device_base> in_pending);
+
     __ProxyTrackable(tag_map, TrackerElementStringMap, tag_map);
 
     __Proxy(server_uuid, uuid, uuid, uuid, server_uuid);
 
-    // Non-exported internal counter used for structured sorting
+    // Non-exported internal ID, assigned by the devicetracker
     uint64_t get_kis_internal_id() {
         return kis_internal_id;
     }
@@ -430,6 +460,47 @@ public:
         kis_internal_id = in_id;
     }
 
+    // Change tracking.  Every change to a top-level field of the device is recorded
+    // against the current change generation, keeping the last few generations in
+    // which the device changed, so that clients can fetch only the fields which 
+    // changed since a generation they have already seen.  Phy records and other
+    // nested components don't report their own changes; whoever modifies them marks
+    // the top-level field (or calls mark_phy_dirty) while holding the device lock.
+    using tracker_component::mark_field_dirty;
+    virtual void mark_field_dirty(int in_id) override;
+
+    // Mark every phy-specific record attached to the device as changed
+    void mark_phy_dirty();
+
+    // Most recent generation in which the device was created or changed
+    uint64_t get_change_generation() const {
+        return std::max(created_generation, dirty_log[dirty_head].generation);
+    }
+
+    // Count of every change to the device; generations are seconds long, this tells
+    // whether the device changed at all since it was last looked at
+    uint64_t get_change_count() const {
+        return change_count;
+    }
+
+    // Fill in_fields with the top-level fields which changed in or after in_generation.
+    // Returns false when the device is newer than in_generation, or its change history
+    // no longer reaches back that far, and the entire device has to be sent.
+    bool get_changed_fields(uint64_t in_generation, 
+            std::vector<SharedTrackerElement>& in_fields);
+
+    // The current global change generation, and advance to a new one; the devicetracker
+    // advances it on a timer (tracker_delta_generation_period), so that clients polling
+    // for changes share generations instead of each pushing the others out of the 
+    // change history.
+    static uint64_t current_generation() {
+        return change_generation.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t advance_generation() {
+        return change_generation.fetch_add(1);
+    }
+
     // Lock our device around serialization
     virtual void pre_serialize() override {
         local_eol_shared_locker lock(device_mutex);
@@ -444,14 +515,75 @@ public:
     // inside it
     kis_recursive_timed_mutex device_mutex;
 
+    // Position of the device in the devicetracker last-seen index, which keeps devices
+    // ordered by last time seen for expiry; owned by the devicetracker and only 
+    // touched under the device shard lock.  lastseen_owner is null when the device
+    // is not indexed.
+    using lastseen_list_t = std::list<std::shared_ptr<kis_tracked_device_base>>;
+    lastseen_list_t *lastseen_owner;
+    lastseen_list_t::iterator lastseen_pos;
+
+    // Position of the device in the devicetracker tracked vector, so that removing it
+    // doesn't search the vector; only meaningful while the device is in the vector, 
+    // and only touched under the devicetracker device vector lock.
+    size_t tracked_vec_pos;
+
+    // Secondary index keys, as (attribute, value) pairs, the device is currently filed
+    // under, and the index change count they were built from; owned by the 
+    // devicetracker and only changed under the device lock.
+    using index_key_t = std::pair<std::string, std::string>;
+    std::vector<index_key_t> index_keys;
+    std::atomic<uint64_t> indexed_changes;
+
+    // Count a change to a value the device is indexed by.  The type, channel, and 
+    // manufacturer setters and new seenby sources count themselves; phys call this 
+    // when they change a record they return index keys for.  The devicetracker only
+    // rebuilds the index keys of a device when the count has moved.
+    void mark_index_dirty() {
+        index_changes++;
+    }
+
+    uint64_t get_index_changes() const {
+        return index_changes;
+    }
+
 protected:
     virtual void register_fields() override;
     virtual void reserve_fields(std::shared_ptr<TrackerElementMap> e) override;
 
-    // Unique, meaningless, incremental ID.  Practically, this is the order
-    // in which kismet saw devices; it has no purpose other than a sorting
-    // key which will always preserve order - time, etc, will not.  Used for breaking
-    // up long-running queries.
+    // Global change generation
+    static std::atomic<uint64_t> change_generation;
+
+    // Dirty bit assigned to each base field, indexed by field id; fields without a bit
+    // of their own (phy records and anything else inserted into the device) share 
+    // the phy bit
+    static std::vector<int8_t> dirty_field_bits;
+    static std::once_flag dirty_field_bits_once;
+    static const int dirty_bit_phy = 63;
+
+    struct dirty_generation {
+        uint64_t generation;
+        uint64_t mask;
+    };
+
+    // Ring of the most recent generations in which the device changed; a client asking
+    // for changes since a generation older than the ring gets the whole device
+    static const unsigned int dirty_history = 4;
+    dirty_generation dirty_log[dirty_history];
+    unsigned int dirty_head;
+
+    // Generation the device was created in, and the newest generation which has been
+    // pushed out of the dirty log
+    uint64_t created_generation;
+    uint64_t dirty_lost_generation;
+
+    uint64_t change_count;
+
+    std::atomic<uint64_t> index_changes;
+
+    // Unique, meaningless ID, assigned by the devicetracker ID allocator.  IDs of 
+    // removed devices are re-used, so this is only unique among live devices and does
+    // not reflect the order devices were seen in.
     uint64_t kis_internal_id;
 
     // Unique key
@@ -570,6 +702,235 @@ protected:
     int seenby_val_id;
 };
 
+// Per-phy memory accounting, reported by the devicetracker memory budget
+class tracked_memory_budget_phy : public tracker_component {
+public:
+    tracked_memory_budget_phy() :
+        tracker_component() {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_memory_budget_phy(int in_id) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_memory_budget_phy(int in_id, std::shared_ptr<TrackerElementMap> e) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(e);
+    }
+
+    virtual uint32_t get_signature() const override {
+        return Adler32Checksum("tracked_memory_budget_phy");
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type() override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t());
+        return std::move(dup);
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type(int in_id) override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t(in_id));
+        return std::move(dup);
+    }
+
+    __Proxy(devices, uint64_t, uint64_t, uint64_t, devices);
+    __Proxy(estimate_kb, uint64_t, uint64_t, uint64_t, estimate_kb);
+    __Proxy(budget_share, double, double, double, budget_share);
+    __Proxy(degraded, uint8_t, bool, bool, degraded);
+
+protected:
+    virtual void register_fields() override {
+        RegisterField("kismet.memory_budget.phy.devices", "number of devices", &devices);
+        RegisterField("kismet.memory_budget.phy.estimate_kb", 
+                "estimated memory used by devices, in kB", &estimate_kb);
+        RegisterField("kismet.memory_budget.phy.budget_share",
+                "fraction of the device memory allowance used by this phy", &budget_share);
+        RegisterField("kismet.memory_budget.phy.degraded",
+                "optional data of devices of this phy has been discarded to save memory",
+                &degraded);
+    }
+
+    std::shared_ptr<TrackerElementUInt64> devices;
+    std::shared_ptr<TrackerElementUInt64> estimate_kb;
+    std::shared_ptr<TrackerElementDouble> budget_share;
+    std::shared_ptr<TrackerElementUInt8> degraded;
+};
+
+// Devicetracker memory budget status
+class tracked_memory_budget : public tracker_component {
+public:
+    tracked_memory_budget() :
+        tracker_component() {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_memory_budget(int in_id) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_memory_budget(int in_id, std::shared_ptr<TrackerElementMap> e) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(e);
+    }
+
+    virtual uint32_t get_signature() const override {
+        return Adler32Checksum("tracked_memory_budget");
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type() override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t());
+        return std::move(dup);
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type(int in_id) override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t(in_id));
+        return std::move(dup);
+    }
+
+    __Proxy(budget_kb, uint64_t, uint64_t, uint64_t, budget_kb);
+    __Proxy(rss_kb, uint64_t, uint64_t, uint64_t, rss_kb);
+    __Proxy(device_allowance_kb, uint64_t, uint64_t, uint64_t, device_allowance_kb);
+    __Proxy(device_estimate_kb, uint64_t, uint64_t, uint64_t, device_estimate_kb);
+    __Proxy(degraded, uint8_t, bool, bool, degraded);
+    __Proxy(evicted_devices, uint64_t, uint64_t, uint64_t, evicted_devices);
+
+    __ProxyTrackable(phys, TrackerElementStringMap, phys);
+
+    // Create the accounting record for a phy when the phy is registered; the phy map is
+    // only changed then, so the budget timer and status serialization can share it
+    void add_phy(const std::string& in_phyname) {
+        if (phys->find(in_phyname) == phys->end())
+            phys->insert(in_phyname, std::make_shared<tracked_memory_budget_phy>(phy_entry_id));
+    }
+
+    // Find the accounting record for a phy, or null if the phy was never added
+    std::shared_ptr<tracked_memory_budget_phy> get_phy(const std::string& in_phyname) {
+        auto pi = phys->find(in_phyname);
+
+        if (pi != phys->end())
+            return std::static_pointer_cast<tracked_memory_budget_phy>(pi->second);
+
+        return nullptr;
+    }
+
+protected:
+    virtual void register_fields() override {
+        RegisterField("kismet.memory_budget.budget_kb", "memory budget, in kB", &budget_kb);
+        RegisterField("kismet.memory_budget.rss_kb", "process RSS, in kB", &rss_kb);
+        RegisterField("kismet.memory_budget.device_allowance_kb",
+                "memory available to devices within the budget, in kB", &device_allowance_kb);
+        RegisterField("kismet.memory_budget.device_estimate_kb",
+                "estimated memory used by devices, in kB", &device_estimate_kb);
+        RegisterField("kismet.memory_budget.degraded", 
+                "optional device data of one or more phys has been discarded to save memory",
+                &degraded);
+        RegisterField("kismet.memory_budget.evicted_devices",
+                "devices removed to stay within the memory budget", &evicted_devices);
+        RegisterField("kismet.memory_budget.phys", "per-phy memory use", &phys);
+
+        phy_entry_id =
+            RegisterField("kismet.memory_budget.phy",
+                    TrackerElementFactory<tracked_memory_budget_phy>(),
+                    "per-phy memory use");
+    }
+
+    std::shared_ptr<TrackerElementUInt64> budget_kb;
+    std::shared_ptr<TrackerElementUInt64> rss_kb;
+    std::shared_ptr<TrackerElementUInt64> device_allowance_kb;
+    std::shared_ptr<TrackerElementUInt64> device_estimate_kb;
+    std::shared_ptr<TrackerElementUInt8> degraded;
+    std::shared_ptr<TrackerElementUInt64> evicted_devices;
+    std::shared_ptr<TrackerElementStringMap> phys;
+    int phy_entry_id;
+};
+
+// Cold storage accounting, reported by the devicetracker when idle devices are tiered
+// out to disk
+class tracked_cold_storage : public tracker_component {
+public:
+    tracked_cold_storage() :
+        tracker_component() {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_cold_storage(int in_id) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(NULL);
+    }
+
+    tracked_cold_storage(int in_id, std::shared_ptr<TrackerElementMap> e) :
+        tracker_component(in_id) {
+        register_fields();
+        reserve_fields(e);
+    }
+
+    virtual uint32_t get_signature() const override {
+        return Adler32Checksum("tracked_cold_storage");
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type() override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t());
+        return std::move(dup);
+    }
+
+    virtual std::unique_ptr<TrackerElement> clone_type(int in_id) override {
+        using this_t = std::remove_pointer<decltype(this)>::type;
+        auto dup = std::unique_ptr<this_t>(new this_t(in_id));
+        return std::move(dup);
+    }
+
+    __Proxy(idle_threshold, uint64_t, uint64_t, uint64_t, idle_threshold);
+    __Proxy(cold_devices, uint64_t, uint64_t, uint64_t, cold_devices);
+    __Proxy(tiered_devices, uint64_t, uint64_t, uint64_t, tiered_devices);
+    __Proxy(rehydrated_devices, uint64_t, uint64_t, uint64_t, rehydrated_devices);
+    __Proxy(store_size, uint64_t, uint64_t, uint64_t, store_size);
+
+    __ProxyTrackable(tiered_rrd, kis_tracked_rrd<>, tiered_rrd);
+    __ProxyTrackable(rehydrated_rrd, kis_tracked_rrd<>, rehydrated_rrd);
+
+protected:
+    virtual void register_fields() override {
+        RegisterField("kismet.cold_storage.idle_threshold", 
+                "devices idle longer than this, in seconds, are moved to cold storage",
+                &idle_threshold);
+        RegisterField("kismet.cold_storage.cold_devices", "devices in cold storage", 
+                &cold_devices);
+        RegisterField("kismet.cold_storage.tiered_devices",
+                "devices moved to cold storage", &tiered_devices);
+        RegisterField("kismet.cold_storage.rehydrated_devices",
+                "devices restored from cold storage", &rehydrated_devices);
+        RegisterField("kismet.cold_storage.store_size", "cold storage size, in bytes",
+                &store_size);
+        RegisterField("kismet.cold_storage.tiered_rrd", 
+                "devices moved to cold storage RRD", &tiered_rrd);
+        RegisterField("kismet.cold_storage.rehydrated_rrd",
+                "devices restored from cold storage RRD", &rehydrated_rrd);
+    }
+
+    std::shared_ptr<TrackerElementUInt64> idle_threshold;
+    std::shared_ptr<TrackerElementUInt64> cold_devices;
+    std::shared_ptr<TrackerElementUInt64> tiered_devices;
+    std::shared_ptr<TrackerElementUInt64> rehydrated_devices;
+    std::shared_ptr<TrackerElementUInt64> store_size;
+    std::shared_ptr<kis_tracked_rrd<>> tiered_rrd;
+    std::shared_ptr<kis_tracked_rrd<>> rehydrated_rrd;
+};
+
 // Packinfo references
 class kis_tracked_device_info : public packet_component {
 public:
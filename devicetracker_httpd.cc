@@ -84,16 +84,17 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                 if (!Httpd_CanSerialize(tokenurl[4]))
                     return false;
 
-                auto tmi = FetchDevice(key);
-
-                if (tmi == NULL)
+                if (!device_key_known(key))
                     return false;
 
                 std::string target = Httpd_StripSuffix(tokenurl[4]);
 
                 if (target == "device") {
-                    // Try to find the exact field
-                    if (tokenurl.size() > 5) {
+                    // Try to find the exact field; devices in cold storage are only
+                    // restored by the request itself, which checks the field then
+                    auto tmi = FetchDevice(key, false);
+
+                    if (tmi != NULL && tokenurl.size() > 5) {
                         std::vector<std::string>::const_iterator first = tokenurl.begin() + 5;
                         std::vector<std::string>::const_iterator last = tokenurl.end();
                         std::vector<std::string> fpath(first, last);
@@ -120,12 +121,8 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                { 
-                    local_shared_locker devlock(&devicelist_mutex);
-
-                    if (tracked_mac_multimap.count(mac) > 0)
-                        return true;
-                }
+                if (device_mac_known(mac))
+                    return true;
 
                 return false;
             } else if (tokenurl[2] == "last-time") {
@@ -182,7 +179,7 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                 if (!Httpd_CanSerialize(tokenurl[4]))
                     return false;
 
-                if (FetchDevice(key) == NULL)
+                if (!device_key_known(key))
                     return false;
 
                 std::string target = Httpd_StripSuffix(tokenurl[4]);
@@ -211,11 +208,8 @@ bool Devicetracker::Httpd_VerifyPath(const char *path, const char *method) {
                     return false;
                 }
 
-                {
-                    local_shared_locker listlocker(&devicelist_mutex);
-                    if (tracked_mac_multimap.count(mac) > 0)
-                        return true;
-                }
+                if (device_mac_known(mac))
+                    return true;
 
                 return false;
             } else if (tokenurl[2] == "by-phy") {
@@ -371,8 +365,6 @@ int Devicetracker::Httpd_CreateStreamResponse(
             if (!Httpd_CanSerialize(tokenurl[4]))
                 return MHD_YES;
 
-            local_shared_locker lock(&devicelist_mutex);
-
             mac_addr mac = mac_addr(tokenurl[3]);
 
             if (mac.error) {
@@ -381,10 +373,8 @@ int Devicetracker::Httpd_CreateStreamResponse(
 
             auto devvec = std::make_shared<TrackerElementVector>();
 
-            const auto& mmp = tracked_mac_multimap.equal_range(mac);
-            for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) {
-                devvec->push_back(mmpi->second);
-            }
+            for (auto d : find_devices_by_mac(mac))
+                devvec->push_back(d);
 
             Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, devvec, NULL);
 
@@ -463,8 +453,8 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
     // Common structured API data
     SharedStructured structdata;
 
-    // Summarization vector
-    std::vector<SharedElementSummary> summary_vec;
+    // Compiled fields summarization, if any
+    std::shared_ptr<TrackerElementProjection> projection;
 
     // Wrapper, if any
     std::string wrapper_name;
@@ -493,30 +483,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
     }
 
     try {
-        if (structdata->hasKey("fields")) {
-            SharedStructured fields = structdata->getStructuredByKey("fields");
-            StructuredData::structured_vec fvec = fields->getStructuredArray();
-
-            for (const auto& i : fvec) {
-                if (i->isString()) {
-                    auto s = std::make_shared<TrackerElementSummary>(i->getString());
-                    summary_vec.push_back(s);
-                } else if (i->isArray()) {
-                    StructuredData::string_vec mapvec = i->getStringVec();
-
-                    if (mapvec.size() != 2) {
-                        // fprintf(stderr, "debug - malformed rename pair\n");
-                        stream << "Invalid request: Expected field, rename";
-                        concls->httpcode = 400;
-                        return MHD_YES;
-                    }
-
-                    auto s = 
-                        std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]);
-                    summary_vec.push_back(s);
-                }
-            }
-        }
+        projection = kishttpd::ProjectionWithStructured(structdata);
 
         // Get the wrapper, if one exists, default to empty if it doesn't
         wrapper_name = structdata->getKeyAsString("wrapper", "");
@@ -549,8 +516,6 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     return MHD_YES;
                 }
 
-                local_demand_locker lock(&devicelist_mutex);
-
                 if (!Httpd_CanSerialize(tokenurl[4])) {
                     stream << "Invalid request: Cannot find serializer for file type\n";
                     concls->httpcode = 400;
@@ -566,25 +531,24 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     return MHD_YES;
                 }
 
-                lock.lock();
-                if (tracked_mac_multimap.count(mac) == 0) {
+                auto macdevs = find_devices_by_mac(mac);
+
+                if (macdevs.size() == 0) {
                     stream << "Invalid request: Could not find device by MAC\n";
                     concls->httpcode = 400;
                     return MHD_YES;
                 }
-                lock.unlock();
 
                 std::string target = Httpd_StripSuffix(tokenurl[4]);
 
                 if (target == "devices") {
                     auto devvec = std::make_shared<TrackerElementVector>();
 
-                    lock.lock();
-                    auto mmp = tracked_mac_multimap.equal_range(mac);
-                    lock.unlock();
+                    for (auto d : macdevs) 
+                        devvec->push_back(d);
 
-                    for (auto mmpi = mmp.first; mmpi != mmp.second; ++mmpi) 
-                        devvec->push_back(SummarizeSingleTrackerElement(mmpi->second, summary_vec, rename_map));
+                    if (projection != nullptr)
+                        projection->mark(devvec, rename_map);
 
                     Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, 
                             devvec, rename_map);
@@ -623,8 +587,10 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 if (target == "device") {
                     local_shared_locker devlock(&(dev->device_mutex));
 
-                    auto simple = 
-                        SummarizeSingleTrackerElement(dev, summary_vec, rename_map);
+                    auto simple = SharedTrackerElement{dev};
+
+                    if (projection != nullptr)
+                        simple = projection->summarize(dev, rename_map);
 
                     Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), 
                             stream, simple, rename_map);
@@ -735,8 +701,8 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
 
                     // Search every field; we could make this more controlled by using
                     // the new colmap code but we don't really need to
-                    if (dt_search.length() != 0) {
-                        for (const auto& svi : summary_vec) 
+                    if (dt_search.length() != 0 && projection != nullptr) {
+                        for (const auto& svi : projection->get_summarization()) 
                             dt_search_paths.push_back(svi->resolved_path);
                     }
 
@@ -801,11 +767,9 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     wrapper->insert(draw_elem);
 
                     // Make the length and filter elements
-                    {
-                        local_shared_locker lock(&devicelist_mutex);
-                        dt_length_elem = 
-                            std::make_shared<TrackerElementUInt64>(dt_length_id, tracked_vec.size());
-                    }
+                    dt_length_elem = 
+                        std::make_shared<TrackerElementUInt64>(dt_length_id, 
+                                fetch_device_snapshot()->size());
                     dt_length_elem->set_local_name("recordsTotal");
                     wrapper->insert(dt_length_elem);
 
@@ -884,7 +848,7 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     }
 
                     for (auto i = vi; i != ei; ++i) 
-                        outdevs->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
+                        outdevs->push_back(*i);
 
                 } else if (dt_search_paths.size() != 0) {
                     // Otherwise, we're doing a search inside a datatables query,
@@ -956,15 +920,11 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                         SetTrackerValue<uint64_t>(dt_filter_elem, matchvec->size());
 
                     for (auto i = vi; i != ei; ++i) 
-                        outdevs->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
+                        outdevs->push_back(*i);
 
                 } else {
-                    // Only lock while copying the vector
-                    local_demand_locker listlock(&devicelist_mutex);
-                    
-                    listlock.lock();
-                    auto tracked_vec_copy = tracked_vec;
-                    listlock.unlock();
+                    // Sort a copy of the device snapshot
+                    auto tracked_vec_copy = *fetch_device_snapshot();
 
                     // Check DT ranges
                     if (dt_start >= tracked_vec_copy.size())
@@ -1024,9 +984,13 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                     }
 
                     for (auto i = vi; i != ei; ++i) 
-                        outdevs->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
+                        outdevs->push_back(*i);
                 }
 
+                // Devices are projected as they're serialized
+                if (projection != nullptr)
+                    projection->mark(outdevs, rename_map);
+
                 // Apply wrapper if we haven't applied it already
                 if (wrapper_name.length() != 0 && wrapper == NULL) {
                     wrapper = std::make_shared<TrackerElementMap>();
@@ -1096,12 +1060,10 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 // Final devices being simplified and sent out
                 auto outdevs = std::make_shared<TrackerElementVector>();
 
-                for (const auto& rei : *regexdevs) {
-                    auto rd = std::static_pointer_cast<kis_tracked_device_base>(rei);
-                    local_shared_locker lock(&rd->device_mutex);
+                outdevs->set(regexdevs->begin(), regexdevs->end());
 
-                    outdevs->push_back(SummarizeSingleTrackerElement(rd, summary_vec, rename_map));
-                }
+                if (projection != nullptr)
+                    projection->mark(outdevs, rename_map);
 
                 Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, 
                         outdevs, rename_map);
@@ -1126,44 +1088,28 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 // Rename cache generated during simplification
                 auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
 
-                // List of devices that pass the timestamp filter
-                std::shared_ptr<TrackerElementVector> timedevs;
-
-                // Devices that pass the phy filter
+                // Devices that pass the phy and timestamp filters
                 std::shared_ptr<TrackerElementVector> phydevs;
 
                 //  List of devices that pass the regex filter
                 std::shared_ptr<TrackerElementVector> regexdevs;
 
-                // Filter by time first, it's fast
-                auto tw = std::make_shared<devicetracker_function_worker>(
-                        [post_ts](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
-
-                        if (d->get_last_time() <= post_ts)
-                            return false;
-
-                        return true;
-                        }, nullptr);
-
                 auto pw = std::make_shared<devicetracker_function_worker>(
-                        [phydevs, phy](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
+                        [post_ts, phy](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
                         if (d->get_phyname() != phy->FetchPhyName())
                             return false;
 
+                        if (post_ts != 0 && d->get_last_time() <= post_ts)
+                            return false;
+
                         return true;
                         }, nullptr);
 
-                if (post_ts != 0) {
-                    // time-match then phy-match then pass to regex
-                    MatchOnReadonlyDevices(tw);
-                    timedevs = tw->GetMatchedDevices();
-                    MatchOnReadonlyDevices(pw, timedevs);
-                    phydevs = pw->GetMatchedDevices();
-                }  else {
-                    // Phy match only
-                    MatchOnReadonlyDevices(pw);
-                    phydevs = pw->GetMatchedDevices();
-                }
+                // Only the devices of this phy are examined when the phy index is available
+                pw->set_index_hint("phy", phy->FetchPhyName());
+
+                MatchOnReadonlyDevices(pw);
+                phydevs = pw->GetMatchedDevices();
 
                 if (regexdata != NULL) {
                     auto worker = std::make_shared<devicetracker_pcre_worker>(regexdata);
@@ -1176,12 +1122,10 @@ int Devicetracker::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
                 // Final devices being simplified and sent out
                 auto outdevs = std::make_shared<TrackerElementVector>();
 
-                for (const auto& rei : *regexdevs) {
-                    auto rd = std::static_pointer_cast<kis_tracked_device_base>(rei);
-                    local_shared_locker lock(&rd->device_mutex);
+                outdevs->set(regexdevs->begin(), regexdevs->end());
 
-                    outdevs->push_back(SummarizeSingleTrackerElement(rd, summary_vec, rename_map));
-                }
+                if (projection != nullptr)
+                    projection->mark(outdevs, rename_map);
 
                 Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(tokenurl[4]), stream, 
                         outdevs, rename_map);
@@ -1222,19 +1166,10 @@ unsigned int Devicetracker::multimac_endp_handler(std::ostream& stream, const st
             macs.push_back(ma);
         }
 
-        // Duplicate the mac index so that we're 'immune' to things changing it under us; because we
-        // may have quite a number of devices in our query list, this is safest.
-        local_demand_locker l(&devicelist_mutex);
-        l.lock();
-        auto immutable_copy = 
-            std::multimap<mac_addr, std::shared_ptr<kis_tracked_device_base>>{tracked_mac_multimap};
-        l.unlock();
-
-        // Pull all the devices out of the list
+        // Pull all the devices out of the index
         for (auto m : macs) {
-            const auto& mi = immutable_copy.equal_range(m);
-            for (auto msi = mi.first; msi != mi.second; ++msi)
-                ret_devices->push_back(msi->second);
+            for (auto d : find_devices_by_mac(m))
+                ret_devices->push_back(d);
         }
 
         // Summarize it all at once
@@ -1289,3 +1224,302 @@ std::shared_ptr<TrackerElement> Devicetracker::all_phys_endp_handler() {
     return ret_vec;
 }
 
+
+// Tally how often each field of each tracked component is populated, recursing into
+// child components and containers
+static void field_population_walk(const std::shared_ptr<TrackerElement>& e,
+        std::map<int, std::pair<uint64_t, std::map<int, uint64_t>>>& tally) {
+
+    if (e == nullptr)
+        return;
+
+    switch (e->get_type()) {
+        case TrackerType::TrackerMap: {
+            auto& t = tally[e->get_id()];
+            t.first++;
+
+            for (auto i : *(std::static_pointer_cast<TrackerElementMap>(e))) {
+                auto& c = t.second[i.first];
+
+                if (i.second != nullptr) {
+                    c++;
+                    field_population_walk(i.second, tally);
+                }
+            }
+            break;
+        }
+        case TrackerType::TrackerVector:
+            for (auto i : *(std::static_pointer_cast<TrackerElementVector>(e)))
+                field_population_walk(i, tally);
+            break;
+        case TrackerType::TrackerIntMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementIntMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        case TrackerType::TrackerHashkeyMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementHashkeyMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        case TrackerType::TrackerDoubleMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        case TrackerType::TrackerMacMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementMacMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        case TrackerType::TrackerStringMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementStringMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        case TrackerType::TrackerKeyMap:
+            for (auto i : *(std::static_pointer_cast<TrackerElementDeviceKeyMap>(e)))
+                field_population_walk(i.second, tally);
+            break;
+        default:
+            break;
+    }
+}
+
+std::shared_ptr<TrackerElement> Devicetracker::field_population_endp_handler() {
+    std::map<int, std::pair<uint64_t, std::map<int, uint64_t>>> tally;
+    uint64_t num_devices = 0;
+    kis_recursive_timed_mutex tally_mutex;
+
+    auto worker = 
+        std::make_shared<devicetracker_function_worker>(
+                [&](Devicetracker *, std::shared_ptr<kis_tracked_device_base> dev) -> bool {
+                    local_locker l(&tally_mutex);
+                    num_devices++;
+                    field_population_walk(dev, tally);
+                    return false;
+                }, nullptr);
+
+    MatchOnReadonlyDevices(worker);
+
+    auto ret_map = std::make_shared<TrackerElementStringMap>();
+    auto components = std::make_shared<TrackerElementStringMap>();
+
+    ret_map->insert("devices", std::make_shared<TrackerElementUInt64>(0, num_devices));
+    ret_map->insert("components", components);
+
+    for (auto t : tally) {
+        auto component = std::make_shared<TrackerElementStringMap>();
+        auto fields = std::make_shared<TrackerElementStringMap>();
+
+        component->insert("instances", std::make_shared<TrackerElementUInt64>(0, t.second.first));
+        component->insert("fields", fields);
+
+        for (auto f : t.second.second) 
+            fields->insert(entrytracker->GetFieldName(f.first),
+                    std::make_shared<TrackerElementUInt64>(0, f.second));
+
+        components->insert(entrytracker->GetFieldName(t.first), component);
+    }
+
+    return ret_map;
+}
+
+bool Devicetracker::delta_endp_path(const std::vector<std::string>& path) {
+    // /devices/delta/[generation]/devices
+
+    if (path.size() != 4)
+        return false;
+
+    if (path[0] != "devices" || path[1] != "delta" || path[3] != "devices")
+        return false;
+
+    try {
+        StringTo<uint64_t>(path[2]);
+    } catch (const std::exception& e) {
+        return false;
+    }
+
+    return true;
+}
+
+// A delta record holds the live fields of a device rather than copies, so it locks the
+// device around serialization the same way serializing the device itself does
+class devicetracker_delta_record : public TrackerElementMap {
+public:
+    devicetracker_delta_record(int in_id, std::shared_ptr<kis_tracked_device_base> in_device) :
+        TrackerElementMap(in_id),
+        device(in_device) { }
+
+    virtual void pre_serialize() override {
+        device->pre_serialize();
+    }
+
+    virtual void post_serialize() override {
+        device->post_serialize();
+    }
+
+protected:
+    std::shared_ptr<kis_tracked_device_base> device;
+};
+
+std::shared_ptr<TrackerElementMap> Devicetracker::build_device_delta(
+        std::shared_ptr<kis_tracked_device_base> in_device, uint64_t in_since,
+        std::shared_ptr<TrackerElementProjection> in_projection,
+        std::shared_ptr<TrackerElementSerializer::rename_map> in_rename_map) {
+
+    std::vector<SharedTrackerElement> fields;
+
+    // Too new or too long ago to describe as a delta, send the whole device
+    bool full = !in_device->get_changed_fields(in_since, fields);
+
+    if (!full && fields.size() == 0)
+        return nullptr;
+
+    auto delta = std::make_shared<devicetracker_delta_record>(delta_device_id, in_device);
+
+    delta->insert(std::make_shared<TrackerElementUInt8>(delta_full_id, full));
+    delta->insert(in_device->get_tracker_key());
+
+    if (in_projection != nullptr && in_projection->get_summarization().size() != 0) {
+        if (full) {
+            in_projection->summarize_into(in_device, delta, in_rename_map, nullptr);
+        } else {
+            std::unordered_set<int> changed;
+
+            for (auto f : fields)
+                changed.insert(f->get_id());
+
+            in_projection->summarize_into(in_device, delta, in_rename_map,
+                    [&changed](int id) -> bool {
+                        return changed.find(id) != changed.end();
+                    });
+        }
+
+        return delta;
+    }
+
+    if (full) {
+        for (auto f : *in_device) {
+            if (f.second != nullptr)
+                delta->insert(f.second);
+        }
+    } else {
+        for (auto f : fields)
+            delta->insert(f);
+    }
+
+    return delta;
+}
+
+bool Devicetracker::fetch_removed_devices(uint64_t in_since, std::vector<device_key>& out_keys) {
+    local_shared_locker listlocker(&devicelist_mutex);
+
+    // A client starting from generation 0 has no devices to remove
+    if (in_since == 0)
+        return true;
+
+    auto ri = std::lower_bound(removed_devices.begin(), removed_devices.end(), in_since,
+            [](const std::pair<uint64_t, device_key>& r, uint64_t g) -> bool {
+                return r.first < g;
+            });
+
+    for (; ri != removed_devices.end(); ++ri)
+        out_keys.push_back(ri->second);
+
+    return in_since > removed_lost_generation;
+}
+
+std::shared_ptr<TrackerElement> Devicetracker::delta_endp_handler(const std::vector<std::string>& path) {
+    auto since = StringTo<uint64_t>(path[2], 0);
+
+    // Generations advance on a timer, not per request, so every client shares them; 
+    // the generation we hand back is the current one, so changes made later in it are
+    // sent again next time rather than lost
+    auto generation = kis_tracked_device_base::current_generation();
+
+    auto ret = std::make_shared<TrackerElementMap>();
+    auto devices = std::make_shared<TrackerElementVector>(delta_devices_id);
+
+    ret->insert(std::make_shared<TrackerElementUInt64>(delta_generation_id, generation));
+    ret->insert(devices);
+
+    // Devices sent in this delta; a device removed and then seen again is sent whole
+    // and not reported as removed
+    std::unordered_set<device_key> sent_keys;
+
+    for (auto d : *fetch_device_snapshot()) {
+        local_shared_locker devlocker(&(d->device_mutex));
+
+        if (d->get_change_generation() < since)
+            continue;
+
+        auto delta = build_device_delta(d, since, nullptr, nullptr);
+
+        if (delta == nullptr)
+            continue;
+
+        devices->push_back(delta);
+        sent_keys.insert(d->get_key());
+    }
+
+    // Devices which have expired, been trimmed, or moved to cold storage since the
+    // requested generation
+    auto removed = std::make_shared<TrackerElementVector>(delta_removed_id);
+    ret->insert(removed);
+
+    std::vector<device_key> removed_keys;
+    bool complete = fetch_removed_devices(since, removed_keys);
+
+    ret->insert(std::make_shared<TrackerElementUInt8>(delta_removed_complete_id, complete));
+
+    for (const auto& rk : removed_keys) {
+        if (sent_keys.find(rk) != sent_keys.end())
+            continue;
+
+        auto k = std::make_shared<TrackerElementDeviceKey>(delta_removed_key_id);
+        k->set(rk);
+        removed->push_back(k);
+    }
+
+    return ret;
+}
+
+bool Devicetracker::index_endp_path(const std::vector<std::string>& path) {
+    // /devices/index/[attribute]/[value]/devices
+
+    if (path.size() != 5)
+        return false;
+
+    if (path[0] != "devices" || path[1] != "index" || path[4] != "devices")
+        return false;
+
+    return true;
+}
+
+std::shared_ptr<TrackerElement> Devicetracker::index_endp_handler(const std::vector<std::string>& path) {
+    auto ret = std::make_shared<TrackerElementVector>();
+
+    std::vector<std::shared_ptr<kis_tracked_device_base>> devs;
+
+    if (FetchIndexedDevices(path[2], path[3], devs)) {
+        for (auto d : devs)
+            ret->push_back(d);
+
+        return ret;
+    }
+
+    // Not an indexed attribute; fall back to matching the field of the same name
+    // against every device
+    auto attribute = path[2];
+    auto value = path[3];
+
+    auto worker = std::make_shared<devicetracker_function_worker>(
+            [attribute, value](Devicetracker *, std::shared_ptr<kis_tracked_device_base> d) -> bool {
+                auto f = d->get_child_path(attribute);
+
+                if (f == nullptr || f->get_type() != TrackerType::TrackerString)
+                    return false;
+
+                return GetTrackerValue<std::string>(f) == value;
+            }, nullptr);
+
+    MatchOnReadonlyDevices(worker);
+
+    return worker->GetMatchedDevices();
+}
@@ -47,7 +47,7 @@ bool Devicetracker_Httpd_Pcap::Httpd_VerifyPath(const char *path, const char *me
         if (key.get_error())
             return false;
 
-        if (devicetracker->FetchDevice(key) == NULL)
+        if (!devicetracker->device_key_known(key))
             return false;
 
         std::string keyurl = tokenurl[3] + ".pcapng";
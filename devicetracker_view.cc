@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include "devicetracker.h"
 #include "devicetracker_view.h"
 #include "devicetracker_component.h"
 #include "util.h"
@@ -57,6 +58,10 @@ DevicetrackerView::DevicetrackerView(const std::string& in_id, const std::string
                 [this](const std::vector<std::string>& path) -> std::shared_ptr<TrackerElement> {
                     return device_time_endpoint(path);
                 });
+
+    stream_endp =
+        std::make_shared<DevicetrackerViewStream>(this, 
+                std::vector<std::string>{fmt::format("/devices/views/{}/stream", in_id)});
 }
 
 DevicetrackerView::DevicetrackerView(const std::string& in_id, const std::string& in_description,
@@ -97,14 +102,20 @@ DevicetrackerView::DevicetrackerView(const std::string& in_id, const std::string
                     return device_time_endpoint(path);
                 });
 
-    if (in_aux_path.size() == 0)
-        return;
-
     // Concatenate the alternate endpoints and register the same endpoint handlers
     std::stringstream ss;
     for (auto i : in_aux_path)
         ss << i << "/";
 
+    auto stream_uris = std::vector<std::string>{fmt::format("/devices/views/{}/stream", in_id)};
+    if (in_aux_path.size() != 0)
+        stream_uris.push_back(fmt::format("/devices/views/{}stream", ss.str()));
+
+    stream_endp = std::make_shared<DevicetrackerViewStream>(this, stream_uris);
+
+    if (in_aux_path.size() == 0)
+        return;
+
     uri = fmt::format("/devices/views/{}devices", ss.str());
     device_uri_endp =
         std::make_shared<Kis_Net_Httpd_Simple_Post_Endpoint>(uri, false,
@@ -124,26 +135,43 @@ DevicetrackerView::DevicetrackerView(const std::string& in_id, const std::string
     
 }
 
-std::shared_ptr<TrackerElementVector> DevicetrackerView::doDeviceWork(DevicetrackerViewWorker& worker) {
-    // Make a copy of the vector
-    std::shared_ptr<TrackerElementVector> immutable_copy;
-    {
-        local_shared_locker dl(&mutex);
-        immutable_copy = std::make_shared<TrackerElementVector>(device_list);
+std::shared_ptr<TrackerElementVector> DevicetrackerView::fetch_work_devices(DevicetrackerViewWorker& worker) {
+    if (worker.get_index_attribute().length() != 0) {
+        auto devicetracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+        std::vector<std::shared_ptr<kis_tracked_device_base>> indexed;
+
+        if (devicetracker->FetchIndexedDevices(worker.get_index_attribute(), 
+                    worker.get_index_value(), indexed)) {
+            // The index is unordered; keep windowed requests stable across calls
+            std::sort(indexed.begin(), indexed.end(),
+                    [](const std::shared_ptr<kis_tracked_device_base>& a,
+                        const std::shared_ptr<kis_tracked_device_base>& b) -> bool {
+                    return a->get_kis_internal_id() < b->get_kis_internal_id();
+                    });
+
+            auto ret = std::make_shared<TrackerElementVector>();
+
+            local_shared_locker dl(&mutex);
+
+            for (auto d : indexed) {
+                if (device_presence_map.find(d->get_key()) != device_presence_map.end())
+                    ret->push_back(d);
+            }
+
+            return ret;
+        }
     }
 
-    return doDeviceWork(worker, immutable_copy);
+    local_shared_locker dl(&mutex);
+    return std::make_shared<TrackerElementVector>(device_list);
 }
 
-std::shared_ptr<TrackerElementVector> DevicetrackerView::doReadonlyDeviceWork(DevicetrackerViewWorker& worker) {
-    // Make a copy of the vector
-    std::shared_ptr<TrackerElementVector> immutable_copy;
-    {
-        local_shared_locker dl(&mutex);
-        immutable_copy = std::make_shared<TrackerElementVector>(device_list);
-    }
+std::shared_ptr<TrackerElementVector> DevicetrackerView::doDeviceWork(DevicetrackerViewWorker& worker) {
+    return doDeviceWork(worker, fetch_work_devices(worker));
+}
 
-    return doReadonlyDeviceWork(worker, immutable_copy);
+std::shared_ptr<TrackerElementVector> DevicetrackerView::doReadonlyDeviceWork(DevicetrackerViewWorker& worker) {
+    return doReadonlyDeviceWork(worker, fetch_work_devices(worker));
 }
 
 std::shared_ptr<TrackerElementVector> DevicetrackerView::doDeviceWork(DevicetrackerViewWorker& worker,
@@ -218,6 +246,7 @@ void DevicetrackerView::newDevice(std::shared_ptr<kis_tracked_device_base> devic
             if (dpmi == device_presence_map.end()) {
                 device_presence_map[device->get_key()] = true;
                 device_list->push_back(device);
+                stream_endp->device_entered(device);
             }
 
             list_sz->set(device_list->size());
@@ -241,6 +270,7 @@ void DevicetrackerView::updateDevice(std::shared_ptr<kis_tracked_device_base> de
         if (retain && dpmi == device_presence_map.end()) {
             device_list->push_back(device);
             device_presence_map[device->get_key()] = true;
+            stream_endp->device_entered(device);
             list_sz->set(device_list->size());
             return;
         }
@@ -256,6 +286,7 @@ void DevicetrackerView::updateDevice(std::shared_ptr<kis_tracked_device_base> de
             }
             device_presence_map.erase(dpmi);
             list_sz->set(device_list->size());
+            stream_endp->device_left(device);
             return;
         }
     }
@@ -277,6 +308,7 @@ void DevicetrackerView::removeDevice(std::shared_ptr<kis_tracked_device_base> de
         }
         
         list_sz->set(device_list->size());
+        stream_endp->device_left(device);
     }
 }
 
@@ -292,6 +324,7 @@ void DevicetrackerView::addDeviceDirect(std::shared_ptr<kis_tracked_device_base>
     device_list->push_back(device);
 
     list_sz->set(device_list->size());
+    stream_endp->device_entered(device);
 }
 
 void DevicetrackerView::removeDeviceDirect(std::shared_ptr<kis_tracked_device_base> device) {
@@ -310,6 +343,7 @@ void DevicetrackerView::removeDeviceDirect(std::shared_ptr<kis_tracked_device_ba
         }
         
         list_sz->set(device_list->size());
+        stream_endp->device_left(device);
     }
 }
 
@@ -438,8 +472,8 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
     // The device worker creates an immutable copy of the device list under its own RO mutex,
     // so we don't have to lock here.
 
-    // Summarization vector based on simplification part of shared data
-    auto summary_vec = std::vector<SharedElementSummary>{};
+    // Compiled summarization based on simplification part of shared data
+    auto projection = std::shared_ptr<TrackerElementProjection>{};
 
     // Rename cache generated by summarization
     auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
@@ -482,29 +516,7 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
     try {
         // If the structured component has a 'fields' record, derive the fields
         // simplification
-        if (structured->hasKey("fields")) {
-            auto fields = structured->getStructuredByKey("fields");
-            auto fvec = fields->getStructuredArray();
-
-            for (const auto& i : fvec) {
-                if (i->isString()) {
-                    auto s = std::make_shared<TrackerElementSummary>(i->getString());
-                    summary_vec.push_back(s);
-                } else if (i->isArray()) {
-                    auto mapvec = i->getStringVec();
-
-                    if (mapvec.size() != 2)
-                        throw StructuredDataException("Invalid field mapping, expected "
-                                "[field, rename]");
-
-                    auto s = std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]);
-                    summary_vec.push_back(s);
-                } else {
-                    throw StructuredDataException("Invalid field mapping, expected "
-                            "field or [field,rename]");
-                }
-            }
-        }
+        projection = kishttpd::ProjectionWithStructured(structured);
 
         // Capture timestamp and negative-offset timestamp
         int64_t raw_ts = structured->getKeyAsNumber("last_time", 0);
@@ -553,8 +565,8 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
                 *(postvars["search[value]"]) >> search_term;
 
             // Search every field we return
-            if (search_term.length() != 0) 
-                for (const auto& svi : summary_vec)
+            if (search_term.length() != 0 && projection != nullptr) 
+                for (const auto& svi : projection->get_summarization())
                     search_paths.push_back(svi->resolved_path);
 
             // We only allow ordering by a single column, we don't do sub-ordering;
@@ -610,13 +622,31 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
         return 400;
     }
 
+    // Compile the regex filter up front, so a filter on an indexed field can start from
+    // only the devices filed under it
+    std::shared_ptr<DevicetrackerViewRegexWorker> regex_worker;
+
+    if (regex != nullptr) {
+        try {
+            regex_worker = std::make_shared<DevicetrackerViewRegexWorker>(regex);
+        } catch (const std::exception& e) {
+            stream << "Invalid regex: " << e.what() << "\n";
+            return 400;
+        }
+    }
+
     // Next vector we do work on
     auto next_work_vec = std::make_shared<TrackerElementVector>();
 
     // Copy the entire vector list, under lock, to the next work vector; this makes it an independent copy
     // which is protected from the main vector being grown/shrank.  While we're in there, log the total
     // size of the original vector for windowed ops.
-    {
+    if (regex_worker != nullptr) {
+        next_work_vec = fetch_work_devices(*regex_worker);
+
+        local_shared_locker l(&mutex);
+        total_sz_elem->set(device_list->size());
+    } else {
         local_locker l(&mutex);
         next_work_vec->set(device_list->begin(), device_list->end());
         total_sz_elem->set(next_work_vec->size());
@@ -645,16 +675,9 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
     }
 
     // Apply a regex filter
-    if (regex != nullptr) {
-        try {
-            auto worker = 
-                DevicetrackerViewRegexWorker(regex);
-            auto r_vec = doReadonlyDeviceWork(worker, next_work_vec);
-            next_work_vec->set(r_vec->begin(), r_vec->end());
-        } catch (const std::exception& e) {
-            stream << "Invalid regex: " << e.what() << "\n";
-            return 400;
-        }
+    if (regex_worker != nullptr) {
+        auto r_vec = doReadonlyDeviceWork(*regex_worker, next_work_vec);
+        next_work_vec->set(r_vec->begin(), r_vec->end());
     }
 
     // Apply the filtered length
@@ -701,11 +724,11 @@ unsigned int DevicetrackerView::device_endpoint_handler(std::ostream& stream,
             });
     }
 
-    // Summarize into the output element
-    for (auto i = si; i != ei; ++i) {
-        auto simple = SharedTrackerElement{};
-        output_devices_elem->push_back(SummarizeSingleTrackerElement(*i, summary_vec, rename_map));
-    }
+    // Copy into the output element; devices are projected as they're serialized
+    output_devices_elem->set(si, ei);
+
+    if (projection != nullptr)
+        projection->mark(output_devices_elem, rename_map);
 
     // If the transmit wasn't assigned to a wrapper...
     if (transmit == nullptr)
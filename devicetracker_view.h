@@ -29,6 +29,7 @@
 #include "trackedcomponent.h"
 #include "devicetracker_component.h"
 #include "devicetracker_view_workers.h"
+#include "devicetracker_view_stream.h"
 
 // Common view holder mechanism which handles view endpoints, view filtering, and so on.
 //
@@ -47,6 +48,9 @@
 //
 // Main device sorting/filtering/datatables view lives under:
 // /devices/view/[view id]/devices.json
+//
+// Changes to the devices in a view are pushed as server-sent events from:
+// /devices/views/[view id]/stream.json
 
 class kis_tracked_device;
 class DevicetrackerView;
@@ -77,6 +81,10 @@ public:
             new_device_cb in_new_cb, updated_device_cb in_upd_cb);
 
     virtual ~DevicetrackerView() {
+        // Close the push streams first; a batch in progress works on our device list
+        if (stream_endp != nullptr)
+            stream_endp->shutdown();
+
         local_locker l(&mutex);
     }
 
@@ -145,6 +153,11 @@ protected:
     // Map of device presence in our list for fast referece during updates
     std::map<device_key, bool> device_presence_map;
 
+    // Independent copy of the devices a worker has to examine; only the devices of this view
+    // the device index files under the worker's index hint, when it has one and the index
+    // is available, otherwise the whole list
+    std::shared_ptr<TrackerElementVector> fetch_work_devices(DevicetrackerViewWorker& worker);
+
     // Complex endpoint and optional extended URI endpoint
     std::shared_ptr<Kis_Net_Httpd_Simple_Post_Endpoint> device_endp;
     std::shared_ptr<Kis_Net_Httpd_Simple_Post_Endpoint> device_uri_endp;
@@ -153,6 +166,9 @@ protected:
     std::shared_ptr<Kis_Net_Httpd_Path_Tracked_Endpoint> time_endp;
     std::shared_ptr<Kis_Net_Httpd_Path_Tracked_Endpoint> time_uri_endp;
 
+    // Push stream of device changes, on the main and extended URIs
+    std::shared_ptr<DevicetrackerViewStream> stream_endp;
+
     // Complex post endp handler
     unsigned int device_endpoint_handler(std::ostream& stream, const std::string& uri, 
             SharedStructured structured, 
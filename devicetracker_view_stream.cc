@@ -0,0 +1,530 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <sstream>
+
+#include "devicetracker_view_stream.h"
+#include "devicetracker.h"
+#include "devicetracker_view.h"
+#include "entrytracker.h"
+#include "kismet_json.h"
+#include "messagebus.h"
+#include "timetracker.h"
+
+DevicetrackerViewStream::DevicetrackerViewStream(DevicetrackerView *in_view,
+        const std::vector<std::string>& in_uris) :
+    Kis_Net_Httpd_Chain_Stream_Handler {},
+    uris {in_uris},
+    view {in_view} {
+
+    for (const auto& u : uris)
+        Bind_Httpd_Route(u);
+}
+
+DevicetrackerViewStream::~DevicetrackerViewStream() {
+    // Connections are closed by shutdown; by now only the timers are left
+    auto timetracker = Globalreg::FetchGlobalAs<Timetracker>();
+
+    if (timetracker == nullptr)
+        return;
+
+    local_locker l(&mutex);
+
+    for (auto si : subscriptions)
+        timetracker->RemoveTimer(si.second->timer_id);
+}
+
+void DevicetrackerViewStream::shutdown() {
+    auto timetracker = Globalreg::FetchGlobalAs<Timetracker>();
+
+    {
+        local_locker l(&mutex);
+
+        for (auto si : subscriptions) {
+            if (timetracker != nullptr)
+                timetracker->RemoveTimer(si.second->timer_id);
+
+            {
+                local_locker ml(&membership_mutex);
+                membership_subscriptions.remove(si.second);
+            }
+
+            // Ending the stream frees the connection, which unsubscribes it
+            local_locker sl(&si.second->mutex);
+            for (auto c : si.second->subscribers)
+                c->aux->trigger_error();
+        }
+
+        subscriptions.clear();
+    }
+
+    // Wait for any batch still using the view
+    local_locker vl(&view_mutex);
+    view = nullptr;
+}
+
+void DevicetrackerViewStream::device_entered(std::shared_ptr<kis_tracked_device_base> device) {
+    local_locker l(&membership_mutex);
+
+    for (auto sub : membership_subscriptions) {
+        sub->left.erase(device->get_key());
+        sub->entered.insert(device->get_key());
+    }
+}
+
+void DevicetrackerViewStream::device_left(std::shared_ptr<kis_tracked_device_base> device) {
+    local_locker l(&membership_mutex);
+
+    for (auto sub : membership_subscriptions) {
+        sub->entered.erase(device->get_key());
+        sub->left.insert(device->get_key());
+    }
+}
+
+bool DevicetrackerViewStream::Httpd_VerifyPath(const char *path, const char *method) {
+    if (strcmp(method, "GET") != 0 && strcmp(method, "POST") != 0)
+        return false;
+
+    // Events are text, so only the json serializers can be streamed
+    auto suffix = kishttpd::GetSuffix(path);
+
+    if (suffix != "json" && suffix != "ekjson")
+        return false;
+
+    auto stripped = kishttpd::StripSuffix(path);
+
+    for (const auto& u : uris) {
+        if (stripped == u)
+            return true;
+    }
+
+    return false;
+}
+
+int DevicetrackerViewStream::Httpd_HandleGetRequest(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, const char *method, const char *upload_data,
+        size_t *upload_data_size) {
+
+    if (connection != nullptr)
+        connection->content_type = "text/event-stream";
+
+    return Kis_Net_Httpd_Chain_Stream_Handler::Httpd_HandleGetRequest(httpd, connection,
+            url, method, upload_data, upload_data_size);
+}
+
+int DevicetrackerViewStream::Httpd_HandlePostRequest(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, const char *method, const char *upload_data,
+        size_t *upload_data_size) {
+
+    if (connection != nullptr)
+        connection->content_type = "text/event-stream";
+
+    return Kis_Net_Httpd_Chain_Stream_Handler::Httpd_HandlePostRequest(httpd, connection,
+            url, method, upload_data, upload_data_size);
+}
+
+int DevicetrackerViewStream::Httpd_CreateStreamResponse(
+        Kis_Net_Httpd *httpd __attribute__((unused)),
+        Kis_Net_Httpd_Connection *connection,
+        const char *url __attribute__((unused)),
+        const char *method __attribute__((unused)),
+        const char *upload_data __attribute__((unused)),
+        size_t *upload_data_size __attribute__((unused))) {
+
+    // GET subscriptions pass the json dictionary as a url argument
+    return Httpd_PostComplete(connection);
+}
+
+int DevicetrackerViewStream::Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) {
+    SharedStructured structdata;
+
+    try {
+        if (concls->variable_cache.find("json") != concls->variable_cache.end()) {
+            structdata =
+                std::make_shared<StructuredJson>(concls->variable_cache["json"]->str());
+        } else {
+            structdata =
+                std::make_shared<StructuredJson>(std::string{"{}"});
+        }
+    } catch (const std::exception& e) {
+        auto saux = (Kis_Net_Httpd_Buffer_Stream_Aux *) concls->custom_extension;
+        saux->get_rbhandler()->PutWriteBufferData(format_event("error",
+                    fmt::format("Invalid request: {}", e.what())));
+        return MHD_YES;
+    }
+
+    return subscribe(concls, structdata);
+}
+
+int DevicetrackerViewStream::subscribe(Kis_Net_Httpd_Connection *connection,
+        SharedStructured structured) {
+    auto saux = (Kis_Net_Httpd_Buffer_Stream_Aux *) connection->custom_extension;
+    auto rbh = saux->get_rbhandler();
+
+    std::shared_ptr<TrackerElementProjection> projection;
+    double raw_cadence;
+
+    try {
+        projection = kishttpd::ProjectionWithStructured(structured);
+        raw_cadence = structured->getKeyAsNumber("cadence", min_cadence);
+    } catch (const StructuredDataException& e) {
+        rbh->PutWriteBufferData(format_event("error",
+                    fmt::format("Invalid request: {}", e.what())));
+        return MHD_YES;
+    }
+
+    // Clamp before converting; negative or out of range values don't convert
+    if (!(raw_cadence >= min_cadence))
+        raw_cadence = min_cadence;
+    else if (raw_cadence > max_cadence)
+        raw_cadence = max_cadence;
+
+    auto cadence = static_cast<unsigned int>(raw_cadence);
+
+    // Compiled projections are cached by the fields requested, so the same fields
+    // resolve to the same projection
+    auto format = kishttpd::GetSuffix(connection->url);
+    auto shape = fmt::format("{}/{}/{}", format, cadence, (void *) projection.get());
+
+    auto client = std::make_shared<subscriber>(saux);
+    std::shared_ptr<subscription> sub;
+
+    {
+        local_locker l(&mutex);
+
+        auto si = subscriptions.find(shape);
+
+        if (si != subscriptions.end()) {
+            sub = si->second;
+        } else {
+            sub = std::make_shared<subscription>(shape, format, projection, cadence);
+            sub->generation = kis_tracked_device_base::current_generation();
+
+            auto timetracker = Globalreg::FetchMandatoryGlobalAs<Timetracker>();
+            auto weak_self = std::weak_ptr<DevicetrackerViewStream>(shared_from_this());
+            auto weak_sub = std::weak_ptr<subscription>(sub);
+
+            sub->timer_id =
+                timetracker->RegisterTimer(SERVER_TIMESLICES_SEC * cadence, NULL, 1,
+                        [weak_self, weak_sub](int) -> int {
+                            auto self = weak_self.lock();
+                            auto sub = weak_sub.lock();
+
+                            if (self != nullptr && sub != nullptr)
+                                self->queue_batch(sub);
+
+                            return 1;
+                        });
+
+            subscriptions[shape] = sub;
+
+            local_locker ml(&membership_mutex);
+            membership_subscriptions.push_back(sub);
+        }
+
+        local_locker sl(&sub->mutex);
+        sub->subscribers.push_back(client);
+    }
+
+    // Closing the connection unsubscribes; the stream and subscription may be gone by then
+    auto weak_self = std::weak_ptr<DevicetrackerViewStream>(shared_from_this());
+    auto weak_sub = std::weak_ptr<subscription>(sub);
+    auto weak_client = std::weak_ptr<subscriber>(client);
+
+    saux->set_aux(nullptr,
+            [weak_self, weak_sub, weak_client](Kis_Net_Httpd_Buffer_Stream_Aux *) {
+                auto self = weak_self.lock();
+
+                if (self != nullptr)
+                    self->unsubscribe(weak_sub, weak_client);
+            });
+
+    // Send the snapshot under the subscription lock, so that no batch built before it
+    // can follow it
+    local_locker sl(&sub->mutex);
+    local_locker vl(&view_mutex);
+
+    if (view == nullptr) {
+        rbh->PutWriteBufferData(format_event("error", "View closed"));
+        return MHD_YES;
+    }
+
+    auto devices = view_devices([](std::shared_ptr<kis_tracked_device_base>) -> bool {
+            return true;
+            });
+
+    rbh->PutWriteBufferData(serialize_event("snapshot", sub, devices));
+    client->primed = true;
+
+    // Keep the stream open; batches are written to it until the client goes away
+    return MHD_NO;
+}
+
+void DevicetrackerViewStream::unsubscribe(std::weak_ptr<subscription> in_sub,
+        std::weak_ptr<subscriber> in_client) {
+    auto sub = in_sub.lock();
+    auto client = in_client.lock();
+
+    if (sub == nullptr || client == nullptr)
+        return;
+
+    local_locker l(&mutex);
+    local_locker sl(&sub->mutex);
+
+    sub->subscribers.remove(client);
+
+    if (sub->subscribers.size() != 0)
+        return;
+
+    auto timetracker = Globalreg::FetchGlobalAs<Timetracker>();
+
+    if (timetracker != nullptr)
+        timetracker->RemoveTimer(sub->timer_id);
+
+    {
+        local_locker ml(&membership_mutex);
+        membership_subscriptions.remove(sub);
+    }
+
+    auto si = subscriptions.find(sub->shape);
+
+    if (si != subscriptions.end() && si->second == sub)
+        subscriptions.erase(si);
+}
+
+void DevicetrackerViewStream::queue_batch(std::shared_ptr<subscription> sub) {
+    // Don't pile up batches behind one which is still running
+    bool expected = false;
+    if (!sub->batch_pending.compare_exchange_strong(expected, true))
+        return;
+
+    auto weak_self = std::weak_ptr<DevicetrackerViewStream>(shared_from_this());
+
+    httpd->FetchGeneratorPool()->submit([weak_self, sub]() {
+            auto self = weak_self.lock();
+
+            if (self != nullptr) {
+                try {
+                    self->send_batch(sub);
+                } catch (const std::exception& e) {
+                    _MSG_ERROR("Failed to send device view stream batch: {}", e.what());
+                }
+            }
+
+            sub->batch_pending = false;
+        });
+}
+
+void DevicetrackerViewStream::send_batch(std::shared_ptr<subscription> sub) {
+    local_locker sl(&sub->mutex);
+    local_locker vl(&view_mutex);
+
+    if (view == nullptr)
+        return;
+
+    std::set<device_key> entered, left;
+
+    {
+        local_locker ml(&membership_mutex);
+        entered.swap(sub->entered);
+        left.swap(sub->left);
+    }
+
+    // The generation we continue from is the current one, so changes made later in it
+    // are sent again next batch rather than lost
+    auto since = sub->generation;
+    sub->generation = kis_tracked_device_base::current_generation();
+
+    // Devices removed from the tracker since the previous batch, as well as those which
+    // left the view; keys of devices a client never had are ignored by it.  Removals
+    // too old to still be remembered have already been reported by earlier batches.
+    std::vector<device_key> removed_keys;
+    auto devicetracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+    devicetracker->fetch_removed_devices(since, removed_keys);
+
+    left.insert(removed_keys.begin(), removed_keys.end());
+
+    // A device which came back is sent whole rather than removed
+    for (const auto& k : entered)
+        left.erase(k);
+
+    // Changes are read under the lock of each device, so the view is only copied here
+    auto devices = view_devices([](std::shared_ptr<kis_tracked_device_base>) -> bool {
+            return true;
+            });
+
+    // Serialized once, the first time a subscriber takes them
+    std::string event, removed_event;
+    bool event_built = false;
+
+    if (left.size() != 0) {
+        auto keys = std::make_shared<TrackerElementVector>();
+
+        for (const auto& k : left) {
+            auto ke = std::make_shared<TrackerElementDeviceKey>();
+            ke->set(k);
+            keys->push_back(ke);
+        }
+
+        std::stringstream ss;
+        Globalreg::globalreg->entrytracker->Serialize(sub->format, ss, keys, nullptr);
+        removed_event = format_event("removed", ss.str());
+    }
+
+    const std::string keepalive = ": keepalive\n\n";
+
+    for (auto c : sub->subscribers) {
+        if (!c->primed)
+            continue;
+
+        // Removals are small and always sent, even to clients which are behind; a
+        // device they missed which has since left is simply not in their catch-up
+        if (removed_event.length() != 0)
+            c->rbh->PutWriteBufferData(removed_event);
+
+        // Too far behind; skip this batch, and send everything which changed since
+        // once the client catches up
+        if (c->rbh->GetWriteBufferUsed() > max_backlog) {
+            if (c->missed_since == 0)
+                c->missed_since = since;
+
+            c->missed_entered.insert(entered.begin(), entered.end());
+
+            continue;
+        }
+
+        if (c->missed_since != 0) {
+            c->missed_entered.insert(entered.begin(), entered.end());
+
+            auto catchup = serialize_delta_event(sub, devices, c->missed_since, c->missed_entered);
+
+            c->missed_since = 0;
+            c->missed_entered.clear();
+
+            if (catchup.length() != 0)
+                c->rbh->PutWriteBufferData(catchup);
+            else if (removed_event.length() == 0)
+                c->rbh->PutWriteBufferData(keepalive);
+
+            continue;
+        }
+
+        if (!event_built) {
+            event = serialize_delta_event(sub, devices, since, entered);
+            event_built = true;
+        }
+
+        if (event.length() == 0) {
+            // Writing is the only way to find out a suspended client has gone away
+            if (removed_event.length() == 0)
+                c->rbh->PutWriteBufferData(keepalive);
+
+            continue;
+        }
+
+        c->rbh->PutWriteBufferData(event);
+    }
+}
+
+std::string DevicetrackerViewStream::serialize_delta_event(std::shared_ptr<subscription> sub,
+        std::shared_ptr<TrackerElementVector> devices, uint64_t in_since,
+        const std::set<device_key>& in_entered) {
+    auto devicetracker = Globalreg::FetchMandatoryGlobalAs<Devicetracker>();
+    auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
+    auto deltas = std::make_shared<TrackerElementVector>();
+
+    for (auto d : *devices) {
+        auto dev = std::static_pointer_cast<kis_tracked_device_base>(d);
+
+        local_shared_locker devlocker(&(dev->device_mutex));
+
+        // Devices new to the view are sent whole
+        uint64_t dev_since = in_since;
+
+        if (in_entered.find(dev->get_key()) != in_entered.end())
+            dev_since = 0;
+        else if (dev->get_change_generation() < in_since)
+            continue;
+
+        auto delta = devicetracker->build_device_delta(dev, dev_since, sub->projection,
+                rename_map);
+
+        if (delta != nullptr)
+            deltas->push_back(delta);
+    }
+
+    if (deltas->size() == 0)
+        return "";
+
+    std::stringstream ss;
+    Globalreg::globalreg->entrytracker->Serialize(sub->format, ss, deltas, rename_map);
+
+    return format_event("devices", ss.str());
+}
+
+std::shared_ptr<TrackerElementVector> DevicetrackerViewStream::view_devices(
+        std::function<bool (std::shared_ptr<kis_tracked_device_base>)> in_filter) {
+    auto worker = DevicetrackerViewFunctionWorker(in_filter);
+    return view->doReadonlyDeviceWork(worker);
+}
+
+std::string DevicetrackerViewStream::serialize_event(const std::string& in_event,
+        std::shared_ptr<subscription> sub, std::shared_ptr<TrackerElementVector> devices) {
+    auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
+
+    if (sub->projection != nullptr)
+        sub->projection->mark(devices, rename_map);
+
+    std::stringstream ss;
+    Globalreg::globalreg->entrytracker->Serialize(sub->format, ss, devices, rename_map);
+
+    return format_event(in_event, ss.str());
+}
+
+std::string DevicetrackerViewStream::format_event(const std::string& in_event,
+        const std::string& in_data) {
+    // Every line of the data is its own data field; the client joins them back
+    // together with newlines
+    std::string ret = fmt::format("event: {}\n", in_event);
+    size_t start = 0;
+
+    while (start < in_data.length()) {
+        auto end = in_data.find('\n', start);
+
+        if (end == std::string::npos)
+            end = in_data.length();
+
+        if (end > start) {
+            ret += "data: ";
+            ret.append(in_data, start, end - start);
+            ret += "\n";
+        }
+
+        start = end + 1;
+    }
+
+    ret += "\n";
+
+    return ret;
+}
+
@@ -0,0 +1,197 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __DEVICETRACKER_VIEW_STREAM_H__
+#define __DEVICETRACKER_VIEW_STREAM_H__
+
+#include "config.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "kis_mutex.h"
+#include "kis_net_microhttpd.h"
+#include "devicetracker_component.h"
+
+class DevicetrackerView;
+
+// Push stream of the devices in a view, sent as server-sent events.
+//
+// Clients subscribe with a GET or POST to /devices/views/[view id]/stream.json (or
+// .ekjson), optionally passing a json= dictionary with the standard 'fields'
+// simplification and a 'cadence' in seconds.  The current devices in the view are sent
+// once as a 'snapshot' event, followed by a 'devices' event every cadence holding the
+// devices which changed or entered the view since the previous one, and a 'removed'
+// event listing the keys of devices which left the view or the device tracker.  A
+// cadence with nothing to send sends a keepalive comment instead, so that clients
+// which went away are noticed.
+//
+// Devices in a 'devices' event are delta records, the same as those of the delta
+// endpoint:  the device key and only the fields which changed since the previous
+// batch, found from the change generations of the device, or the complete device
+// (flagged as full) when it entered the view or its changes can't be described as a
+// delta.  Requested fields limit a delta to the changed fields among them.
+//
+// Subscriptions of the same shape - format, fields, and cadence - share a single
+// batch:  the changed devices are found and serialized once per cadence, and the same
+// event is written to every subscriber.  A subscriber still holding more than
+// max_backlog of unsent data skips the batch; the generation it fell behind at is
+// remembered, and the next batch it has room for carries everything which changed
+// since.  Slow clients lose intermediate updates, never the latest state of a device.
+class DevicetrackerViewStream : public Kis_Net_Httpd_Chain_Stream_Handler,
+    public std::enable_shared_from_this<DevicetrackerViewStream> {
+public:
+    // Unsent data a subscriber can hold before it starts skipping batches
+    const static size_t max_backlog = 1024 * 1024;
+
+    // Cadence limits, in seconds
+    const static unsigned int min_cadence = 1;
+    const static unsigned int max_cadence = 3600;
+
+    DevicetrackerViewStream(DevicetrackerView *in_view, const std::vector<std::string>& in_uris);
+    virtual ~DevicetrackerViewStream();
+
+    // Close all subscribers and detach from the view; called by the view before it is
+    // destroyed, because a batch in progress may still hold a reference to us
+    void shutdown();
+
+    // Called by the view, under its own lock, as devices enter and leave it
+    void device_entered(std::shared_ptr<kis_tracked_device_base> device);
+    void device_left(std::shared_ptr<kis_tracked_device_base> device);
+
+    virtual bool Httpd_VerifyPath(const char *path, const char *method) override;
+
+    virtual int Httpd_HandleGetRequest(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size) override;
+    virtual int Httpd_HandlePostRequest(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size) override;
+
+    virtual int Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size) override;
+
+    virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *concls) override;
+
+protected:
+    struct subscriber {
+        subscriber(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux) :
+            aux {in_aux},
+            rbh {in_aux->get_rbhandler()},
+            primed {false},
+            missed_since {0} { }
+
+        Kis_Net_Httpd_Buffer_Stream_Aux *aux;
+        std::shared_ptr<BufferHandlerGeneric> rbh;
+
+        // Has the snapshot been sent?  Batches skip subscribers until it has
+        bool primed;
+
+        // Change generation of the first batch this subscriber skipped, or 0, and the
+        // devices which entered the view in the batches it skipped
+        uint64_t missed_since;
+        std::set<device_key> missed_entered;
+    };
+
+    struct subscription {
+        subscription(const std::string& in_shape, const std::string& in_format,
+                std::shared_ptr<TrackerElementProjection> in_projection,
+                unsigned int in_cadence) :
+            shape {in_shape},
+            format {in_format},
+            projection {in_projection},
+            cadence {in_cadence},
+            timer_id {-1},
+            generation {0},
+            batch_pending {false} { }
+
+        std::string shape;
+        std::string format;
+        std::shared_ptr<TrackerElementProjection> projection;
+        unsigned int cadence;
+
+        int timer_id;
+
+        // Change generation the next batch starts from; devices changed in it or
+        // since are sent
+        uint64_t generation;
+
+        // Is a batch queued or running on the pool?
+        std::atomic<bool> batch_pending;
+
+        // Held while building and sending a batch, and while adding subscribers
+        kis_recursive_timed_mutex mutex;
+        std::list<std::shared_ptr<subscriber>> subscribers;
+
+        // Devices which entered or left the view since the last batch; protected by
+        // the membership mutex of the stream rather than the subscription mutex,
+        // because they are recorded while the view holds its lock
+        std::set<device_key> entered;
+        std::set<device_key> left;
+    };
+
+    // Join a subscription of the requested shape, creating it if needed, and send the
+    // initial snapshot; returns MHD_YES if the request failed and the stream should end
+    int subscribe(Kis_Net_Httpd_Connection *connection, SharedStructured structured);
+    void unsubscribe(std::weak_ptr<subscription> in_sub, std::weak_ptr<subscriber> in_client);
+
+    void queue_batch(std::shared_ptr<subscription> sub);
+    void send_batch(std::shared_ptr<subscription> sub);
+
+    // Devices in the view matching a filter; view_mutex must be held
+    std::shared_ptr<TrackerElementVector> view_devices(
+            std::function<bool (std::shared_ptr<kis_tracked_device_base>)> in_filter);
+
+    // Serialize devices, through the projection of the subscription, as an event
+    std::string serialize_event(const std::string& in_event, std::shared_ptr<subscription> sub,
+            std::shared_ptr<TrackerElementVector> devices);
+
+    // Serialize the delta records of the devices which changed since a generation, and
+    // the complete records of those which entered the view, as a 'devices' event;
+    // returns an empty string if there are none
+    std::string serialize_delta_event(std::shared_ptr<subscription> sub,
+            std::shared_ptr<TrackerElementVector> devices, uint64_t in_since,
+            const std::set<device_key>& in_entered);
+    static std::string format_event(const std::string& in_event, const std::string& in_data);
+
+    std::vector<std::string> uris;
+
+    // Protects the view; shutdown clears it once no batch is using it
+    kis_recursive_timed_mutex view_mutex;
+    DevicetrackerView *view;
+
+    // Protects the subscription map; taken before the mutex of a subscription
+    kis_recursive_timed_mutex mutex;
+    std::map<std::string, std::shared_ptr<subscription>> subscriptions;
+
+    // Protects the entered and left sets of every subscription and the list of
+    // subscriptions to record them in; never held while taking another lock
+    kis_recursive_timed_mutex membership_mutex;
+    std::list<std::shared_ptr<subscription>> membership_subscriptions;
+};
+
+#endif
+
@@ -20,6 +20,7 @@
 
 #include "devicetracker_view_workers.h"
 #include "devicetracker_component.h"
+#include "devicetracker_workers.h"
 #include "util.h"
 
 #include "kis_mutex.h"
@@ -94,6 +95,14 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(SharedStructured shar
 
         filter_vec.push_back(worker_filter);
     }
+
+    if (vec.size() == 1) {
+        auto rpair = vec[0]->getStructuredArray();
+        std::string attr, value;
+
+        if (devicetracker_regex_index_hint(rpair[0]->getString(), rpair[1]->getString(), attr, value))
+            set_index_hint(attr, value);
+    }
 #else
     throw std::runtime_error("Kismet was not compiled with PCRE support");
 #endif
@@ -109,6 +118,13 @@ DevicetrackerViewRegexWorker::DevicetrackerViewRegexWorker(const std::vector<std
 
         filter_vec.push_back(worker_filter);
     }
+
+    if (str_pcre_vec.size() == 1) {
+        std::string attr, value;
+
+        if (devicetracker_regex_index_hint(str_pcre_vec[0].first, str_pcre_vec[0].second, attr, value))
+            set_index_hint(attr, value);
+    }
 #else
     throw std::runtime_error("Kismet was ot compiled with PCRE support");
 #endif
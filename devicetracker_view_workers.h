@@ -43,6 +43,16 @@ public:
         return matched;
     }
 
+    // Only devices the device index files under this attribute value can match; work on
+    // the whole view then only examines the devices of the view among those
+    void set_index_hint(const std::string& in_attribute, const std::string& in_value) {
+        index_attribute = in_attribute;
+        index_value = in_value;
+    }
+
+    const std::string& get_index_attribute() const { return index_attribute; }
+    const std::string& get_index_value() const { return index_value; }
+
 protected:
     friend class DevicetrackerView;
 
@@ -50,6 +60,9 @@ protected:
 
     kis_recursive_timed_mutex mutex;
     std::shared_ptr<TrackerElementVector> matched;
+
+    std::string index_attribute;
+    std::string index_value;
 };
 
 class DevicetrackerViewFunctionWorker : public DevicetrackerViewWorker {
@@ -99,6 +112,8 @@ public:
     DevicetrackerViewRegexWorker(const DevicetrackerViewRegexWorker& w) {
         filter_vec = w.filter_vec;
         matched = w.matched;
+        index_attribute = w.index_attribute;
+        index_value = w.index_value;
     }
 
     virtual ~DevicetrackerViewRegexWorker() { }
@@ -132,6 +132,34 @@ void devicetracker_stringmatch_worker::Finalize(Devicetracker *devicetracker __a
 
 }
 
+bool devicetracker_regex_index_hint(const std::string& in_field, const std::string& in_regex,
+        std::string& out_attribute, std::string& out_value) {
+    static const std::map<std::string, std::string> indexed_fields = {
+        { "kismet.device.base.phyname", "phy" },
+        { "kismet.device.base.type", "type" },
+        { "kismet.device.base.channel", "channel" },
+        { "kismet.device.base.manuf", "manuf" },
+    };
+
+    auto fi = indexed_fields.find(in_field);
+    if (fi == indexed_fields.end())
+        return false;
+
+    // Only an anchored literal matches exactly one indexed value
+    if (in_regex.length() < 2 || in_regex.front() != '^' || in_regex.back() != '$')
+        return false;
+
+    auto literal = in_regex.substr(1, in_regex.length() - 2);
+
+    if (literal.find_first_of("\\^$.|?*+()[]{}") != std::string::npos)
+        return false;
+
+    out_attribute = fi->second;
+    out_value = literal;
+
+    return true;
+}
+
 #ifdef HAVE_LIBPCRE
 
 devicetracker_pcre_worker::devicetracker_pcre_worker(
@@ -179,6 +207,14 @@ devicetracker_pcre_worker::devicetracker_pcre_worker(SharedStructured raw_pcre_v
 
         filter_vec.push_back(filter);
     }
+
+    if (rawvec.size() == 1) {
+        auto rpair = rawvec[0]->getStructuredArray();
+        std::string attr, value;
+
+        if (devicetracker_regex_index_hint(rpair[0]->getString(), rpair[1]->getString(), attr, value))
+            set_index_hint(attr, value);
+    }
 }
 
 devicetracker_pcre_worker::devicetracker_pcre_worker(const std::vector<std::pair<std::string, std::string>>& str_pcre_vec) {
@@ -210,6 +246,13 @@ devicetracker_pcre_worker::devicetracker_pcre_worker(const std::vector<std::pair
 
         filter_vec.push_back(filter);
     }
+
+    if (str_pcre_vec.size() == 1) {
+        std::string attr, value;
+
+        if (devicetracker_regex_index_hint(str_pcre_vec[0].first, str_pcre_vec[0].second, attr, value))
+            set_index_hint(attr, value);
+    }
 }
 
 devicetracker_pcre_worker::devicetracker_pcre_worker(const std::string& in_target,
@@ -249,6 +292,13 @@ devicetracker_pcre_worker::devicetracker_pcre_worker(const std::string& in_targe
 
         filter_vec.push_back(filter);
     }
+
+    if (rawvec.size() == 1) {
+        std::string attr, value;
+
+        if (devicetracker_regex_index_hint(in_target, rawvec[0]->getString(), attr, value))
+            set_index_hint(attr, value);
+    }
 }
 
 devicetracker_pcre_worker::~devicetracker_pcre_worker() {
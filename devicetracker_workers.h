@@ -30,6 +30,12 @@
 
 class kis_tracked_device_base;
 
+// Find the device index attribute and value a single field:regex filter can be answered
+// from, when the regex only matches one exact value of an indexed field; returns false
+// for anything else, which has to be matched against every device
+bool devicetracker_regex_index_hint(const std::string& in_field, const std::string& in_regex,
+        std::string& out_attribute, std::string& out_value);
+
 // Filter-handler class.  Subclassed by a filter supplicant to be passed to the
 // device filter functions.
 class DevicetrackerFilterWorker {
@@ -52,6 +58,17 @@ public:
         return matched_devices;
     }
 
+    // Only devices the device index files under this attribute value can match; a match
+    // against the whole device list then only examines those devices.  Each of them is
+    // still passed to MatchDevice.
+    void set_index_hint(const std::string& in_attribute, const std::string& in_value) {
+        index_attribute = in_attribute;
+        index_value = in_value;
+    }
+
+    const std::string& get_index_attribute() const { return index_attribute; }
+    const std::string& get_index_value() const { return index_value; }
+
 protected:
     virtual void MatchedDevice(SharedTrackerElement d) {
         local_locker lock(&worker_mutex);
@@ -60,6 +77,9 @@ protected:
 
     kis_recursive_timed_mutex worker_mutex;
     std::shared_ptr<TrackerElementVector> matched_devices;
+
+    std::string index_attribute;
+    std::string index_value;
 };
 
 // C++ lambda matcher
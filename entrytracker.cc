@@ -29,6 +29,8 @@ EntryTracker::EntryTracker(GlobalRegistry *in_globalreg) :
     globalreg = in_globalreg;
 
     next_field_num = 1;
+    field_generation = 1;
+    num_name_formats = 0;
 
     Bind_Httpd_Server();
 }
@@ -67,6 +69,7 @@ int EntryTracker::RegisterField(const std::string& in_name,
 
     field_name_map[lname] = definition;
     field_id_map[definition->field_id] = definition;
+    field_generation++;
 
     return definition->field_id;
 }
@@ -99,6 +102,7 @@ std::shared_ptr<TrackerElement> EntryTracker::RegisterAndGetField(const std::str
 
     field_name_map[lname] = definition;
     field_id_map[definition->field_id] = definition;
+    field_generation++;
 
     return definition->builder->clone_type(definition->field_id);
 }
@@ -126,6 +130,61 @@ std::string EntryTracker::GetFieldName(int in_id) {
     return iter->second->field_name;
 }
 
+int EntryTracker::RegisterFieldNameFormat(const std::string& in_format,
+        field_name_formatter in_formatter) {
+    local_locker lock(&entry_mutex);
+
+    for (int i = 0; i < num_name_formats; i++) {
+        if (name_formats[i].format == in_format)
+            return i;
+    }
+
+    if (num_name_formats >= max_name_formats) {
+        _MSG_ERROR("Unable to register field name format {}, too many formats", in_format);
+        return -1;
+    }
+
+    auto id = (int) num_name_formats;
+
+    name_formats[id].format = in_format;
+    name_formats[id].formatter = in_formatter;
+
+    num_name_formats++;
+
+    return id;
+}
+
+std::shared_ptr<const EntryTracker::field_name_cache> 
+EntryTracker::GetFieldNameCache(int in_format_id) {
+    if (in_format_id < 0 || in_format_id >= num_name_formats)
+        return nullptr;
+
+    auto& nf = name_formats[in_format_id];
+
+    auto cache = std::atomic_load(&nf.cache);
+
+    if (cache != nullptr && cache->generation == field_generation)
+        return cache;
+
+    local_locker lock(&entry_mutex);
+
+    // Someone may have rebuilt it while we waited
+    cache = std::atomic_load(&nf.cache);
+    if (cache != nullptr && cache->generation == field_generation)
+        return cache;
+
+    auto rebuild = std::make_shared<field_name_cache>();
+    rebuild->generation = field_generation;
+    rebuild->names.resize(next_field_num);
+
+    for (auto i : field_id_map)
+        rebuild->names[i.first] = nf.formatter(i.second->field_name);
+
+    std::atomic_store(&nf.cache, std::shared_ptr<const field_name_cache>(rebuild));
+
+    return rebuild;
+}
+
 std::string EntryTracker::GetFieldDescription(int in_id) {
     local_locker lock(&entry_mutex);
 
@@ -150,6 +209,47 @@ std::shared_ptr<TrackerElement> EntryTracker::GetSharedInstance(int in_id) {
     return iter->second->builder->clone_type(iter->second->field_id);
 }
 
+std::vector<std::shared_ptr<TrackerElement>> 
+    EntryTracker::GetSharedInstances(const std::vector<int>& in_ids) {
+    local_locker lock(&entry_mutex);
+
+    std::vector<std::shared_ptr<TrackerElement>> ret(in_ids.size());
+    std::vector<TrackerElement *> inline_builders(in_ids.size(), nullptr);
+    size_t block_size = 0;
+    size_t block_num = 0;
+
+    for (size_t i = 0; i < in_ids.size(); i++) {
+        auto iter = field_id_map.find(in_ids[i]);
+
+        if (iter == field_id_map.end()) 
+            continue;
+
+        auto sz = iter->second->builder->inline_size();
+
+        if (sz == 0) {
+            ret[i] = iter->second->builder->clone_type(iter->second->field_id);
+            continue;
+        }
+
+        inline_builders[i] = iter->second->builder.get();
+        block_size += tracker_element_block::slot_size(sz);
+        block_num++;
+    }
+
+    if (block_num == 0)
+        return ret;
+
+    auto block = std::make_shared<tracker_element_block>(block_size, block_num);
+
+    for (size_t i = 0; i < in_ids.size(); i++) {
+        if (inline_builders[i] != nullptr)
+            ret[i] = std::shared_ptr<TrackerElement>(block, 
+                    block->emplace(inline_builders[i], in_ids[i]));
+    }
+
+    return ret;
+}
+
 std::shared_ptr<TrackerElement> EntryTracker::GetSharedInstance(const std::string& in_name) {
     local_locker lock(&entry_mutex);
 
@@ -273,6 +373,10 @@ bool EntryTracker::Serialize(const std::string& in_name, std::ostream &stream,
     }
     lock.unlock();
 
+    // Serializers which don't walk projections get summarized copies
+    if (name_map != nullptr && !i->second->projects())
+        TrackerElementProjection::expand(name_map);
+
     // Call the serializer
     i->second->serialize(e, stream, name_map);
 
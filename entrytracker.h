@@ -27,6 +27,10 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <vector>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
@@ -96,6 +100,35 @@ public:
     }
     std::shared_ptr<TrackerElement> GetSharedInstance(int in_id);
 
+    // Generate an instance of each field in in_ids, in order; fields which can be built
+    // in place are packed together into one allocation.  Unknown fields are null.
+    std::vector<std::shared_ptr<TrackerElement>> GetSharedInstances(const std::vector<int>& in_ids);
+
+    // Field names pre-formatted for an output format (quoted and escaped for json, 
+    // encoded as a string for binary formats, etc), indexed by field ID.  Serializers
+    // fetch the cache once per output and index it directly without taking the entry
+    // lock; fields without a cached name (local names, renames, unregistered IDs) fall
+    // back to GetFieldName.
+    struct field_name_cache {
+        uint64_t generation;
+        std::vector<std::string> names;
+    };
+
+    using field_name_formatter = std::function<std::string (const std::string&)>;
+
+    // Register an output format; returns the format ID used to fetch its cache, or 
+    // negative if too many formats are registered
+    int RegisterFieldNameFormat(const std::string& in_format, field_name_formatter in_formatter);
+
+    // Current field generation, incremented whenever a new field is registered
+    uint64_t GetFieldGeneration() const {
+        return field_generation;
+    }
+
+    // Fetch the name cache for a format, rebuilding it if fields have been registered
+    // since it was built
+    std::shared_ptr<const field_name_cache> GetFieldNameCache(int in_format_id);
+
     // Register a serializer for auto-serialization based on type
     void RegisterSerializer(const std::string& type, std::shared_ptr<TrackerElementSerializer> in_ser);
     void RemoveSerializer(const std::string& type);
@@ -133,6 +166,23 @@ protected:
 
     std::map<std::string, std::shared_ptr<reserved_field> > field_name_map;
     std::map<int, std::shared_ptr<reserved_field> > field_id_map;
+
+    // Incremented for every new field, so stale name caches can be found without 
+    // taking the entry lock
+    std::atomic<uint64_t> field_generation;
+
+    // Name cache formats are only ever added, into a fixed table, so a format can be
+    // read without locking
+    static const int max_name_formats = 8;
+
+    struct name_format {
+        std::string format;
+        field_name_formatter formatter;
+        std::shared_ptr<const field_name_cache> cache;
+    };
+
+    std::array<name_format, max_name_formats> name_formats;
+    std::atomic<int> num_name_formats;
     std::map<std::string, std::shared_ptr<TrackerElementSerializer> > serializer_map;
 };
 
@@ -17,126 +17,396 @@
 */
 
 #include "eventbus.h"
+#include "configfile.h"
+#include "entrytracker.h"
+#include "messagebus.h"
 
 Eventbus::Eventbus() {
     next_cbl_id = 1;
+    queue_depth = 0;
+    dispatch_wakeups = 0;
 
     shutdown = false;
 
-    event_cl.lock();
+    // Channel ID 0 is reserved for 'not yet interned'
+    channel_table.push_back(nullptr);
+
+    auto entrytracker = Globalreg::FetchMandatoryGlobalAs<EntryTracker>();
+
+    stats_id =
+        entrytracker->RegisterField("kismet.eventbus.stats",
+                TrackerElementFactory<TrackerElementMap>(),
+                "Eventbus statistics");
+    stats_threads_id =
+        entrytracker->RegisterField("kismet.eventbus.dispatch_threads",
+                TrackerElementFactory<TrackerElementUInt32>(),
+                "Number of event dispatch threads");
+    stats_queue_depth_id =
+        entrytracker->RegisterField("kismet.eventbus.queue_depth",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Undelivered events across all listeners");
+    stats_channel_vec_id =
+        entrytracker->RegisterField("kismet.eventbus.channels",
+                TrackerElementFactory<TrackerElementVector>(),
+                "Eventbus channels");
+    stats_channel_id =
+        entrytracker->RegisterField("kismet.eventbus.channel",
+                TrackerElementFactory<TrackerElementMap>(),
+                "Eventbus channel");
+    stats_channel_name_id =
+        entrytracker->RegisterField("kismet.eventbus.channel.name",
+                TrackerElementFactory<TrackerElementString>(),
+                "Channel name");
+    stats_channel_published_id =
+        entrytracker->RegisterField("kismet.eventbus.channel.published",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Events published to channel");
+    stats_listener_vec_id =
+        entrytracker->RegisterField("kismet.eventbus.listeners",
+                TrackerElementFactory<TrackerElementVector>(),
+                "Eventbus listeners");
+    stats_listener_id =
+        entrytracker->RegisterField("kismet.eventbus.listener",
+                TrackerElementFactory<TrackerElementMap>(),
+                "Eventbus listener");
+    stats_listener_id_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.id",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Listener ID");
+    stats_listener_channels_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.channels",
+                TrackerElementFactory<TrackerElementVectorString>(),
+                "Channels listener is subscribed to");
+    stats_listener_pending_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.pending",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Undelivered events queued for listener");
+    stats_listener_delivered_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.delivered",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Events delivered to listener");
+    stats_listener_latency_avg_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.latency_avg_us",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Average time from publish to delivery, in microseconds");
+    stats_listener_latency_max_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.latency_max_us",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Maximum time from publish to delivery, in microseconds");
+    stats_listener_runtime_avg_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.runtime_avg_us",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Average listener callback run time, in microseconds");
+    stats_listener_runtime_max_id =
+        entrytracker->RegisterField("kismet.eventbus.listener.runtime_max_us",
+                TrackerElementFactory<TrackerElementUInt64>(),
+                "Maximum listener callback run time, in microseconds");
+
+    stats_endp =
+        std::make_shared<Kis_Net_Httpd_Simple_Tracked_Endpoint>("/eventbus/stats", true,
+                [this]() -> std::shared_ptr<TrackerElement> {
+                    return stats_endp_handler();
+                }, &mutex);
+
+    unsigned int n_threads = 
+        Globalreg::globalreg->kismet_config->FetchOptUInt("eventbus_dispatch_threads", 
+                std::min(std::thread::hardware_concurrency(), 4U));
+
+    if (n_threads == 0)
+        n_threads = 1;
+
+    for (unsigned int i = 0; i < n_threads; i++) {
+        dispatch_threads.push_back(std::thread([this]() {
+            event_queue_dispatcher();
+        }));
+
+        thread_set_process_name(fmt::format("kismet [eventbus {}/{}]", i, n_threads),
+                dispatch_threads.back());
+    }
+}
+
+Eventbus::~Eventbus() {
+    {
+        std::lock_guard<std::mutex> lk(dispatch_mutex);
+        shutdown = true;
+    }
 
-    event_dispatch_t =
-        std::thread([this]() {
-                thread_set_process_name("kismet [eventbus]", event_dispatch_t);
-                event_queue_dispatcher();
-            });
+    dispatch_cv.notify_all();
 
+    for (auto& t : dispatch_threads)
+        t.join();
 }
 
-Eventbus::~Eventbus() {
-    shutdown = true;
+void Eventbus::wake_dispatchers(size_t in_count) {
+    {
+        std::lock_guard<std::mutex> lk(dispatch_mutex);
+        dispatch_wakeups += in_count;
+    }
 
-    event_cl.unlock(0);
-    event_dispatch_t.join();
+    for (size_t i = 0; i < in_count; i++)
+        dispatch_cv.notify_one();
 }
 
 void Eventbus::event_queue_dispatcher() {
     local_demand_locker l(&mutex);
 
     while (1) {
-        if (shutdown)
-            return;
-
         // Lock while we examine the queue
         l.lock();
 
-        if (event_queue.size() > 0) {
-            auto e = event_queue.front();
-            event_queue.pop();
+        if (shutdown)
+            return;
 
-            auto ch_listeners = callback_table.find(e->get_event());
+        if (ready_queue.size() > 0) {
+            auto cbl = ready_queue.front();
+            ready_queue.pop();
 
-            if (ch_listeners == callback_table.end()) {
+            if (cbl->removed || cbl->pending.size() == 0) {
+                cbl->scheduled = false;
                 l.unlock();
                 continue;
             }
 
-            // Lock the handler mutex while we're processing an event
-            {
-                local_locker rl(&handler_mutex);
+            auto e = cbl->pending.front();
+            cbl->pending.pop_front();
+            queue_depth--;
 
-                // Unlock the rest of the eventbus
-                l.unlock();
+            // Claim the listener; no other dispatch thread will see it until we
+            // put it back on the ready queue, which keeps delivery in order
+            cbl->running_thread = std::this_thread::get_id();
+
+            // Unlock the rest of the eventbus while the listener runs
+            l.unlock();
+
+            auto start_ts = std::chrono::steady_clock::now();
+            cbl->cb(e);
+            auto end_ts = std::chrono::steady_clock::now();
+
+            l.lock();
+
+            auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(start_ts - 
+                    e->publish_ts).count();
+            auto runtime_us = std::chrono::duration_cast<std::chrono::microseconds>(end_ts - 
+                    start_ts).count();
+
+            cbl->delivered++;
+            cbl->latency_total_us += latency_us;
+            cbl->runtime_total_us += runtime_us;
+
+            if ((uint64_t) latency_us > cbl->latency_max_us)
+                cbl->latency_max_us = latency_us;
+            if ((uint64_t) runtime_us > cbl->runtime_max_us)
+                cbl->runtime_max_us = runtime_us;
 
-                auto listeners{ch_listeners->second};
+            cbl->running_thread = std::thread::id();
 
-                for (auto cbl : ch_listeners->second) {
-                    cbl->cb(e);
-                }
+            // Requeue at the tail so busy listeners share the pool fairly; this thread
+            // loops for the head of the queue, so only wake another when there is more
+            // than one listener waiting
+            bool requeued = false;
+
+            if (!cbl->removed && cbl->pending.size() > 0) {
+                ready_queue.push(cbl);
+                requeued = ready_queue.size() > 1;
+            } else {
+                cbl->scheduled = false;
             }
 
+            l.unlock();
+
+            if (requeued)
+                wake_dispatchers(1);
+
+            // Wake anyone waiting to remove a listener
+            removal_cl.unlock(0);
+
             // Loop for more events
             continue;
         }
 
-        // Reset the lock
-        event_cl.lock();
-      
         // Unlock our hold on the system
         l.unlock();
 
-        // Wait until new events
-        event_cl.block_until();
+        // Wait until a listener is queued; a wakeup for a listener another thread has
+        // already taken just loops back here
+        std::unique_lock<std::mutex> lk(dispatch_mutex);
+        dispatch_cv.wait(lk, [this]() { return dispatch_wakeups > 0 || shutdown; });
+
+        if (dispatch_wakeups > 0)
+            dispatch_wakeups--;
     }
 }
 
-unsigned long Eventbus::register_listener(const std::string& channel, cb_func cb) {
-    local_locker l(&handler_mutex);
+unsigned long Eventbus::intern_channel_nl(const std::string& channel) {
+    auto ci = channel_id_map.find(channel);
 
-    auto cbl = std::make_shared<callback_listener>(std::list<std::string>{channel}, cb, next_cbl_id++);
+    if (ci != channel_id_map.end())
+        return ci->second;
 
-    callback_table[channel].push_back(cbl);
-    callback_id_table[cbl->id] = cbl;
+    auto id = channel_table.size();
+    channel_table.push_back(std::make_shared<channel_record>(channel, id));
+    channel_id_map[channel] = id;
 
-    return cbl->id;
+    return id;
 }
 
-unsigned long Eventbus::register_listener(const std::list<std::string>& channels, cb_func cb) {
-    local_locker l(&handler_mutex);
+unsigned long Eventbus::intern_channel(const std::string& channel) {
+    local_locker l(&mutex);
+    return intern_channel_nl(channel);
+}
+
+void Eventbus::publish_event(std::shared_ptr<EventbusEvent> event) {
+    size_t wake = 0;
+
+    {
+        local_locker l(&mutex);
+
+        if (event->channel_id == 0)
+            event->channel_id = intern_channel_nl(event->event_id);
+
+        event->publish_ts = std::chrono::steady_clock::now();
 
-    auto cbl = std::make_shared<callback_listener>(channels, cb, next_cbl_id++);
+        auto ch = channel_table[event->channel_id];
 
-    for (auto i : channels) {
-        callback_table[i].push_back(cbl);
+        ch->published++;
+
+        for (auto cbl : ch->listeners) {
+            cbl->pending.push_back(event);
+            queue_depth++;
+
+            if (!cbl->scheduled) {
+                cbl->scheduled = true;
+                ready_queue.push(cbl);
+                wake++;
+            }
+        }
     }
 
+    // One thread for each listener which became ready
+    if (wake > 0)
+        wake_dispatchers(wake);
+}
+
+unsigned long Eventbus::register_listener(const std::string& channel, cb_func cb) {
+    return register_listener(std::list<std::string>{channel}, cb);
+}
+
+unsigned long Eventbus::register_listener(const std::list<std::string>& channels, cb_func cb) {
+    local_locker l(&mutex);
+
+    std::list<unsigned long> channel_ids;
+
+    for (auto i : channels)
+        channel_ids.push_back(intern_channel_nl(i));
+
+    auto cbl = std::make_shared<callback_listener>(channel_ids, cb, next_cbl_id++);
+
+    for (auto i : channel_ids)
+        channel_table[i]->listeners.push_back(cbl);
+
     callback_id_table[cbl->id] = cbl;
 
     return cbl->id;
 }
 
 void Eventbus::remove_listener(unsigned long id) {
-    local_locker l(&handler_mutex);
+    local_demand_locker l(&mutex);
+
+    l.lock();
 
     // Find matching cbl
-    auto cbl = callback_id_table.find(id);
-    if (cbl == callback_id_table.end())
+    auto cbi = callback_id_table.find(id);
+    if (cbi == callback_id_table.end())
         return;
 
-    // Match all channels this cbl is subscribed to
-    for (auto c : cbl->second->channels) {
-        auto cb_list = callback_table[c];
+    auto cbl = cbi->second;
 
-        // remove from each chanel
-        for (auto cbi = cb_list.begin(); cbi != cb_list.end(); ++cbi) {
-            if ((*cbi)->id == id) {
-                cb_list.erase(cbi);
+    // Remove from each channel
+    for (auto c : cbl->channels) {
+        auto& cb_list = channel_table[c]->listeners;
+
+        for (auto li = cb_list.begin(); li != cb_list.end(); ++li) {
+            if ((*li)->id == id) {
+                cb_list.erase(li);
                 break;
             }
         }
     }
 
     // Remove from CBL ID table
-    callback_id_table.erase(cbl);
+    callback_id_table.erase(cbi);
+
+    // Discard anything not yet delivered
+    cbl->removed = true;
+    queue_depth -= cbl->pending.size();
+    cbl->pending.clear();
+
+    // Block until any in-progress delivery to this listener completes, unless we're
+    // being called from inside that listener
+    while (cbl->running_thread != std::thread::id() &&
+            cbl->running_thread != std::this_thread::get_id()) {
+        removal_cl.lock();
+        l.unlock();
+        removal_cl.block_for_ms(std::chrono::milliseconds(100));
+        l.lock();
+    }
 }
 
+std::shared_ptr<TrackerElement> Eventbus::stats_endp_handler() {
+    auto stats = std::make_shared<TrackerElementMap>(stats_id);
+
+    stats->insert(std::make_shared<TrackerElementUInt32>(stats_threads_id, dispatch_threads.size()));
+    stats->insert(std::make_shared<TrackerElementUInt64>(stats_queue_depth_id, queue_depth));
+
+    auto channel_vec = std::make_shared<TrackerElementVector>(stats_channel_vec_id);
+    stats->insert(channel_vec);
+
+    for (auto ch : channel_table) {
+        if (ch == nullptr)
+            continue;
+
+        auto ch_rec = std::make_shared<TrackerElementMap>(stats_channel_id);
+
+        ch_rec->insert(std::make_shared<TrackerElementString>(stats_channel_name_id, ch->name));
+        ch_rec->insert(std::make_shared<TrackerElementUInt64>(stats_channel_published_id, ch->published));
+
+        channel_vec->push_back(ch_rec);
+    }
+
+    auto listener_vec = std::make_shared<TrackerElementVector>(stats_listener_vec_id);
+    stats->insert(listener_vec);
+
+    for (auto cbi : callback_id_table) {
+        auto cbl = cbi.second;
+        auto l_rec = std::make_shared<TrackerElementMap>(stats_listener_id);
+
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_id_id, cbl->id));
+
+        auto channels = std::make_shared<TrackerElementVectorString>(stats_listener_channels_id);
+        for (auto c : cbl->channels)
+            channels->push_back(channel_table[c]->name);
+        l_rec->insert(channels);
+
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_pending_id, 
+                    cbl->pending.size()));
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_delivered_id, 
+                    cbl->delivered));
+
+        uint64_t latency_avg = 0, runtime_avg = 0;
+        if (cbl->delivered > 0) {
+            latency_avg = cbl->latency_total_us / cbl->delivered;
+            runtime_avg = cbl->runtime_total_us / cbl->delivered;
+        }
+
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_latency_avg_id, latency_avg));
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_latency_max_id, 
+                    cbl->latency_max_us));
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_runtime_avg_id, runtime_avg));
+        l_rec->insert(std::make_shared<TrackerElementUInt64>(stats_listener_runtime_max_id, 
+                    cbl->runtime_max_us));
+
+        listener_vec->push_back(l_rec);
+    }
+
+    return stats;
+}
@@ -34,6 +34,15 @@
  *   DEVICETRACKER_NEW_DEVICE
  *   PHYTRACKER_NEW_PHY
  *   ALERTRACKER_NEW_ALERT
+ *
+ * Channel names are interned to numeric IDs the first time they are seen, so
+ * dispatch never compares strings.
+ *
+ * Events are dispatched by a pool of threads.  Each listener has its own
+ * pending queue and is only ever serviced by one dispatch thread at a time, so
+ * a listener always sees events in the order they were published, while a slow
+ * listener does not hold up delivery to the others.  Each listener made ready
+ * wakes a single idle dispatch thread.
  */
 
 #ifndef __EVENTBUS_H__
@@ -41,29 +50,51 @@
 
 #include "config.h"
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 #include <queue>
 #include <thread>
 #include <functional>
+#include <unordered_map>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
+#include "kis_net_microhttpd.h"
+
+class Eventbus;
 
 // Most basic event bus event that all other events are derived from
 class EventbusEvent {
 public:
     EventbusEvent(const std::string& in_id) :
-        event_id{in_id} { }
+        event_id{in_id},
+        channel_id{0} { }
+
+    virtual ~EventbusEvent() { }
 
     std::string get_event() { 
         return event_id;
     }
 
+    unsigned long get_channel_id() {
+        return channel_id;
+    }
+
 protected:
+    friend class Eventbus;
+
     std::string event_id;
+
+    // Interned channel, resolved by the eventbus when the event is published
+    unsigned long channel_id;
+
+    // Publish time, used to compute delivery latency
+    std::chrono::steady_clock::time_point publish_ts;
 };
 
 class Eventbus : public LifetimeGlobal {
@@ -85,51 +116,109 @@ private:
 public:
 	virtual ~Eventbus();
 
+    // Intern a channel name, returning the numeric channel ID
+    unsigned long intern_channel(const std::string& channel);
+
     unsigned long register_listener(const std::string& channel, cb_func cb);
     unsigned long register_listener(const std::list<std::string>& channels, cb_func cb);
     void remove_listener(unsigned long id);
 
     template<typename T>
     void publish(T event) {
-        local_locker l(&mutex);
-
         auto evt_cast = 
             std::static_pointer_cast<EventbusEvent>(event);
 
-        event_queue.push(evt_cast);
-        event_cl.unlock(1);
+        publish_event(evt_cast);
     }
 
 protected:
-    // We need 2 mutexes - we have to block removing a callback while we're dispatching
-    // an event, because we need to not lock up the entire event bus while we're 
-    // sending out events
-    kis_recursive_timed_mutex mutex, handler_mutex;
+    kis_recursive_timed_mutex mutex;
 
     unsigned long next_cbl_id;
 
     struct callback_listener {
-        callback_listener(const std::list<std::string>& channels, cb_func cb, unsigned long id) :
+        callback_listener(const std::list<unsigned long>& channels, cb_func cb, unsigned long id) :
             cb{cb},
             channels{channels},
-            id{id} { }
+            id{id},
+            scheduled{false},
+            removed{false},
+            delivered{0},
+            latency_total_us{0},
+            latency_max_us{0},
+            runtime_total_us{0},
+            runtime_max_us{0} { }
 
         cb_func cb;
-        std::list<std::string> channels;
+        std::list<unsigned long> channels;
         unsigned long id;
+
+        // Undelivered events; a listener is only handed to one dispatch thread at a
+        // time, which preserves ordering for this listener
+        std::list<std::shared_ptr<EventbusEvent>> pending;
+
+        // Listener is queued for or currently being processed by a dispatch thread
+        bool scheduled;
+        std::thread::id running_thread;
+
+        // Listener has been removed and must not be called again
+        bool removed;
+
+        // Delivery metrics
+        uint64_t delivered;
+        uint64_t latency_total_us, latency_max_us;
+        uint64_t runtime_total_us, runtime_max_us;
     };
 
-    // Map of event IDs to listener objects
-    std::map<std::string, std::vector<std::shared_ptr<callback_listener>>> callback_table;
+    struct channel_record {
+        channel_record(const std::string& name, unsigned long id) :
+            name{name},
+            id{id},
+            published{0} { }
+
+        std::string name;
+        unsigned long id;
+        std::vector<std::shared_ptr<callback_listener>> listeners;
+
+        uint64_t published;
+    };
+
+    unsigned long intern_channel_nl(const std::string& channel);
+
+    void publish_event(std::shared_ptr<EventbusEvent> event);
+
+    // Interned channel names; channel IDs index the channel table
+    std::unordered_map<std::string, unsigned long> channel_id_map;
+    std::vector<std::shared_ptr<channel_record>> channel_table;
+
     std::map<unsigned long, std::shared_ptr<callback_listener>> callback_id_table;
 
-    // Event pool and handler thread
-    std::queue<std::shared_ptr<EventbusEvent>> event_queue;
-    std::thread event_dispatch_t;
-    conditional_locker<int> event_cl;
+    // Listeners with pending events, waiting for a dispatch thread
+    std::queue<std::shared_ptr<callback_listener>> ready_queue;
+    size_t queue_depth;
+
+    // Dispatch pool; dispatch_wakeups counts listeners queued for which no thread
+    // has been woken yet, so each one wakes a single thread and none are lost
+    std::vector<std::thread> dispatch_threads;
+    std::mutex dispatch_mutex;
+    std::condition_variable dispatch_cv;
+    size_t dispatch_wakeups;
+    conditional_locker<int> removal_cl;
     std::atomic<bool> shutdown;
     void event_queue_dispatcher();
-    
+    void wake_dispatchers(size_t in_count);
+
+    // Metrics
+    std::shared_ptr<Kis_Net_Httpd_Simple_Tracked_Endpoint> stats_endp;
+    std::shared_ptr<TrackerElement> stats_endp_handler();
+
+    int stats_id, stats_threads_id, stats_queue_depth_id, 
+        stats_channel_vec_id, stats_channel_id, stats_channel_name_id,
+        stats_channel_published_id,
+        stats_listener_vec_id, stats_listener_id, stats_listener_id_id, stats_listener_channels_id,
+        stats_listener_pending_id, stats_listener_delivered_id, 
+        stats_listener_latency_avg_id, stats_listener_latency_max_id,
+        stats_listener_runtime_avg_id, stats_listener_runtime_max_id;
 };
 
 #endif
@@ -0,0 +1,140 @@
+/* test harness for the Kismet eventbus
+ *
+ * Holds a listener in its callback while a burst of events is published, then
+ * releases it and checks it was handed every event in the order published.
+ *
+ * # configure kismet, optionally with asan
+ * ./configure --enable-asan
+ *
+ * # build and run every test harness
+ * make check
+ *
+ * # or build this harness alone
+ * make eventbus_test
+ *
+ * ./eventbus_test
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "globalregistry.h"
+#include "eventbus.h"
+#include "kis_test_harness.h"
+
+class test_event : public EventbusEvent {
+public:
+    test_event(const std::string& in_channel, const std::string& in_key, int in_value) :
+        EventbusEvent(in_channel),
+        key{in_key},
+        value{in_value} { }
+
+    std::string key;
+    int value;
+};
+
+// Publish a held event, a burst of events for two keys while the listener is still
+// held in its callback, and return what the listener received once released
+std::vector<std::pair<std::string, int>> run_burst(std::shared_ptr<Eventbus> eventbus,
+        const std::string& in_channel, int in_burst) {
+    std::mutex received_mutex;
+    std::condition_variable received_cv;
+    std::vector<std::pair<std::string, int>> received;
+
+    std::promise<void> started;
+    std::promise<void> release;
+    auto release_f = release.get_future().share();
+    bool first = true;
+
+    auto id = eventbus->register_listener(in_channel,
+            [&](std::shared_ptr<EventbusEvent> evt) {
+                auto te = std::static_pointer_cast<test_event>(evt);
+
+                {
+                    std::lock_guard<std::mutex> lk(received_mutex);
+                    received.push_back(std::make_pair(te->key, te->value));
+                }
+
+                received_cv.notify_one();
+
+                if (first) {
+                    first = false;
+                    started.set_value();
+                    release_f.wait();
+                }
+            });
+
+    eventbus->publish(std::make_shared<test_event>(in_channel, "a", 0));
+    started.get_future().wait();
+
+    for (int i = 1; i <= in_burst; i++) {
+        eventbus->publish(std::make_shared<test_event>(in_channel, "a", i));
+
+        if (i <= in_burst / 2)
+            eventbus->publish(std::make_shared<test_event>(in_channel, "b", i));
+    }
+
+    release.set_value();
+
+    // Wait for the last of each key, or give up
+    std::unique_lock<std::mutex> lk(received_mutex);
+    received_cv.wait_for(lk, std::chrono::seconds(5), [&]() {
+            bool last_a = false, last_b = false;
+
+            for (auto r : received) {
+                if (r.first == "a" && r.second == in_burst)
+                    last_a = true;
+                if (r.first == "b" && r.second == in_burst / 2)
+                    last_b = true;
+            }
+
+            return last_a && last_b;
+        });
+
+    auto result = received;
+    lk.unlock();
+
+    eventbus->remove_listener(id);
+
+    return result;
+}
+
+int main(void) {
+    const int burst = 100;
+
+    test_harness_init();
+
+    auto eventbus = Eventbus::create_eventbus();
+
+    // Every event, in the order published
+    auto plain = run_burst(eventbus, "TEST_PLAIN", burst);
+
+    std::vector<std::pair<std::string, int>> expected_plain { {"a", 0} };
+
+    for (int i = 1; i <= burst; i++) {
+        expected_plain.push_back(std::make_pair("a", i));
+
+        if (i <= burst / 2)
+            expected_plain.push_back(std::make_pair("b", i));
+    }
+
+    if (plain != expected_plain) {
+        fprintf(stderr, "Plain channel delivered %lu events, expected %lu\n",
+                plain.size(), expected_plain.size());
+        exit(1);
+    }
+
+    printf("Plain channel delivered all %lu events in order\n", plain.size());
+
+    test_harness_shutdown();
+
+    return 0;
+}
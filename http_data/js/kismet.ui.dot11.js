@@ -362,13 +362,17 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                 id: "dot11_extras",
                 help: "Some devices advertise additional information about capabilities via additional tag fields when joining a network.",
                 filter: function(opts) {
-                    if (opts['data']['dot11.device']['dot11.device.min_tx_power'] != 0)
+                    var dot11 = opts['data']['dot11.device'];
+
+                    // Capability fields are only present once a device has advertised them
+                    if (dot11['dot11.device.min_tx_power'])
                         return true;
 
-                    if (opts['data']['dot11.device']['dot11.device.max_tx_power'] != 0)
+                    if (dot11['dot11.device.max_tx_power'])
                         return true;
 
-                    if (opts['data']['dot11.device']['dot11.device.supported_channels'].length > 0)
+                    if ('dot11.device.supported_channels' in dot11 &&
+                            dot11['dot11.device.supported_channels'].length > 0)
                         return true;
 
                     return false;
@@ -392,7 +396,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     title: "Supported Channels",
                     help: "Some devices advertise the 5GHz channels they support while joining a network.  Supported 2.4GHz channels are not included in this list.  This data is in the IE 36 field.  This data can be manipulated by hostile devices, but can be informational for normal deices.",
                     filter: function(opts) {
-                        return (opts['data']['dot11.device']['dot11.device.supported_channels'].length);
+                        var dot11 = opts['data']['dot11.device'];
+                        return ('dot11.device.supported_channels' in dot11 &&
+                            dot11['dot11.device.supported_channels'].length);
                     },
                     render: function(opts) {
                         return opts['data']['dot11.device']['dot11.device.supported_channels'].join(',');
@@ -406,7 +412,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                 id: "wpa_handshake",
                 help: "When a client joins a WPA network, it performs a &quot;handshake&quot; of four packets to establish the connection and the unique per-session key.  To decrypt WPA or derive the PSK, at least two specific packets of this handshake are required.  Kismet provides a simplified pcap file of the handshake packets seen, which can be used with other tools to derive the PSK or decrypt the packet stream.",
                 filter: function(opts) {
-                    return (opts['data']['dot11.device']['dot11.device.wpa_handshake_list'].length);
+                    var dot11 = opts['data']['dot11.device'];
+                    return ('dot11.device.wpa_handshake_list' in dot11 &&
+                        dot11['dot11.device.wpa_handshake_list'].length);
                 },
                 groupTitle: "WPA Key Exchange",
 
@@ -515,6 +523,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     field: "dot11.probedssid.dot11r_mobility",
                     title: "802.11r Mobility",
                     filterOnZero: true,
+                    filter: function(opts) {
+                        return (typeof(opts['value']) !== 'undefined');
+                    },
                     help: "The 802.11r standard allows for fast roaming between access points on the same network.  Typically this is found on enterprise-level access points, on a network where multiple APs service the same area.",
                     render: function(opts) { return "Enabled"; }
                 },
@@ -522,6 +533,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     field: "dot11.probedssid.dot11r_mobility_domain_id",
                     title: "Mobility Domain",
                     filterOnZero: true,
+                    filter: function(opts) {
+                        return (typeof(opts['value']) !== 'undefined');
+                    },
                     help: "The 802.11r standard allows for fast roaming between access points on the same network."
                 },
                 {
@@ -658,6 +672,7 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                         if (opts['base']['dot11.advertisedssid.wpa_mfp_supported'])
                             return "Supported (802.11w)";
 
+                        // Cisco MFP is only present when the network advertised it
                         if (opts['base']['dot11.advertisedssid.cisco_client_mfp'])
                             return "Supported (Cisco)";
 
@@ -698,8 +713,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     title: "Connected Stations",
                     help: "Access points which provide 802.11e / QBSS report the number of stations observed on the channel as part of the channel quality of service.",
                     filter: function(opts) {
-                        console.log(opts);
-                        return (opts['base']['dot11.advertisedssid.dot11e_qbss'] == 1);
+                        // QBSS fields are only present on networks which advertise them
+                        return (opts['base']['dot11.advertisedssid.dot11e_qbss'] == 1 &&
+                            typeof(opts['value']) !== 'undefined');
                     }
                 },
                 {
@@ -710,13 +726,17 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                         return opts['value'].toFixed(2) + '%';
                     },
                     filter: function(opts) {
-                        return (opts['base']['dot11.advertisedssid.dot11e_qbss'] == 1);
+                        return (opts['base']['dot11.advertisedssid.dot11e_qbss'] == 1 &&
+                            typeof(opts['value']) !== 'undefined');
                     }
                 },
                 {
                     field: "dot11.advertisedssid.ccx_txpower",
                     title: "Cisco CCX TxPower",
                     filterOnZero: true,
+                    filter: function(opts) {
+                        return (typeof(opts['value']) !== 'undefined');
+                    },
                     help: "Cisco access points may advertise their transmit power in a Cisco CCX IE tag.  Typically this is found on enterprise-level access points, where multiple APs service the same area.",
                     render: function(opts) {
                         return opts['value'] + "dBm";
@@ -726,6 +746,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     field: "dot11.advertisedssid.dot11r_mobility",
                     title: "802.11r Mobility",
                     filterOnZero: true,
+                    filter: function(opts) {
+                        return (typeof(opts['value']) !== 'undefined');
+                    },
                     help: "The 802.11r standard allows for fast roaming between access points on the same network.  Typically this is found on enterprise-level access points, on a network where multiple APs service the same area.",
                     render: function(opts) { return "Enabled"; }
                 },
@@ -733,6 +756,9 @@ kismet_ui.AddDeviceDetail("dot11", "Wi-Fi (802.11)", 0, {
                     field: "dot11.advertisedssid.dot11r_mobility_domain_id",
                     title: "Mobility Domain",
                     filterOnZero: true,
+                    filter: function(opts) {
+                        return (typeof(opts['value']) !== 'undefined');
+                    },
                     help: "The 802.11r standard allows for fast roaming between access points on the same network."
                 },
                 {
@@ -35,6 +35,7 @@
 #include "uuid.h"
 #include "devicetracker_component.h"
 #include "json_adapter.h"
+#include "endian_magic.h"
 
 /* StringExtraSpace and SanitizeString taken from nlohmann's jsonhpp library,
    Copyright 2013-2015 Niels Lohmann. and under the MIT license */
@@ -162,357 +163,676 @@ std::string JsonAdapter::SanitizeString(const std::string& s) noexcept {
     return result;
 }
 
-void JsonAdapter::Pack(std::ostream &stream, SharedTrackerElement e, 
-        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
-        bool prettyprint, unsigned int depth) {
+namespace {
+
+const char json_hex_upper[] = "0123456789ABCDEF";
+
+// Buffered JSON writer.  Output is formatted into a contiguous buffer and handed to
+// the stream in large blocks; it is byte-for-byte the same as streaming each value
+// through the ostream, including the ostream quirk that std::fixed, once set by a 
+// double, sticks for every following floating point value in the stream.
+class json_writer {
+public:
+    json_writer(std::ostream& in_stream,
+            std::shared_ptr<TrackerElementSerializer::rename_map> in_name_map,
+            bool in_prettyprint) :
+        stream(in_stream),
+        name_map(in_name_map),
+        prettyprint(in_prettyprint) {
+        fixed = (stream.flags() & std::ios::floatfield) == std::ios::fixed;
+        precision = stream.precision();
+
+        static int name_format = 
+            Globalreg::globalreg->entrytracker->RegisterFieldNameFormat("json",
+                    [](const std::string& name) -> std::string {
+                        return "\"" + JsonAdapter::SanitizeString(name) + "\"";
+                    });
+
+        names = Globalreg::globalreg->entrytracker->GetFieldNameCache(name_format);
+    }
 
-    std::string indent;
-    std::string ppendl;
-    
-    if (prettyprint) {
-        indent = std::string(depth, ' ');
-        ppendl = "\r\n";
+    ~json_writer() {
+        flush();
     }
 
-    if (e == NULL) {
-        return;
+    void flush() {
+        if (buf.size() > 0) {
+            stream.write(buf.data(), buf.size());
+            buf.resize(0);
+        }
+
+        if (fixed)
+            stream.setf(std::ios::fixed, std::ios::floatfield);
     }
 
-    SerializerScope s(e, name_map);
+    void pack(const SharedTrackerElement& e, unsigned int depth) {
+        if (e == nullptr)
+            return;
 
-    mac_addr mac;
-    uuid euuid;
+        pack(e, find_summary(e), depth);
+    }
 
-    std::string tname;
+protected:
+    std::ostream& stream;
+    std::shared_ptr<TrackerElementSerializer::rename_map> name_map;
+    bool prettyprint;
 
-    std::string bytes;
-    const char* bytes_c;
+    fmt::memory_buffer buf;
 
-    bool prepend_comma;
+    bool fixed;
+    std::streamsize precision;
 
-    std::ios::fmtflags fflags;
+    // Quoted, escaped field names
+    std::shared_ptr<const EntryTracker::field_name_cache> names;
 
-    switch (e->get_type()) {
-        case TrackerType::TrackerString:
-            stream << "\"" << SanitizeString(GetTrackerValue<std::string>(e)) << "\"";
-            break;
-        case TrackerType::TrackerInt8:
-            stream << (int) GetTrackerValue<int8_t>(e);
-            break;
-        case TrackerType::TrackerUInt8:
-            stream << (unsigned int) GetTrackerValue<uint8_t>(e);
-            break;
-        case TrackerType::TrackerInt16:
-            stream << (int) GetTrackerValue<int16_t>(e);
-            break;
-        case TrackerType::TrackerUInt16:
-            stream << (unsigned int) GetTrackerValue<uint16_t>(e);
-            break;
-        case TrackerType::TrackerInt32:
-            stream << GetTrackerValue<int32_t>(e);
-            break;
-        case TrackerType::TrackerUInt32:
-            stream << GetTrackerValue<uint32_t>(e);
-            break;
-        case TrackerType::TrackerInt64:
-            stream << GetTrackerValue<int64_t>(e);
-            break;
-        case TrackerType::TrackerUInt64:
-            stream << GetTrackerValue<uint64_t>(e);
-            break;
-        case TrackerType::TrackerFloat:
-            if (std::isnan(GetTrackerValue<float>(e)) || std::isinf(GetTrackerValue<float>(e)))
-                stream << 0;
+    // Pre- and post-serialize an element, like SerializerScope, without repeating the
+    // rename map lookup
+    class serialize_scope {
+    public:
+        serialize_scope(const SharedTrackerElement& in_elem, const SharedElementSummary *in_summary) :
+            elem(in_elem),
+            summary(in_summary) {
+            if (summary != nullptr)
+                TrackerElementSerializer::pre_serialize_path(*summary);
             else
-                stream << std::fixed << GetTrackerValue<float>(e);
-            break;
-        case TrackerType::TrackerDouble:
-            if (std::isnan(GetTrackerValue<double>(e)) || std::isinf(GetTrackerValue<double>(e)))
-                stream << 0;
+                elem->pre_serialize();
+        }
+
+        ~serialize_scope() {
+            if (summary != nullptr)
+                TrackerElementSerializer::post_serialize_path(*summary);
             else
-                stream << std::fixed << GetTrackerValue<double>(e);
-            break;
-        case TrackerType::TrackerMac:
-            mac = GetTrackerValue<mac_addr>(e);
-            // Mac is quoted as a string value, mac only
-            stream << "\"" << mac.Mac2String() << "\"";
-            break;
-        case TrackerType::TrackerUuid:
-            euuid = GetTrackerValue<uuid>(e);
-            // UUID is quoted as a string value
-            stream << "\"" << euuid.UUID2String() << "\"";
-            break;
-        case TrackerType::TrackerKey:
-            stream << "\"" << GetTrackerValue<device_key>(e).as_string() << "\"";
-            break;
-        case TrackerType::TrackerVector:
-            stream << ppendl << indent << "[" << ppendl;
+                elem->post_serialize();
+        }
 
-            prepend_comma = false;
+    protected:
+        const SharedTrackerElement& elem;
+        const SharedElementSummary *summary;
+    };
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVector>(e))) {
-                if (i == NULL)
-                    continue;
+    const SharedElementSummary *find_summary(const SharedTrackerElement& e) {
+        if (name_map == nullptr)
+            return nullptr;
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+        auto nmi = name_map->find(e);
+        if (nmi == name_map->end())
+            return nullptr;
 
-                if (prettyprint)
-                    stream << indent;
+        return &(nmi->second);
+    }
 
-                JsonAdapter::Pack(stream, i, name_map, prettyprint, depth + 1);
+    void append(const char *s, size_t len) {
+        buf.append(s, s + len);
+    }
 
-                stream << ppendl;
-            }
-            stream << indent << "]";
-            break;
-        case TrackerType::TrackerVectorDouble:
-            stream << ppendl << indent << "[" << ppendl;
+    void append(const std::string& s) {
+        append(s.data(), s.length());
+    }
 
-            prepend_comma = false;
+    void append(char c) {
+        buf.push_back(c);
+    }
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVectorDouble>(e))) {
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+    void append_endl() {
+        if (prettyprint)
+            append("\r\n", 2);
+    }
 
-                if (prettyprint)
-                    stream << indent;
+    void append_indent(unsigned int depth) {
+        if (prettyprint) {
+            for (unsigned int x = 0; x < depth; x++)
+                append(' ');
+        }
+    }
 
-                stream << i;
+    template<typename T>
+    void append_int(T v) {
+        fmt::format_to(buf, "{}", v);
+    }
+
+    // Floating point values follow the stream's notation; std::fixed is set by doubles
+    // and double-keyed maps and stays set
+    void append_floating(double v) {
+        if (fixed)
+            fmt::format_to(buf, "{:.{}f}", v, (int) precision);
+        else
+            fmt::format_to(buf, "{:.{}g}", v, (int) precision);
+    }
+
+    void append_fixed(double v) {
+        fixed = true;
+        append_floating(v);
+    }
 
-                stream << ppendl;
+    // Escape a string in place, matching JsonAdapter::SanitizeString
+    void append_escaped(const std::string& s) {
+        const char *start = s.data();
+        const char *end = start + s.length();
+        const char *run = start;
+
+        for (const char *c = start; c < end; c++) {
+            const char *esc = nullptr;
+
+            switch (*c) {
+                case '"':
+                    esc = "\\\"";
+                    break;
+                case '\\':
+                    esc = "\\\\";
+                    break;
+                case '\b':
+                    esc = "\\b";
+                    break;
+                case '\f':
+                    esc = "\\f";
+                    break;
+                case '\n':
+                    esc = "\\n";
+                    break;
+                case '\r':
+                    esc = "\\r";
+                    break;
+                case '\t':
+                    esc = "\\t";
+                    break;
+                default:
+                    if (*c >= 0x00 && *c <= 0x1f) {
+                        append(run, c - run);
+                        append("\\u00", 4);
+                        append("0123456789abcdef"[(*c >> 4) & 0x0F]);
+                        append("0123456789abcdef"[*c & 0x0F]);
+                        run = c + 1;
+                    }
+                    continue;
             }
-            stream << indent << "]";
-            break;
-        case TrackerType::TrackerVectorString:
-            stream << ppendl << indent << "[" << ppendl;
 
-            prepend_comma = false;
+            append(run, c - run);
+            append(esc, 2);
+            run = c + 1;
+        }
 
-            for (auto i : *(std::static_pointer_cast<TrackerElementVectorString>(e))) {
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+        append(run, end - run);
+    }
 
-                if (prettyprint)
-                    stream << indent;
+    void append_hex_byte(uint8_t b) {
+        append(json_hex_upper[(b >> 4) & 0x0F]);
+        append(json_hex_upper[b & 0x0F]);
+    }
 
-                stream << i;
+    // Uppercase hex with a minimum width, zero padded
+    void append_hex(uint64_t v, unsigned int min_digits) {
+        char hbuf[16];
+        unsigned int n = 0;
+
+        do {
+            hbuf[n++] = json_hex_upper[v & 0x0F];
+            v >>= 4;
+        } while (v != 0 || n < min_digits);
+
+        while (n > 0)
+            append(hbuf[--n]);
+    }
 
-                stream << ppendl;
+    void append_mac(const mac_addr& m) {
+        for (unsigned int x = 0; x < 6; x++) {
+            if (x > 0)
+                append(':');
+            append_hex_byte(m.index64(m.longmac, x));
+        }
+    }
+
+    void append_uuid(const uuid& u) {
+        append_hex(*u.time_low, 8);
+        append('-');
+        append_hex(*u.time_mid, 4);
+        append('-');
+        append_hex(*u.time_hi, 4);
+        append('-');
+        append_hex(*u.clock_seq, 4);
+        append('-');
+        for (unsigned int x = 0; x < 6; x++)
+            append_hex_byte(u.node[x]);
+    }
+
+    void append_key(const device_key& k) {
+        append_hex(kis_hton64(k.get_spkey()), 2);
+        append('_');
+        append_hex(kis_hton64(k.get_dkey()), 1);
+    }
+
+    void open_container(char c, unsigned int depth) {
+        append_endl();
+        append_indent(depth);
+        append(c);
+        append_endl();
+    }
+
+    void close_container(char c, unsigned int depth) {
+        append_indent(depth);
+        append(c);
+    }
+
+    void pack(const SharedTrackerElement& e, const SharedElementSummary *summary, 
+            unsigned int depth) {
+
+        serialize_scope s(e, summary);
+
+        bool prepend_comma = false;
+
+        switch (e->get_type()) {
+            case TrackerType::TrackerString:
+                append('"');
+                append_escaped(GetTrackerValue<std::string>(e));
+                append('"');
+                break;
+            case TrackerType::TrackerInt8:
+                append_int((int) GetTrackerValue<int8_t>(e));
+                break;
+            case TrackerType::TrackerUInt8:
+                append_int((unsigned int) GetTrackerValue<uint8_t>(e));
+                break;
+            case TrackerType::TrackerInt16:
+                append_int((int) GetTrackerValue<int16_t>(e));
+                break;
+            case TrackerType::TrackerUInt16:
+                append_int((unsigned int) GetTrackerValue<uint16_t>(e));
+                break;
+            case TrackerType::TrackerInt32:
+                append_int(GetTrackerValue<int32_t>(e));
+                break;
+            case TrackerType::TrackerUInt32:
+                append_int(GetTrackerValue<uint32_t>(e));
+                break;
+            case TrackerType::TrackerInt64:
+                append_int(GetTrackerValue<int64_t>(e));
+                break;
+            case TrackerType::TrackerUInt64:
+                append_int(GetTrackerValue<uint64_t>(e));
+                break;
+            case TrackerType::TrackerFloat: {
+                auto f = GetTrackerValue<float>(e);
+                if (std::isnan(f) || std::isinf(f))
+                    append('0');
+                else
+                    append_fixed(f);
+                break;
             }
-            stream << indent << "]";
-            break;
-        case TrackerType::TrackerMap:
-            stream << ppendl << indent << "{" << ppendl;
+            case TrackerType::TrackerDouble: {
+                auto d = GetTrackerValue<double>(e);
+                if (std::isnan(d) || std::isinf(d))
+                    append('0');
+                else
+                    append_fixed(d);
+                break;
+            }
+            case TrackerType::TrackerMac:
+                // Mac is quoted as a string value, mac only
+                append('"');
+                append_mac(GetTrackerValue<mac_addr>(e));
+                append('"');
+                break;
+            case TrackerType::TrackerUuid:
+                append('"');
+                append_uuid(GetTrackerValue<uuid>(e));
+                append('"');
+                break;
+            case TrackerType::TrackerKey:
+                append('"');
+                append_key(GetTrackerValue<device_key>(e));
+                append('"');
+                break;
+            case TrackerType::TrackerVector:
+                open_container('[', depth);
+
+                for (auto i : *(std::static_pointer_cast<TrackerElementVector>(e))) {
+                    if (i == nullptr)
+                        continue;
+
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
+
+                    append_indent(depth);
+
+                    if (summary != nullptr && (*summary)->projection != nullptr)
+                        pack_projected(i, *(*summary)->projection, depth + 1);
+                    else
+                        pack(i, depth + 1);
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    append_endl();
+                }
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                close_container(']', depth);
+                break;
+            case TrackerType::TrackerVectorDouble:
+                open_container('[', depth);
 
-                bool named = false;
+                for (auto i : *(std::static_pointer_cast<TrackerElementVectorDouble>(e))) {
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-                if (name_map != NULL) {
-                    TrackerElementSerializer::rename_map::iterator nmi = name_map->find(i.second);
-                    if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
-                        tname = nmi->second->rename;
-                        named = true;
-                    }
+                    append_indent(depth);
+                    append_floating(i);
+                    append_endl();
                 }
 
-                if (!named) {
-                    if (i.second == NULL) {
-                        tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
-                    } else {
-                        if ((tname = i.second->get_local_name()) == "")
-                            tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
-                    }
+                close_container(']', depth);
+                break;
+            case TrackerType::TrackerVectorString:
+                open_container('[', depth);
+
+                for (auto i : *(std::static_pointer_cast<TrackerElementVectorString>(e))) {
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
+
+                    append_indent(depth);
+                    append(i);
+                    append_endl();
                 }
 
-                tname = SanitizeString(tname);
+                close_container(']', depth);
+                break;
+            case TrackerType::TrackerMap:
+                open_container('{', depth);
 
-                if (prettyprint) {
-                    stream << indent << "\"description." << tname << "\": ";
-                    stream << "\"";
-                    if (i.second != nullptr) {
-                        stream << SanitizeString(i.second->get_type_as_string());
-                        stream << ", ";
-                    }
-                    stream << SanitizeString(Globalreg::globalreg->entrytracker->GetFieldDescription(i.first));
-                    stream << "\",";
-                    stream << ppendl;
+                for (auto i : *(std::static_pointer_cast<TrackerElementMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
+
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
+
+                    auto child_summary = find_summary(i.second);
+
+                    pack_field(i.first, i.second, child_summary, child_summary, depth);
                 }
 
-                stream << indent << "\"" << tname << "\": ";
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerIntMap:
+                open_container('{', depth);
 
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                for (auto i : *(std::static_pointer_cast<TrackerElementIntMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
 
-                stream << ppendl << ppendl;
-            }
-            stream << indent << "}";
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-            break;
-        case TrackerType::TrackerIntMap:
-            stream << ppendl << indent << "{" << ppendl;
+                    // Integer dictionary keys in json are still quoted as strings
+                    append_indent(depth);
+                    append('"');
+                    append_int(i.first);
+                    append("\": ", 3);
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementIntMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    pack(i.second, depth + 1);
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    append_endl();
+                }
 
-                // Integer dictionary keys in json are still quoted as strings
-                stream << indent << "\"" << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerMacMap:
+                open_container('{', depth);
 
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerMacMap:
-            stream << ppendl << indent << "{" << ppendl;
+                for (auto i : *(std::static_pointer_cast<TrackerElementMacMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementMacMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    // Mac keys are strings and we push only the mac not the mask
+                    append_indent(depth);
+                    append('"');
+                    append_mac(i.first);
+                    append("\": ", 3);
 
-                // Mac keys are strings and we push only the mac not the mask */
-                stream << indent << "\"" << i.first.Mac2String() << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                    pack(i.second, depth + 1);
 
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerStringMap:
-            stream << ppendl << indent << "{" << ppendl;
+                    append_endl();
+                }
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementStringMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerStringMap:
+                open_container('{', depth);
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                for (auto i : *(std::static_pointer_cast<TrackerElementStringMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
 
-                stream << indent << "\"" << JsonAdapter::SanitizeString(i.first) << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerDoubleMap:
-            stream << ppendl << indent << "{" << ppendl;
+                    append_indent(depth);
+                    append('"');
+                    append_escaped(i.first);
+                    append("\": ", 3);
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    pack(i.second, depth + 1);
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    append_endl();
+                }
 
-                // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerDoubleMap:
+                open_container('{', depth);
 
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerHashkeyMap:
-            stream << ppendl << indent << "{" << ppendl;
+                for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementHashkeyMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    // Double keys are handled as strings in json
+                    append_indent(depth);
+                    append('"');
+                    append_fixed(i.first);
+                    append("\": ", 3);
 
-                // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                JsonAdapter::Pack(stream, i.second, name_map, prettyprint, depth + 1);
+                    pack(i.second, depth + 1);
 
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerDoubleMapDouble:
-            stream << ppendl << indent << "{" << ppendl;
+                    append_endl();
+                }
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMapDouble>(e))) {
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerHashkeyMap:
+                open_container('{', depth);
 
-                // Double keys are handled as strings in json
-                stream << indent << "\"" << std::fixed << i.first << "\": ";
-                stream << i.second;
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerKeyMap:
-            stream << ppendl << indent << "{" << ppendl;
+                for (auto i : *(std::static_pointer_cast<TrackerElementHashkeyMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
 
-            prepend_comma = false;
-            for (auto i : *(std::static_pointer_cast<TrackerElementDeviceKeyMap>(e))) {
-                if (i.second == NULL)
-                    continue;
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
 
-                if (prepend_comma)
-                    stream << ",";
-                prepend_comma = true;
+                    // Hash keys are handled as strings; the stream writer sets 
+                    // std::fixed here too
+                    fixed = true;
+                    append_indent(depth);
+                    append('"');
+                    append_int(i.first);
+                    append("\": ", 3);
 
-                // Keymap keys are handled as strings
-                stream << indent << "\"" << i.first << "\": ";
-                JsonAdapter::Pack(stream,i.second, name_map, prettyprint, depth + 1);
-                stream << ppendl;
-            }
-            stream << indent << "}";
-            break;
-        case TrackerType::TrackerByteArray:
-            bytes = std::static_pointer_cast<TrackerElementByteArray>(e)->get();
-            bytes_c = bytes.data();
-           
-            fflags = stream.flags();
+                    pack(i.second, depth + 1);
 
-            stream << "\"";
-            for (size_t szx = 0; szx < bytes.length(); szx++) {
-                stream << std::uppercase << std::setfill('0') << std::setw(2) 
-                    << std::hex << (int) (bytes_c[szx] & 0xFF);
+                    append_endl();
+                }
+
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerDoubleMapDouble:
+                open_container('{', depth);
+
+                for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMapDouble>(e))) {
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
+
+                    // Double keys are handled as strings in json
+                    append_indent(depth);
+                    append('"');
+                    append_fixed(i.first);
+                    append("\": ", 3);
+                    append_floating(i.second);
+                    append_endl();
+                }
+
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerKeyMap:
+                open_container('{', depth);
+
+                for (auto i : *(std::static_pointer_cast<TrackerElementDeviceKeyMap>(e))) {
+                    if (i.second == nullptr)
+                        continue;
+
+                    if (prepend_comma)
+                        append(',');
+                    prepend_comma = true;
+
+                    // Keymap keys are handled as strings
+                    append_indent(depth);
+                    append('"');
+                    append_key(i.first);
+                    append("\": ", 3);
+
+                    pack(i.second, depth + 1);
+
+                    append_endl();
+                }
+
+                close_container('}', depth);
+                break;
+            case TrackerType::TrackerByteArray: {
+                auto bytes = std::static_pointer_cast<TrackerElementByteArray>(e)->get();
+
+                append('"');
+                for (auto b : bytes)
+                    append_hex_byte((uint8_t) b);
+                append('"');
+
+                break;
             }
-            stream << "\"";
-            stream.flags(fflags);
+            default:
+                break;
+        }
 
-            break;
+        // Hand large outputs to the stream as we go instead of building the entire
+        // document
+        if (buf.size() > (1 << 16))
+            flush();
+    }
+
+    // A map entry; the summary names the field, and the scope summary (which is the
+    // same summary, for anything but a projected field) pre-serializes it
+    void pack_field(int id, const SharedTrackerElement& elem, const SharedElementSummary *summary,
+            const SharedElementSummary *scope_summary, unsigned int depth) {
+        append_indent(depth);
+
+        if (prettyprint) {
+            append("\"description.", 13);
+            append_name(id, elem, summary);
+            append("\": \"", 4);
+            append_escaped(elem->get_type_as_string());
+            append(", ", 2);
+            append_escaped(Globalreg::globalreg->entrytracker->GetFieldDescription(id));
+            append("\",", 2);
+            append_endl();
+            append_indent(depth);
+        }
 
+        append_quoted_name(id, elem, summary);
+        append(": ", 2);
 
-        default:
-            break;
+        pack(elem, scope_summary, depth + 1);
+
+        append_endl();
+        append_endl();
+    }
+
+    // An element of a projected vector, written exactly as its summarized map would be
+    void pack_projected(const SharedTrackerElement& e, const TrackerElementProjection& projection,
+            unsigned int depth) {
+        serialize_scope s(e, nullptr);
+
+        bool prepend_comma = false;
+
+        open_container('{', depth);
+
+        for (const auto& slot : projection.get_slots()) {
+            auto f = projection.resolve(slot, e);
+
+            if (prepend_comma)
+                append(',');
+            prepend_comma = true;
+
+            projection.enter(slot, e, f);
+            pack_field(f->get_id(), f, slot.summarized ? &slot.summary : nullptr, nullptr, depth);
+            projection.leave(slot, e, f);
+        }
+
+        close_container('}', depth);
+    }
+
+    // Field name of a map entry: the summary rename, the element local name, or the
+    // registered field name
+    void append_name(int id, const SharedTrackerElement& elem, const SharedElementSummary *summary) {
+        if (summary != nullptr && (*summary)->rename.length() != 0) {
+            append_escaped((*summary)->rename);
+            return;
+        }
+
+        auto lname = elem->get_local_name();
+
+        if (lname.length() != 0) {
+            append_escaped(lname);
+            return;
+        }
+
+        append_escaped(Globalreg::globalreg->entrytracker->GetFieldName(id));
+    }
+
+    // Quoted field name of a map entry, from the name cache when the field isn't 
+    // renamed
+    void append_quoted_name(int id, const SharedTrackerElement& elem, 
+            const SharedElementSummary *summary) {
+        if (names != nullptr && id >= 0 && (size_t) id < names->names.size() &&
+                names->names[id].length() != 0 &&
+                (summary == nullptr || (*summary)->rename.length() == 0) &&
+                !elem->has_local_name()) {
+            append(names->names[id]);
+            return;
+        }
+
+        append('"');
+        append_name(id, elem, summary);
+        append('"');
     }
+};
+
+}
+
+void JsonAdapter::Pack(std::ostream &stream, SharedTrackerElement e, 
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
+        bool prettyprint, unsigned int depth) {
+
+    if (e == nullptr)
+        return;
+
+    json_writer(stream, name_map, prettyprint).pack(e, depth);
 }
 
 // An unfortunate duplication of code but overloading the json/prettyjson to also do
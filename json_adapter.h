@@ -48,6 +48,10 @@ public:
             std::shared_ptr<rename_map> name_map = nullptr) override {
         Pack(stream, in_elem, name_map);
     }
+
+    virtual bool projects() const override {
+        return true;
+    }
 };
 
 }
@@ -96,6 +100,10 @@ public:
         JsonAdapter::Pack(stream, in_elem, name_map, true, 1);
     }
 
+    virtual bool projects() const override {
+        return true;
+    }
+
 };
 
 }
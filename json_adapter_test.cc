@@ -0,0 +1,574 @@
+/* test and benchmark harness for the Kismet json adapter
+ *
+ * Serializes 100k device-like records with JsonAdapter::Pack and with a copy of the
+ * original ostream-based packer, checks that the output is byte-identical, and
+ * reports the time each takes.  Records hold every type the json adapter writes,
+ * strings which need escaping, and the floating point edge cases (nan, inf, -0,
+ * large and small values) whose formatting has to match.
+ *
+ * # configure kismet, optionally with asan; leave out asan for representative
+ * # timings
+ * ./configure --enable-asan
+ *
+ * # build and run every test harness
+ * make check
+ *
+ * # or build this harness alone
+ * make json_adapter_test
+ *
+ * ./json_adapter_test [number of records]
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <iostream>
+
+#include "trackedelement.h"
+#include "json_adapter.h"
+#include "kis_test_harness.h"
+
+// The ostream packer JsonAdapter::Pack replaced, kept as the reference output
+void ReferencePack(std::ostream &stream, SharedTrackerElement e,
+        bool prettyprint = false, unsigned int depth = 0) {
+
+    std::string indent;
+    std::string ppendl;
+
+    if (prettyprint) {
+        indent = std::string(depth, ' ');
+        ppendl = "\r\n";
+    }
+
+    if (e == NULL) {
+        return;
+    }
+
+    mac_addr mac;
+    uuid euuid;
+
+    std::string tname;
+
+    std::string bytes;
+    const char* bytes_c;
+
+    bool prepend_comma;
+
+    std::ios::fmtflags fflags;
+
+    switch (e->get_type()) {
+        case TrackerType::TrackerString:
+            stream << "\"" << JsonAdapter::SanitizeString(GetTrackerValue<std::string>(e)) << "\"";
+            break;
+        case TrackerType::TrackerInt8:
+            stream << (int) GetTrackerValue<int8_t>(e);
+            break;
+        case TrackerType::TrackerUInt8:
+            stream << (unsigned int) GetTrackerValue<uint8_t>(e);
+            break;
+        case TrackerType::TrackerInt16:
+            stream << (int) GetTrackerValue<int16_t>(e);
+            break;
+        case TrackerType::TrackerUInt16:
+            stream << (unsigned int) GetTrackerValue<uint16_t>(e);
+            break;
+        case TrackerType::TrackerInt32:
+            stream << GetTrackerValue<int32_t>(e);
+            break;
+        case TrackerType::TrackerUInt32:
+            stream << GetTrackerValue<uint32_t>(e);
+            break;
+        case TrackerType::TrackerInt64:
+            stream << GetTrackerValue<int64_t>(e);
+            break;
+        case TrackerType::TrackerUInt64:
+            stream << GetTrackerValue<uint64_t>(e);
+            break;
+        case TrackerType::TrackerFloat:
+            if (std::isnan(GetTrackerValue<float>(e)) || std::isinf(GetTrackerValue<float>(e)))
+                stream << 0;
+            else
+                stream << std::fixed << GetTrackerValue<float>(e);
+            break;
+        case TrackerType::TrackerDouble:
+            if (std::isnan(GetTrackerValue<double>(e)) || std::isinf(GetTrackerValue<double>(e)))
+                stream << 0;
+            else
+                stream << std::fixed << GetTrackerValue<double>(e);
+            break;
+        case TrackerType::TrackerMac:
+            mac = GetTrackerValue<mac_addr>(e);
+            stream << "\"" << mac.Mac2String() << "\"";
+            break;
+        case TrackerType::TrackerUuid:
+            euuid = GetTrackerValue<uuid>(e);
+            stream << "\"" << euuid.UUID2String() << "\"";
+            break;
+        case TrackerType::TrackerKey:
+            stream << "\"" << GetTrackerValue<device_key>(e).as_string() << "\"";
+            break;
+        case TrackerType::TrackerVector:
+            stream << ppendl << indent << "[" << ppendl;
+
+            prepend_comma = false;
+
+            for (auto i : *(std::static_pointer_cast<TrackerElementVector>(e))) {
+                if (i == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                if (prettyprint)
+                    stream << indent;
+
+                ReferencePack(stream, i, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "]";
+            break;
+        case TrackerType::TrackerVectorDouble:
+            stream << ppendl << indent << "[" << ppendl;
+
+            prepend_comma = false;
+
+            for (auto i : *(std::static_pointer_cast<TrackerElementVectorDouble>(e))) {
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                if (prettyprint)
+                    stream << indent;
+
+                stream << i;
+
+                stream << ppendl;
+            }
+            stream << indent << "]";
+            break;
+        case TrackerType::TrackerVectorString:
+            stream << ppendl << indent << "[" << ppendl;
+
+            prepend_comma = false;
+
+            for (auto i : *(std::static_pointer_cast<TrackerElementVectorString>(e))) {
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                if (prettyprint)
+                    stream << indent;
+
+                stream << i;
+
+                stream << ppendl;
+            }
+            stream << indent << "]";
+            break;
+        case TrackerType::TrackerMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                if ((tname = i.second->get_local_name()) == "")
+                    tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
+
+                tname = JsonAdapter::SanitizeString(tname);
+
+                if (prettyprint) {
+                    stream << indent << "\"description." << tname << "\": ";
+                    stream << "\"";
+                    stream << JsonAdapter::SanitizeString(i.second->get_type_as_string());
+                    stream << ", ";
+                    stream << JsonAdapter::SanitizeString(Globalreg::globalreg->entrytracker->GetFieldDescription(i.first));
+                    stream << "\",";
+                    stream << ppendl;
+                }
+
+                stream << indent << "\"" << tname << "\": ";
+
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl << ppendl;
+            }
+            stream << indent << "}";
+
+            break;
+        case TrackerType::TrackerIntMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementIntMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << i.first << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerMacMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementMacMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << i.first.Mac2String() << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerStringMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementStringMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << JsonAdapter::SanitizeString(i.first) << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerDoubleMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << std::fixed << i.first << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerHashkeyMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementHashkeyMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << std::fixed << i.first << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerDoubleMapDouble:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementDoubleMapDouble>(e))) {
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << std::fixed << i.first << "\": ";
+                stream << i.second;
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerKeyMap:
+            stream << ppendl << indent << "{" << ppendl;
+
+            prepend_comma = false;
+            for (auto i : *(std::static_pointer_cast<TrackerElementDeviceKeyMap>(e))) {
+                if (i.second == NULL)
+                    continue;
+
+                if (prepend_comma)
+                    stream << ",";
+                prepend_comma = true;
+
+                stream << indent << "\"" << i.first << "\": ";
+                ReferencePack(stream, i.second, prettyprint, depth + 1);
+                stream << ppendl;
+            }
+            stream << indent << "}";
+            break;
+        case TrackerType::TrackerByteArray:
+            bytes = std::static_pointer_cast<TrackerElementByteArray>(e)->get();
+            bytes_c = bytes.data();
+
+            fflags = stream.flags();
+
+            stream << "\"";
+            for (size_t szx = 0; szx < bytes.length(); szx++) {
+                stream << std::uppercase << std::setfill('0') << std::setw(2)
+                    << std::hex << (int) (bytes_c[szx] & 0xFF);
+            }
+            stream << "\"";
+            stream.flags(fflags);
+
+            break;
+
+        default:
+            break;
+    }
+}
+
+// The shared device record, whose integers come before its first double so that the
+// sticky std::fixed of the reference packer is exercised both ways, followed by every
+// other type the json adapter writes and the edge cases of each
+std::shared_ptr<TrackerElementMap> build_device(unsigned int n) {
+    static int mac_id = test_field("json.macaddr", TrackerElementFactory<TrackerElementMacAddr>());
+    static int name_id = test_field("json.name", TrackerElementFactory<TrackerElementString>());
+    static int i8_id = test_field("json.int8", TrackerElementFactory<TrackerElementInt8>());
+    static int u8_id = test_field("json.uint8", TrackerElementFactory<TrackerElementUInt8>());
+    static int i16_id = test_field("json.int16", TrackerElementFactory<TrackerElementInt16>());
+    static int u16_id = test_field("json.uint16", TrackerElementFactory<TrackerElementUInt16>());
+    static int i32_id = test_field("json.int32", TrackerElementFactory<TrackerElementInt32>());
+    static int u32_id = test_field("json.uint32", TrackerElementFactory<TrackerElementUInt32>());
+    static int i64_id = test_field("json.int64", TrackerElementFactory<TrackerElementInt64>());
+    static int u64_id = test_field("json.uint64", TrackerElementFactory<TrackerElementUInt64>());
+    static int float_id = test_field("json.float", TrackerElementFactory<TrackerElementFloat>());
+    static int double_id = test_field("json.double", TrackerElementFactory<TrackerElementDouble>());
+    static int bytes_id = test_field("json.bytes", TrackerElementFactory<TrackerElementByteArray>());
+    static int vec_id = test_field("json.vector", TrackerElementFactory<TrackerElementVector>());
+    static int vecd_id = test_field("json.vectordouble", TrackerElementFactory<TrackerElementVectorDouble>());
+    static int vecs_id = test_field("json.vectorstring", TrackerElementFactory<TrackerElementVectorString>());
+    static int intmap_id = test_field("json.intmap", TrackerElementFactory<TrackerElementIntMap>());
+    static int macmap_id = test_field("json.macmap", TrackerElementFactory<TrackerElementMacMap>());
+    static int strmap_id = test_field("json.stringmap", TrackerElementFactory<TrackerElementStringMap>());
+    static int dblmap_id = test_field("json.doublemap", TrackerElementFactory<TrackerElementDoubleMap>());
+    static int hashmap_id = test_field("json.hashkeymap", TrackerElementFactory<TrackerElementHashkeyMap>());
+    static int keymap_id = test_field("json.keymap", TrackerElementFactory<TrackerElementDeviceKeyMap>());
+    static int dmd_id = test_field("json.doublemapdouble", TrackerElementFactory<TrackerElementDoubleMapDouble>());
+
+    static const double edge_doubles[] = {
+        0.0, -0.0, 0.1, -2.5, 1e20, 1e-20, 123456789.123456789,
+        std::numeric_limits<double>::quiet_NaN(),
+        std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::max(),
+        std::numeric_limits<double>::denorm_min(),
+    };
+    const size_t num_edge = sizeof(edge_doubles) / sizeof(double);
+
+    static const char *edge_strings[] = {
+        "", "plain", "quote \" backslash \\ slash /", "tab\tnewline\nreturn\r",
+        "control \x01\x1f", "utf-8 \xc3\xa9\xe2\x82\xac", "\x7f del",
+    };
+    const size_t num_strings = sizeof(edge_strings) / sizeof(char *);
+
+    auto mac = test_mac(0x001122000000ULL + n);
+    double d = edge_doubles[n % num_edge];
+
+    auto device = test_device_record(n);
+
+    device->insert(test_value<TrackerElementString>(name_id,
+                std::string(edge_strings[n % num_strings]) + std::to_string(n)));
+    device->insert(test_value<TrackerElementInt8>(i8_id, (int8_t) (n & 0xFF)));
+    device->insert(test_value<TrackerElementUInt8>(u8_id, (uint8_t) (n & 0xFF)));
+    device->insert(test_value<TrackerElementInt16>(i16_id, (int16_t) -n));
+    device->insert(test_value<TrackerElementUInt16>(u16_id, (uint16_t) n));
+    device->insert(test_value<TrackerElementInt32>(i32_id, (int32_t) -n * 1000));
+    device->insert(test_value<TrackerElementUInt32>(u32_id, (uint32_t) n * 1000));
+    device->insert(test_value<TrackerElementInt64>(i64_id, (int64_t) n * -1000000000LL));
+    device->insert(test_value<TrackerElementUInt64>(u64_id, (uint64_t) n * 1000000000ULL));
+    device->insert(test_value<TrackerElementFloat>(float_id, (float) d));
+    device->insert(test_value<TrackerElementDouble>(double_id, d + n));
+    device->insert(test_value<TrackerElementByteArray>(bytes_id,
+                std::string("\x00\x7f\x80\xff", 4) + std::to_string(n)));
+
+    auto vec = std::make_shared<TrackerElementVector>(vec_id);
+    vec->push_back(test_value<TrackerElementUInt32>(u32_id, n));
+    vec->push_back(test_value<TrackerElementString>(name_id, edge_strings[(n + 1) % num_strings]));
+    device->insert(vec);
+
+    auto vecd = std::make_shared<TrackerElementVectorDouble>(vecd_id);
+    for (unsigned int x = 0; x < 4; x++)
+        vecd->push_back(edge_doubles[(n + x) % num_edge]);
+    device->insert(vecd);
+
+    auto vecs = std::make_shared<TrackerElementVectorString>(vecs_id);
+    vecs->push_back("first");
+    vecs->push_back(std::to_string(n));
+    device->insert(vecs);
+
+    auto intmap = std::make_shared<TrackerElementIntMap>(intmap_id);
+    intmap->insert((int) n, test_value<TrackerElementInt32>(i32_id, n));
+    intmap->insert(-1, test_value<TrackerElementDouble>(double_id, d));
+    device->insert(intmap);
+
+    auto macmap = std::make_shared<TrackerElementMacMap>(macmap_id);
+    for (unsigned int c = 0; c < n % 4; c++) {
+        auto cmac = test_mac(0x665544000000ULL + (n << 2) + c);
+        macmap->insert(cmac, test_value<TrackerElementMacAddr>(mac_id, cmac));
+    }
+    device->insert(macmap);
+
+    auto strmap = std::make_shared<TrackerElementStringMap>(strmap_id);
+    strmap->insert(edge_strings[n % num_strings], test_value<TrackerElementUInt64>(u64_id, n));
+    device->insert(strmap);
+
+    auto dblmap = std::make_shared<TrackerElementDoubleMap>(dblmap_id);
+    dblmap->insert(2412000.0 + (n % 11) * 5000, test_value<TrackerElementUInt64>(u64_id, n));
+    dblmap->insert(d == d ? d : 0, test_value<TrackerElementUInt64>(u64_id, n));
+    device->insert(dblmap);
+
+    auto hashmap = std::make_shared<TrackerElementHashkeyMap>(hashmap_id);
+    hashmap->insert((size_t) n * 0x9E3779B97F4A7C15ULL, test_value<TrackerElementUInt8>(u8_id, 1));
+    device->insert(hashmap);
+
+    auto keymap = std::make_shared<TrackerElementDeviceKeyMap>(keymap_id);
+    keymap->insert(device_key(0x4321, mac), test_value<TrackerElementUInt32>(u32_id, n));
+    device->insert(keymap);
+
+    auto dmd = std::make_shared<TrackerElementDoubleMapDouble>(dmd_id);
+    dmd->insert(-80.0, n);
+    dmd->insert(0.5, d == d ? d : 0);
+    device->insert(dmd);
+
+    return device;
+}
+
+// Report the first difference between the reference and packed output
+bool identical(const std::string& in_what, const std::string& in_reference,
+        const std::string& in_packed) {
+    if (in_reference == in_packed)
+        return true;
+
+    size_t pos = 0;
+
+    while (pos < in_reference.length() && pos < in_packed.length() &&
+            in_reference[pos] == in_packed[pos])
+        pos++;
+
+    size_t start = pos < 40 ? 0 : pos - 40;
+
+    fprintf(stderr, "%s differs at byte %lu of %lu/%lu:\n  reference: %s\n  packed:    %s\n",
+            in_what.c_str(), pos, in_reference.length(), in_packed.length(),
+            in_reference.substr(start, 80).c_str(), in_packed.substr(start, 80).c_str());
+
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int num_records = 100000;
+
+    if (argc > 1)
+        num_records = strtoul(argv[1], NULL, 10);
+
+    test_harness_init();
+
+    auto devices = std::make_shared<TrackerElementVector>();
+
+    for (unsigned int n = 0; n < num_records; n++)
+        devices->push_back(build_device(n));
+
+    // Each record on its own, from a fresh stream
+    for (unsigned int n = 0; n < num_records; n++) {
+        std::stringstream reference, packed;
+
+        ReferencePack(reference, (*devices)[n]);
+        JsonAdapter::Pack(packed, (*devices)[n]);
+
+        if (!identical("record " + std::to_string(n), reference.str(), packed.str()))
+            exit(1);
+    }
+
+    // Pretty printed, on a sample
+    for (unsigned int n = 0; n < num_records && n < 1000; n++) {
+        std::stringstream reference, packed;
+
+        ReferencePack(reference, (*devices)[n], true, 1);
+        JsonAdapter::Pack(packed, (*devices)[n], nullptr, true, 1);
+
+        if (!identical("pretty record " + std::to_string(n), reference.str(), packed.str()))
+            exit(1);
+    }
+
+    // Several records written to the same stream, as the ekjson serializer does, so
+    // that stream flags set by one carry into the next
+    {
+        std::stringstream reference, packed;
+
+        for (unsigned int n = 0; n < num_records && n < 1000; n++) {
+            ReferencePack(reference, (*devices)[n]);
+            reference << "\n";
+            JsonAdapter::Pack(packed, (*devices)[n]);
+            packed << "\n";
+        }
+
+        if (!identical("record stream", reference.str(), packed.str()))
+            exit(1);
+    }
+
+    // The whole list, timed
+    std::stringstream reference, packed;
+
+    auto start = std::chrono::steady_clock::now();
+    ReferencePack(reference, devices);
+    auto reference_ms = test_elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    JsonAdapter::Pack(packed, devices);
+    auto packed_ms = test_elapsed_ms(start);
+
+    if (!identical("device list", reference.str(), packed.str()))
+        exit(1);
+
+    double mb = packed.str().length() / (1024.0 * 1024.0);
+
+    printf("%u device records, %.1f MB of json, byte-identical\n", num_records, mb);
+    printf("%-12s %10s %10s\n", "packer", "ms", "MB/s");
+    printf("%-12s %10.1f %10.1f\n", "reference", reference_ms, mb / (reference_ms / 1000));
+    printf("%-12s %10.1f %10.1f\n", "JsonAdapter", packed_ms, mb / (packed_ms / 1000));
+
+    test_harness_shutdown();
+
+    return 0;
+}
+
@@ -0,0 +1,703 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "globalregistry.h"
+#include "trackedelement.h"
+#include "entrytracker.h"
+#include "macaddr.h"
+#include "uuid.h"
+#include "kbin_adapter.h"
+
+namespace {
+
+const char kbin_magic[] = { 'K', 'B', 'I', 'N' };
+
+// Type byte of a null element
+const uint8_t kbin_null = 0xFF;
+
+// Deepest tree we'll rebuild from a record, to keep a corrupt record from recursing
+// off the stack
+const unsigned int kbin_max_depth = 128;
+
+class kbin_packer {
+public:
+    kbin_packer(std::ostream& in_stream,
+            std::shared_ptr<TrackerElementSerializer::rename_map> in_name_map) :
+        stream(in_stream),
+        name_map(in_name_map) { }
+
+    void pack(const SharedTrackerElement& e) {
+        if (e == nullptr) {
+            put_byte(kbin_null);
+            put_varint(0);
+            return;
+        }
+
+        SerializerScope s(e, name_map);
+
+        put_byte((uint8_t) e->get_type());
+        put_name(e);
+
+        switch (e->get_type()) {
+            case TrackerType::TrackerString:
+                put_string(GetTrackerValue<std::string>(e));
+                break;
+            case TrackerType::TrackerInt8:
+                put_byte((uint8_t) GetTrackerValue<int8_t>(e));
+                break;
+            case TrackerType::TrackerUInt8:
+                put_byte(GetTrackerValue<uint8_t>(e));
+                break;
+            case TrackerType::TrackerInt16:
+                put_svarint(GetTrackerValue<int16_t>(e));
+                break;
+            case TrackerType::TrackerUInt16:
+                put_varint(GetTrackerValue<uint16_t>(e));
+                break;
+            case TrackerType::TrackerInt32:
+                put_svarint(GetTrackerValue<int32_t>(e));
+                break;
+            case TrackerType::TrackerUInt32:
+                put_varint(GetTrackerValue<uint32_t>(e));
+                break;
+            case TrackerType::TrackerInt64:
+                put_svarint(GetTrackerValue<int64_t>(e));
+                break;
+            case TrackerType::TrackerUInt64:
+                put_varint(GetTrackerValue<uint64_t>(e));
+                break;
+            case TrackerType::TrackerFloat:
+                put_float(GetTrackerValue<float>(e));
+                break;
+            case TrackerType::TrackerDouble:
+                put_double(GetTrackerValue<double>(e));
+                break;
+            case TrackerType::TrackerMac:
+                put_mac(GetTrackerValue<mac_addr>(e));
+                break;
+            case TrackerType::TrackerUuid:
+                stream.write((const char *) GetTrackerValue<uuid>(e).uuid_block, 16);
+                break;
+            case TrackerType::TrackerKey:
+                put_string(GetTrackerValue<device_key>(e).as_string());
+                break;
+            case TrackerType::TrackerByteArray:
+                put_string(std::static_pointer_cast<TrackerElementByteArray>(e)->get());
+                break;
+            case TrackerType::TrackerVector: {
+                auto v = std::static_pointer_cast<TrackerElementVector>(e);
+                put_varint(count_present(*v));
+                for (auto i : *v) {
+                    if (i != nullptr)
+                        pack(i);
+                }
+                break;
+            }
+            case TrackerType::TrackerVectorDouble: {
+                auto v = std::static_pointer_cast<TrackerElementVectorDouble>(e);
+                put_varint(v->size());
+                for (auto i : *v)
+                    put_double(i);
+                break;
+            }
+            case TrackerType::TrackerVectorString: {
+                auto v = std::static_pointer_cast<TrackerElementVectorString>(e);
+                put_varint(v->size());
+                for (auto i : *v)
+                    put_string(i);
+                break;
+            }
+            case TrackerType::TrackerMap: {
+                // Map children are keyed by their field, which is carried in their
+                // name tag
+                auto m = std::static_pointer_cast<TrackerElementMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second != nullptr)
+                        pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerIntMap: {
+                auto m = std::static_pointer_cast<TrackerElementIntMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_svarint(i.first);
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerMacMap: {
+                auto m = std::static_pointer_cast<TrackerElementMacMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_mac(i.first);
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerStringMap: {
+                auto m = std::static_pointer_cast<TrackerElementStringMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_string(i.first);
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerDoubleMap: {
+                auto m = std::static_pointer_cast<TrackerElementDoubleMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_double(i.first);
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerHashkeyMap: {
+                auto m = std::static_pointer_cast<TrackerElementHashkeyMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_varint(i.first);
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerKeyMap: {
+                auto m = std::static_pointer_cast<TrackerElementDeviceKeyMap>(e);
+                put_varint(count_present_second(*m));
+                for (auto i : *m) {
+                    if (i.second == nullptr)
+                        continue;
+                    put_string(i.first.as_string());
+                    pack(i.second);
+                }
+                break;
+            }
+            case TrackerType::TrackerDoubleMapDouble: {
+                auto m = std::static_pointer_cast<TrackerElementDoubleMapDouble>(e);
+                put_varint(m->size());
+                for (auto i : *m) {
+                    put_double(i.first);
+                    put_double(i.second);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+protected:
+    std::ostream& stream;
+    std::shared_ptr<TrackerElementSerializer::rename_map> name_map;
+
+    // Name references already written to this record, by field ID and by name
+    std::unordered_map<int, uint64_t> id_refs;
+    std::unordered_map<std::string, uint64_t> name_refs;
+
+    template<typename C>
+    static uint64_t count_present(C& c) {
+        uint64_t n = 0;
+        for (auto i : c)
+            if (i != nullptr)
+                n++;
+        return n;
+    }
+
+    template<typename C>
+    static uint64_t count_present_second(C& c) {
+        uint64_t n = 0;
+        for (auto i : c)
+            if (i.second != nullptr)
+                n++;
+        return n;
+    }
+
+    void put_byte(uint8_t b) {
+        stream.put((char) b);
+    }
+
+    void put_varint(uint64_t v) {
+        char buf[10];
+        size_t len = 0;
+
+        while (v >= 0x80) {
+            buf[len++] = (char) ((v & 0x7F) | 0x80);
+            v >>= 7;
+        }
+        buf[len++] = (char) v;
+
+        stream.write(buf, len);
+    }
+
+    void put_svarint(int64_t v) {
+        put_varint(((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+    }
+
+    void put_fixed(uint64_t v, unsigned int len) {
+        char buf[8];
+
+        for (unsigned int x = 0; x < len; x++)
+            buf[x] = (char) ((v >> (x * 8)) & 0xFF);
+
+        stream.write(buf, len);
+    }
+
+    void put_float(float f) {
+        uint32_t v;
+        memcpy(&v, &f, sizeof(v));
+        put_fixed(v, 4);
+    }
+
+    void put_double(double d) {
+        uint64_t v;
+        memcpy(&v, &d, sizeof(v));
+        put_fixed(v, 8);
+    }
+
+    void put_string(const std::string& s) {
+        put_varint(s.length());
+        stream.write(s.data(), s.length());
+    }
+
+    void put_mac(const mac_addr& m) {
+        put_varint(m.longmac);
+        put_varint(m.longmask);
+    }
+
+    void put_name(const SharedTrackerElement& e) {
+        if (name_map != nullptr) {
+            auto nmi = name_map->find(e);
+            if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
+                put_named_ref(nmi->second->rename);
+                return;
+            }
+        }
+
+        auto id = e->get_id();
+
+        if (id < 0) {
+            put_varint(0);
+            return;
+        }
+
+        auto ri = id_refs.find(id);
+        if (ri != id_refs.end()) {
+            put_varint(ri->second);
+            return;
+        }
+
+        id_refs[id] = put_named_ref(Globalreg::globalreg->entrytracker->GetFieldName(id));
+    }
+
+    uint64_t put_named_ref(const std::string& name) {
+        auto ri = name_refs.find(name);
+        if (ri != name_refs.end()) {
+            put_varint(ri->second);
+            return ri->second;
+        }
+
+        // Define the next name
+        uint64_t ref = name_refs.size() + 1;
+        name_refs[name] = ref;
+
+        put_varint(ref);
+        put_string(name);
+
+        return ref;
+    }
+};
+
+class kbin_unpacker {
+public:
+    kbin_unpacker(std::istream& in_stream) :
+        stream(in_stream) { }
+
+    SharedTrackerElement unpack(unsigned int depth = 0) {
+        if (depth > kbin_max_depth)
+            throw std::runtime_error("kbin record nested too deeply");
+
+        auto type_byte = get_byte();
+        auto id = get_name();
+
+        if (type_byte == kbin_null)
+            return nullptr;
+
+        SharedTrackerElement elem;
+
+        switch ((TrackerType) type_byte) {
+            case TrackerType::TrackerString:
+                elem = std::make_shared<TrackerElementString>();
+                std::static_pointer_cast<TrackerElementString>(elem)->set(get_string());
+                break;
+            case TrackerType::TrackerInt8:
+                elem = std::make_shared<TrackerElementInt8>();
+                std::static_pointer_cast<TrackerElementInt8>(elem)->set((int8_t) get_byte());
+                break;
+            case TrackerType::TrackerUInt8:
+                elem = std::make_shared<TrackerElementUInt8>();
+                std::static_pointer_cast<TrackerElementUInt8>(elem)->set(get_byte());
+                break;
+            case TrackerType::TrackerInt16:
+                elem = std::make_shared<TrackerElementInt16>();
+                std::static_pointer_cast<TrackerElementInt16>(elem)->set((int16_t) get_svarint());
+                break;
+            case TrackerType::TrackerUInt16:
+                elem = std::make_shared<TrackerElementUInt16>();
+                std::static_pointer_cast<TrackerElementUInt16>(elem)->set((uint16_t) get_varint());
+                break;
+            case TrackerType::TrackerInt32:
+                elem = std::make_shared<TrackerElementInt32>();
+                std::static_pointer_cast<TrackerElementInt32>(elem)->set((int32_t) get_svarint());
+                break;
+            case TrackerType::TrackerUInt32:
+                elem = std::make_shared<TrackerElementUInt32>();
+                std::static_pointer_cast<TrackerElementUInt32>(elem)->set((uint32_t) get_varint());
+                break;
+            case TrackerType::TrackerInt64:
+                elem = std::make_shared<TrackerElementInt64>();
+                std::static_pointer_cast<TrackerElementInt64>(elem)->set(get_svarint());
+                break;
+            case TrackerType::TrackerUInt64:
+                elem = std::make_shared<TrackerElementUInt64>();
+                std::static_pointer_cast<TrackerElementUInt64>(elem)->set(get_varint());
+                break;
+            case TrackerType::TrackerFloat:
+                elem = std::make_shared<TrackerElementFloat>();
+                std::static_pointer_cast<TrackerElementFloat>(elem)->set(get_float());
+                break;
+            case TrackerType::TrackerDouble:
+                elem = std::make_shared<TrackerElementDouble>();
+                std::static_pointer_cast<TrackerElementDouble>(elem)->set(get_double());
+                break;
+            case TrackerType::TrackerMac:
+                elem = std::make_shared<TrackerElementMacAddr>();
+                std::static_pointer_cast<TrackerElementMacAddr>(elem)->set(get_mac());
+                break;
+            case TrackerType::TrackerUuid: {
+                uuid u;
+                get_bytes((char *) u.uuid_block, 16);
+                u.error = 0;
+                elem = std::make_shared<TrackerElementUUID>();
+                std::static_pointer_cast<TrackerElementUUID>(elem)->set(u);
+                break;
+            }
+            case TrackerType::TrackerKey:
+                elem = std::make_shared<TrackerElementDeviceKey>();
+                std::static_pointer_cast<TrackerElementDeviceKey>(elem)->set(get_key());
+                break;
+            case TrackerType::TrackerByteArray:
+                elem = std::make_shared<TrackerElementByteArray>();
+                std::static_pointer_cast<TrackerElementByteArray>(elem)->set(get_string());
+                break;
+            case TrackerType::TrackerVector: {
+                auto v = std::make_shared<TrackerElementVector>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        v->push_back(re);
+                }
+                elem = v;
+                break;
+            }
+            case TrackerType::TrackerVectorDouble: {
+                auto v = std::make_shared<TrackerElementVectorDouble>();
+                for (auto n = get_count(); n > 0; n--)
+                    v->push_back(get_double());
+                elem = v;
+                break;
+            }
+            case TrackerType::TrackerVectorString: {
+                auto v = std::make_shared<TrackerElementVectorString>();
+                for (auto n = get_count(); n > 0; n--)
+                    v->push_back(get_string());
+                elem = v;
+                break;
+            }
+            case TrackerType::TrackerMap: {
+                auto m = std::make_shared<TrackerElementMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerIntMap: {
+                auto m = std::make_shared<TrackerElementIntMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = (int) get_svarint();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerMacMap: {
+                auto m = std::make_shared<TrackerElementMacMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = get_mac();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerStringMap: {
+                auto m = std::make_shared<TrackerElementStringMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = get_string();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerDoubleMap: {
+                auto m = std::make_shared<TrackerElementDoubleMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = get_double();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerHashkeyMap: {
+                auto m = std::make_shared<TrackerElementHashkeyMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = (size_t) get_varint();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerKeyMap: {
+                auto m = std::make_shared<TrackerElementDeviceKeyMap>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = get_key();
+                    auto re = unpack(depth + 1);
+                    if (re != nullptr)
+                        m->insert(k, re);
+                }
+                elem = m;
+                break;
+            }
+            case TrackerType::TrackerDoubleMapDouble: {
+                auto m = std::make_shared<TrackerElementDoubleMapDouble>();
+                for (auto n = get_count(); n > 0; n--) {
+                    auto k = get_double();
+                    m->insert(k, get_double());
+                }
+                elem = m;
+                break;
+            }
+            default:
+                throw std::runtime_error(fmt::format("unknown kbin element type {}",
+                            (unsigned int) type_byte));
+        }
+
+        elem->set_id(id);
+
+        return elem;
+    }
+
+protected:
+    std::istream& stream;
+
+    // Field IDs of the names defined so far in this record
+    std::vector<int> name_ids;
+
+    uint8_t get_byte() {
+        auto c = stream.get();
+
+        if (c == std::char_traits<char>::eof())
+            throw std::runtime_error("truncated kbin record");
+
+        return (uint8_t) c;
+    }
+
+    void get_bytes(char *buf, size_t len) {
+        if (!stream.read(buf, len))
+            throw std::runtime_error("truncated kbin record");
+    }
+
+    uint64_t get_varint() {
+        uint64_t v = 0;
+
+        for (unsigned int shift = 0; shift < 64; shift += 7) {
+            auto b = get_byte();
+
+            v |= (uint64_t) (b & 0x7F) << shift;
+
+            if ((b & 0x80) == 0)
+                return v;
+        }
+
+        throw std::runtime_error("invalid varint in kbin record");
+    }
+
+    int64_t get_svarint() {
+        auto v = get_varint();
+        return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+    }
+
+    // Every counted item consumes at least one byte, so a corrupt count runs into the
+    // end of the record instead of looping forever
+    uint64_t get_count() {
+        return get_varint();
+    }
+
+    uint64_t get_fixed(unsigned int len) {
+        char buf[8];
+        uint64_t v = 0;
+
+        get_bytes(buf, len);
+
+        for (unsigned int x = 0; x < len; x++)
+            v |= (uint64_t) (buf[x] & 0xFF) << (x * 8);
+
+        return v;
+    }
+
+    float get_float() {
+        uint32_t v = (uint32_t) get_fixed(4);
+        float f;
+        memcpy(&f, &v, sizeof(f));
+        return f;
+    }
+
+    double get_double() {
+        uint64_t v = get_fixed(8);
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+
+    // Strings are read in chunks so a corrupt length fails on the end of the record
+    // rather than on allocating it
+    std::string get_string() {
+        auto len = get_count();
+        std::string s;
+        char buf[4096];
+
+        while (len > 0) {
+            auto chunk = std::min(len, (uint64_t) sizeof(buf));
+            get_bytes(buf, chunk);
+            s.append(buf, chunk);
+            len -= chunk;
+        }
+
+        return s;
+    }
+
+    mac_addr get_mac() {
+        mac_addr m;
+        m.longmac = get_varint();
+        m.longmask = get_varint();
+        return m;
+    }
+
+    device_key get_key() {
+        device_key k(get_string());
+
+        if (k.get_error())
+            throw std::runtime_error("invalid device key in kbin record");
+
+        return k;
+    }
+
+    int get_name() {
+        auto ref = get_varint();
+
+        if (ref == 0)
+            return -1;
+
+        if (ref <= name_ids.size())
+            return name_ids[ref - 1];
+
+        if (ref != name_ids.size() + 1)
+            throw std::runtime_error("invalid field name reference in kbin record");
+
+        name_ids.push_back(Globalreg::globalreg->entrytracker->GetFieldId(get_string()));
+
+        return name_ids.back();
+    }
+};
+
+}
+
+void KbinAdapter::Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map) {
+    stream.write(kbin_magic, sizeof(kbin_magic));
+    stream.put((char) kbin_version);
+
+    kbin_packer(stream, name_map).pack(e);
+}
+
+SharedTrackerElement KbinAdapter::Unpack(std::istream &stream) {
+    char magic[sizeof(kbin_magic)];
+
+    if (!stream.read(magic, sizeof(magic)) || memcmp(magic, kbin_magic, sizeof(magic)) != 0)
+        throw std::runtime_error("not a kbin record");
+
+    auto version = stream.get();
+
+    if (version != kbin_version)
+        throw std::runtime_error(fmt::format("unsupported kbin record version {}", version));
+
+    return kbin_unpacker(stream).unpack();
+}
+
+SharedTrackerElement KbinAdapter::Unpack(const std::string& data) {
+    std::stringstream ss(data);
+    return Unpack(ss);
+}
+
+bool KbinAdapter::IsKbin(const std::string& data) {
+    return data.length() > sizeof(kbin_magic) &&
+        memcmp(data.data(), kbin_magic, sizeof(kbin_magic)) == 0;
+}
+
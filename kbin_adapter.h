@@ -0,0 +1,80 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KBIN_ADAPTER_H__
+#define __KBIN_ADAPTER_H__
+
+#include "config.h"
+
+#include <iostream>
+#include <string>
+
+#include "globalregistry.h"
+#include "trackedelement.h"
+#include "entrytracker.h"
+
+// Compact binary serialization of tracked element trees.
+//
+// A kbin record is the magic 'KBIN', a format version byte, and a single element.
+// Every element is written as:
+//
+//    type     (uint8, the fixed TrackerType value, or 0xFF for a null element)
+//    name     (varint name reference, see below)
+//    data     (type-specific)
+//
+// Field names are tagged inline the first time they are used: a name reference of 0
+// is an unnamed element, a reference of N refers to the N-1th name already defined in
+// this record, and a reference of one past the last defined name defines a new name,
+// followed by the length-prefixed name string.  This keeps records self-describing,
+// so they can be loaded by a server with different field IDs, while only costing a
+// byte or two per repeated field.
+//
+// Integers are varints (zigzag encoded for signed types), floating point values are
+// little-endian IEEE, strings and byte arrays are length-prefixed, mac addresses are
+// the address and mask as varints, UUIDs are the raw 16 bytes, and device keys are
+// their string form.  Containers are a varint count followed by their contents.
+namespace KbinAdapter {
+
+const uint8_t kbin_version = 1;
+
+void Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map = nullptr);
+
+// Rebuild an element tree from a kbin record; field names are resolved to the IDs
+// registered in this server.  Throws std::runtime_error on a malformed record.
+SharedTrackerElement Unpack(std::istream &stream);
+SharedTrackerElement Unpack(const std::string& data);
+
+// Does the data start with the kbin magic?
+bool IsKbin(const std::string& data);
+
+class Serializer : public TrackerElementSerializer {
+public:
+    Serializer() :
+        TrackerElementSerializer() { }
+
+    virtual void serialize(SharedTrackerElement in_elem, std::ostream &stream,
+            std::shared_ptr<rename_map> name_map = nullptr) override {
+        Pack(stream, in_elem, name_map);
+    }
+};
+
+}
+
+#endif
+
@@ -0,0 +1,431 @@
+/* test harness for the Kismet kbin adapter
+ *
+ * Packs a record holding one element of every TrackerType, including each of the
+ * keyed maps, unpacks it, and compares the rebuilt tree to the original.  Then packs
+ * and loads a batch of device-like records as kbin and as storage json, and reports
+ * the size, compressed size, and time of each.
+ *
+ * # configure kismet, optionally with asan
+ * ./configure --enable-asan
+ *
+ * # build and run every test harness
+ * make check
+ *
+ * # or build this harness alone
+ * make kbin_adapter_test
+ *
+ * ./kbin_adapter_test [number of records]
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <iostream>
+
+#include "globalregistry.h"
+#include "entrytracker.h"
+#include "trackedelement.h"
+#include "kbin_adapter.h"
+#include "json_adapter.h"
+#include "kismet_json.h"
+#include "storageloader.h"
+#include "zstr.hpp"
+#include "kis_test_harness.h"
+
+template<typename TE, typename V>
+std::shared_ptr<TE> scalar(const std::string& in_name, const V& in_value) {
+    auto e = std::make_shared<TE>(test_field("kbin." + in_name, TrackerElementFactory<TE>()));
+    e->set(in_value);
+    return e;
+}
+
+template<typename TE>
+std::shared_ptr<TE> named(const std::string& in_name) {
+    return std::make_shared<TE>(test_field("kbin." + in_name, TrackerElementFactory<TE>()));
+}
+
+// A record with one element of every type
+std::shared_ptr<TrackerElementMap> build_all_types() {
+    auto root = named<TrackerElementMap>("root");
+
+    root->insert(scalar<TrackerElementString>("string", std::string("kbin \"test\"\n")));
+    root->insert(scalar<TrackerElementInt8>("int8", (int8_t) -100));
+    root->insert(scalar<TrackerElementUInt8>("uint8", (uint8_t) 250));
+    root->insert(scalar<TrackerElementInt16>("int16", (int16_t) -30000));
+    root->insert(scalar<TrackerElementUInt16>("uint16", (uint16_t) 60000));
+    root->insert(scalar<TrackerElementInt32>("int32", (int32_t) -2000000000));
+    root->insert(scalar<TrackerElementUInt32>("uint32", (uint32_t) 4000000000U));
+    root->insert(scalar<TrackerElementInt64>("int64", (int64_t) -9000000000000000000LL));
+    root->insert(scalar<TrackerElementUInt64>("uint64", (uint64_t) 18000000000000000000ULL));
+    root->insert(scalar<TrackerElementFloat>("float", (float) -1.5e-7));
+    root->insert(scalar<TrackerElementDouble>("double", 3.141592653589793));
+    root->insert(scalar<TrackerElementMacAddr>("mac", mac_addr("AA:BB:CC:00:00:00/FF:FF:FF:00:00:00")));
+    root->insert(scalar<TrackerElementUUID>("uuid", uuid("01234567-89AB-CDEF-0123-456789ABCDEF")));
+    root->insert(scalar<TrackerElementDeviceKey>("key", device_key(0x12345678, mac_addr("00:11:22:33:44:55"))));
+    root->insert(scalar<TrackerElementByteArray>("bytes", std::string("\x00\x01\xFF\x7F", 4)));
+
+    auto vec = named<TrackerElementVector>("vector");
+    vec->push_back(std::make_shared<TrackerElementString>(-1, "unnamed"));
+    vec->push_back(std::make_shared<TrackerElementUInt32>(-1, 42));
+    root->insert(vec);
+
+    auto submap = named<TrackerElementMap>("map");
+    submap->insert(scalar<TrackerElementString>("map.string", std::string("nested")));
+    root->insert(submap);
+
+    auto intmap = named<TrackerElementIntMap>("intmap");
+    intmap->insert(-5, std::make_shared<TrackerElementString>(-1, "negative"));
+    intmap->insert(7, std::make_shared<TrackerElementDouble>(-1, 7.25));
+    root->insert(intmap);
+
+    auto macmap = named<TrackerElementMacMap>("macmap");
+    macmap->insert(mac_addr("00:11:22:33:44:55"),
+            std::make_shared<TrackerElementUInt64>(-1, 1));
+    macmap->insert(mac_addr("66:77:88:99:AA:BB"),
+            std::make_shared<TrackerElementUInt64>(-1, 2));
+    root->insert(macmap);
+
+    auto stringmap = named<TrackerElementStringMap>("stringmap");
+    stringmap->insert("", std::make_shared<TrackerElementString>(-1, "empty key"));
+    stringmap->insert("key", std::make_shared<TrackerElementInt32>(-1, -1));
+    root->insert(stringmap);
+
+    auto doublemap = named<TrackerElementDoubleMap>("doublemap");
+    doublemap->insert(-0.5, std::make_shared<TrackerElementString>(-1, "half"));
+    doublemap->insert(2412.0, std::make_shared<TrackerElementString>(-1, "channel 1"));
+    root->insert(doublemap);
+
+    auto hashmap = named<TrackerElementHashkeyMap>("hashkeymap");
+    hashmap->insert((size_t) 0xFFFFFFFFFFFFFFFFULL, std::make_shared<TrackerElementUInt8>(-1, 1));
+    hashmap->insert((size_t) 12345, std::make_shared<TrackerElementUInt8>(-1, 2));
+    root->insert(hashmap);
+
+    auto keymap = named<TrackerElementDeviceKeyMap>("keymap");
+    keymap->insert(device_key(1, mac_addr("00:00:00:00:00:01")),
+            std::make_shared<TrackerElementString>(-1, "first"));
+    keymap->insert(device_key(2, mac_addr("00:00:00:00:00:02")),
+            std::make_shared<TrackerElementString>(-1, "second"));
+    root->insert(keymap);
+
+    auto vecdouble = named<TrackerElementVectorDouble>("vectordouble");
+    vecdouble->push_back(0);
+    vecdouble->push_back(-1.25);
+    vecdouble->push_back(1e300);
+    root->insert(vecdouble);
+
+    auto mapdouble = named<TrackerElementDoubleMapDouble>("doublemapdouble");
+    mapdouble->insert(2412.0, 10.0);
+    mapdouble->insert(5180.0, -0.001);
+    root->insert(mapdouble);
+
+    auto vecstring = named<TrackerElementVectorString>("vectorstring");
+    vecstring->push_back("");
+    vecstring->push_back("second");
+    root->insert(vecstring);
+
+    return root;
+}
+
+bool compare(const SharedTrackerElement& a, const SharedTrackerElement& b,
+        const std::string& path);
+
+template<typename TE>
+bool compare_map(const SharedTrackerElement& a, const SharedTrackerElement& b,
+        const std::string& path) {
+    auto am = std::static_pointer_cast<TE>(a);
+    auto bm = std::static_pointer_cast<TE>(b);
+
+    if (am->size() != bm->size()) {
+        fprintf(stderr, "%s: map size %lu != %lu\n", path.c_str(), am->size(), bm->size());
+        return false;
+    }
+
+    for (auto i : *am) {
+        auto bi = bm->find(i.first);
+
+        std::stringstream ss;
+        ss << path << "[" << i.first << "]";
+
+        if (bi == bm->end()) {
+            fprintf(stderr, "%s: missing after unpacking\n", ss.str().c_str());
+            return false;
+        }
+
+        if (!compare(i.second, bi->second, ss.str()))
+            return false;
+    }
+
+    return true;
+}
+
+template<typename V>
+bool compare_value(const SharedTrackerElement& a, const SharedTrackerElement& b,
+        const std::string& path) {
+    if (GetTrackerValue<V>(a) == GetTrackerValue<V>(b))
+        return true;
+
+    std::stringstream ss;
+    ss << GetTrackerValue<V>(a) << " != " << GetTrackerValue<V>(b);
+    fprintf(stderr, "%s: %s\n", path.c_str(), ss.str().c_str());
+
+    return false;
+}
+
+bool compare(const SharedTrackerElement& a, const SharedTrackerElement& b,
+        const std::string& path) {
+    if (a == nullptr || b == nullptr) {
+        if (a == b)
+            return true;
+
+        fprintf(stderr, "%s: null element\n", path.c_str());
+        return false;
+    }
+
+    if (a->get_type() != b->get_type()) {
+        fprintf(stderr, "%s: type %s != %s\n", path.c_str(),
+                a->get_type_as_string().c_str(), b->get_type_as_string().c_str());
+        return false;
+    }
+
+    if (a->get_id() != b->get_id()) {
+        fprintf(stderr, "%s: field %d != %d\n", path.c_str(), a->get_id(), b->get_id());
+        return false;
+    }
+
+    switch (a->get_type()) {
+        case TrackerType::TrackerString:
+            return compare_value<std::string>(a, b, path);
+        case TrackerType::TrackerInt8:
+            return compare_value<int8_t>(a, b, path);
+        case TrackerType::TrackerUInt8:
+            return compare_value<uint8_t>(a, b, path);
+        case TrackerType::TrackerInt16:
+            return compare_value<int16_t>(a, b, path);
+        case TrackerType::TrackerUInt16:
+            return compare_value<uint16_t>(a, b, path);
+        case TrackerType::TrackerInt32:
+            return compare_value<int32_t>(a, b, path);
+        case TrackerType::TrackerUInt32:
+            return compare_value<uint32_t>(a, b, path);
+        case TrackerType::TrackerInt64:
+            return compare_value<int64_t>(a, b, path);
+        case TrackerType::TrackerUInt64:
+            return compare_value<uint64_t>(a, b, path);
+        case TrackerType::TrackerFloat:
+            return compare_value<float>(a, b, path);
+        case TrackerType::TrackerDouble:
+            return compare_value<double>(a, b, path);
+        case TrackerType::TrackerMac:
+            return compare_value<mac_addr>(a, b, path);
+        case TrackerType::TrackerUuid:
+            return compare_value<uuid>(a, b, path);
+        case TrackerType::TrackerKey:
+            return compare_value<device_key>(a, b, path);
+        case TrackerType::TrackerByteArray:
+            if (std::static_pointer_cast<TrackerElementByteArray>(a)->get() ==
+                    std::static_pointer_cast<TrackerElementByteArray>(b)->get())
+                return true;
+            fprintf(stderr, "%s: byte arrays differ\n", path.c_str());
+            return false;
+        case TrackerType::TrackerVector: {
+            auto av = std::static_pointer_cast<TrackerElementVector>(a);
+            auto bv = std::static_pointer_cast<TrackerElementVector>(b);
+
+            if (av->size() != bv->size()) {
+                fprintf(stderr, "%s: vector size %lu != %lu\n", path.c_str(),
+                        av->size(), bv->size());
+                return false;
+            }
+
+            for (size_t i = 0; i < av->size(); i++) {
+                if (!compare((*av)[i], (*bv)[i], path + "[" + std::to_string(i) + "]"))
+                    return false;
+            }
+
+            return true;
+        }
+        case TrackerType::TrackerVectorDouble:
+            if (std::static_pointer_cast<TrackerElementVectorDouble>(a)->get() ==
+                    std::static_pointer_cast<TrackerElementVectorDouble>(b)->get())
+                return true;
+            fprintf(stderr, "%s: double vectors differ\n", path.c_str());
+            return false;
+        case TrackerType::TrackerVectorString:
+            if (std::static_pointer_cast<TrackerElementVectorString>(a)->get() ==
+                    std::static_pointer_cast<TrackerElementVectorString>(b)->get())
+                return true;
+            fprintf(stderr, "%s: string vectors differ\n", path.c_str());
+            return false;
+        case TrackerType::TrackerMap: {
+            auto am = std::static_pointer_cast<TrackerElementMap>(a);
+            auto bm = std::static_pointer_cast<TrackerElementMap>(b);
+
+            if (am->size() != bm->size()) {
+                fprintf(stderr, "%s: map size %lu != %lu\n", path.c_str(),
+                        am->size(), bm->size());
+                return false;
+            }
+
+            for (auto i : *am) {
+                auto name = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
+
+                if (!compare(i.second, bm->get_sub(i.first), path + "/" + name))
+                    return false;
+            }
+
+            return true;
+        }
+        case TrackerType::TrackerIntMap:
+            return compare_map<TrackerElementIntMap>(a, b, path);
+        case TrackerType::TrackerMacMap:
+            return compare_map<TrackerElementMacMap>(a, b, path);
+        case TrackerType::TrackerStringMap:
+            return compare_map<TrackerElementStringMap>(a, b, path);
+        case TrackerType::TrackerDoubleMap:
+            return compare_map<TrackerElementDoubleMap>(a, b, path);
+        case TrackerType::TrackerHashkeyMap:
+            return compare_map<TrackerElementHashkeyMap>(a, b, path);
+        case TrackerType::TrackerKeyMap:
+            return compare_map<TrackerElementDeviceKeyMap>(a, b, path);
+        case TrackerType::TrackerDoubleMapDouble: {
+            auto am = std::static_pointer_cast<TrackerElementDoubleMapDouble>(a);
+            auto bm = std::static_pointer_cast<TrackerElementDoubleMapDouble>(b);
+
+            if (am->size() != bm->size()) {
+                fprintf(stderr, "%s: map size %lu != %lu\n", path.c_str(),
+                        am->size(), bm->size());
+                return false;
+            }
+
+            for (auto i : *am) {
+                auto bi = bm->find(i.first);
+
+                if (bi == bm->end() || bi->second != i.second) {
+                    fprintf(stderr, "%s[%f]: values differ\n", path.c_str(), i.first);
+                    return false;
+                }
+            }
+
+            return true;
+        }
+    }
+
+    fprintf(stderr, "%s: unknown type\n", path.c_str());
+    return false;
+}
+
+size_t compressed_size(const std::string& in_data) {
+    // Compressed the same way the device stores compress records
+    std::stringbuf sbuf;
+
+    {
+        zstr::ostreambuf zobuf(&sbuf, 1 << 16, true);
+        std::ostream zstream(&zobuf);
+        zstream.write(in_data.data(), in_data.length());
+        zobuf.pubsync();
+    }
+
+    return sbuf.str().length();
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int num_records = 10000;
+
+    if (argc > 1)
+        num_records = strtoul(argv[1], NULL, 10);
+
+    test_harness_init();
+
+    // Round-trip every type
+    auto all = build_all_types();
+
+    std::stringstream packed;
+    KbinAdapter::Pack(packed, all);
+
+    SharedTrackerElement unpacked;
+
+    try {
+        unpacked = KbinAdapter::Unpack(packed.str());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Could not unpack kbin record: %s\n", e.what());
+        exit(1);
+    }
+
+    if (!compare(all, unpacked, "root")) {
+        fprintf(stderr, "kbin record did not round-trip\n");
+        exit(1);
+    }
+
+    printf("Round-tripped every type in %lu bytes\n", packed.str().length());
+
+    // Compare kbin and storage json on a batch of device-like records
+    std::vector<SharedTrackerElement> devices;
+
+    for (unsigned int n = 0; n < num_records; n++)
+        devices.push_back(test_device_record(n));
+
+    std::vector<std::string> kbin_records, json_records;
+    size_t kbin_sz = 0, kbin_zsz = 0, json_sz = 0, json_zsz = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto d : devices) {
+        std::stringstream ss;
+        KbinAdapter::Pack(ss, d);
+        kbin_records.push_back(ss.str());
+    }
+    auto kbin_pack_ms = test_elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    for (auto d : devices) {
+        std::stringstream ss;
+        StorageJsonAdapter::Pack(ss, d);
+        json_records.push_back(ss.str());
+    }
+    auto json_pack_ms = test_elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int n = 0; n < num_records; n++) {
+        auto e = KbinAdapter::Unpack(kbin_records[n]);
+
+        if (!compare(devices[n], e, "device")) {
+            fprintf(stderr, "kbin device record %u did not round-trip\n", n);
+            exit(1);
+        }
+    }
+    auto kbin_unpack_ms = test_elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int n = 0; n < num_records; n++) {
+        SharedStructured sjson(new StructuredJson(json_records[n]));
+        auto e = StorageLoader::storage_to_tracker(sjson);
+
+        if (e == nullptr) {
+            fprintf(stderr, "storage json device record %u did not load\n", n);
+            exit(1);
+        }
+    }
+    auto json_unpack_ms = test_elapsed_ms(start);
+
+    for (unsigned int n = 0; n < num_records; n++) {
+        kbin_sz += kbin_records[n].length();
+        kbin_zsz += compressed_size(kbin_records[n]);
+        json_sz += json_records[n].length();
+        json_zsz += compressed_size(json_records[n]);
+    }
+
+    printf("%u device records\n", num_records);
+    printf("%-14s %12s %12s %10s %10s\n", "format", "bytes", "compressed", "pack ms", "load ms");
+    printf("%-14s %12lu %12lu %10.1f %10.1f\n", "kbin", kbin_sz, kbin_zsz,
+            kbin_pack_ms, kbin_unpack_ms);
+    printf("%-14s %12lu %12lu %10.1f %10.1f\n", "storage json", json_sz, json_zsz,
+            json_pack_ms, json_unpack_ms);
+
+    test_harness_shutdown();
+
+    return 0;
+}
+
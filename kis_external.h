@@ -166,6 +166,10 @@ public:
     virtual int Httpd_PostComplete(Kis_Net_Httpd_Connection *con __attribute__((unused))) override;
 
 protected:
+    // Proxied requests wait on the external tool for as long as it takes to answer,
+    // so keep them off the shared generator pool
+    virtual bool Httpd_GeneratorBlocks() override { return true; }
+
     // Central packet dispatch handler
     virtual bool dispatch_rx_packet(std::shared_ptr<KismetExternal::Command> c) override;
 
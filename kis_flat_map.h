@@ -0,0 +1,144 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_FLAT_MAP_H__
+#define __KIS_FLAT_MAP_H__
+
+#include "config.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Sorted-vector map with the subset of the std::map API used by the tracked element
+// maps.
+//
+// Tracked components hold a handful to a few dozen fields, keyed by field id, and
+// there are a great many of them; a std::map costs a separately allocated tree node
+// per field, where this costs only the key and value.  Iteration order is the same
+// as std::map (ascending by key), so serialized output is unchanged.
+//
+// Unlike std::map, inserting or erasing a key invalidates every iterator and reference
+// into the map; lookups and inserts are O(log n) and O(n), which is faster than a tree
+// at these sizes.  Assigning to the value of an existing key moves nothing.  Tracked 
+// components rely on this: every field they may ever hold has a slot, empty until it
+// is set, so setting and clearing fields never changes the shape of the map.
+template<typename K, typename V>
+class kis_flat_map {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using vector_t = std::vector<value_type>;
+    using iterator = typename vector_t::iterator;
+    using const_iterator = typename vector_t::const_iterator;
+    using size_type = typename vector_t::size_type;
+
+    iterator begin() noexcept { return vec.begin(); }
+    const_iterator begin() const noexcept { return vec.begin(); }
+    const_iterator cbegin() const noexcept { return vec.cbegin(); }
+
+    iterator end() noexcept { return vec.end(); }
+    const_iterator end() const noexcept { return vec.end(); }
+    const_iterator cend() const noexcept { return vec.cend(); }
+
+    bool empty() const noexcept { return vec.empty(); }
+    size_type size() const noexcept { return vec.size(); }
+    void clear() noexcept { vec.clear(); }
+
+    void reserve(size_type n) { vec.reserve(n); }
+    void shrink_to_fit() { vec.shrink_to_fit(); }
+
+    iterator find(const K& k) {
+        auto i = lower_bound(k);
+
+        if (i != vec.end() && !(k < i->first))
+            return i;
+
+        return vec.end();
+    }
+
+    const_iterator find(const K& k) const {
+        auto i = lower_bound(k);
+
+        if (i != vec.end() && !(k < i->first))
+            return i;
+
+        return vec.end();
+    }
+
+    size_type count(const K& k) const {
+        return find(k) != vec.end() ? 1 : 0;
+    }
+
+    std::pair<iterator, bool> insert(const value_type& v) {
+        auto i = lower_bound(v.first);
+
+        if (i != vec.end() && !(v.first < i->first))
+            return std::make_pair(i, false);
+
+        return std::make_pair(vec.insert(i, v), true);
+    }
+
+    V& operator[](const K& k) {
+        auto i = lower_bound(k);
+
+        if (i == vec.end() || k < i->first)
+            i = vec.insert(i, std::make_pair(k, V()));
+
+        return i->second;
+    }
+
+    iterator erase(const_iterator i) {
+        return vec.erase(i);
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        return vec.erase(first, last);
+    }
+
+    size_type erase(const K& k) {
+        auto i = find(k);
+
+        if (i == vec.end())
+            return 0;
+
+        vec.erase(i);
+        return 1;
+    }
+
+protected:
+    iterator lower_bound(const K& k) {
+        return std::lower_bound(vec.begin(), vec.end(), k,
+                [](const value_type& v, const K& k) -> bool {
+                    return v.first < k;
+                });
+    }
+
+    const_iterator lower_bound(const K& k) const {
+        return std::lower_bound(vec.begin(), vec.end(), k,
+                [](const value_type& v, const K& k) -> bool {
+                    return v.first < k;
+                });
+    }
+
+    vector_t vec;
+};
+
+#endif
+
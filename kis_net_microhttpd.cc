@@ -29,8 +29,10 @@
 #include <string.h>
 #include <errno.h>
 #include <microhttpd.h>
+#include <zlib.h>
 
 #include <memory>
+#include <unordered_map>
 #include <chrono>
 
 #include <sys/types.h>
@@ -98,33 +100,82 @@ std::string kishttpd::EscapeHtml(const std::string& in) {
 std::shared_ptr<TrackerElement> kishttpd::SummarizeWithStructured(std::shared_ptr<TrackerElement> in_data,
         SharedStructured structured, std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) {
 
-    auto summary_vec = std::vector<SharedElementSummary>{};
+    auto projection = ProjectionWithStructured(structured);
+
+    if (projection == nullptr)
+        return SummarizeTrackerElement(in_data, std::vector<SharedElementSummary>{}, rename_map);
 
-    if (structured->hasKey("fields")) {
-        auto fields = structured->getStructuredByKey("fields");
-        auto fvec = fields->getStructuredArray();
+    return projection->apply(in_data, rename_map);
+}
 
-        for (const auto& i : fvec) {
-            if (i->isString()) {
-                auto s = std::make_shared<TrackerElementSummary>(i->getString());
-                summary_vec.push_back(s);
-            } else if (i->isArray()) {
-                auto mapvec = i->getStringVec();
+std::shared_ptr<TrackerElementProjection> kishttpd::ProjectionWithStructured(SharedStructured structured) {
+    // Compiled projections, keyed by the fields requested; cleared whenever it fills
+    static kis_recursive_timed_mutex projection_mutex;
+    static std::unordered_map<std::string, std::shared_ptr<TrackerElementProjection>> projection_cache;
+    const size_t max_projection_cache = 128;
 
-                if (mapvec.size() != 2)
-                    throw StructuredDataException("Invalid field mapping, expected "
-                            "[field, rename]");
+    if (!structured->hasKey("fields"))
+        return nullptr;
 
-                auto s = std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]);
-                summary_vec.push_back(s);
-            } else {
+    auto fields = structured->getStructuredByKey("fields");
+    auto fvec = fields->getStructuredArray();
+
+    // Paths and renames are joined with separators which can't appear in a field name
+    auto key = std::string{};
+
+    for (const auto& i : fvec) {
+        if (i->isString()) {
+            key += i->getString();
+            key += '\x1e';
+        } else if (i->isArray()) {
+            auto mapvec = i->getStringVec();
+
+            if (mapvec.size() != 2)
                 throw StructuredDataException("Invalid field mapping, expected "
-                        "field or [field,rename]");
-            }
+                        "[field, rename]");
+
+            key += mapvec[0];
+            key += '\x1f';
+            key += mapvec[1];
+            key += '\x1e';
+        } else {
+            throw StructuredDataException("Invalid field mapping, expected "
+                    "field or [field,rename]");
+        }
+    }
+
+    auto generation = Globalreg::globalreg->entrytracker->GetFieldGeneration();
+
+    {
+        local_locker l(&projection_mutex);
+
+        auto ci = projection_cache.find(key);
+        if (ci != projection_cache.end() && ci->second->get_generation() == generation)
+            return ci->second;
+    }
+
+    // Resolve the paths against the fields registered now
+    auto summary_vec = std::vector<SharedElementSummary>{};
+
+    for (const auto& i : fvec) {
+        if (i->isString()) {
+            summary_vec.push_back(std::make_shared<TrackerElementSummary>(i->getString()));
+        } else {
+            auto mapvec = i->getStringVec();
+            summary_vec.push_back(std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]));
         }
     }
 
-    return SummarizeTrackerElement(in_data, summary_vec, rename_map);
+    auto projection = std::make_shared<TrackerElementProjection>(summary_vec);
+
+    local_locker l(&projection_mutex);
+
+    if (projection_cache.size() >= max_projection_cache)
+        projection_cache.clear();
+
+    projection_cache[key] = projection;
+
+    return projection;
 }
 
 Kis_Net_Httpd::Kis_Net_Httpd() {
@@ -195,6 +246,50 @@ Kis_Net_Httpd::Kis_Net_Httpd() {
     pem_path = Globalreg::globalreg->kismet_config->FetchOpt("httpd_ssl_cert");
     key_path = Globalreg::globalreg->kismet_config->FetchOpt("httpd_ssl_key");
 
+    use_compression = 
+        Globalreg::globalreg->kismet_config->FetchOptBoolean("httpd_compression", true);
+    compression_level = 
+        Globalreg::globalreg->kismet_config->FetchOptInt("httpd_compression_level", 3);
+    compression_min =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_compression_min", 1024);
+
+    if (compression_level < 1 || compression_level > 9) {
+        _MSG_ERROR("Invalid httpd_compression_level {}, expected 1-9; using 3",
+                compression_level);
+        compression_level = 3;
+    }
+
+    // Connections are served by a fixed pool of server threads, and the generators for
+    // streamed responses run on a shared pool, so the number of threads doesn't grow 
+    // with the number of clients
+    http_threads = 
+        Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_threads", 4);
+    auto generator_threads =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_generator_threads", 8);
+    generator_limit =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("httpd_endpoint_generators", 4);
+
+    if (http_threads == 0) {
+        _MSG_ERROR("Invalid httpd_threads 0, expected at least 1; using 1");
+        http_threads = 1;
+    }
+
+    if (generator_threads == 0) {
+        _MSG_ERROR("Invalid httpd_generator_threads 0, expected at least 1; using 1");
+        generator_threads = 1;
+    }
+
+    if (generator_limit == 0) {
+        _MSG_ERROR("Invalid httpd_endpoint_generators 0, expected at least 1; using 1");
+        generator_limit = 1;
+    }
+
+    generator_pool = std::make_shared<kis_thread_pool>(generator_threads);
+
+    // Requests matched by scanning the handlers which haven't registered a route
+    legacy_route = 
+        std::make_shared<Kis_Net_Httpd_Route_Trie::route_record>("(legacy)", nullptr);
+
     RegisterMimeType("html", "text/html");
     RegisterMimeType("svg", "image/svg+xml");
     RegisterMimeType("css", "text/css");
@@ -203,6 +298,9 @@ Kis_Net_Httpd::Kis_Net_Httpd() {
     RegisterMimeType("ico", "image/x-icon");
     RegisterMimeType("json", "application/json");
     RegisterMimeType("ekjson", "application/json");
+    RegisterMimeType("kbin", "application/x-kismet-kbin");
+    RegisterMimeType("msgpack", "application/msgpack");
+    RegisterMimeType("cbor", "application/cbor");
     RegisterMimeType("pcap", "application/vnd.tcpdump.pcap");
 
     std::vector<std::string> mimeopts = Globalreg::globalreg->kismet_config->FetchOptVec("httpd_mime");
@@ -386,11 +484,100 @@ void Kis_Net_Httpd::RemoveHandler(Kis_Net_Httpd_Handler *in_handler) {
             break;
         }
     }
+
+    route_trie.remove(in_handler);
+}
+
+void Kis_Net_Httpd::RegisterRoute(const std::string& in_route, Kis_Net_Httpd_Handler *in_handler) {
+    local_locker lock(&controller_mutex);
+
+    route_trie.insert(in_route, in_handler);
+}
+
+Kis_Net_Httpd_Handler *Kis_Net_Httpd::find_handler(const std::string& url, const char *method,
+        Kis_Net_Httpd_Route_Trie::param_map& params,
+        std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record>& route) {
+
+    route = route_trie.match(StripSuffix(url), 
+            [&url, method](Kis_Net_Httpd_Handler *h) -> bool {
+                return h->Httpd_VerifyPath(url.c_str(), method);
+            }, params);
+
+    if (route != nullptr)
+        return route->handler;
+
+    for (auto h : handler_vec) {
+        if (h->Httpd_VerifyPath(url.c_str(), method))
+            return h;
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<TrackerElement> Kis_Net_Httpd::routes_endp_handler() {
+    auto routes = std::make_shared<TrackerElementVector>(routes_id);
+
+    auto make_route = [this](const Kis_Net_Httpd_Route_Trie::route_record& r) {
+        auto route = std::make_shared<TrackerElementMap>(route_id);
+
+        uint64_t match_avg = 0;
+        if (r.requests > 0)
+            match_avg = r.match_ns_total / r.requests;
+
+        route->insert(std::make_shared<TrackerElementString>(route_path_id, r.route));
+        route->insert(std::make_shared<TrackerElementUInt64>(route_requests_id, r.requests));
+        route->insert(std::make_shared<TrackerElementUInt64>(route_match_avg_id, match_avg));
+        route->insert(std::make_shared<TrackerElementUInt64>(route_match_max_id, r.match_ns_max));
+
+        return route;
+    };
+
+    for (auto r : route_trie.get_routes())
+        routes->push_back(make_route(*r));
+
+    routes->push_back(make_route(*legacy_route));
+
+    return routes;
 }
 
 int Kis_Net_Httpd::StartHttpd() {
     local_locker lock(&controller_mutex);
 
+    if (routes_endp == nullptr) {
+        auto entrytracker = Globalreg::FetchMandatoryGlobalAs<EntryTracker>();
+
+        routes_id =
+            entrytracker->RegisterField("kismet.httpd.routes",
+                    TrackerElementFactory<TrackerElementVector>(),
+                    "registered http routes");
+        route_id =
+            entrytracker->RegisterField("kismet.httpd.route",
+                    TrackerElementFactory<TrackerElementMap>(),
+                    "http route");
+        route_path_id =
+            entrytracker->RegisterField("kismet.httpd.route.path",
+                    TrackerElementFactory<TrackerElementString>(),
+                    "route path");
+        route_requests_id =
+            entrytracker->RegisterField("kismet.httpd.route.requests",
+                    TrackerElementFactory<TrackerElementUInt64>(),
+                    "requests dispatched to route");
+        route_match_avg_id =
+            entrytracker->RegisterField("kismet.httpd.route.match_avg_ns",
+                    TrackerElementFactory<TrackerElementUInt64>(),
+                    "average time to match route (ns)");
+        route_match_max_id =
+            entrytracker->RegisterField("kismet.httpd.route.match_max_ns",
+                    TrackerElementFactory<TrackerElementUInt64>(),
+                    "maximum time to match route (ns)");
+
+        routes_endp =
+            std::make_shared<Kis_Net_Httpd_Simple_Tracked_Endpoint>("/httpd/routes", true,
+                    [this]() -> std::shared_ptr<TrackerElement> {
+                        return routes_endp_handler();
+                    }, &controller_mutex);
+    }
+
     if (use_ssl) {
         // If we can't load the SSL key files, crash and burn.  We can't safely
         // degrade to non-ssl when the user is expecting encryption.
@@ -441,18 +628,30 @@ int Kis_Net_Httpd::StartHttpd() {
         }
     }
 
+    // Poll connections from a pool of internal threads; streams waiting on their 
+    // generators are suspended instead of holding a thread
+    unsigned int mhd_flags = MHD_USE_SELECT_INTERNALLY | MHD_USE_SUSPEND_RESUME;
+
+#ifdef SYS_LINUX
+    mhd_flags |= MHD_USE_EPOLL_LINUX_ONLY;
+#else
+    mhd_flags |= MHD_USE_POLL;
+#endif
+
     if (!use_ssl) {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION,
+        microhttpd = MHD_start_daemon(mhd_flags,
                 http_port, NULL, NULL, 
                 &http_request_handler, this, 
                 MHD_OPTION_NOTIFY_COMPLETED, &http_request_completed, NULL,
                 MHD_OPTION_SOCK_ADDR, (struct sockaddr *) &listen_addr, 
+                MHD_OPTION_THREAD_POOL_SIZE, http_threads,
                 MHD_OPTION_END); 
     } else {
-        microhttpd = MHD_start_daemon(MHD_USE_THREAD_PER_CONNECTION | MHD_USE_SSL,
+        microhttpd = MHD_start_daemon(mhd_flags | MHD_USE_SSL,
                 http_port, NULL, NULL, &http_request_handler, this, 
                 MHD_OPTION_NOTIFY_COMPLETED, &http_request_completed, NULL,
                 MHD_OPTION_SOCK_ADDR, (struct sockaddr *) &listen_addr, 
+                MHD_OPTION_THREAD_POOL_SIZE, http_threads,
                 MHD_OPTION_HTTPS_MEM_KEY, cert_key,
                 MHD_OPTION_HTTPS_MEM_CERT, cert_pem,
                 MHD_OPTION_END); 
@@ -482,11 +681,21 @@ int Kis_Net_Httpd::StopHttpd() {
     local_locker lock(&controller_mutex);
 
     handler_vec.clear();
+    route_trie.clear();
     static_dir_vec.clear();
 
     if (microhttpd != NULL) {
         running = false;
 
+        // End any streams still waiting for data; microhttpd can't stop with 
+        // connections suspended
+        {
+            std::lock_guard<std::mutex> lk(stream_mutex);
+
+            for (auto a : stream_set)
+                a->trigger_error();
+        }
+
         // If possible we want to quiesce the daemon and stop it fully in our 
         // deconstructor; however on some implementations of microhttpd that's 
         // not available.
@@ -625,15 +834,53 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
             url = "/" + url;
     }
     
-    {
+    // Clients can ask for a binary serialization of a json endpoint with the Accept 
+    // header; the url is rewritten to the matching suffix so the handler, serializer,
+    // and content type all follow it.  Endpoints which only support json keep the
+    // original url.  Either way the response depends on the Accept header.
+    std::string negotiated_url;
+    bool negotiable = GetSuffix(url) == "json";
+
+    if (negotiable) {
+        auto accept = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept");
+
+        if (accept != nullptr) {
+            auto ext = kishttpd->GetAcceptedSerializer(accept);
+
+            if (ext != "")
+                negotiated_url = StripSuffix(url) + "." + ext;
+        }
+    }
+
+    Kis_Net_Httpd_Route_Trie::param_map path_params;
+
+    // We're called many times per request, as post data arrives and as suspended
+    // connections resume; only find the handler the first time, and remember it
+    if (*ptr == NULL) {
         local_locker conclock(&(kishttpd->controller_mutex));
         /* Find a handler that can handle this path & method */
 
-        for (auto h : kishttpd->handler_vec) {
-            if (h->Httpd_VerifyPath(url.c_str(), method)) {
-                handler = h;
-                break;
-            }
+        auto match_start = std::chrono::steady_clock::now();
+        std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record> route;
+
+        if (negotiated_url.length() != 0) {
+            handler = kishttpd->find_handler(negotiated_url, method, path_params, route);
+
+            if (handler != NULL)
+                url = negotiated_url;
+        }
+
+        if (handler == NULL)
+            handler = kishttpd->find_handler(url, method, path_params, route);
+
+        if (handler != NULL) {
+            auto match_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - match_start).count();
+
+            if (route != nullptr)
+                route->record_match(match_ns);
+            else
+                kishttpd->legacy_route->record_match(match_ns);
         }
     }
 
@@ -650,6 +897,10 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         concls->httpcode = MHD_HTTP_OK;
         concls->url = std::string(url);
         concls->connection = connection;
+        concls->path_params = path_params;
+
+        if (negotiable)
+            concls->add_vary("Accept");
 
         // Normally we'd build the post processor and read in the post data; if we don't have a handler,
         // we don't do that
@@ -679,6 +930,8 @@ int Kis_Net_Httpd::http_request_handler(void *cls, struct MHD_Connection *connec
         }
     } else {
         concls = (Kis_Net_Httpd_Connection *) *ptr;
+        handler = concls->httpdhandler;
+        url = concls->url;
     }
 
     if (handler == NULL) {
@@ -783,6 +1036,27 @@ void Kis_Net_Httpd::http_request_completed(void *cls __attribute__((unused)),
         }
     }
 
+    // A stream generator may still be queued or running against the connection, so 
+    // hand the record to the generator state instead of destroying it; it's freed
+    // once the stream and the generator are both done with it
+    if (con_info->custom_extension != NULL) {
+        auto aux = (Kis_Net_Httpd_Buffer_Stream_Aux *) con_info->custom_extension;
+        auto state = aux->get_generator_state();
+
+        aux->detach_connection();
+
+        // A stream which ended before its response was queued was never handed to 
+        // microhttpd, so free it ourselves
+        if (con_info->response == NULL) {
+            Kis_Net_Httpd_Buffer_Stream_Handler::free_buffer_aux_callback(aux);
+            con_info->custom_extension = NULL;
+        }
+
+        state->connection.reset(con_info);
+
+        return;
+    }
+
     // Destroy connection
     
     delete(con_info);
@@ -810,6 +1084,73 @@ std::string Kis_Net_Httpd::GetMimeType(std::string ext) {
     return "";
 }
 
+std::string Kis_Net_Httpd::GetAcceptedEncoding(Kis_Net_Httpd_Connection *connection) {
+    if (!use_compression)
+        return "";
+
+    auto accept = 
+        MHD_lookup_connection_value(connection->connection, MHD_HEADER_KIND, "Accept-Encoding");
+
+    if (accept == nullptr)
+        return "";
+
+    // Unlisted (-1), refused with a zero quality (0), or accepted (1)
+    int gzip = -1, deflate = -1, wildcard = -1;
+
+    for (auto a : StrTokenize(accept, ",")) {
+        auto params = StrTokenize(a, ";");
+
+        if (params.size() == 0)
+            continue;
+
+        auto coding = StrLower(StrStrip(params[0]));
+        bool accepted = true;
+
+        for (size_t p = 1; p < params.size(); p++) {
+            auto q = StrStrip(params[p]);
+
+            if (q.length() > 2 && q[0] == 'q' && q[1] == '=')
+                accepted = strtod(q.c_str() + 2, nullptr) > 0;
+        }
+
+        if (coding == "gzip" || coding == "x-gzip")
+            gzip = accepted;
+        else if (coding == "deflate")
+            deflate = accepted;
+        else if (coding == "*")
+            wildcard = accepted;
+    }
+
+    if (gzip == 1 || (gzip == -1 && wildcard == 1))
+        return "gzip";
+
+    if (deflate == 1 || (deflate == -1 && wildcard == 1))
+        return "deflate";
+
+    return "";
+}
+
+std::string Kis_Net_Httpd::GetAcceptedSerializer(const std::string& accept) {
+    local_locker lock(&controller_mutex);
+
+    // Media types are taken in the order the client lists them; the first one we can
+    // serialize wins, and json or a wildcard ends the search
+    for (auto a : StrTokenize(accept, ",")) {
+        auto mime = StrLower(StrStrip(a.substr(0, a.find(";"))));
+
+        if (mime == "application/json" || mime == "*/*" || mime == "application/*")
+            return "";
+
+        for (auto mi : mime_type_map) {
+            if (mi.second == mime && mi.first != "json" &&
+                    Globalreg::globalreg->entrytracker->CanSerialize(mi.first))
+                return mi.first;
+        }
+    }
+
+    return "";
+}
+
 int Kis_Net_Httpd::handle_static_file(void *cls, Kis_Net_Httpd_Connection *connection,
         const char *url, const char *method) {
     Kis_Net_Httpd *kishttpd = (Kis_Net_Httpd *) cls;
@@ -968,7 +1309,10 @@ void Kis_Net_Httpd::AppendStandardHeaders(Kis_Net_Httpd *httpd,
     std::string suffix = GetSuffix(url);
     std::string mime = httpd->GetMimeType(suffix);
 
-    if (mime != "") {
+    if (connection->content_type != "") {
+        MHD_add_response_header(connection->response, "Content-Type", 
+                connection->content_type.c_str());
+    } else if (mime != "") {
         MHD_add_response_header(connection->response, "Content-Type", mime.c_str());
     } else {
         MHD_add_response_header(connection->response, "Content-Type", "text/plain");
@@ -985,13 +1329,19 @@ void Kis_Net_Httpd::AppendStandardHeaders(Kis_Net_Httpd *httpd,
     MHD_add_response_header(connection->response, 
             "Access-Control-Allow-Origin", "*");
 
-    // Never let the browser cache our responses.  Maybe moderate this
-    // in the future to cache for 60 seconds or something?
+    // Never let the browser use a cached response without checking with us; responses
+    // with an entity tag can be revalidated with a conditional request
     MHD_add_response_header(connection->response, "Cache-Control", "no-cache");
     MHD_add_response_header(connection->response, "Pragma", "no-cache");
     MHD_add_response_header(connection->response, 
             "Expires", "Sat, 01 Jan 2000 00:00:00 GMT");
 
+    if (connection->etag.length() != 0)
+        MHD_add_response_header(connection->response, "ETag", connection->etag.c_str());
+
+    if (connection->vary.length() != 0)
+        MHD_add_response_header(connection->response, "Vary", connection->vary.c_str());
+
 }
 
 int Kis_Net_Httpd::SendHttpResponse(Kis_Net_Httpd *httpd __attribute__((unused)),
@@ -1005,6 +1355,16 @@ int Kis_Net_Httpd::SendHttpResponse(Kis_Net_Httpd *httpd __attribute__((unused))
     return MHD_YES;
 }
 
+void Kis_Net_Httpd::RegisterStream(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux) {
+    std::lock_guard<std::mutex> lk(stream_mutex);
+    stream_set.insert(in_aux);
+}
+
+void Kis_Net_Httpd::RemoveStream(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux) {
+    std::lock_guard<std::mutex> lk(stream_mutex);
+    stream_set.erase(in_aux);
+}
+
 int Kis_Net_Httpd::SendStandardHttpResponse(Kis_Net_Httpd *httpd,
         Kis_Net_Httpd_Connection *connection, const char *url) {
     AppendHttpSession(httpd, connection);
@@ -1012,6 +1372,27 @@ int Kis_Net_Httpd::SendStandardHttpResponse(Kis_Net_Httpd *httpd,
     return SendHttpResponse(httpd, connection);
 }
 
+int Kis_Net_Httpd::SendNotModified(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection) {
+    connection->response = 
+        MHD_create_response_from_buffer(0, (void *) "", MHD_RESPMEM_PERSISTENT);
+    connection->httpcode = MHD_HTTP_NOT_MODIFIED;
+
+    AppendHttpSession(httpd, connection);
+
+    MHD_add_response_header(connection->response, "ETag", connection->etag.c_str());
+    MHD_add_response_header(connection->response, "Cache-Control", "no-cache");
+
+    // A 304 varies the same way the full response would have
+    if (connection->vary.length() != 0)
+        MHD_add_response_header(connection->response, "Vary", connection->vary.c_str());
+
+    MHD_add_response_header(connection->response, 
+            "Access-Control-Allow-Origin", "*");
+
+    return SendHttpResponse(httpd, connection);
+}
+
 Kis_Net_Httpd_Handler::Kis_Net_Httpd_Handler() {
     httpd = Globalreg::FetchMandatoryGlobalAs<Kis_Net_Httpd>();
 
@@ -1030,6 +1411,170 @@ void Kis_Net_Httpd_Handler::Bind_Httpd_Server() {
     httpd->RegisterHandler(this);
 }
 
+void Kis_Net_Httpd_Handler::Bind_Httpd_Route(const std::string& in_route) {
+    httpd->RegisterRoute(in_route, this);
+}
+
+std::vector<std::string> Kis_Net_Httpd_Route_Trie::split_path(const std::string& in_path) {
+    std::vector<std::string> ret;
+    size_t start = 0;
+
+    // Empty components (leading and doubled slashes) aren't part of the route
+    while (start <= in_path.length()) {
+        auto end = in_path.find('/', start);
+
+        if (end == std::string::npos)
+            end = in_path.length();
+
+        if (end > start)
+            ret.push_back(in_path.substr(start, end - start));
+
+        start = end + 1;
+    }
+
+    return ret;
+}
+
+void Kis_Net_Httpd_Route_Trie::insert(const std::string& in_route, 
+        Kis_Net_Httpd_Handler *in_handler) {
+    auto record = std::make_shared<route_record>(in_route, in_handler);
+    auto components = split_path(in_route);
+
+    route_node *node = &root;
+
+    for (size_t i = 0; i < components.size(); i++) {
+        auto& c = components[i];
+
+        if (c[0] == '*') {
+            record->rest_pos = i;
+            record->rest = c.substr(1);
+
+            node->rest_routes.push_back(record);
+            route_list.push_back(record);
+
+            return;
+        } else if (c[0] == ':') {
+            record->params.push_back(std::make_pair(i, c.substr(1)));
+
+            if (node->param == nullptr)
+                node->param = std::unique_ptr<route_node>(new route_node());
+
+            node = node->param.get();
+        } else {
+            auto& next = node->literals[c];
+
+            if (next == nullptr)
+                next = std::unique_ptr<route_node>(new route_node());
+
+            node = next.get();
+        }
+    }
+
+    node->routes.push_back(record);
+    route_list.push_back(record);
+}
+
+void Kis_Net_Httpd_Route_Trie::remove_node(route_node *node, Kis_Net_Httpd_Handler *in_handler) {
+    node->routes.erase(std::remove_if(node->routes.begin(), node->routes.end(),
+                [in_handler](const std::shared_ptr<route_record>& r) {
+                    return r->handler == in_handler;
+                }), node->routes.end());
+
+    node->rest_routes.erase(std::remove_if(node->rest_routes.begin(), node->rest_routes.end(),
+                [in_handler](const std::shared_ptr<route_record>& r) {
+                    return r->handler == in_handler;
+                }), node->rest_routes.end());
+
+    for (auto& l : node->literals)
+        remove_node(l.second.get(), in_handler);
+
+    if (node->param != nullptr)
+        remove_node(node->param.get(), in_handler);
+}
+
+void Kis_Net_Httpd_Route_Trie::remove(Kis_Net_Httpd_Handler *in_handler) {
+    remove_node(&root, in_handler);
+
+    route_list.erase(std::remove_if(route_list.begin(), route_list.end(),
+                [in_handler](const std::shared_ptr<route_record>& r) {
+                    return r->handler == in_handler;
+                }), route_list.end());
+}
+
+void Kis_Net_Httpd_Route_Trie::clear() {
+    root.literals.clear();
+    root.param.reset();
+    root.routes.clear();
+    route_list.clear();
+}
+
+std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record> 
+    Kis_Net_Httpd_Route_Trie::match_node(route_node *node, const std::vector<std::string>& in_path,
+            size_t pos, accept_func& in_accept) {
+
+    if (pos == in_path.size()) {
+        for (auto r : node->routes) {
+            if (in_accept(r->handler))
+                return r;
+        }
+
+        return nullptr;
+    }
+
+    auto l = node->literals.find(in_path[pos]);
+
+    if (l != node->literals.end()) {
+        auto r = match_node(l->second.get(), in_path, pos + 1, in_accept);
+
+        if (r != nullptr)
+            return r;
+    }
+
+    if (node->param != nullptr) {
+        auto r = match_node(node->param.get(), in_path, pos + 1, in_accept);
+
+        if (r != nullptr)
+            return r;
+    }
+
+    for (auto r : node->rest_routes) {
+        if (in_accept(r->handler))
+            return r;
+    }
+
+    return nullptr;
+}
+
+std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record> 
+    Kis_Net_Httpd_Route_Trie::match(const std::string& in_path, accept_func in_accept,
+            param_map& out_params) {
+
+    auto components = split_path(in_path);
+    auto r = match_node(&root, components, 0, in_accept);
+
+    if (r == nullptr)
+        return nullptr;
+
+    out_params.clear();
+
+    for (auto p : r->params)
+        out_params[p.second] = components[p.first];
+
+    if (r->rest.length() != 0) {
+        std::stringstream rest;
+
+        for (size_t i = r->rest_pos; i < components.size(); i++) {
+            if (i != r->rest_pos)
+                rest << "/";
+            rest << components[i];
+        }
+
+        out_params[r->rest] = rest.str();
+    }
+
+    return r;
+}
+
 bool Kis_Net_Httpd_Handler::Httpd_CanSerialize(const std::string& path) {
     return Globalreg::globalreg->entrytracker->CanSerialize(httpd->GetSuffix(path));
 }
@@ -1090,27 +1635,51 @@ int Kis_Net_Httpd_CPPStream_Handler::Httpd_HandlePostRequest(Kis_Net_Httpd *http
 
     std::lock_guard<std::mutex> lk(connection->connection_mutex);
 
-    try {
-        Httpd_PostComplete(connection);
-    } catch (const std::exception& e) {
-        auto err = fmt::format("Server error:  Uncaught exception '{}'\n", e.what());
+    if (connection->response != NULL)
+        return MHD_NO;
 
-        connection->response = 
-            MHD_create_response_from_buffer(err.length(), (void *) err.c_str(), MHD_RESPMEM_MUST_COPY);
-        connection->httpcode = 500;
-        return httpd->SendStandardHttpResponse(httpd, connection, url);
+    // Completing a post can wait on sources and other slow work, so it runs off the
+    // server thread with the connection suspended; microhttpd doesn't end a suspended
+    // connection, so the record outlives the completion, which doesn't touch it once 
+    // it has resumed the connection
+    if (!connection->post_started) {
+        connection->post_started = true;
+
+        MHD_suspend_connection(connection->connection);
+
+        auto work = [this, connection]() {
+            try {
+                Httpd_PostComplete(connection);
+            } catch (const std::exception& e) {
+                connection->response_stream.str("");
+                connection->response_stream << 
+                    fmt::format("Server error:  Uncaught exception '{}'\n", e.what());
+                connection->httpcode = 500;
+            }
+
+            connection->post_finished = true;
+            MHD_resume_connection(connection->connection);
+        };
+
+        if (Httpd_GeneratorBlocks()) {
+            std::thread t(work);
+            t.detach();
+        } else {
+            httpd->FetchGeneratorPool()->submit(work);
+        }
+
+        return MHD_YES;
     }
 
-    if (connection->response == NULL) {
-        connection->response = 
-            MHD_create_response_from_buffer(connection->response_stream.str().length(),
-                    (void *) connection->response_stream.str().data(), 
-                    MHD_RESPMEM_MUST_COPY);
+    if (!connection->post_finished)
+        return MHD_YES;
 
-        return httpd->SendStandardHttpResponse(httpd, connection, url);
-    } 
+    connection->response = 
+        MHD_create_response_from_buffer(connection->response_stream.str().length(),
+                (void *) connection->response_stream.str().data(), 
+                MHD_RESPMEM_MUST_COPY);
 
-    return MHD_YES;
+    return httpd->SendStandardHttpResponse(httpd, connection, url);
 }
 
 
@@ -1280,8 +1849,15 @@ Kis_Net_Httpd_Buffer_Stream_Aux::Kis_Net_Httpd_Buffer_Stream_Aux(
     httpd_connection(in_httpd_connection),
     ringbuf_handler(in_ringbuf_handler),
     in_error(false),
+    httpd(in_httpd_connection->httpd),
+    suspended(false),
+    detached(false),
+    gen_state(std::make_shared<generator_shared_state>()),
+    generator_returned(false),
+    headers_held(false),
     aux(in_aux),
-    free_aux_cb(in_free_aux) {
+    free_aux_cb(in_free_aux),
+    zstream_end(false) {
 
     httpd_stream_handler = in_handler;
     httpd_connection = in_httpd_connection;
@@ -1292,6 +1868,8 @@ Kis_Net_Httpd_Buffer_Stream_Aux::Kis_Net_Httpd_Buffer_Stream_Aux(
     cl = std::make_shared<conditional_locker<int>>();
     cl->lock();
 
+    httpd->RegisterStream(this);
+
     // If the buffer encounters an error, unlock the variable and set the error state
     ringbuf_handler->SetProtocolErrorCb([this]() {
             trigger_error();
@@ -1302,6 +1880,8 @@ Kis_Net_Httpd_Buffer_Stream_Aux::Kis_Net_Httpd_Buffer_Stream_Aux(
 }
 
 Kis_Net_Httpd_Buffer_Stream_Aux::~Kis_Net_Httpd_Buffer_Stream_Aux() {
+    httpd->RemoveStream(this);
+
     // Get out of the lock and flag an error so we end
     in_error = true;
 
@@ -1316,9 +1896,41 @@ Kis_Net_Httpd_Buffer_Stream_Aux::~Kis_Net_Httpd_Buffer_Stream_Aux() {
 void Kis_Net_Httpd_Buffer_Stream_Aux::BufferAvailable(size_t in_amt __attribute__((unused))) {
     // All we need to do here is unlock the conditional lock; the 
     // buffer_event_cb callback will unlock and read from the buffer, then
-    // re-lock and block
+    // re-lock and block; a connection suspended waiting for data is resumed
     // fmt::print(stderr, "buffer available {}\n", in_amt);
     cl->unlock(1);
+    resume();
+}
+
+bool Kis_Net_Httpd_Buffer_Stream_Aux::suspend_until_data(std::shared_ptr<BufferHandlerGeneric> rbh) {
+    // Data arriving or the stream completing resumes us under the same lock, so we
+    // can't miss a wakeup between checking the buffer and suspending
+    local_locker lock(&aux_mutex);
+
+    if (rbh->GetWriteBufferUsed() || get_in_error() || detached)
+        return false;
+
+    suspended = true;
+    MHD_suspend_connection(httpd_connection->connection);
+
+    return true;
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::resume() {
+    local_locker lock(&aux_mutex);
+
+    if (!suspended || detached)
+        return;
+
+    suspended = false;
+    MHD_resume_connection(httpd_connection->connection);
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::detach_connection() {
+    local_locker lock(&aux_mutex);
+
+    detached = true;
+    suspended = false;
 }
 
 void Kis_Net_Httpd_Buffer_Stream_Aux::block_until_data(std::shared_ptr<BufferHandlerGeneric> rbh) {
@@ -1346,6 +1958,143 @@ void Kis_Net_Httpd_Buffer_Stream_Aux::block_until_data(std::shared_ptr<BufferHan
     }
 }
 
+bool Kis_Net_Httpd_Buffer_Stream_Aux::suspend_until_ready(size_t in_sz) {
+    local_locker lock(&aux_mutex);
+
+    if (ringbuf_handler->GetWriteBufferUsed() >= in_sz || generator_returned || get_in_error() ||
+            detached)
+        return false;
+
+    // Every write to the buffer resumes us, so we're called again to check the size
+    suspended = true;
+    MHD_suspend_connection(httpd_connection->connection);
+
+    return true;
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::generator_complete() {
+    local_locker lock(&aux_mutex);
+
+    generator_returned = true;
+    headers_held = false;
+    resume();
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::hold_headers() {
+    local_locker lock(&aux_mutex);
+
+    headers_held = true;
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Aux::release_headers() {
+    local_locker lock(&aux_mutex);
+
+    headers_held = false;
+    resume();
+}
+
+bool Kis_Net_Httpd_Buffer_Stream_Aux::suspend_until_headers() {
+    local_locker lock(&aux_mutex);
+
+    if (!headers_held || generator_returned || get_in_error() || detached)
+        return false;
+
+    suspended = true;
+    MHD_suspend_connection(httpd_connection->connection);
+
+    return true;
+}
+
+bool Kis_Net_Httpd_Buffer_Stream_Aux::start_compression(const std::string& in_encoding, 
+        int in_level) {
+    // gzip and zlib framing are both handled by deflate, selected by the window bits
+    int window_bits = 15;
+
+    if (in_encoding == "gzip")
+        window_bits += 16;
+    else if (in_encoding != "deflate")
+        return false;
+
+    // deflateEnd is safe to call on a stream which failed to initialize
+    auto z = std::shared_ptr<z_stream_s>(new z_stream_s(), 
+            [](z_stream_s *z) {
+                deflateEnd(z);
+                delete(z);
+            });
+
+    z->zalloc = Z_NULL;
+    z->zfree = Z_NULL;
+    z->opaque = Z_NULL;
+
+    if (deflateInit2(z.get(), in_level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    zstream = z;
+
+    return true;
+}
+
+ssize_t Kis_Net_Httpd_Buffer_Stream_Aux::compress_into(std::shared_ptr<BufferHandlerGeneric> rbh,
+        char *buf, size_t max) {
+    zstream->next_out = (Bytef *) buf;
+    zstream->avail_out = max;
+
+    // Keep going until deflate gives us something to send
+    while (zstream->avail_out == max) {
+        if (zstream_end)
+            return MHD_CONTENT_READER_END_OF_STREAM;
+
+        // Nothing to compress yet; wait for more without holding the server thread
+        if (rbh->GetWriteBufferUsed() == 0 && suspend_until_data(rbh))
+            return 0;
+
+        // Check for completion before looking at the buffer, so that a completed 
+        // generator has already written everything we see
+        bool complete = get_in_error();
+
+        unsigned char *zbuf;
+        size_t pending = rbh->GetWriteBufferUsed();
+        size_t read_sz = rbh->ZeroCopyPeekWriteBufferData((void **) &zbuf, pending);
+
+        // Compress straight out of the buffer into the http buffer; hold output
+        // back while there is more queued behind this block, and flush whatever we
+        // have once we've caught up with the generator so a slow stream isn't held
+        // up waiting for more data
+        int flush = Z_SYNC_FLUSH;
+
+        if (read_sz < pending)
+            flush = Z_NO_FLUSH;
+        else if (complete)
+            flush = Z_FINISH;
+
+        zstream->next_in = zbuf;
+        zstream->avail_in = read_sz;
+
+        auto r = deflate(zstream.get(), flush);
+
+        rbh->PeekFreeWriteBufferData(zbuf);
+        rbh->ConsumeWriteBufferData(read_sz - zstream->avail_in);
+
+        if (r == Z_STREAM_END) {
+            zstream_end = true;
+        } else if (r != Z_OK && r != Z_BUF_ERROR) {
+            return MHD_CONTENT_READER_END_WITH_ERROR;
+        }
+    }
+
+    return (ssize_t) (max - zstream->avail_out);
+}
+
+Kis_Net_Httpd_Buffer_Stream_Handler::Kis_Net_Httpd_Buffer_Stream_Handler() : 
+    Kis_Net_Httpd_Handler() {
+    // Default rb size
+    k_n_h_r_ringbuf_size = 1024*1024*4;
+
+    generator_limiter = 
+        std::make_shared<kis_thread_pool_limiter>(httpd->FetchGeneratorPool(),
+                httpd->FetchGeneratorLimit());
+}
+
 Kis_Net_Httpd_Buffer_Stream_Handler::~Kis_Net_Httpd_Buffer_Stream_Handler() {
 
 }
@@ -1362,6 +2111,12 @@ ssize_t Kis_Net_Httpd_Buffer_Stream_Handler::buffer_event_cb(void *cls, uint64_t
 
     std::shared_ptr<BufferHandlerGeneric> rbh = stream_aux->get_rbhandler();
 
+    if (stream_aux->compressing()) {
+        auto r = stream_aux->compress_into(rbh, buf, max);
+        stream_aux->get_buffer_event_mutex()->unlock();
+        return r;
+    }
+
     // Target buffer before we send it out via MHD
     size_t read_sz = 0;
     unsigned char *zbuf;
@@ -1369,9 +2124,13 @@ ssize_t Kis_Net_Httpd_Buffer_Stream_Handler::buffer_event_cb(void *cls, uint64_t
     // Keep going until we have something to send
     while (read_sz == 0) {
         // We get called as soon as the webserver has either a) processed our request
-        // or b) sent what we gave it; we need to hold the thread until we
-        // get more data in the buf, so we block until we have data
-        stream_aux->block_until_data(rbh);
+        // or b) sent what we gave it; if there's nothing in the buf yet, suspend the
+        // connection until there is so the server thread can service other connections,
+        // and we'll get called again once it's resumed
+        if (stream_aux->suspend_until_data(rbh)) {
+            stream_aux->get_buffer_event_mutex()->unlock();
+            return 0;
+        }
 
         // We want to send everything we had in the buffer, even if we're in an error 
         // state, because the error text might be in the buffer (or the buffer generator
@@ -1408,7 +2167,88 @@ ssize_t Kis_Net_Httpd_Buffer_Stream_Handler::buffer_event_cb(void *cls, uint64_t
     return (ssize_t) read_sz;
 }
 
-static void free_buffer_aux_callback(void *cls) {
+std::string Kis_Net_Httpd::TrackedETag(const std::string& format, SharedTrackerElement e) {
+    // Weak tags, because the same content may be sent with different content encodings;
+    // the serialization format is part of the tag since it changes the body, and the
+    // same url may be negotiated to different formats
+    return fmt::format("W/\"{}-{:016x}\"", format, DigestTrackerElement(e));
+}
+
+bool Kis_Net_Httpd::ETagMatches(const std::string& in_if_none_match, const std::string& etag) {
+    if (in_if_none_match.length() == 0)
+        return false;
+
+    // If-None-Match uses the weak comparison, so ignore the weak prefix on either side
+    auto strip_weak = [](const std::string& t) -> std::string {
+        if (t.substr(0, 2) == "W/")
+            return t.substr(2);
+        return t;
+    };
+
+    auto match = strip_weak(etag);
+
+    for (auto t : StrTokenize(in_if_none_match, ",")) {
+        t = StrStrip(t);
+
+        if (t == "*" || strip_weak(t) == match)
+            return true;
+    }
+
+    return false;
+}
+
+int Kis_Net_Httpd_Buffer_Stream_Handler::queue_stream_response(Kis_Net_Httpd *httpd,
+        Kis_Net_Httpd_Connection *connection, Kis_Net_Httpd_Buffer_Stream_Aux *aux,
+        const char *url) {
+
+    // Wait for a generator which sets headers; if it found the client already has the 
+    // content, answer without a body.  The generator has returned, so the stream is
+    // finished with and freed here.
+    if (aux->suspend_until_headers())
+        return MHD_YES;
+
+    if (connection->httpcode == MHD_HTTP_NOT_MODIFIED) {
+        free_buffer_aux_callback(aux);
+        connection->custom_extension = NULL;
+        return httpd->SendNotModified(httpd, connection);
+    }
+
+    // The content encoding goes out with the headers, before any of the body, so it has
+    // to be decided before the response is queued.  Small responses which are already
+    // complete aren't worth compressing, anything larger or still being generated is 
+    // compressed as it streams; until the generator has shown us which this is, suspend
+    // the connection instead of holding the server thread, and decide when it resumes.
+    auto encoding = httpd->GetAcceptedEncoding(connection);
+
+    if (encoding.length() != 0) {
+        auto min_sz = httpd->FetchCompressionMinimum();
+
+        if (aux->suspend_until_ready(min_sz))
+            return MHD_YES;
+
+        // Check for completion before looking at the buffer, so that a completed 
+        // generator has already written everything we see
+        bool complete = aux->get_in_error();
+
+        if (complete && aux->get_rbhandler()->GetWriteBufferUsed() < min_sz)
+            encoding = "";
+        else if (!aux->start_compression(encoding, httpd->FetchCompressionLevel()))
+            encoding = "";
+    }
+
+    connection->response = 
+        MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
+                &buffer_event_cb, aux, &free_buffer_aux_callback);
+
+    if (encoding.length() != 0) {
+        MHD_add_response_header(connection->response, "Content-Encoding", encoding.c_str());
+        connection->add_vary("Accept-Encoding");
+    }
+
+    return httpd->SendStandardHttpResponse(httpd, connection, url);
+}
+
+void Kis_Net_Httpd_Buffer_Stream_Handler::free_buffer_aux_callback(void *cls) {
     Kis_Net_Httpd_Buffer_Stream_Aux *aux = (Kis_Net_Httpd_Buffer_Stream_Aux *) cls;
 
     // fprintf(stderr, "debug - free_buffer_aux\n");
@@ -1442,8 +2282,19 @@ static void free_buffer_aux_callback(void *cls) {
 
     aux->get_buffer_event_mutex()->unlock();
 
-    // Get the thread that's generating data
-    aux->generator_thread.join();
+    // Don't hold the server thread waiting on the generator:  one still queued is 
+    // canceled and never runs, and one still running frees the stream when it returns
+    auto state = aux->get_generator_state();
+    auto expected = Kis_Net_Httpd_Buffer_Stream_Aux::generator_state::queued;
+
+    if (!state->state.compare_exchange_strong(expected, 
+                Kis_Net_Httpd_Buffer_Stream_Aux::generator_state::canceled)) {
+        expected = Kis_Net_Httpd_Buffer_Stream_Aux::generator_state::running;
+
+        if (state->state.compare_exchange_strong(expected, 
+                    Kis_Net_Httpd_Buffer_Stream_Aux::generator_state::orphaned))
+            return;
+    }
 
     if (aux->free_aux_cb != NULL) {
         aux->free_aux_cb(aux);
@@ -1452,6 +2303,59 @@ static void free_buffer_aux_callback(void *cls) {
     delete(aux);
 }
 
+void Kis_Net_Httpd_Buffer_Stream_Handler::schedule_generator(Kis_Net_Httpd_Buffer_Stream_Aux *aux,
+        std::function<int ()> in_gen) {
+    // The generator holds the shared state for as long as it exists, which keeps the 
+    // connection record it was given alive even if the request ends first
+    auto state = aux->get_generator_state();
+
+    auto work = [aux, state, in_gen]() {
+            using gen_state = Kis_Net_Httpd_Buffer_Stream_Aux::generator_state;
+
+            // If the stream was canceled while we were queued it has already been 
+            // freed; get out without touching it
+            auto expected = gen_state::queued;
+
+            if (!state->state.compare_exchange_strong(expected, gen_state::running))
+                return;
+
+            // When the generator returns MHD_YES (or throws) the stream is complete; 
+            // flag it so the buffer callback ends the response once it has sent 
+            // everything.  Generators returning MHD_NO keep writing to the stream from
+            // elsewhere and close it themselves.
+            try {
+                if (in_gen() == MHD_YES) {
+                    aux->sync();
+                    aux->trigger_error();
+                }
+            } catch (const std::exception& e) {
+                aux->sync();
+                aux->trigger_error();
+            }
+
+            aux->generator_complete();
+
+            // If the http response finished with the stream while we were running, 
+            // it's ours to free
+            expected = gen_state::running;
+
+            if (!state->state.compare_exchange_strong(expected, gen_state::done)) {
+                if (aux->free_aux_cb != NULL)
+                    aux->free_aux_cb(aux);
+
+                delete(aux);
+            }
+        };
+
+    if (Httpd_GeneratorBlocks()) {
+        std::thread t(work);
+        t.detach();
+        return;
+    }
+
+    generator_limiter->submit(work);
+}
+
 int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandleGetRequest(Kis_Net_Httpd *httpd, 
         Kis_Net_Httpd_Connection *connection,
         const char *url, const char *method, const char *upload_data,
@@ -1462,36 +2366,32 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandleGetRequest(Kis_Net_Httpd *h
 
     std::lock_guard<std::mutex> lk(connection->connection_mutex);
 
-    if (connection->response == NULL) {
+    if (connection->response != NULL)
+        return MHD_NO;
+
+    // We're called again each time the connection resumes while the response is waiting
+    // to be queued; only start the stream the first time
+    if (connection->custom_extension == NULL) {
         std::shared_ptr<BufferHandlerGeneric> rbh(allocate_buffer());
 
         Kis_Net_Httpd_Buffer_Stream_Aux *aux = 
             new Kis_Net_Httpd_Buffer_Stream_Aux(this, connection, rbh, NULL, NULL);
         connection->custom_extension = aux;
 
-        // Set up a locker to make sure the thread is up and running; this keeps us from
-        // processing the stream contents until that thread is up and doing something.
-        conditional_locker<int> aux_startup_cl;
-        aux_startup_cl.lock();
+        if (Httpd_GeneratorSetsHeaders())
+            aux->hold_headers();
 
-        // Run it in its own thread and set up the connection streaming object; we MUST pass
-        // the aux as a direct pointer because the microhttpd backend can delete the 
-        // connection BEFORE calling our cleanup on our response!
+        // Run the generator on the shared pool and set up the connection streaming object;
+        // we MUST pass the aux as a direct pointer because the microhttpd backend can 
+        // delete the connection BEFORE calling our cleanup on our response!
         
-        // Copy our function parameters in case we lose them before the lambda thread executes
-        // on a very slow or single-core system
+        // Copy our function parameters in case we lose them before the generator runs
         auto url_copy = std::string(url);
         auto method_copy = std::string(method);
         auto upload_data_copy = std::string(upload_data, *upload_data_size);
 
-        aux->generator_thread =
-            std::thread([this, &aux_startup_cl, aux, httpd, connection, url_copy, 
-                    method_copy, upload_data_copy] {
-                // fmt::print(stderr, "generator thread starting for url {}\n", url_copy);
-
-                // Unlock the http thread as soon as we've spawned it
-                aux_startup_cl.unlock(1);
-
+        schedule_generator(aux, 
+                [this, httpd, connection, url_copy, method_copy, upload_data_copy]() -> int {
                 // Callbacks can do two things - either run forever until their data is
                 // done being generated, or spawn their own processing systems that write
                 // back to the stream over time.  Most generate all their data in one go and
@@ -1505,38 +2405,14 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandleGetRequest(Kis_Net_Httpd *h
                 // If it returns MHD_NO we let it run on forever until it kills its stream itself.
                 // Exceptions are treated as MHD_YES and the stream closed - something went wrong
                 // in the generator and it's not going to clean itself up.
-                try {
-                    size_t sz = upload_data_copy.size();
-                    int r = Httpd_CreateStreamResponse(httpd, connection, url_copy.c_str(), 
-                            method_copy.c_str(), upload_data_copy.data(), &sz);
-
-                    // fmt::print(stderr, "generator completed callback\n");
-
-                    if (r == MHD_YES) {
-                        aux->sync();
-                        aux->trigger_error();
-                    }
-                } catch (const std::exception& e) {
-                    // fmt::print(stderr, "generator thread exception: {}\n", e.what());
-                    aux->sync();
-                    aux->trigger_error();
-                }
-
+                size_t sz = upload_data_copy.size();
+                return Httpd_CreateStreamResponse(httpd, connection, url_copy.c_str(), 
+                        method_copy.c_str(), upload_data_copy.data(), &sz);
                 });
-
-        // We unlock when the generator thread has started
-        // fmt::print(stderr, "blocking until generator\n");
-        aux_startup_cl.block_until();
-        // fmt::print(stderr, "unblocked from generator\n");
-
-        connection->response = 
-            MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
-                    &buffer_event_cb, aux, &free_buffer_aux_callback);
-
-        return httpd->SendStandardHttpResponse(httpd, connection, url);
     }
 
-    return MHD_NO;
+    return queue_stream_response(httpd, connection, 
+            (Kis_Net_Httpd_Buffer_Stream_Aux *) connection->custom_extension, url);
 }
 
 int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandlePostRequest(Kis_Net_Httpd *httpd,
@@ -1549,7 +2425,12 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandlePostRequest(Kis_Net_Httpd *
 
     std::lock_guard<std::mutex> lk(connection->connection_mutex);
 
-    if (connection->response == NULL) {
+    if (connection->response != NULL)
+        return MHD_NO;
+
+    // We're called again each time the connection resumes while the response is waiting
+    // to be queued; only start the stream the first time
+    if (connection->custom_extension == NULL) {
         // No read, default write
         std::shared_ptr<BufferHandlerGeneric> rbh(allocate_buffer());
 
@@ -1560,43 +2441,21 @@ int Kis_Net_Httpd_Buffer_Stream_Handler::Httpd_HandlePostRequest(Kis_Net_Httpd *
         // fprintf(stderr, "debug - made post aux %p\n", aux);
 
         // Call the post complete and populate our stream;
-        // Run it in its own thread and set up the connection streaming object; we MUST pass
+        // Run it on the shared pool and set up the connection streaming object; we MUST pass
         // the aux as a direct pointer because the microhttpd backend can delete the 
         // connection BEFORE calling our cleanup on our response!
-        //
-        // Set up a locker to make sure the thread is up and running
-        conditional_locker<int> cl;
-        cl.lock();
-
-        aux->generator_thread =
-            std::thread([this, &cl, aux, connection] {
-                cl.unlock(1);
-
+        schedule_generator(aux, [this, connection]() -> int {
                 try {
-                    int r = Httpd_PostComplete(connection);
-                    if (r == MHD_YES) {
-                        // fprintf(stderr, "debug - triggering complete\n");
-                        aux->sync();
-                        aux->trigger_error();
-                    }
+                    return Httpd_PostComplete(connection);
                 } catch (const std::exception& e) {
-                    // fprintf(stderr, "debug - exception - triggering error\n");
                     _MSG_ERROR("HTTPD: Uncaught exception '{}' on '{}'", e.what(), connection->url);
-                    aux->sync();
-                    aux->trigger_error();
+                    throw;
                 }
                 });
-
-        cl.block_until();
-
-        connection->response = 
-            MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 32 * 1024,
-                    &buffer_event_cb, aux, &free_buffer_aux_callback);
-
-        return httpd->SendStandardHttpResponse(httpd, connection, url);
     }
 
-    return MHD_NO;
+    return queue_stream_response(httpd, connection, 
+            (Kis_Net_Httpd_Buffer_Stream_Aux *) connection->custom_extension, url);
 }
 
 Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(const std::string& in_uri,
@@ -1607,7 +2466,7 @@ Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(con
     content {in_element},
     generator {nullptr},
     mutex {in_mutex} { 
-        Bind_Httpd_Server();
+        Bind_Httpd_Route(uri);
     }
 
 Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(const std::string& in_uri,
@@ -1619,7 +2478,7 @@ Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(con
     generator {in_func},
     mutex {nullptr} {
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route(uri);
 }
 
 Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(const std::string& in_uri,
@@ -1632,7 +2491,7 @@ Kis_Net_Httpd_Simple_Tracked_Endpoint::Kis_Net_Httpd_Simple_Tracked_Endpoint(con
     generator {in_func},
     mutex {in_mutex} {
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route(uri);
 }
 
 bool Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_VerifyPath(const char *path, const char *method) {
@@ -1644,6 +2503,29 @@ bool Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_VerifyPath(const char *path, c
     return false;
 }
 
+int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_HandleGetRequest(Kis_Net_Httpd *httpd, 
+        Kis_Net_Httpd_Connection *connection,
+        const char *url, const char *method, const char *upload_data,
+        size_t *upload_data_size) {
+
+    if (connection == NULL)
+        return MHD_NO;
+
+    // The generator tags the content and compares it with the tag the client has, 
+    // off the server thread; only the header is read here
+    if (connection->response == NULL && connection->custom_extension == NULL) {
+        auto inm = 
+            MHD_lookup_connection_value(connection->connection, MHD_HEADER_KIND, 
+                    MHD_HTTP_HEADER_IF_NONE_MATCH);
+
+        if (inm != nullptr)
+            connection->if_none_match = std::string(inm);
+    }
+
+    return Kis_Net_Httpd_Chain_Stream_Handler::Httpd_HandleGetRequest(httpd, connection,
+            url, method, upload_data, upload_data_size);
+}
+
 int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_CreateStreamResponse(
         Kis_Net_Httpd *httpd __attribute__((unused)),
         Kis_Net_Httpd_Connection *connection,
@@ -1687,20 +2569,37 @@ int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_CreateStreamResponse(
     }
 
     try {
-        std::shared_ptr<TrackerElement> output_content;
-
         if (content == nullptr && generator == nullptr) {
             stream << "Invalid request: No backing content present";
             connection->httpcode = 400;
             return MHD_YES;
         }
 
+        std::shared_ptr<TrackerElement> output_content;
+
         if (generator != nullptr)
             output_content = generator();
         else
             output_content = content;
 
-        Globalreg::FetchMandatoryGlobalAs<EntryTracker>("ENTRYTRACKER")->Serialize(httpd->GetSuffix(connection->url), stream, output_content, nullptr);
+        // The format negotiated for the request; the url has already been rewritten to
+        // its suffix
+        auto format = httpd->GetSuffix(connection->url);
+
+        // Digesting the content is much cheaper than serializing it; tag it before the
+        // headers go out, and skip the body when the client already has it
+        if (output_content != nullptr) {
+            connection->etag = httpd->TrackedETag(format, output_content);
+
+            if (httpd->ETagMatches(connection->if_none_match, connection->etag)) {
+                connection->httpcode = MHD_HTTP_NOT_MODIFIED;
+                return MHD_YES;
+            }
+        }
+
+        saux->release_headers();
+
+        Globalreg::FetchMandatoryGlobalAs<EntryTracker>("ENTRYTRACKER")->Serialize(format, stream, output_content, nullptr);
     } catch (const std::exception& e) {
         stream << "Error: " << e.what() << "\n";
         connection->httpcode = 500;
@@ -1764,7 +2663,7 @@ int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Conn
 
     // Common structured API data
     SharedStructured structdata;
-    std::vector<SharedElementSummary> summary_vec;
+    std::shared_ptr<TrackerElementProjection> projection;
     auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
 
     try {
@@ -1784,30 +2683,7 @@ int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Conn
     }
 
     try {
-        if (structdata->hasKey("fields")) {
-            SharedStructured fields = structdata->getStructuredByKey("fields");
-            StructuredData::structured_vec fvec = fields->getStructuredArray();
-
-            for (const auto& i : fvec) {
-                if (i->isString()) {
-                    auto s = std::make_shared<TrackerElementSummary>(i->getString());
-                    summary_vec.push_back(s);
-                } else if (i->isArray()) {
-                    StructuredData::string_vec mapvec = i->getStringVec();
-
-                    if (mapvec.size() != 2) {
-                        // fprintf(stderr, "debug - malformed rename pair\n");
-                        stream << "Invalid request: Expected field, rename";
-                        concls->httpcode = 400;
-                        return MHD_YES;
-                    }
-
-                    auto s = 
-                        std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]);
-                    summary_vec.push_back(s);
-                }
-            }
-        }
+        projection = kishttpd::ProjectionWithStructured(structdata);
     } catch(const StructuredDataException& e) {
         stream << "Invalid request: ";
         stream << e.what();
@@ -1815,9 +2691,8 @@ int Kis_Net_Httpd_Simple_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Conn
         return MHD_YES;
     }
 
-    if (summary_vec.size()) {
-        auto simple = 
-            SummarizeTrackerElement(output_content, summary_vec, rename_map);
+    if (projection != nullptr) {
+        auto simple = projection->apply(output_content, rename_map);
 
         Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(concls->url), stream, 
                 simple, rename_map);
@@ -1854,11 +2729,41 @@ Kis_Net_Httpd_Path_Tracked_Endpoint::Kis_Net_Httpd_Path_Tracked_Endpoint(
         Bind_Httpd_Server();
 }
 
+Kis_Net_Httpd_Path_Tracked_Endpoint::Kis_Net_Httpd_Path_Tracked_Endpoint(
+        const std::string& in_route,
+        Kis_Net_Httpd_Path_Tracked_Endpoint::path_func in_path,
+        bool in_auth, 
+        Kis_Net_Httpd_Path_Tracked_Endpoint::gen_func in_gen) :
+    Kis_Net_Httpd_Chain_Stream_Handler {},
+    path { in_path },
+    auth_req {in_auth},
+    generator {in_gen},
+    mutex {nullptr} { 
+        Bind_Httpd_Route(in_route);
+}
+
+Kis_Net_Httpd_Path_Tracked_Endpoint::Kis_Net_Httpd_Path_Tracked_Endpoint(
+        const std::string& in_route,
+        Kis_Net_Httpd_Path_Tracked_Endpoint::path_func in_path,
+        bool in_auth, 
+        Kis_Net_Httpd_Path_Tracked_Endpoint::gen_func in_gen,
+        kis_recursive_timed_mutex *in_mutex) :
+    Kis_Net_Httpd_Chain_Stream_Handler {},
+    path { in_path },
+    auth_req {in_auth},
+    generator {in_gen},
+    mutex {in_mutex} { 
+        Bind_Httpd_Route(in_route);
+}
+
 
 bool Kis_Net_Httpd_Path_Tracked_Endpoint::Httpd_VerifyPath(const char *in_path, const char *in_method) {
     if (!Httpd_CanSerialize(in_path))
         return false;
 
+    if (path == nullptr)
+        return true;
+
     auto stripped = Httpd_StripSuffix(in_path);
     auto tokenurl = StrTokenize(stripped, "/");
 
@@ -1989,7 +2894,7 @@ int Kis_Net_Httpd_Path_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Connec
 
     // Common structured API data
     SharedStructured structdata;
-    std::vector<SharedElementSummary> summary_vec;
+    std::shared_ptr<TrackerElementProjection> projection;
     auto rename_map = std::make_shared<TrackerElementSerializer::rename_map>();
 
     try {
@@ -2007,30 +2912,7 @@ int Kis_Net_Httpd_Path_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Connec
     }
 
     try {
-        if (structdata->hasKey("fields")) {
-            SharedStructured fields = structdata->getStructuredByKey("fields");
-            StructuredData::structured_vec fvec = fields->getStructuredArray();
-
-            for (const auto& i : fvec) {
-                if (i->isString()) {
-                    auto s = std::make_shared<TrackerElementSummary>(i->getString());
-                    summary_vec.push_back(s);
-                } else if (i->isArray()) {
-                    StructuredData::string_vec mapvec = i->getStringVec();
-
-                    if (mapvec.size() != 2) {
-                        // fprintf(stderr, "debug - malformed rename pair\n");
-                        stream << "Invalid request: Expected field, rename";
-                        concls->httpcode = 400;
-                        return MHD_YES;
-                    }
-
-                    auto s = 
-                        std::make_shared<TrackerElementSummary>(mapvec[0], mapvec[1]);
-                    summary_vec.push_back(s);
-                }
-            }
-        }
+        projection = kishttpd::ProjectionWithStructured(structdata);
     } catch(const StructuredDataException& e) {
         stream << "Invalid request: ";
         stream << e.what();
@@ -2038,9 +2920,8 @@ int Kis_Net_Httpd_Path_Tracked_Endpoint::Httpd_PostComplete(Kis_Net_Httpd_Connec
         return MHD_YES;
     }
 
-    if (summary_vec.size()) {
-        auto simple = 
-            SummarizeTrackerElement(output_content, summary_vec, rename_map);
+    if (projection != nullptr) {
+        auto simple = projection->apply(output_content, rename_map);
 
         Globalreg::globalreg->entrytracker->Serialize(httpd->GetSuffix(concls->url), stream, 
                 simple, rename_map);
@@ -2060,7 +2941,7 @@ Kis_Net_Httpd_Simple_Post_Endpoint::Kis_Net_Httpd_Simple_Post_Endpoint(const std
     generator {in_func}, 
     mutex {nullptr} {
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route(uri);
 }
 
 Kis_Net_Httpd_Simple_Post_Endpoint::Kis_Net_Httpd_Simple_Post_Endpoint(const std::string& in_uri,
@@ -2072,7 +2953,7 @@ Kis_Net_Httpd_Simple_Post_Endpoint::Kis_Net_Httpd_Simple_Post_Endpoint(const std
     generator {in_func},
     mutex {in_mutex} {
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route(uri);
 }
 
 bool Kis_Net_Httpd_Simple_Post_Endpoint::Httpd_VerifyPath(const char *path, const char *method) {
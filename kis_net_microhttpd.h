@@ -22,10 +22,12 @@
 #include "config.h"
 
 #include <atomic>
+#include <chrono>
 #include <stdio.h>
 #include <time.h>
 #include <list>
 #include <map>
+#include <set>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -35,16 +37,20 @@
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
+#include "kis_threadpool.h"
 #include "trackedelement.h"
 #include "ringbuf2.h"
 #include "chainbuf.h"
 #include "buffer_handler.h"
 #include "structured.h"
 
+struct z_stream_s;
+
 class Kis_Net_Httpd;
 class Kis_Net_Httpd_Session;
 class Kis_Net_Httpd_Connection;
 class Kis_Net_Httpd_Handler;
+class Kis_Net_Httpd_Buffer_Stream_Aux;
 
 class EntryTracker;
 
@@ -62,6 +68,12 @@ namespace kishttpd {
     // a summarized device)
     std::shared_ptr<TrackerElement> SummarizeWithStructured(std::shared_ptr<TrackerElement> in_data,
             SharedStructured structured, std::shared_ptr<TrackerElementSerializer::rename_map> rename_map);
+
+    // Compile the 'fields' summarization dictionary into a projection, or return nullptr 
+    // if there is no fields record.  Projections are cached by the fields requested, so
+    // repeated requests of the same shape only resolve their paths once.
+    // MAY THROW EXCEPTIONS if summarization is malformed.
+    std::shared_ptr<TrackerElementProjection> ProjectionWithStructured(SharedStructured structured);
 };
 
 // Connection data, generated for all requests by the processing system;
@@ -78,6 +90,8 @@ public:
         httpcode = 200;
         postprocessor = NULL;
         post_complete = false;
+        post_started = false;
+        post_finished = false;
         connection_type = CONNECTION_GET;
         httpd = NULL;
         httpdhandler = NULL;
@@ -117,6 +131,29 @@ public:
     // Optional alternate filename to pass to the browser for downloading
     std::string optional_filename;
 
+    // Optional entity tag of the response, sent with the standard headers
+    std::string etag;
+
+    // Optional content type, replacing the one derived from the url suffix
+    std::string content_type;
+
+    // Request headers which chose the form of the response, sent as the Vary header so
+    // that caches keep the forms apart
+    std::string vary;
+
+    void add_vary(const std::string& in_header) {
+        if (vary.length() != 0)
+            vary += ", ";
+        vary += in_header;
+    }
+
+    // If-None-Match header of a conditional request, captured on the server thread
+    // for generators which compare it to the entity tag of their content
+    std::string if_none_match;
+
+    // Named parameters captured from the path by the route which matched, if any
+    std::map<std::string, std::string> path_params;
+
     // HTTP code of response
     int httpcode;
 
@@ -129,6 +166,11 @@ public:
     // Is the post complete?
     bool post_complete;
 
+    // Has the handler started completing the post off the server thread, and has it
+    // finished?  The connection is suspended in between.
+    bool post_started;
+    std::atomic<bool> post_finished;
+
     // Type of request/connection
     int connection_type;
 
@@ -181,6 +223,11 @@ public:
     // Bind a http server if we need to do that later in the instantiation
     void Bind_Httpd_Server();
 
+    // Bind to a route instead of being asked about every request; only requests 
+    // matching the route are passed to Httpd_VerifyPath.  A handler may bind multiple
+    // routes.
+    void Bind_Httpd_Route(const std::string& in_route);
+
     // Handle a GET request; must allocate the response mechanism via
     // MHD_create_response_from_... and will typically call some other
     // function to generate the data for the response
@@ -284,10 +331,18 @@ public:
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size);
 
+    // Completes the post on the generator pool, with the connection suspended until
+    // it has finished; we're called again when the connection resumes
     virtual int Httpd_HandlePostRequest(Kis_Net_Httpd *httpd,
             Kis_Net_Httpd_Connection *connection, 
             const char *url, const char *method, const char *upload_data,
             size_t *upload_data_size);
+
+protected:
+    // Handlers whose post completion can block on something outside the server, such
+    // as waiting on a datasource, complete each post on a thread of its own instead 
+    // of the shared generator pool
+    virtual bool Httpd_GeneratorBlocks() { return false; }
 };
 
 // Fallback handler to report that we can't serve static files
@@ -308,10 +363,7 @@ public:
 // inside a connection object.
 class Kis_Net_Httpd_Buffer_Stream_Handler : public Kis_Net_Httpd_Handler {
 public:
-    Kis_Net_Httpd_Buffer_Stream_Handler() : Kis_Net_Httpd_Handler() {
-        // Default rb size
-        k_n_h_r_ringbuf_size = 1024*1024*4;
-    }
+    Kis_Net_Httpd_Buffer_Stream_Handler();
     virtual ~Kis_Net_Httpd_Buffer_Stream_Handler();
 
     virtual int Httpd_HandleGetRequest(Kis_Net_Httpd *httpd,
@@ -351,10 +403,14 @@ public:
 
     // Called by microhttpd during servicing a connecting; cls is a 
     // kis_net_httpd_buffer_stream_aux which contains all our references to
-    // this class instance, the buf streams, etc.  Locks waiting for the
-    // buf to have data available to write.
+    // this class instance, the buf streams, etc.  Suspends the connection until
+    // the buf has data available to write, instead of blocking the server thread.
     static ssize_t buffer_event_cb(void *cls, uint64_t pos, char *buf, size_t max);
 
+    // Free a stream once the http server is done with it; called by microhttpd when the
+    // response is destroyed, or when a request ends before its response was queued
+    static void free_buffer_aux_callback(void *cls);
+
     virtual void Httpd_Set_Buffer_Size(size_t in_sz) {
         k_n_h_r_ringbuf_size = in_sz;
     }
@@ -362,7 +418,29 @@ public:
 protected:
     virtual std::shared_ptr<BufferHandlerGeneric> allocate_buffer() = 0;
 
+    // Negotiate compression for a stream and queue the response; suspends the connection
+    // until the generator shows us whether the response is worth compressing, and is 
+    // called again when it resumes
+    int queue_stream_response(Kis_Net_Httpd *httpd, Kis_Net_Httpd_Connection *connection,
+            Kis_Net_Httpd_Buffer_Stream_Aux *aux, const char *url);
+
+    // Run the generator for a stream on the shared generator pool
+    void schedule_generator(Kis_Net_Httpd_Buffer_Stream_Aux *aux, std::function<int ()> in_gen);
+
+    // Handlers whose generators can block indefinitely on something outside the server,
+    // such as a proxied external tool, run each generator on a thread of its own 
+    // instead of the shared generator pool, so they can't tie up the pool
+    virtual bool Httpd_GeneratorBlocks() { return false; }
+
+    // Handlers whose generators set response headers, such as an entity tag computed
+    // from the content, hold the response until the generator releases the headers 
+    // or returns
+    virtual bool Httpd_GeneratorSetsHeaders() { return false; }
+
     size_t k_n_h_r_ringbuf_size;
+
+    // Limit on how many of our streams generate at once on the shared pool
+    std::shared_ptr<kis_thread_pool_limiter> generator_limiter;
 };
 
 // Ringbuf-based stream handler
@@ -411,6 +489,7 @@ public:
     void trigger_error() {
         in_error = true;
         cl->unlock(0);
+        resume();
     }
 
     void set_aux(void *in_aux, 
@@ -440,10 +519,68 @@ public:
     // Let the httpd callback pull the rb handler out
     std::shared_ptr<BufferHandlerGeneric> get_rbhandler() { return ringbuf_handler; }
 
-    // Block until data is available (called by the buffer_event_cb in the http
-    // session)
+    // Block until data is available
     void block_until_data(std::shared_ptr<BufferHandlerGeneric> rbh);
 
+    // Suspend the http connection until data is available (called by the 
+    // buffer_event_cb in the http session); returns false without suspending if 
+    // there is already data or the stream is complete
+    bool suspend_until_data(std::shared_ptr<BufferHandlerGeneric> rbh);
+
+    // Resume the http connection if it is suspended waiting for data
+    void resume();
+
+    // Suspend the http connection until we can tell how big the response is:  at 
+    // least in_sz bytes are buffered, or the generator has returned; returns false
+    // without suspending if we already can
+    bool suspend_until_ready(size_t in_sz);
+
+    // Flag the generator as having returned, and resume a connection waiting on it
+    void generator_complete();
+
+    // Hold the response headers until the generator has set them; the generator 
+    // releases them, or they are released when it returns
+    void hold_headers();
+    void release_headers();
+
+    // Suspend the http connection until the headers are released; returns false 
+    // without suspending if they already are
+    bool suspend_until_headers();
+
+    // The http connection has ended; stop suspending and resuming it
+    void detach_connection();
+
+    // Who owns the stream, the generator or the http response, is tracked outside of 
+    // the stream so that a generator which is still queued can find out the stream
+    // was canceled and freed without touching it.  The shared state also takes over 
+    // the connection record when the request ends, so that a generator still queued 
+    // or running never touches a freed connection; the record is freed with the 
+    // state, once both the stream and the generator are done with it.
+    enum class generator_state { queued, running, done, canceled, orphaned };
+
+    struct generator_shared_state {
+        generator_shared_state() : state{generator_state::queued} { }
+
+        std::atomic<generator_state> state;
+        std::unique_ptr<Kis_Net_Httpd_Connection> connection;
+    };
+
+    using shared_generator_state = std::shared_ptr<generator_shared_state>;
+
+    shared_generator_state get_generator_state() {
+        return gen_state;
+    }
+
+    // Compress the stream with a content encoding (gzip or deflate) from here on
+    bool start_compression(const std::string& in_encoding, int in_level);
+
+    bool compressing() {
+        return zstream != nullptr;
+    }
+
+    // Compress buffered data directly into the output buffer of the http session
+    ssize_t compress_into(std::shared_ptr<BufferHandlerGeneric> rbh, char *buf, size_t max);
+
     // Get the buffer event mutex
     kis_recursive_timed_mutex *get_buffer_event_mutex() {
         return &buffer_event_mutex;
@@ -468,8 +605,23 @@ public:
     // Are we in error?
     std::atomic<bool> in_error;
 
-    // Possible worker thread for processing the buffer fill
-    std::thread generator_thread;
+    // Http server we belong to
+    Kis_Net_Httpd *httpd;
+
+    // Is the connection suspended waiting for data?
+    bool suspended;
+
+    // Has the http connection ended?
+    bool detached;
+
+    // State of the generator filling the buffer, shared with the queued generator
+    shared_generator_state gen_state;
+
+    // Has the generator returned?
+    bool generator_returned;
+
+    // Is the generator still setting the response headers?
+    bool headers_held;
 
     // Additional arbitrary data - Used by the buffer streamer to store the
     // buffer processor, and by the CPP Streamer to store the streambuf
@@ -481,6 +633,10 @@ public:
     // Sync function; called to make sure the buffer is flushed and fully synced 
     // prior to flagging it complete
     std::function<void (Kis_Net_Httpd_Buffer_Stream_Aux *)> sync_cb;
+
+    // Compression state, if the stream is compressed
+    std::shared_ptr<z_stream_s> zstream;
+    bool zstream_end;
     
 };
 
@@ -501,6 +657,16 @@ public:
     // HTTP handlers
     virtual bool Httpd_VerifyPath(const char *path, const char *method) override;
 
+    // Answer conditional requests from the entity tag of the content, and only 
+    // stream the content when it has changed; the content is generated and tagged
+    // by the generator, so the response waits for the tag
+    virtual int Httpd_HandleGetRequest(Kis_Net_Httpd *httpd, 
+            Kis_Net_Httpd_Connection *connection,
+            const char *url, const char *method, const char *upload_data,
+            size_t *upload_data_size) override;
+
+    virtual bool Httpd_GeneratorSetsHeaders() override { return true; }
+
     virtual int Httpd_CreateStreamResponse(Kis_Net_Httpd *httpd,
             Kis_Net_Httpd_Connection *connection,
             const char *url, const char *method, const char *upload_data,
@@ -526,6 +692,13 @@ public:
     Kis_Net_Httpd_Path_Tracked_Endpoint(path_func in_path, bool in_auth, gen_func in_gen);
     Kis_Net_Httpd_Path_Tracked_Endpoint(path_func in_path, bool in_auth, gen_func in_gen,
             kis_recursive_timed_mutex *in_mutex);
+
+    // Routed path endpoints are only asked about paths matching the route; the path
+    // function may be nullptr if the route is enough to accept the request
+    Kis_Net_Httpd_Path_Tracked_Endpoint(const std::string& in_route, path_func in_path, 
+            bool in_auth, gen_func in_gen);
+    Kis_Net_Httpd_Path_Tracked_Endpoint(const std::string& in_route, path_func in_path, 
+            bool in_auth, gen_func in_gen, kis_recursive_timed_mutex *in_mutex);
     virtual ~Kis_Net_Httpd_Path_Tracked_Endpoint() { }
 
     // HTTP handlers
@@ -612,6 +785,86 @@ protected:
 #define KIS_SESSION_COOKIE      "KISMET"
 #define KIS_HTTPD_POSTBUFFERSZ  (1024 * 32)
 
+// Trie of routes to their handlers, built as handlers register.  A route is a path 
+// split on '/'; a component beginning with ':' matches any single component of the 
+// request and captures it as a named parameter, so "/phy/phy80211/clients-of/:key/clients"
+// matches "/phy/phy80211/clients-of/4202770D00000000_0000AABBCCDDEEFF/clients.json".
+// A final component beginning with '*' matches the rest of the request, one or more 
+// components, and captures them joined by '/'.  Routes are matched against the path 
+// without its serialization suffix, and literal components are preferred over 
+// parameters, and parameters over the rest of the path, when more than one would match.
+class Kis_Net_Httpd_Route_Trie {
+public:
+    using param_map = std::map<std::string, std::string>;
+    using accept_func = std::function<bool (Kis_Net_Httpd_Handler *)>;
+
+    struct route_record {
+        route_record(const std::string& in_route, Kis_Net_Httpd_Handler *in_handler) :
+            route {in_route},
+            handler {in_handler},
+            rest_pos {0},
+            requests {0},
+            match_ns_total {0},
+            match_ns_max {0} { }
+
+        std::string route;
+        Kis_Net_Httpd_Handler *handler;
+
+        // Position and name of each parameter component
+        std::vector<std::pair<size_t, std::string>> params;
+
+        // Position and name of the component capturing the rest of the path, if any
+        size_t rest_pos;
+        std::string rest;
+
+        // Requests dispatched to this route, and the time spent finding it
+        uint64_t requests;
+        uint64_t match_ns_total, match_ns_max;
+
+        void record_match(uint64_t in_ns) {
+            requests++;
+            match_ns_total += in_ns;
+            if (in_ns > match_ns_max)
+                match_ns_max = in_ns;
+        }
+    };
+
+    void insert(const std::string& in_route, Kis_Net_Httpd_Handler *in_handler);
+    void remove(Kis_Net_Httpd_Handler *in_handler);
+    void clear();
+
+    // Find the most specific route matching the path whose handler accepts the request,
+    // and capture its parameters; returns nullptr if nothing matches
+    std::shared_ptr<route_record> match(const std::string& in_path, accept_func in_accept,
+            param_map& out_params);
+
+    const std::vector<std::shared_ptr<route_record>>& get_routes() const {
+        return route_list;
+    }
+
+    static std::vector<std::string> split_path(const std::string& in_path);
+
+protected:
+    struct route_node {
+        std::map<std::string, std::unique_ptr<route_node>> literals;
+        std::unique_ptr<route_node> param;
+        std::vector<std::shared_ptr<route_record>> routes;
+
+        // Routes ending in a component matching the rest of the path
+        std::vector<std::shared_ptr<route_record>> rest_routes;
+    };
+
+    std::shared_ptr<route_record> match_node(route_node *node, 
+            const std::vector<std::string>& in_path, size_t pos, accept_func& in_accept);
+
+    void remove_node(route_node *node, Kis_Net_Httpd_Handler *in_handler);
+
+    route_node root;
+    std::vector<std::shared_ptr<route_record>> route_list;
+};
+
+class Kis_Net_Httpd_Simple_Tracked_Endpoint;
+
 class Kis_Net_Httpd : public LifetimeGlobal {
 public:
     static std::string global_name() { return "HTTPD_SERVER"; }
@@ -641,12 +894,43 @@ public:
     void RegisterHandler(Kis_Net_Httpd_Handler *in_handler);
     void RemoveHandler(Kis_Net_Httpd_Handler *in_handler);
 
+    // Route requests for a path pattern to a handler, see Kis_Net_Httpd_Route_Trie
+    void RegisterRoute(const std::string& in_route, Kis_Net_Httpd_Handler *in_handler);
+
     static std::string GetSuffix(std::string url);
     static std::string StripSuffix(std::string url);
 
     void RegisterMimeType(std::string suffix, std::string mimetype);
     std::string GetMimeType(std::string suffix);
 
+    // Find the serializer suffix requested by an Accept header, if the client prefers
+    // a registered serializer other than json; returns an empty string otherwise
+    std::string GetAcceptedSerializer(const std::string& accept);
+
+    // Find the content encoding to compress a streamed response with, from the 
+    // Accept-Encoding header of the request; returns an empty string if compression
+    // is disabled or the client doesn't accept a supported encoding
+    std::string GetAcceptedEncoding(Kis_Net_Httpd_Connection *connection);
+
+    int FetchCompressionLevel() { return compression_level; }
+    size_t FetchCompressionMinimum() { return compression_min; }
+
+    // Shared pool for running stream generators, and the number of streams a single
+    // endpoint may generate at once
+    std::shared_ptr<kis_thread_pool> FetchGeneratorPool() { return generator_pool; }
+    unsigned int FetchGeneratorLimit() { return generator_limit; }
+
+    // Track live streams, so that any suspended waiting for data can be ended
+    // when the server stops
+    void RegisterStream(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux);
+    void RemoveStream(Kis_Net_Httpd_Buffer_Stream_Aux *in_aux);
+
+    // Compute the entity tag of a tracked element, as serialized in a format
+    static std::string TrackedETag(const std::string& format, SharedTrackerElement e);
+
+    // Does an If-None-Match header match the entity tag?
+    static bool ETagMatches(const std::string& in_if_none_match, const std::string& etag);
+
     // Register a static files directory (used for system, home, and plugin data)
     void RegisterStaticDir(std::string in_url_prefix, std::string in_path);
 
@@ -676,6 +960,11 @@ public:
     static int SendStandardHttpResponse(Kis_Net_Httpd *httpd,
             Kis_Net_Httpd_Connection *connection, const char *url);
 
+    // Send an empty 304 response to a conditional request whose entity tag 
+    // still matches
+    static int SendNotModified(Kis_Net_Httpd *httpd,
+            Kis_Net_Httpd_Connection *connection);
+
     // Catch MHD panics and try to close more elegantly
     static void MHD_Panic(void *cls, const char *file, unsigned int line,
             const char *reason);
@@ -691,12 +980,39 @@ protected:
     struct MHD_Daemon *microhttpd;
     std::vector<Kis_Net_Httpd_Handler *> handler_vec;
 
+    // Routed handlers, and the metrics of requests which fell back to asking 
+    // the legacy handlers
+    Kis_Net_Httpd_Route_Trie route_trie;
+    std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record> legacy_route;
+
+    // Find the handler for a request, by route and then by asking every legacy handler
+    Kis_Net_Httpd_Handler *find_handler(const std::string& url, const char *method,
+            Kis_Net_Httpd_Route_Trie::param_map& params,
+            std::shared_ptr<Kis_Net_Httpd_Route_Trie::route_record>& route);
+
+    std::shared_ptr<Kis_Net_Httpd_Simple_Tracked_Endpoint> routes_endp;
+    std::shared_ptr<TrackerElement> routes_endp_handler();
+
+    int routes_id, route_id, route_path_id, route_requests_id, 
+        route_match_avg_id, route_match_max_id;
+
     std::string conf_username, conf_password;
 
     bool use_ssl;
     char *cert_pem, *cert_key;
     std::string pem_path, key_path;
 
+    bool use_compression;
+    int compression_level;
+    size_t compression_min;
+
+    unsigned int http_threads;
+    std::shared_ptr<kis_thread_pool> generator_pool;
+    unsigned int generator_limit;
+
+    std::mutex stream_mutex;
+    std::set<Kis_Net_Httpd_Buffer_Stream_Aux *> stream_set;
+
     bool running;
 
     std::map<std::string, std::string> mime_type_map;
@@ -0,0 +1,314 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_OPEN_HASHMAP_H__
+#define __KIS_OPEN_HASHMAP_H__
+
+#include "config.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash map with linear probing, used for the large, hot indexes
+// (such as the device key and MAC indexes in the devicetracker).
+//
+// Entries are stored inline in a single flat array, so a lookup is typically a
+// single cache line fetch instead of the pointer chasing of a std::map.  The table
+// is always a power of two in size; the slot is selected by fibonacci hashing the
+// value returned by Hash, so keys with low-entropy low bits (such as MAC addresses)
+// still spread evenly.  Deletion uses backwards-shift, so there are no tombstones
+// and lookups never degrade over time.
+//
+// The map can hold either unique keys (insert_unique / find) or multiple values
+// per key (insert_multi / for_each_equal); don't mix the two on the same map.
+//
+// Not thread safe; callers provide their own locking.
+template<typename K, typename V, typename Hash = std::hash<K>>
+class kis_open_hashmap {
+public:
+    struct slot {
+        slot() :
+            used{false} { }
+
+        bool used;
+        K first;
+        V second;
+    };
+
+    class iterator {
+    public:
+        iterator(std::vector<slot> *in_slots, size_t in_pos) :
+            slots{in_slots},
+            pos{in_pos} {
+            skip_empty();
+        }
+
+        slot& operator*() const { return (*slots)[pos]; }
+        slot* operator->() const { return &(*slots)[pos]; }
+
+        iterator& operator++() {
+            pos++;
+            skip_empty();
+            return *this;
+        }
+
+        bool operator==(const iterator& i) const { return pos == i.pos; }
+        bool operator!=(const iterator& i) const { return pos != i.pos; }
+
+    protected:
+        void skip_empty() {
+            while (pos < slots->size() && !(*slots)[pos].used)
+                pos++;
+        }
+
+        std::vector<slot> *slots;
+        size_t pos;
+    };
+
+    kis_open_hashmap() :
+        n_used{0} {
+        rehash(16);
+    }
+
+    kis_open_hashmap(size_t in_presize) :
+        n_used{0} {
+        reserve(in_presize);
+    }
+
+    size_t size() const {
+        return n_used;
+    }
+
+    bool empty() const {
+        return n_used == 0;
+    }
+
+    void clear() {
+        slots.clear();
+        n_used = 0;
+        rehash(16);
+    }
+
+    // Size the table so that in_sz elements fit without growing
+    void reserve(size_t in_sz) {
+        size_t target = 16;
+
+        while (target * max_load_num < in_sz * max_load_den)
+            target <<= 1;
+
+        if (slots.size() < target)
+            rehash(target);
+    }
+
+    iterator begin() {
+        return iterator(&slots, 0);
+    }
+
+    iterator end() {
+        return iterator(&slots, slots.size());
+    }
+
+    // Find a unique key
+    iterator find(const K& key) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key)
+                return iterator(&slots, pos);
+
+            pos = (pos + 1) & mask;
+        }
+
+        return end();
+    }
+
+    // Insert or replace a unique key
+    void insert_unique(const K& key, const V& value) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key) {
+                slots[pos].second = value;
+                return;
+            }
+
+            pos = (pos + 1) & mask;
+        }
+
+        fill_slot(pos, key, value);
+    }
+
+    // Insert a value without replacing any other values with the same key
+    void insert_multi(const K& key, const V& value) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used)
+            pos = (pos + 1) & mask;
+
+        fill_slot(pos, key, value);
+    }
+
+    // Number of values stored under a key
+    size_t count(const K& key) const {
+        size_t pos = ideal_pos(key);
+        size_t n = 0;
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key)
+                n++;
+
+            pos = (pos + 1) & mask;
+        }
+
+        return n;
+    }
+
+    // Call fn on every value stored under a key
+    void for_each_equal(const K& key, const std::function<void (V&)>& fn) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key)
+                fn(slots[pos].second);
+
+            pos = (pos + 1) & mask;
+        }
+    }
+
+    // Erase a unique key, returning the number of values removed
+    size_t erase(const K& key) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key) {
+                erase_slot(pos);
+                return 1;
+            }
+
+            pos = (pos + 1) & mask;
+        }
+
+        return 0;
+    }
+
+    // Erase the first value under a key which matches a predicate
+    size_t erase_if(const K& key, const std::function<bool (const V&)>& pred) {
+        size_t pos = ideal_pos(key);
+
+        while (slots[pos].used) {
+            if (slots[pos].first == key && pred(slots[pos].second)) {
+                erase_slot(pos);
+                return 1;
+            }
+
+            pos = (pos + 1) & mask;
+        }
+
+        return 0;
+    }
+
+protected:
+    // Grow when the table is more than 7/10 full
+    static const size_t max_load_num = 7;
+    static const size_t max_load_den = 10;
+
+    std::vector<slot> slots;
+    size_t mask;
+    unsigned int shift;
+    size_t n_used;
+
+    size_t ideal_pos(const K& key) const {
+        // Fibonacci hashing; take the high bits of the product so that every bit of
+        // the key contributes to the slot
+        return (size_t) ((((uint64_t) Hash{}(key)) * 11400714819323198485ULL) >> shift);
+    }
+
+    void fill_slot(size_t pos, const K& key, const V& value) {
+        slots[pos].used = true;
+        slots[pos].first = key;
+        slots[pos].second = value;
+        n_used++;
+
+        if (n_used * max_load_den > slots.size() * max_load_num)
+            rehash(slots.size() << 1);
+    }
+
+    void erase_slot(size_t pos) {
+        slots[pos] = slot();
+        n_used--;
+
+        // Backwards-shift any following entries which would otherwise become
+        // unreachable from their ideal position
+        size_t hole = pos;
+        size_t next = (pos + 1) & mask;
+
+        while (slots[next].used) {
+            size_t ideal = ideal_pos(slots[next].first);
+
+            // Can the entry at next move into the hole?  Only if its ideal slot is
+            // not cyclically within (hole, next]
+            bool movable;
+            if (hole <= next)
+                movable = (ideal <= hole || ideal > next);
+            else
+                movable = (ideal <= hole && ideal > next);
+
+            if (movable) {
+                slots[hole] = std::move(slots[next]);
+                slots[next] = slot();
+                hole = next;
+            }
+
+            next = (next + 1) & mask;
+        }
+    }
+
+    void rehash(size_t in_sz) {
+        std::vector<slot> old_slots(in_sz);
+        old_slots.swap(slots);
+
+        mask = in_sz - 1;
+
+        shift = 64;
+        for (size_t s = in_sz; s > 1; s >>= 1)
+            shift--;
+
+        n_used = 0;
+
+        for (auto& s : old_slots) {
+            if (!s.used)
+                continue;
+
+            size_t pos = ideal_pos(s.first);
+
+            while (slots[pos].used)
+                pos = (pos + 1) & mask;
+
+            slots[pos].used = true;
+            slots[pos].first = std::move(s.first);
+            slots[pos].second = std::move(s.second);
+            n_used++;
+        }
+    }
+};
+
+#endif
+
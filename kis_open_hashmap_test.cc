@@ -0,0 +1,213 @@
+/* benchmark harness for the Kismet open hashmap
+ *
+ * Times the device key index and the MAC index of the devicetracker, as
+ * kis_open_hashmap and as the std::map and std::multimap they replaced, at 10k,
+ * 100k, and 1M devices:  inserting every device, looking up every device in random
+ * order, looking up every MAC, and removing every device.  Results are the average
+ * nanoseconds per operation.  Fails if the open hashmap finds a different number of
+ * devices or MACs than the std containers, or isn't empty once every device is removed.
+ *
+ * # configure kismet, optionally with asan
+ * ./configure --enable-asan
+ *
+ * # build and run every test harness
+ * make check
+ *
+ * # or build this harness alone
+ * make kis_open_hashmap_test
+ *
+ * ./kis_open_hashmap_test [device count ...]
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "macaddr.h"
+#include "trackedelement.h"
+#include "kis_open_hashmap.h"
+
+using value_t = std::shared_ptr<int>;
+
+struct result {
+    double insert_ns;
+    double find_ns;
+    double mac_ns;
+    double erase_ns;
+
+    size_t found_keys;
+    size_t found_macs;
+    bool emptied;
+};
+
+template<typename F>
+double time_ns(size_t in_ops, F in_fn) {
+    auto start = std::chrono::steady_clock::now();
+    in_fn();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / in_ops;
+}
+
+result bench_std(const std::vector<device_key>& keys, const std::vector<mac_addr>& macs,
+        const std::vector<size_t>& order, const value_t& value) {
+    result r;
+
+    std::map<device_key, value_t> key_map;
+    std::multimap<mac_addr, value_t> mac_map;
+
+    r.insert_ns = time_ns(keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            key_map.insert(std::make_pair(keys[i], value));
+            mac_map.insert(std::make_pair(macs[i], value));
+        }
+    });
+
+    r.found_keys = 0;
+    r.find_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            if (key_map.find(keys[i]) != key_map.end())
+                r.found_keys++;
+        }
+    });
+
+    r.found_macs = 0;
+    r.mac_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            auto range = mac_map.equal_range(macs[i]);
+            for (auto mi = range.first; mi != range.second; ++mi)
+                r.found_macs++;
+        }
+    });
+
+    r.erase_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            key_map.erase(keys[i]);
+
+            auto range = mac_map.equal_range(macs[i]);
+            for (auto mi = range.first; mi != range.second; ++mi) {
+                if (mi->second == value) {
+                    mac_map.erase(mi);
+                    break;
+                }
+            }
+        }
+    });
+
+    r.emptied = key_map.empty() && mac_map.empty();
+
+    return r;
+}
+
+result bench_open(const std::vector<device_key>& keys, const std::vector<mac_addr>& macs,
+        const std::vector<size_t>& order, const value_t& value) {
+    result r;
+
+    kis_open_hashmap<device_key, value_t> key_map;
+    kis_open_hashmap<mac_addr, value_t> mac_map;
+
+    r.insert_ns = time_ns(keys.size(), [&]() {
+        for (size_t i = 0; i < keys.size(); i++) {
+            key_map.insert_unique(keys[i], value);
+            mac_map.insert_multi(macs[i], value);
+        }
+    });
+
+    r.found_keys = 0;
+    r.find_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            if (key_map.find(keys[i]) != key_map.end())
+                r.found_keys++;
+        }
+    });
+
+    r.found_macs = 0;
+    r.mac_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            mac_map.for_each_equal(macs[i], [&r](value_t&) { r.found_macs++; });
+        }
+    });
+
+    r.erase_ns = time_ns(keys.size(), [&]() {
+        for (auto i : order) {
+            key_map.erase(keys[i]);
+            mac_map.erase_if(macs[i], [&value](const value_t& v) { return v == value; });
+        }
+    });
+
+    r.emptied = key_map.empty() && mac_map.empty();
+
+    return r;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<size_t> counts;
+
+    for (int i = 1; i < argc; i++)
+        counts.push_back(strtoul(argv[i], NULL, 10));
+
+    if (counts.size() == 0)
+        counts = {10000, 100000, 1000000};
+
+    std::mt19937_64 rng(0x4B49534D);
+
+    auto value = std::make_shared<int>(0);
+    auto phy = device_key::gen_pkey("IEEE802.11");
+
+    printf("%-9s %-18s %-18s %-18s %-18s\n", "devices",
+            "insert map/hash", "find map/hash", "mac map/hash", "erase map/hash");
+
+    for (auto n : counts) {
+        std::vector<device_key> keys;
+        std::vector<mac_addr> macs;
+        std::vector<size_t> order;
+
+        keys.reserve(n);
+        macs.reserve(n);
+        order.reserve(n);
+
+        for (size_t i = 0; i < n; i++) {
+            uint64_t m = rng() & 0xFFFFFFFFFFFFULL;
+            uint8_t bytes[6];
+
+            for (unsigned int x = 0; x < 6; x++)
+                bytes[x] = (m >> ((5 - x) * 8)) & 0xFF;
+
+            macs.push_back(mac_addr(bytes, 6));
+            keys.push_back(device_key(phy, macs.back()));
+            order.push_back(i);
+        }
+
+        std::shuffle(order.begin(), order.end(), rng);
+
+        auto rs = bench_std(keys, macs, order, value);
+        auto ro = bench_open(keys, macs, order, value);
+
+        printf("%-9lu %7.0fns/%7.0fns %7.0fns/%7.0fns %7.0fns/%7.0fns %7.0fns/%7.0fns\n", n,
+                rs.insert_ns, ro.insert_ns, rs.find_ns, ro.find_ns,
+                rs.mac_ns, ro.mac_ns, rs.erase_ns, ro.erase_ns);
+
+        if (ro.found_keys != rs.found_keys || ro.found_macs != rs.found_macs || 
+                rs.found_keys != n) {
+            fprintf(stderr, "Open hashmap found %lu devices and %lu macs, expected %lu "
+                    "and %lu\n", ro.found_keys, ro.found_macs, rs.found_keys, rs.found_macs);
+            exit(1);
+        }
+
+        if (!ro.emptied) {
+            fprintf(stderr, "Open hashmap not empty after removing every device\n");
+            exit(1);
+        }
+    }
+
+    return 0;
+}
+
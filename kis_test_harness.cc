@@ -0,0 +1,123 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include "kis_test_harness.h"
+
+#include "globalregistry.h"
+#include "messagebus.h"
+#include "configfile.h"
+#include "timetracker.h"
+#include "kis_net_microhttpd.h"
+#include "entrytracker.h"
+
+// Normally provided by kismet_server.cc
+char *exec_name = (char *) "kismet_test";
+
+void test_harness_init() {
+    Globalreg::globalreg = new GlobalRegistry;
+
+    MessageBus::create_messagebus(Globalreg::globalreg);
+    Globalreg::globalreg->kismet_config = new ConfigFile(Globalreg::globalreg);
+    Timetracker::create_timetracker();
+    Kis_Net_Httpd::create_httpd();
+    EntryTracker::create_entrytracker(Globalreg::globalreg);
+}
+
+void test_harness_shutdown() {
+    Globalreg::globalreg->DeleteLifetimeGlobals();
+}
+
+int test_field(const std::string& in_name, std::unique_ptr<TrackerElement> in_builder) {
+    return Globalreg::globalreg->entrytracker->RegisterField("test." + in_name,
+            std::move(in_builder), "test field, \"quoted\"");
+}
+
+mac_addr test_mac(uint64_t in_mac) {
+    uint8_t bytes[6];
+
+    for (unsigned int x = 0; x < 6; x++)
+        bytes[x] = (in_mac >> ((5 - x) * 8)) & 0xFF;
+
+    return mac_addr(bytes, 6);
+}
+
+double test_elapsed_ms(std::chrono::steady_clock::time_point in_start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+            in_start).count();
+}
+
+std::shared_ptr<TrackerElementMap> test_device_record(unsigned int n) {
+    static int device_id = test_field("device", TrackerElementFactory<TrackerElementMap>());
+    static int key_id = test_field("device.key", TrackerElementFactory<TrackerElementDeviceKey>());
+    static int mac_id = test_field("device.macaddr", TrackerElementFactory<TrackerElementMacAddr>());
+    static int name_id = test_field("device.name", TrackerElementFactory<TrackerElementString>());
+    static int type_id = test_field("device.type", TrackerElementFactory<TrackerElementString>());
+    static int first_id = test_field("device.first_time", TrackerElementFactory<TrackerElementUInt64>());
+    static int last_id = test_field("device.last_time", TrackerElementFactory<TrackerElementUInt64>());
+    static int packets_id = test_field("device.packets", TrackerElementFactory<TrackerElementUInt64>());
+    static int signal_id = test_field("device.signal", TrackerElementFactory<TrackerElementInt32>());
+    static int freq_id = test_field("device.frequency", TrackerElementFactory<TrackerElementDouble>());
+    static int uuid_id = test_field("device.server_uuid", TrackerElementFactory<TrackerElementUUID>());
+    static int seenby_id = test_field("device.seenby", TrackerElementFactory<TrackerElementIntMap>());
+    static int seen_id = test_field("device.seenby.record", TrackerElementFactory<TrackerElementMap>());
+    static int seen_packets_id = test_field("device.seenby.packets", TrackerElementFactory<TrackerElementUInt64>());
+    static int clients_id = test_field("device.clients", TrackerElementFactory<TrackerElementMacMap>());
+    static int client_id = test_field("device.client", TrackerElementFactory<TrackerElementMap>());
+    static int client_mac_id = test_field("device.client.mac", TrackerElementFactory<TrackerElementMacAddr>());
+    static int client_time_id = test_field("device.client.last_time", TrackerElementFactory<TrackerElementUInt64>());
+
+    auto mac = test_mac(0x001122000000ULL + n);
+
+    auto device = std::make_shared<TrackerElementMap>(device_id);
+
+    device->insert(test_value<TrackerElementDeviceKey>(key_id, device_key(0x1234, mac)));
+    device->insert(std::make_shared<TrackerElementMacAddr>(mac_id, mac));
+    device->insert(std::make_shared<TrackerElementString>(name_id,
+                "Device " + std::to_string(n)));
+    device->insert(std::make_shared<TrackerElementString>(type_id, "Wi-Fi AP"));
+    device->insert(std::make_shared<TrackerElementUInt64>(first_id, 1500000000 + n));
+    device->insert(std::make_shared<TrackerElementUInt64>(last_id, 1500003600 + n));
+    device->insert(std::make_shared<TrackerElementUInt64>(packets_id, n * 37));
+    device->insert(std::make_shared<TrackerElementInt32>(signal_id, -40 - (int) (n % 50)));
+    device->insert(std::make_shared<TrackerElementDouble>(freq_id, 2412000 + (n % 11) * 5000));
+    device->insert(std::make_shared<TrackerElementUUID>(uuid_id,
+                uuid("01234567-89AB-CDEF-0123-456789ABCDEF")));
+
+    auto seenby = std::make_shared<TrackerElementIntMap>(seenby_id);
+    for (int s = 0; s < 2; s++) {
+        auto r = std::make_shared<TrackerElementMap>(seen_id);
+        r->insert(std::make_shared<TrackerElementUInt64>(seen_packets_id, n * (s + 1)));
+        seenby->insert(s, r);
+    }
+    device->insert(seenby);
+
+    auto clients = std::make_shared<TrackerElementMacMap>(clients_id);
+    for (unsigned int c = 0; c < n % 8; c++) {
+        auto cmac = test_mac(0x665544000000ULL + (n << 3) + c);
+        auto r = std::make_shared<TrackerElementMap>(client_id);
+        r->insert(std::make_shared<TrackerElementMacAddr>(client_mac_id, cmac));
+        r->insert(std::make_shared<TrackerElementUInt64>(client_time_id, 1500003600 + n));
+        clients->insert(cmac, r);
+    }
+    device->insert(clients);
+
+    return device;
+}
+
@@ -0,0 +1,62 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_TEST_HARNESS_H__
+#define __KIS_TEST_HARNESS_H__
+
+#include "config.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "macaddr.h"
+#include "trackedelement.h"
+
+// Shared fixture for the *_test harnesses, which are linked against the server
+// objects without kismet_server.cc; see the check target in Makefile.in
+
+// Bring up the global registry and the core trackers every harness needs:  the
+// messagebus, an empty config, the timetracker, the httpd, and the entrytracker
+void test_harness_init();
+
+// Tear down everything test_harness_init and the harness created
+void test_harness_shutdown();
+
+// Register a field under the test. namespace and return its id
+int test_field(const std::string& in_name, std::unique_ptr<TrackerElement> in_builder);
+
+// Element of an already registered field
+template<typename TE, typename V>
+std::shared_ptr<TE> test_value(int in_id, const V& in_value) {
+    auto e = std::make_shared<TE>(in_id);
+    e->set(in_value);
+    return e;
+}
+
+mac_addr test_mac(uint64_t in_mac);
+
+double test_elapsed_ms(std::chrono::steady_clock::time_point in_start);
+
+// A record shaped like a stored device, using only the types the storage json loader
+// understands:  key, address, name and type, times and counters, signal, frequency,
+// server uuid, a seenby map of two records, and a client map of n % 8 records
+std::shared_ptr<TrackerElementMap> test_device_record(unsigned int n);
+
+#endif
+
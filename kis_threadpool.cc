@@ -0,0 +1,123 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include "kis_threadpool.h"
+
+kis_thread_pool::kis_thread_pool(unsigned int in_threads) :
+    shutdown {false} {
+
+    if (in_threads == 0)
+        in_threads = 1;
+
+    for (unsigned int i = 0; i < in_threads; i++)
+        threads.emplace_back(std::thread([this]() { worker(); }));
+}
+
+kis_thread_pool::~kis_thread_pool() {
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        shutdown = true;
+    }
+
+    queue_cv.notify_all();
+
+    for (auto& t : threads) {
+        if (t.joinable())
+            t.join();
+    }
+}
+
+void kis_thread_pool::submit(std::function<void ()> in_work) {
+    {
+        std::lock_guard<std::mutex> lk(queue_mutex);
+        work_queue.push_back(in_work);
+    }
+
+    queue_cv.notify_one();
+}
+
+void kis_thread_pool::worker() {
+    while (1) {
+        std::function<void ()> work;
+
+        {
+            std::unique_lock<std::mutex> lk(queue_mutex);
+
+            queue_cv.wait(lk, [this]() { return shutdown || work_queue.size() > 0; });
+
+            if (work_queue.size() == 0)
+                return;
+
+            work = std::move(work_queue.front());
+            work_queue.pop_front();
+        }
+
+        work();
+    }
+}
+
+kis_thread_pool_limiter::kis_thread_pool_limiter(std::shared_ptr<kis_thread_pool> in_pool,
+        unsigned int in_limit) :
+    pool {in_pool},
+    limit {in_limit == 0 ? 1 : in_limit},
+    running {0} { }
+
+void kis_thread_pool_limiter::submit(std::function<void ()> in_work) {
+    {
+        std::lock_guard<std::mutex> lk(limiter_mutex);
+
+        if (running >= limit) {
+            pending.push_back(in_work);
+            return;
+        }
+
+        running++;
+    }
+
+    run(in_work);
+}
+
+void kis_thread_pool_limiter::run(std::function<void ()> in_work) {
+    // Hold a reference to ourselves so work queued in the pool can always find its 
+    // way back to the limiter
+    auto self = shared_from_this();
+
+    pool->submit([self, in_work]() {
+        in_work();
+
+        std::function<void ()> next;
+
+        {
+            std::lock_guard<std::mutex> lk(self->limiter_mutex);
+
+            if (self->pending.size() == 0) {
+                self->running--;
+                return;
+            }
+
+            // Hand our slot directly to the next piece of waiting work
+            next = std::move(self->pending.front());
+            self->pending.pop_front();
+        }
+
+        self->run(next);
+    });
+}
+
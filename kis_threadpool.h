@@ -0,0 +1,82 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __KIS_THREADPOOL_H__
+#define __KIS_THREADPOOL_H__
+
+#include "config.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed pool of worker threads which run queued work in order.  Work which would 
+// otherwise spawn a thread per request runs here instead, so the number of threads 
+// stays flat no matter how many requests are in flight.
+//
+// Work must not throw; the pool stops accepting work and joins its threads when it 
+// is destroyed, after finishing anything already queued.
+class kis_thread_pool {
+public:
+    kis_thread_pool(unsigned int in_threads);
+    ~kis_thread_pool();
+
+    // Queue work to run on the next free thread
+    void submit(std::function<void ()> in_work);
+
+    size_t get_num_threads() const {
+        return threads.size();
+    }
+
+protected:
+    void worker();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::function<void ()>> work_queue;
+    bool shutdown;
+
+    std::vector<std::thread> threads;
+};
+
+// Limit how much work from one source runs on a shared pool at once.  Work past the 
+// limit waits in the limiter, not the pool, until earlier work from the same source 
+// completes, so one busy source can't tie up every thread in the pool.
+class kis_thread_pool_limiter : public std::enable_shared_from_this<kis_thread_pool_limiter> {
+public:
+    kis_thread_pool_limiter(std::shared_ptr<kis_thread_pool> in_pool, unsigned int in_limit);
+
+    void submit(std::function<void ()> in_work);
+
+protected:
+    void run(std::function<void ()> in_work);
+
+    std::shared_ptr<kis_thread_pool> pool;
+    unsigned int limit;
+
+    std::mutex limiter_mutex;
+    unsigned int running;
+    std::deque<std::function<void ()>> pending;
+};
+
+#endif
+
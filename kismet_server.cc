@@ -105,6 +105,8 @@
 #include "manuf.h"
 #include "entrytracker.h"
 #include "json_adapter.h"
+#include "kbin_adapter.h"
+#include "msgpack_adapter.h"
 
 #ifndef exec_name
 char *exec_name;
@@ -233,7 +235,8 @@ void SpindownKismet(std::shared_ptr<PollableTracker> pollabletracker) {
     auto devicetracker =
         Globalreg::FetchGlobalAs<Devicetracker>("DEVICETRACKER");
     if (devicetracker != NULL) {
-        devicetracker->store_all_devices();
+        devicetracker->stop_restore();
+        devicetracker->store_devices();
         devicetracker->databaselog_write_devices();
     }
 
@@ -305,6 +308,10 @@ void SpindownKismet(std::shared_ptr<PollableTracker> pollabletracker) {
     if (plugintracker != NULL)
         plugintracker->ShutdownPlugins();
 
+    // Make sure any queued messages reach the clients
+    if (globalregistry->messagebus != NULL)
+        globalregistry->messagebus->Flush();
+
     // Dump fatal errors again
     if (fqmescli != NULL) //  && globalregistry->fatal_condition) 
         fqmescli->DumpFatals();
@@ -647,9 +654,6 @@ int main(int argc, char *argv[], char *envp[]) {
     // Register the smart msg printer for everything
     globalregistry->messagebus->RegisterClient(smartmsgcli, MSGFLAG_ALL);
 
-	// Create the event bus
-	Eventbus::create_eventbus();
-
     // We need to create the pollable system near the top of execution as well
     std::shared_ptr<PollableTracker> pollabletracker(PollableTracker::create_pollabletracker(globalregistry));
 
@@ -666,6 +670,9 @@ int main(int argc, char *argv[], char *envp[]) {
     }
     globalregistry->kismet_config = conf;
 
+    // Apply the message queue limits now that we have a config
+    globalregistry->messagebus->LoadConfig();
+
     struct stat fstat;
     std::string configdir;
 
@@ -755,10 +762,17 @@ int main(int argc, char *argv[], char *envp[]) {
     entrytracker->RegisterSerializer("ekjson", std::make_shared<EkJsonAdapter::Serializer>());
     entrytracker->RegisterSerializer("prettyjson", std::make_shared<PrettyJsonAdapter::Serializer>());
     entrytracker->RegisterSerializer("storagejson", std::make_shared<StorageJsonAdapter::Serializer>());
+    entrytracker->RegisterSerializer("kbin", std::make_shared<KbinAdapter::Serializer>());
+    entrytracker->RegisterSerializer("msgpack", std::make_shared<MsgpackAdapter::Serializer>());
+    entrytracker->RegisterSerializer("cbor", std::make_shared<CborAdapter::Serializer>());
 
     entrytracker->RegisterSerializer("jcmd", std::make_shared<JsonAdapter::Serializer>());
     entrytracker->RegisterSerializer("cmd", std::make_shared<JsonAdapter::Serializer>());
 
+    // Create the event bus; it needs the config, httpd, and entrytracker to publish
+    // its stats
+    Eventbus::create_eventbus();
+
     if (daemonize) {
         // remove messagebus clients so we stop printing
         globalregistry->messagebus->RemoveClient(fqmescli);
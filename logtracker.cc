@@ -39,7 +39,10 @@ LogTracker::LogTracker() :
     register_fields();
     reserve_fields(NULL);
     
-    Bind_Httpd_Server();
+    Bind_Httpd_Route("/logging/drivers");
+    Bind_Httpd_Route("/logging/active");
+    Bind_Httpd_Route("/logging/by-uuid/:uuid/stop");
+    Bind_Httpd_Route("/logging/by-class/:class/start");
 }
 
 LogTracker::~LogTracker() {
@@ -43,6 +43,7 @@
 #include <map>
 #include <sstream>
 #include <iomanip>
+#include <functional>
 
 #include "fmt.h"
 #include "multi_constexpr.h"
@@ -343,5 +344,15 @@ struct mac_addr {
 std::ostream& operator<<(std::ostream& os, const mac_addr& m);
 std::istream& operator>>(std::istream& is, mac_addr& m);
 
+// Hash only the address itself; masked addresses can't be hash-indexed and
+// must be matched with a scan
+namespace std {
+    template<> struct hash<mac_addr> {
+        size_t operator()(const mac_addr& m) const {
+            return (size_t) m.longmac;
+        }
+    };
+}
+
 #endif
 
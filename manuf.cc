@@ -135,6 +135,8 @@ std::shared_ptr<TrackerElementString> Manuf::LookupOUI(mac_addr in_mac) {
     if (mfile == NULL)
         return unknown_manuf;
 
+    local_locker lock(&mutex);
+
     // Use the cache first
     if (oui_map.find(soui) != oui_map.end()) {
         return oui_map[soui].manuf;
@@ -34,6 +34,7 @@
 #endif
 #include "util.h"
 #include "globalregistry.h"
+#include "kis_mutex.h"
 
 #include "trackedelement.h"
 
@@ -60,6 +61,10 @@ class Manuf {
         bool IsUnknownManuf(std::shared_ptr<TrackerElementString> in_manuf);
 
     protected:
+        // Lookups share the cache and the file position, and may be called from
+        // multiple threads when restoring devices
+        kis_recursive_timed_mutex mutex;
+
         std::vector<index_pos> index_vec;
 
         std::map<uint32_t, manuf_data> oui_map;
@@ -19,6 +19,7 @@
 #include "config.h"
 
 #include "messagebus.h"
+#include "configfile.h"
 #include "entrytracker.h"
 
 #include "util.h"
@@ -34,28 +35,177 @@ void StdoutMessageClient::ProcessMessage(std::string in_msg, int in_flags) {
 
 MessageBus::MessageBus(GlobalRegistry *in_globalreg) {
     globalreg = in_globalreg;
+
+    // Defaults until the config is loaded
+    max_queue = 1024;
+    policy = overflow_policy::drop_oldest;
+
+    dropped = 0;
+    dropped_unreported = 0;
+
+    shutdown = false;
+    delivery_thread = std::thread::id();
+
+    msg_cl.lock();
+
+    msg_dispatch_t = 
+        std::thread([this]() {
+                msg_queue_dispatcher();
+            });
+
+    thread_set_process_name("kismet [messagebus]", msg_dispatch_t);
 }
 
 MessageBus::~MessageBus() {
+    {
+        local_locker lock(&msg_mutex);
+        shutdown = true;
+        msg_cl.unlock(0);
+        space_cl.unlock(0);
+    }
+
+    msg_dispatch_t.join();
+
+    local_locker dlock(&delivery_mutex);
     local_locker lock(&msg_mutex);
 
     globalreg->RemoveGlobal("MESSAGEBUS");
     globalreg->messagebus = NULL;
 }
 
+void MessageBus::LoadConfig() {
+    auto policy_opt = StrLower(globalreg->kismet_config->FetchOptDfl("messagebus_overflow", 
+                "drop_oldest"));
+
+    {
+        local_locker lock(&msg_mutex);
+
+        max_queue = globalreg->kismet_config->FetchOptAs<size_t>("messagebus_queue_limit", 1024);
+
+        if (policy_opt == "drop_newest") {
+            policy = overflow_policy::drop_newest;
+        } else if (policy_opt == "block") {
+            policy = overflow_policy::block;
+        } else {
+            policy = overflow_policy::drop_oldest;
+        }
+    }
+
+    // Reported once the new policy is in place, since the report goes through the queue
+    if (policy_opt != "drop_newest" && policy_opt != "block" && policy_opt != "drop_oldest")
+        _MSG_ERROR("Unknown messagebus_overflow option '{}', using 'drop_oldest'", policy_opt);
+}
+
 void MessageBus::InjectMessage(std::string in_msg, int in_flags) {
+    // Fatal messages are delivered immediately, after anything already queued, 
+    // since the caller is likely to shut down
+    if (in_flags & MSGFLAG_FATAL) {
+        local_locker dlock(&delivery_mutex);
+        auto prev_thread = delivery_thread.exchange(std::this_thread::get_id());
+        deliver_queue();
+        deliver_message(in_msg, in_flags);
+        delivery_thread = prev_thread;
+        return;
+    }
+
+    local_demand_locker lock(&msg_mutex);
+    lock.lock();
+
+    // A client may generate messages while they're being delivered; the delivering
+    // thread can never wait for room in the queue
+    while (max_queue != 0 && msg_queue.size() >= max_queue && !shutdown &&
+            policy == overflow_policy::block && 
+            std::this_thread::get_id() != delivery_thread.load()) {
+        space_cl.lock();
+        lock.unlock();
+        space_cl.block_for_ms(std::chrono::milliseconds(100));
+        lock.lock();
+    }
+
+    if (max_queue != 0 && msg_queue.size() >= max_queue) {
+        dropped++;
+        dropped_unreported++;
+
+        if (policy == overflow_policy::drop_newest)
+            return;
+
+        msg_queue.pop_front();
+    }
+
+    msg_queue.emplace_back(in_msg, in_flags);
+
+    msg_cl.unlock(1);
+}
+
+void MessageBus::Flush() {
+    local_locker dlock(&delivery_mutex);
+    auto prev_thread = delivery_thread.exchange(std::this_thread::get_id());
+    deliver_queue();
+    delivery_thread = prev_thread;
+}
+
+size_t MessageBus::FetchQueueDepth() {
     local_locker lock(&msg_mutex);
+    return msg_queue.size();
+}
+
+void MessageBus::msg_queue_dispatcher() {
+    local_demand_locker l(&msg_mutex);
+
+    while (1) {
+        l.lock();
+
+        if (msg_queue.size() > 0) {
+            l.unlock();
 
+            Flush();
+
+            continue;
+        }
+
+        if (shutdown)
+            return;
+
+        // Wait for more messages
+        msg_cl.lock();
+        l.unlock();
+        msg_cl.block_until();
+    }
+}
+
+void MessageBus::deliver_queue() {
+    std::deque<queued_msg> batch;
+    uint64_t batch_dropped;
+
+    {
+        local_locker lock(&msg_mutex);
+        batch.swap(msg_queue);
+        batch_dropped = dropped_unreported;
+        dropped_unreported = 0;
+    }
+
+    // Wake anything waiting for queue space
+    space_cl.unlock(0);
+
+    for (auto& m : batch)
+        deliver_message(m.msg, m.flags);
+
+    if (batch_dropped != 0) 
+        deliver_message(fmt::format("The message queue overflowed and {} message{} "
+                    "{} dropped; a message client may be too slow, or the messagebus_queue_limit "
+                    "may be too small.", batch_dropped, batch_dropped == 1 ? "" : "s",
+                    batch_dropped == 1 ? "was" : "were"), MSGFLAG_ERROR);
+}
+
+void MessageBus::deliver_message(const std::string& in_msg, int in_flags) {
     for (unsigned int x = 0; x < subscribers.size(); x++) {
         if (subscribers[x]->mask & in_flags)
             subscribers[x]->client->ProcessMessage(in_msg, in_flags);
     }
-
-    return;
 }
 
 void MessageBus::RegisterClient(MessageClient *in_subscriber, int in_mask) {
-    local_locker lock(&msg_mutex);
+    local_locker lock(&delivery_mutex);
 
     busclient *bc = new busclient;
 
@@ -68,10 +218,12 @@ void MessageBus::RegisterClient(MessageClient *in_subscriber, int in_mask) {
 }
 
 void MessageBus::RemoveClient(MessageClient *in_unsubscriber) {
-    local_locker lock(&msg_mutex);
+    // Holding the delivery lock guarantees the client is not being called
+    local_locker lock(&delivery_mutex);
 
     for (unsigned int x = 0; x < subscribers.size(); x++) {
         if (subscribers[x]->client == in_unsubscriber) {
+            delete subscribers[x];
             subscribers.erase(subscribers.begin() + x);
             return;
         }
@@ -79,4 +231,3 @@ void MessageBus::RemoveClient(MessageClient *in_unsubscriber) {
 
     return;
 }
-
@@ -24,9 +24,12 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <thread>
 
 #include "globalregistry.h"
 #include "kis_mutex.h"
+#include "util.h"
 
 // Message flags for queuing data
 #define MSGFLAG_NONE    0
@@ -76,6 +79,11 @@ public:
     void ProcessMessage(std::string in_msg, int in_flags);
 };
 
+// Messages are queued and delivered to clients by a dedicated thread, so a client
+// which does slow work (such as writing to a log database) never stalls the thread
+// which generated the message.  The queue is bounded; when it fills, the overflow
+// policy decides if the oldest or newest messages are dropped, or if the caller
+// waits for room.  Fatal messages are always delivered before InjectMessage returns.
 class MessageBus : public LifetimeGlobal {
 public:
     static std::string global_name() { return "MESSAGEBUS"; }
@@ -88,23 +96,39 @@ public:
         return mon;
     }
 
+    enum class overflow_policy {
+        drop_oldest, drop_newest, block
+    };
+
 private:
     MessageBus(GlobalRegistry *in_globalreg);
 
 public:
     virtual ~MessageBus();
 
+    // Load the queue options; the messagebus is created before the config file is
+    // parsed, so this is called once the config is available
+    void LoadConfig();
+
     // Inject a message into the bus
     void InjectMessage(std::string in_msg, int in_flags);
 
+    // Deliver everything currently queued before returning
+    void Flush();
+
     // Link a meessage display system
     void RegisterClient(MessageClient *in_subcriber, int in_mask);
     void RemoveClient(MessageClient *in_unsubscriber);
 
+    size_t FetchQueueDepth();
+    uint64_t FetchDropped() { return dropped; }
+
 protected:
     GlobalRegistry *globalreg;
 
-    kis_recursive_timed_mutex msg_mutex;
+    // Queue lock and client delivery lock; when both are needed the delivery lock
+    // is always acquired first
+    kis_recursive_timed_mutex msg_mutex, delivery_mutex;
 
     typedef struct {
         MessageClient *client;
@@ -112,6 +136,36 @@ protected:
     } busclient;
 
     std::vector<MessageBus::busclient *> subscribers;
+
+    struct queued_msg {
+        queued_msg(const std::string& msg, int flags) :
+            msg{msg},
+            flags{flags} { }
+
+        std::string msg;
+        int flags;
+    };
+
+    std::deque<queued_msg> msg_queue;
+    size_t max_queue;
+    overflow_policy policy;
+
+    // Dropped messages, total and since the last time we reported them
+    std::atomic<uint64_t> dropped;
+    uint64_t dropped_unreported;
+
+    std::thread msg_dispatch_t;
+
+    // Thread currently delivering messages to clients
+    std::atomic<std::thread::id> delivery_thread;
+    conditional_locker<int> msg_cl, space_cl;
+    std::atomic<bool> shutdown;
+
+    void msg_queue_dispatcher();
+
+    // Deliver all queued messages; delivery_mutex must be held
+    void deliver_queue();
+    void deliver_message(const std::string& in_msg, int in_flags);
 };
 
 
@@ -50,10 +50,11 @@ RestMessageClient::RestMessageClient(GlobalRegistry *in_globalreg, void *in_aux)
 }
 
 RestMessageClient::~RestMessageClient() {
-    local_eol_locker lock(&msg_mutex);
-
+    // Remove ourselves before locking; the messagebus may be delivering to us
     globalreg->messagebus->RemoveClient(this);
 
+    local_eol_locker lock(&msg_mutex);
+
     globalreg->RemoveGlobal("REST_MSG_CLIENT");
 
     message_list.clear();
@@ -0,0 +1,582 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+#include "globalregistry.h"
+#include "trackedelement.h"
+#include "entrytracker.h"
+#include "macaddr.h"
+#include "uuid.h"
+#include "msgpack_adapter.h"
+
+namespace {
+
+void put_be(std::ostream& stream, uint64_t v, unsigned int len) {
+    char buf[8];
+
+    for (unsigned int x = 0; x < len; x++)
+        buf[x] = (char) ((v >> ((len - x - 1) * 8)) & 0xFF);
+
+    stream.write(buf, len);
+}
+
+uint64_t float_bits(float f) {
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+uint64_t double_bits(double d) {
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    return v;
+}
+
+class msgpack_encoder {
+public:
+    msgpack_encoder(std::ostream& in_stream) :
+        stream(in_stream) { }
+
+    static std::string format_name(const std::string& name) {
+        std::stringstream ss;
+        msgpack_encoder(ss).put_string(name);
+        return ss.str();
+    }
+
+    static int name_format() {
+        static int id = 
+            Globalreg::globalreg->entrytracker->RegisterFieldNameFormat("msgpack", format_name);
+        return id;
+    }
+
+    void put_raw(const std::string& s) {
+        stream.write(s.data(), s.length());
+    }
+
+    void put_nil() {
+        stream.put((char) 0xc0);
+    }
+
+    void put_uint(uint64_t v) {
+        if (v < 0x80) {
+            stream.put((char) v);
+        } else if (v <= 0xFF) {
+            stream.put((char) 0xcc);
+            put_be(stream, v, 1);
+        } else if (v <= 0xFFFF) {
+            stream.put((char) 0xcd);
+            put_be(stream, v, 2);
+        } else if (v <= 0xFFFFFFFF) {
+            stream.put((char) 0xce);
+            put_be(stream, v, 4);
+        } else {
+            stream.put((char) 0xcf);
+            put_be(stream, v, 8);
+        }
+    }
+
+    void put_int(int64_t v) {
+        if (v >= 0) {
+            put_uint(v);
+        } else if (v >= -32) {
+            stream.put((char) v);
+        } else if (v >= INT8_MIN) {
+            stream.put((char) 0xd0);
+            put_be(stream, (uint64_t) v, 1);
+        } else if (v >= INT16_MIN) {
+            stream.put((char) 0xd1);
+            put_be(stream, (uint64_t) v, 2);
+        } else if (v >= INT32_MIN) {
+            stream.put((char) 0xd2);
+            put_be(stream, (uint64_t) v, 4);
+        } else {
+            stream.put((char) 0xd3);
+            put_be(stream, (uint64_t) v, 8);
+        }
+    }
+
+    void put_float(float f) {
+        stream.put((char) 0xca);
+        put_be(stream, float_bits(f), 4);
+    }
+
+    void put_double(double d) {
+        stream.put((char) 0xcb);
+        put_be(stream, double_bits(d), 8);
+    }
+
+    void put_string(const std::string& s) {
+        auto len = s.length();
+
+        if (len < 32) {
+            stream.put((char) (0xa0 | len));
+        } else if (len <= 0xFF) {
+            stream.put((char) 0xd9);
+            put_be(stream, len, 1);
+        } else if (len <= 0xFFFF) {
+            stream.put((char) 0xda);
+            put_be(stream, len, 2);
+        } else {
+            stream.put((char) 0xdb);
+            put_be(stream, len, 4);
+        }
+
+        stream.write(s.data(), len);
+    }
+
+    void put_bytes(const std::string& s) {
+        auto len = s.length();
+
+        if (len <= 0xFF) {
+            stream.put((char) 0xc4);
+            put_be(stream, len, 1);
+        } else if (len <= 0xFFFF) {
+            stream.put((char) 0xc5);
+            put_be(stream, len, 2);
+        } else {
+            stream.put((char) 0xc6);
+            put_be(stream, len, 4);
+        }
+
+        stream.write(s.data(), len);
+    }
+
+    void put_array(size_t n) {
+        if (n < 16) {
+            stream.put((char) (0x90 | n));
+        } else if (n <= 0xFFFF) {
+            stream.put((char) 0xdc);
+            put_be(stream, n, 2);
+        } else {
+            stream.put((char) 0xdd);
+            put_be(stream, n, 4);
+        }
+    }
+
+    void put_map(size_t n) {
+        if (n < 16) {
+            stream.put((char) (0x80 | n));
+        } else if (n <= 0xFFFF) {
+            stream.put((char) 0xde);
+            put_be(stream, n, 2);
+        } else {
+            stream.put((char) 0xdf);
+            put_be(stream, n, 4);
+        }
+    }
+
+protected:
+    std::ostream& stream;
+};
+
+class cbor_encoder {
+public:
+    cbor_encoder(std::ostream& in_stream) :
+        stream(in_stream) { }
+
+    static std::string format_name(const std::string& name) {
+        std::stringstream ss;
+        cbor_encoder(ss).put_string(name);
+        return ss.str();
+    }
+
+    static int name_format() {
+        static int id = 
+            Globalreg::globalreg->entrytracker->RegisterFieldNameFormat("cbor", format_name);
+        return id;
+    }
+
+    void put_raw(const std::string& s) {
+        stream.write(s.data(), s.length());
+    }
+
+    void put_nil() {
+        stream.put((char) 0xf6);
+    }
+
+    void put_uint(uint64_t v) {
+        put_head(0, v);
+    }
+
+    void put_int(int64_t v) {
+        if (v >= 0)
+            put_head(0, v);
+        else
+            put_head(1, (uint64_t) (-1 - v));
+    }
+
+    void put_float(float f) {
+        stream.put((char) 0xfa);
+        put_be(stream, float_bits(f), 4);
+    }
+
+    void put_double(double d) {
+        stream.put((char) 0xfb);
+        put_be(stream, double_bits(d), 8);
+    }
+
+    void put_string(const std::string& s) {
+        put_head(3, s.length());
+        stream.write(s.data(), s.length());
+    }
+
+    void put_bytes(const std::string& s) {
+        put_head(2, s.length());
+        stream.write(s.data(), s.length());
+    }
+
+    void put_array(size_t n) {
+        put_head(4, n);
+    }
+
+    void put_map(size_t n) {
+        put_head(5, n);
+    }
+
+protected:
+    std::ostream& stream;
+
+    void put_head(uint8_t major, uint64_t v) {
+        major <<= 5;
+
+        if (v < 24) {
+            stream.put((char) (major | v));
+        } else if (v <= 0xFF) {
+            stream.put((char) (major | 24));
+            put_be(stream, v, 1);
+        } else if (v <= 0xFFFF) {
+            stream.put((char) (major | 25));
+            put_be(stream, v, 2);
+        } else if (v <= 0xFFFFFFFF) {
+            stream.put((char) (major | 26));
+            put_be(stream, v, 4);
+        } else {
+            stream.put((char) (major | 27));
+            put_be(stream, v, 8);
+        }
+    }
+};
+
+template<typename C>
+size_t count_present(C& c) {
+    size_t n = 0;
+    for (auto i : c)
+        if (i != nullptr)
+            n++;
+    return n;
+}
+
+template<typename C>
+size_t count_present_second(C& c) {
+    size_t n = 0;
+    for (auto i : c)
+        if (i.second != nullptr)
+            n++;
+    return n;
+}
+
+using name_cache_t = std::shared_ptr<const EntryTracker::field_name_cache>;
+
+TrackerElementProjection *find_projection(const SharedTrackerElement& e,
+        const std::shared_ptr<TrackerElementSerializer::rename_map>& name_map) {
+    if (name_map == nullptr)
+        return nullptr;
+
+    auto nmi = name_map->find(e);
+    if (nmi == name_map->end())
+        return nullptr;
+
+    return nmi->second->projection.get();
+}
+
+template<typename E>
+void pack_element(E& enc, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
+        const name_cache_t& names);
+
+// Write an element of a projected vector as the map its summarization would produce
+template<typename E>
+void pack_projected(E& enc, const SharedTrackerElement& e, 
+        const TrackerElementProjection& projection,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
+        const name_cache_t& names) {
+
+    SerializerScope s(e, nullptr);
+
+    enc.put_map(projection.get_slots().size());
+
+    for (const auto& slot : projection.get_slots()) {
+        auto f = projection.resolve(slot, e);
+        auto id = f->get_id();
+
+        if (slot.summarized && slot.summary->rename.length() != 0)
+            enc.put_string(slot.summary->rename);
+        else if (f->has_local_name())
+            enc.put_string(f->get_local_name());
+        else if (names != nullptr && id >= 0 && (size_t) id < names->names.size() &&
+                names->names[id].length() != 0)
+            enc.put_raw(names->names[id]);
+        else
+            enc.put_string(Globalreg::globalreg->entrytracker->GetFieldName(id));
+
+        projection.enter(slot, e, f);
+        pack_element(enc, f, name_map, names);
+        projection.leave(slot, e, f);
+    }
+}
+
+// Walk the element the same way JsonAdapter::Pack does, emitting through the encoder;
+// field names come pre-encoded from the entrytracker name cache for the format
+template<typename E>
+void pack_element(E& enc, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map,
+        const name_cache_t& names) {
+
+    if (e == nullptr) {
+        enc.put_nil();
+        return;
+    }
+
+    SerializerScope s(e, name_map);
+
+    switch (e->get_type()) {
+        case TrackerType::TrackerString:
+            enc.put_string(GetTrackerValue<std::string>(e));
+            break;
+        case TrackerType::TrackerInt8:
+            enc.put_int(GetTrackerValue<int8_t>(e));
+            break;
+        case TrackerType::TrackerUInt8:
+            enc.put_uint(GetTrackerValue<uint8_t>(e));
+            break;
+        case TrackerType::TrackerInt16:
+            enc.put_int(GetTrackerValue<int16_t>(e));
+            break;
+        case TrackerType::TrackerUInt16:
+            enc.put_uint(GetTrackerValue<uint16_t>(e));
+            break;
+        case TrackerType::TrackerInt32:
+            enc.put_int(GetTrackerValue<int32_t>(e));
+            break;
+        case TrackerType::TrackerUInt32:
+            enc.put_uint(GetTrackerValue<uint32_t>(e));
+            break;
+        case TrackerType::TrackerInt64:
+            enc.put_int(GetTrackerValue<int64_t>(e));
+            break;
+        case TrackerType::TrackerUInt64:
+            enc.put_uint(GetTrackerValue<uint64_t>(e));
+            break;
+        case TrackerType::TrackerFloat:
+            // Match the JSON output, which can't represent nan or inf
+            if (std::isnan(GetTrackerValue<float>(e)) || std::isinf(GetTrackerValue<float>(e)))
+                enc.put_uint(0);
+            else
+                enc.put_float(GetTrackerValue<float>(e));
+            break;
+        case TrackerType::TrackerDouble:
+            if (std::isnan(GetTrackerValue<double>(e)) || std::isinf(GetTrackerValue<double>(e)))
+                enc.put_uint(0);
+            else
+                enc.put_double(GetTrackerValue<double>(e));
+            break;
+        case TrackerType::TrackerMac:
+            enc.put_string(GetTrackerValue<mac_addr>(e).Mac2String());
+            break;
+        case TrackerType::TrackerUuid:
+            enc.put_string(GetTrackerValue<uuid>(e).UUID2String());
+            break;
+        case TrackerType::TrackerKey:
+            enc.put_string(GetTrackerValue<device_key>(e).as_string());
+            break;
+        case TrackerType::TrackerByteArray:
+            enc.put_bytes(std::static_pointer_cast<TrackerElementByteArray>(e)->get());
+            break;
+        case TrackerType::TrackerVector: {
+            auto v = std::static_pointer_cast<TrackerElementVector>(e);
+            enc.put_array(count_present(*v));
+
+            auto projection = find_projection(e, name_map);
+
+            for (auto i : *v) {
+                if (i == nullptr)
+                    continue;
+
+                if (projection != nullptr)
+                    pack_projected(enc, i, *projection, name_map, names);
+                else
+                    pack_element(enc, i, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerVectorDouble: {
+            auto v = std::static_pointer_cast<TrackerElementVectorDouble>(e);
+            enc.put_array(v->size());
+            for (auto i : *v)
+                enc.put_double(i);
+            break;
+        }
+        case TrackerType::TrackerVectorString: {
+            auto v = std::static_pointer_cast<TrackerElementVectorString>(e);
+            enc.put_array(v->size());
+            for (auto i : *v)
+                enc.put_string(i);
+            break;
+        }
+        case TrackerType::TrackerMap: {
+            auto m = std::static_pointer_cast<TrackerElementMap>(e);
+            enc.put_map(count_present_second(*m));
+
+            std::string tname;
+
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+
+                bool named = false;
+
+                if (name_map != nullptr) {
+                    auto nmi = name_map->find(i.second);
+                    if (nmi != name_map->end() && nmi->second->rename.length() != 0) {
+                        tname = nmi->second->rename;
+                        named = true;
+                    }
+                }
+
+                if (!named && !i.second->has_local_name() && names != nullptr &&
+                        i.first >= 0 && (size_t) i.first < names->names.size() &&
+                        names->names[i.first].length() != 0) {
+                    enc.put_raw(names->names[i.first]);
+                    pack_element(enc, i.second, name_map, names);
+                    continue;
+                }
+
+                if (!named) {
+                    if ((tname = i.second->get_local_name()) == "")
+                        tname = Globalreg::globalreg->entrytracker->GetFieldName(i.first);
+                }
+
+                enc.put_string(tname);
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        // Keyed maps use the same string keys as the JSON output
+        case TrackerType::TrackerIntMap: {
+            auto m = std::static_pointer_cast<TrackerElementIntMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(fmt::format("{}", i.first));
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerMacMap: {
+            auto m = std::static_pointer_cast<TrackerElementMacMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(i.first.Mac2String());
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerStringMap: {
+            auto m = std::static_pointer_cast<TrackerElementStringMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(i.first);
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerDoubleMap: {
+            auto m = std::static_pointer_cast<TrackerElementDoubleMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(fmt::format("{:f}", i.first));
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerHashkeyMap: {
+            auto m = std::static_pointer_cast<TrackerElementHashkeyMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(fmt::format("{}", i.first));
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerKeyMap: {
+            auto m = std::static_pointer_cast<TrackerElementDeviceKeyMap>(e);
+            enc.put_map(count_present_second(*m));
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+                enc.put_string(i.first.as_string());
+                pack_element(enc, i.second, name_map, names);
+            }
+            break;
+        }
+        case TrackerType::TrackerDoubleMapDouble: {
+            auto m = std::static_pointer_cast<TrackerElementDoubleMapDouble>(e);
+            enc.put_map(m->size());
+            for (auto i : *m) {
+                enc.put_string(fmt::format("{:f}", i.first));
+                enc.put_double(i.second);
+            }
+            break;
+        }
+        default:
+            enc.put_nil();
+            break;
+    }
+}
+
+}
+
+void MsgpackAdapter::Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map) {
+    msgpack_encoder enc(stream);
+    pack_element(enc, e, name_map, 
+            Globalreg::globalreg->entrytracker->GetFieldNameCache(msgpack_encoder::name_format()));
+}
+
+void CborAdapter::Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map) {
+    cbor_encoder enc(stream);
+    pack_element(enc, e, name_map, 
+            Globalreg::globalreg->entrytracker->GetFieldNameCache(cbor_encoder::name_format()));
+}
+
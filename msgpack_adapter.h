@@ -0,0 +1,81 @@
+/*
+    This file is part of Kismet
+
+    Kismet is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    Kismet is distributed in the hope that it will be useful,
+      but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Kismet; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef __MSGPACK_ADAPTER_H__
+#define __MSGPACK_ADAPTER_H__
+
+#include "config.h"
+
+#include <iostream>
+
+#include "globalregistry.h"
+#include "trackedelement.h"
+#include "entrytracker.h"
+
+// MessagePack and CBOR serialization adapters.  These produce the same document
+// structure as the standard JSON adapter - maps are keyed by field name (or by the
+// rename from a summarization), keyed maps use the same string keys as JSON, and
+// macs, uuids, and keys are strings - so a client can switch formats without
+// changing how it walks the results.  Numbers are sent natively instead of as text,
+// and byte arrays are sent as binary instead of hex.
+namespace MsgpackAdapter {
+
+void Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map = nullptr);
+
+class Serializer : public TrackerElementSerializer {
+public:
+    Serializer() :
+        TrackerElementSerializer() { }
+
+    virtual void serialize(SharedTrackerElement in_elem, std::ostream &stream,
+            std::shared_ptr<rename_map> name_map = nullptr) override {
+        Pack(stream, in_elem, name_map);
+    }
+
+    virtual bool projects() const override {
+        return true;
+    }
+};
+
+}
+
+namespace CborAdapter {
+
+void Pack(std::ostream &stream, SharedTrackerElement e,
+        std::shared_ptr<TrackerElementSerializer::rename_map> name_map = nullptr);
+
+class Serializer : public TrackerElementSerializer {
+public:
+    Serializer() :
+        TrackerElementSerializer() { }
+
+    virtual void serialize(SharedTrackerElement in_elem, std::ostream &stream,
+            std::shared_ptr<rename_map> name_map = nullptr) override {
+        Pack(stream, in_elem, name_map);
+    }
+
+    virtual bool projects() const override {
+        return true;
+    }
+};
+
+}
+
+#endif
+
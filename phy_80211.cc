@@ -220,6 +220,7 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("dot11.device",
                 TrackerElementFactory<dot11_tracked_device>(),
                 "IEEE802.11 device");
+    device_record_ids.push_back(dot11_device_entry_id);
 
 	// Packet classifier - makes basic records plus dot11 data
 	packetchain->RegisterHandler(&CommonClassifierDot11, this,
@@ -583,6 +584,9 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
     }
     recent_packet_checksum_pos = 0;
 
+    budget_keep_entries =
+        Globalreg::globalreg->kismet_config->FetchOptUInt("dot11_memory_budget_keep", 4);
+
     // Parse the ssid regex options
     auto apspoof_lines = Globalreg::globalreg->kismet_config->FetchOptVec("apspoof");
 
@@ -729,16 +733,8 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
 
     clients_of_endp =
         std::make_shared<Kis_Net_Httpd_Path_Tracked_Endpoint>(
+                "/phy/phy80211/clients-of/:key/clients",
                 [this](const std::vector<std::string>& path) -> bool {
-                // /phy/phy80211/clients-of/[key]/clients
-                
-                if (path.size() < 5)
-                    return false;
-
-                if (path[0] != "phy" || path[1] != "phy80211" || path[2] != "clients-of" || 
-                        path[4] != "clients")
-                    return false;
-
                 try {
                     auto key = StringTo<device_key>(path[3]);
                     auto dev = devicetracker->FetchDevice(key);
@@ -791,16 +787,8 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
 
     related_to_key_endp =
         std::make_shared<Kis_Net_Httpd_Path_Tracked_Endpoint>(
+                "/phy/phy80211/related-to/:key/devices",
                 [this](const std::vector<std::string>& path) -> bool {
-                // /phy/phy80211/related-to/[key]/devices
-
-                if (path.size() < 5)
-                return false;
-
-                if (path[0] != "phy" || path[1] != "phy80211" || path[2] != "related-to" || 
-                        path[4] != "devices")
-                return false;
-
                 try {
                 auto key = StringTo<device_key>(path[3]);
                 auto dev = devicetracker->FetchDevice(key);
@@ -877,7 +865,7 @@ Kis_80211_Phy::Kis_80211_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
                 return cl;
                 });
 
-    Bind_Httpd_Server();
+    Bind_Httpd_Route("/phy/phy80211/by-key/:key/pcap/:file");
 }
 
 Kis_80211_Phy::~Kis_80211_Phy() {
@@ -1101,6 +1089,9 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (bssid_dev != NULL) {
             local_locker bssidlocker(&(bssid_dev->device_mutex));
 
+            // The dot11 record is updated below; mark it changed for delta clients
+            bssid_dev->mark_phy_dirty();
+
             bssid_dot11 =
                 bssid_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1158,6 +1149,8 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (source_dev != NULL) {
             local_locker sourcelocker(&(source_dev->device_mutex));
 
+            source_dev->mark_phy_dirty();
+
             source_dot11 =
                 source_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1215,6 +1208,8 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (dest_dev != NULL) {
             local_locker destlocker(&(dest_dev->device_mutex));
 
+            dest_dev->mark_phy_dirty();
+
             dest_dot11 =
                 dest_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1359,6 +1354,9 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (bssid_dev != NULL) {
             local_locker bssidlocker(&(bssid_dev->device_mutex));
 
+            // The dot11 record is updated below; mark it changed for delta clients
+            bssid_dev->mark_phy_dirty();
+
             bssid_dot11 =
                 bssid_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
 
@@ -1472,6 +1470,8 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (source_dev != NULL) {
             local_locker sourcelocker(&(source_dev->device_mutex));
 
+            source_dev->mark_phy_dirty();
+
             source_dot11 =
                 source_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1549,7 +1549,7 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
                 if (globalreg->timestamp.tv_sec - source_dot11->get_wps_m3_last() > (60 * 5))
                     source_dot11->set_wps_m3_count(1);
                 else
-                    source_dot11->inc_wps_m3_count(1);
+                    source_dot11->set_wps_m3_count(source_dot11->get_wps_m3_count() + 1);
 
                 source_dot11->set_wps_m3_last(globalreg->timestamp.tv_sec);
 
@@ -1574,6 +1574,8 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (dest_dev != NULL) {
             local_locker destlocker(&(dest_dev->device_mutex));
 
+            dest_dev->mark_phy_dirty();
+
             dest_dot11 =
                 dest_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1632,6 +1634,8 @@ int Kis_80211_Phy::CommonClassifierDot11(CHAINCALL_PARMS) {
         if (other_dev != NULL) {
             local_locker otherlocker(&(other_dev->device_mutex));
 
+            other_dev->mark_phy_dirty();
+
             other_dot11 =
                 other_dev->get_sub_as<dot11_tracked_device>(d11phy->dot11_device_entry_id);
             std::stringstream newdevstr;
@@ -1801,6 +1805,7 @@ void Kis_80211_Phy::HandleSSID(std::shared_ptr<kis_tracked_device_base> basedev,
         
         ssid = dot11dev->new_advertised_ssid();
         adv_ssid_map->insert(dot11info->ssid_csum, ssid);
+        basedev->mark_index_dirty();
 
         ssid->set_crypt_set(dot11info->cryptset);
         ssid->set_first_time(in_pack->ts.tv_sec);
@@ -1955,11 +1960,12 @@ void Kis_80211_Phy::HandleSSID(std::shared_ptr<kis_tracked_device_base> basedev,
             ssid->set_dot11r_mobility_domain_id(dot11info->dot11r_mobility->mobility_domain());
         }
 
-        // Set tx power
-        ssid->set_ccx_txpower(dot11info->ccx_txpower);
+        // Set tx power and client mfp; these are only created once an AP advertises them
+        if (dot11info->ccx_txpower != 0 || ssid->has_ccx_txpower())
+            ssid->set_ccx_txpower(dot11info->ccx_txpower);
 
-        // Set client mfp
-        ssid->set_cisco_client_mfp(dot11info->cisco_client_mfp);
+        if (dot11info->cisco_client_mfp || ssid->has_cisco_client_mfp())
+            ssid->set_cisco_client_mfp(dot11info->cisco_client_mfp);
 
         // Set QBSS
         if (dot11info->qbss != NULL) {
@@ -2843,7 +2849,7 @@ bool Kis_80211_Phy::Httpd_VerifyPath(const char *path, const char *method) {
             return false;
 
         // Does it exist?
-        if (devicetracker->FetchDevice(key) != nullptr)
+        if (devicetracker->device_key_known(key))
             return true;
     }
 
@@ -2880,7 +2886,7 @@ void Kis_80211_Phy::GenerateHandshakePcap(std::shared_ptr<kis_tracked_device_bas
         auto dot11dev =
             dev->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
 
-        if (dot11dev != nullptr) {
+        if (dot11dev != nullptr && dot11dev->has_wpa_key_vec()) {
             for (auto i : *(dot11dev->get_wpa_key_vec())) {
                 auto eapol =
                     std::static_pointer_cast<dot11_tracked_eapol>(i);
@@ -3019,6 +3025,8 @@ public:
 
                 adv_ssid_map->erase(int_itr);
                 int_itr = adv_ssid_map->begin();
+                device->mark_index_dirty();
+                device->mark_phy_dirty();
                 devicetracker->UpdateFullRefresh();
             }
         }
@@ -3036,6 +3044,7 @@ public:
             if (time(0) - pssid->get_last_time() > timeout && device->get_packets() < packets) {
                 probe_map->erase(int_itr);
                 int_itr = probe_map->begin();
+                device->mark_phy_dirty();
                 devicetracker->UpdateFullRefresh();
             }
         }
@@ -3054,6 +3063,7 @@ public:
             if (time(0) - client->get_last_time() > timeout && device->get_packets() < packets) {
                 client_map->erase(mac_itr);
                 mac_itr = client_map->begin();
+                device->mark_phy_dirty();
                 devicetracker->UpdateFullRefresh();
             }
         }
@@ -3102,7 +3112,150 @@ void Kis_80211_Phy::LoadPhyStorage(SharedTrackerElement in_storage, SharedTracke
         auto d11dev =
             std::make_shared<dot11_tracked_device>(dot11_device_entry_id,
                     std::static_pointer_cast<TrackerElementMap>(d11devi->second));
-        in_map->insert(d11dev);
+        std::static_pointer_cast<TrackerElementMap>(in_device)->insert(d11dev);
+    }
+}
+
+// Keep only the in_keep most recently seen records in a map of dot11 records
+template<typename M, typename R>
+static void dot11_trim_map_recent(std::shared_ptr<M> in_map, size_t in_keep) {
+    if (in_map->size() <= in_keep)
+        return;
+
+    std::vector<std::pair<time_t, typename M::pair::first_type>> ages;
+
+    for (auto i : *in_map)
+        ages.push_back(std::make_pair(std::static_pointer_cast<R>(i.second)->get_last_time(),
+                    i.first));
+
+    std::nth_element(ages.begin(), ages.begin() + in_keep, ages.end(),
+            [](const std::pair<time_t, typename M::pair::first_type>& a,
+                const std::pair<time_t, typename M::pair::first_type>& b) -> bool {
+                return a.first > b.first;
+            });
+
+    for (auto i = ages.begin() + in_keep; i != ages.end(); ++i)
+        in_map->erase(i->second);
+}
+
+void Kis_80211_Phy::ShrinkDevice(std::shared_ptr<kis_tracked_device_base> in_device) {
+    auto dot11dev =
+        in_device->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
+
+    if (dot11dev == nullptr)
+        return;
+
+    dot11_trim_map_recent<TrackerElementIntMap, dot11_probed_ssid>(dot11dev->get_probed_ssid_map(),
+            budget_keep_entries);
+    dot11_trim_map_recent<TrackerElementIntMap, dot11_advertised_ssid>(dot11dev->get_advertised_ssid_map(),
+            budget_keep_entries);
+    in_device->mark_index_dirty();
+    in_device->mark_phy_dirty();
+    dot11_trim_map_recent<TrackerElementMacMap, dot11_client>(dot11dev->get_client_map(),
+            budget_keep_entries);
+}
+
+// Add the records of in_src missing from in_dest; records in both keep the history of
+// in_dest and the last time seen of whichever is newer
+template<typename M, typename R>
+static void dot11_merge_map_recent(std::shared_ptr<M> in_dest, std::shared_ptr<M> in_src) {
+    for (auto i : *in_src) {
+        auto d = in_dest->find(i.first);
+
+        if (d == in_dest->end()) {
+            in_dest->insert(i.first, i.second);
+            continue;
+        }
+
+        auto dr = std::static_pointer_cast<R>(d->second);
+        auto sr = std::static_pointer_cast<R>(i.second);
+
+        if (sr->get_last_time() > dr->get_last_time())
+            dr->set_last_time(sr->get_last_time());
+    }
+}
+
+// Append the records of in_src, dropping the oldest past in_max
+static void dot11_merge_vec(std::shared_ptr<TrackerElementVector> in_dest,
+        std::shared_ptr<TrackerElementVector> in_src, size_t in_max) {
+    for (auto i : *in_src)
+        in_dest->push_back(i);
+
+    while (in_dest->size() > in_max)
+        in_dest->erase(in_dest->begin());
+}
+
+void Kis_80211_Phy::MergeRestoredDevice(std::shared_ptr<kis_tracked_device_base> in_device,
+        std::shared_ptr<kis_tracked_device_base> in_pending) {
+    auto dot11dev =
+        in_device->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
+    auto pending_dot11 =
+        in_pending->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
+
+    if (dot11dev == nullptr || pending_dot11 == nullptr || dot11dev == pending_dot11)
+        return;
+
+    dot11dev->bitset_type_set(pending_dot11->get_type_set());
+
+    dot11_merge_map_recent<TrackerElementIntMap, dot11_advertised_ssid>(dot11dev->get_advertised_ssid_map(),
+            pending_dot11->get_advertised_ssid_map());
+    dot11_merge_map_recent<TrackerElementIntMap, dot11_probed_ssid>(dot11dev->get_probed_ssid_map(),
+            pending_dot11->get_probed_ssid_map());
+    dot11_merge_map_recent<TrackerElementMacMap, dot11_client>(dot11dev->get_client_map(),
+            pending_dot11->get_client_map());
+
+    for (auto c : *(pending_dot11->get_associated_client_map())) {
+        if (dot11dev->get_associated_client_map()->find(c.first) == 
+                dot11dev->get_associated_client_map()->end())
+            dot11dev->get_associated_client_map()->insert(c.first, c.second);
+    }
+
+    dot11dev->inc_client_disconnects(pending_dot11->get_client_disconnects());
+    dot11dev->inc_num_fragments(pending_dot11->get_num_fragments());
+    dot11dev->inc_num_retries(pending_dot11->get_num_retries());
+    dot11dev->inc_datasize(pending_dot11->get_datasize());
+    dot11dev->inc_datasize_retry(pending_dot11->get_datasize_retry());
+
+    if (pending_dot11->has_last_bssid())
+        dot11dev->set_last_bssid(pending_dot11->get_last_bssid());
+
+    if (pending_dot11->has_last_beaconed_ssid()) {
+        dot11dev->set_last_beaconed_ssid(pending_dot11->get_last_beaconed_ssid());
+        dot11dev->set_last_beaconed_ssid_csum(pending_dot11->get_last_beaconed_ssid_csum());
+    }
+
+    if (pending_dot11->has_last_probed_ssid()) {
+        dot11dev->set_last_probed_ssid(pending_dot11->get_last_probed_ssid());
+        dot11dev->set_last_probed_ssid_csum(pending_dot11->get_last_probed_ssid_csum());
+    }
+
+    if (pending_dot11->get_last_beacon_timestamp() > dot11dev->get_last_beacon_timestamp())
+        dot11dev->set_last_beacon_timestamp(pending_dot11->get_last_beacon_timestamp());
+
+    if (pending_dot11->has_wpa_key_vec())
+        dot11_merge_vec(dot11dev->get_wpa_key_vec(), pending_dot11->get_wpa_key_vec(), 16);
+
+    if (pending_dot11->has_wpa_nonce_vec())
+        dot11_merge_vec(dot11dev->get_wpa_nonce_vec(), pending_dot11->get_wpa_nonce_vec(), 128);
+
+    if (pending_dot11->has_wpa_anonce_vec())
+        dot11_merge_vec(dot11dev->get_wpa_anonce_vec(), pending_dot11->get_wpa_anonce_vec(), 128);
+
+    in_device->mark_index_dirty();
+    in_device->mark_phy_dirty();
+}
+
+void Kis_80211_Phy::DeviceIndexKeys(std::shared_ptr<kis_tracked_device_base> in_device,
+        std::vector<std::pair<std::string, std::string>>& in_keys) {
+    auto dot11dev =
+        in_device->get_sub_as<dot11_tracked_device>(dot11_device_entry_id);
+
+    if (dot11dev == nullptr)
+        return;
+
+    for (auto s : *(dot11dev->get_advertised_ssid_map())) {
+        auto ssid = std::static_pointer_cast<dot11_advertised_ssid>(s.second);
+        in_keys.emplace_back("ssid", ssid->get_ssid());
     }
 }
 
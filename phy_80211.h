@@ -599,9 +599,9 @@ public:
 
     __ProxyDynamicTrackable(location, kis_tracked_location, location, location_id);
 
-    __Proxy(dot11r_mobility, uint8_t, bool, bool, dot11r_mobility);
-    __Proxy(dot11r_mobility_domain_id, uint16_t, uint16_t, uint16_t, 
-            dot11r_mobility_domain_id);
+    __ProxyDynamic(dot11r_mobility, uint8_t, bool, bool, dot11r_mobility, dot11r_mobility_id);
+    __ProxyDynamic(dot11r_mobility_domain_id, uint16_t, uint16_t, uint16_t, 
+            dot11r_mobility_domain_id, dot11r_mobility_domain_id_id);
 
     __Proxy(crypt_set, uint64_t, uint64_t, uint64_t, crypt_set);
     __Proxy(wpa_mfp_required, uint8_t, bool, bool, wpa_mfp_required);
@@ -634,10 +634,12 @@ protected:
         location_id = 
             RegisterDynamicField("dot11.probedssid.location", "location", &location);
 
-        RegisterField("dot11.probedssid.dot11r_mobility", 
-                "advertised dot11r mobility support", &dot11r_mobility);
-        RegisterField("dot11.probedssid.dot11r_mobility_domain_id", 
-                "advertised dot11r mobility domain id", &dot11r_mobility_domain_id);
+        dot11r_mobility_id =
+            RegisterDynamicField("dot11.probedssid.dot11r_mobility", 
+                    "advertised dot11r mobility support", &dot11r_mobility);
+        dot11r_mobility_domain_id_id =
+            RegisterDynamicField("dot11.probedssid.dot11r_mobility_domain_id", 
+                    "advertised dot11r mobility domain id", &dot11r_mobility_domain_id);
 
         RegisterField("dot11.probedssid.crypt_set", "Requested encryption set", &crypt_set);
 
@@ -677,7 +679,9 @@ protected:
     std::shared_ptr<TrackerElementUInt64> last_time;
 
     std::shared_ptr<TrackerElementUInt8> dot11r_mobility;
+    int dot11r_mobility_id;
     std::shared_ptr<TrackerElementUInt16> dot11r_mobility_domain_id;
+    int dot11r_mobility_domain_id_id;
 
     std::shared_ptr<kis_tracked_location> location;
     int location_id;
@@ -819,16 +823,20 @@ public:
 
     __ProxyDynamicTrackable(location, kis_tracked_location, location, location_id);
 
-    __Proxy(dot11r_mobility, uint8_t, bool, bool, dot11r_mobility);
-    __Proxy(dot11r_mobility_domain_id, uint16_t, uint16_t, uint16_t, 
-            dot11r_mobility_domain_id);
+    __ProxyDynamic(dot11r_mobility, uint8_t, bool, bool, dot11r_mobility, dot11r_mobility_id);
+    __ProxyDynamic(dot11r_mobility_domain_id, uint16_t, uint16_t, uint16_t, 
+            dot11r_mobility_domain_id, dot11r_mobility_domain_id_id);
 
-    __Proxy(dot11e_qbss, uint8_t, bool, bool, dot11e_qbss);
-    __Proxy(dot11e_qbss_stations, uint16_t, uint16_t, uint16_t, dot11e_qbss_stations);
-    __Proxy(dot11e_qbss_channel_load, double, double, double, dot11e_qbss_channel_load);
+    __ProxyDynamic(dot11e_qbss, uint8_t, bool, bool, dot11e_qbss, dot11e_qbss_id);
+    __ProxyDynamic(dot11e_qbss_stations, uint16_t, uint16_t, uint16_t, dot11e_qbss_stations,
+            dot11e_qbss_stations_id);
+    __ProxyDynamic(dot11e_qbss_channel_load, double, double, double, dot11e_qbss_channel_load,
+            dot11e_qbss_channel_load_id);
 
-    __Proxy(ccx_txpower, uint8_t, unsigned int, unsigned int, ccx_txpower);
-    __Proxy(cisco_client_mfp, uint8_t, bool, bool, cisco_client_mfp);
+    __ProxyDynamic(ccx_txpower, uint8_t, unsigned int, unsigned int, ccx_txpower, 
+            ccx_txpower_id);
+    __ProxyDynamic(cisco_client_mfp, uint8_t, bool, bool, cisco_client_mfp, 
+            cisco_client_mfp_id);
 
     __ProxyTrackable(ie_tag_list, TrackerElementVectorDouble, ie_tag_list);
 
@@ -911,24 +919,31 @@ protected:
         location_id = 
             RegisterDynamicField("dot11.advertisedssid.location", "location", &location);
 
-        RegisterField("dot11.advertisedssid.dot11r_mobility", 
-                "advertised dot11r mobility support", &dot11r_mobility);
-        RegisterField("dot11.advertisedssid.dot11r_mobility_domain_id", 
-                "advertised dot11r mobility domain id", &dot11r_mobility_domain_id);
-
-        RegisterField("dot11.advertisedssid.dot11e_qbss", 
-                "SSID advertises 802.11e QBSS", &dot11e_qbss);
-        RegisterField("dot11.advertisedssid.dot11e_qbss_stations", 
-                "802.11e QBSS station count", &dot11e_qbss_stations);
-        RegisterField("dot11.advertisedssid.dot11e_channel_utilization_perc", 
-                "802.11e QBSS reported channel utilization, as percentage", 
-                &dot11e_qbss_channel_load);
-
-        RegisterField("dot11.advertisedssid.ccx_txpower",
-                "Cisco CCX advertised TX power (dBm)", &ccx_txpower);
-
-        RegisterField("dot11.advertisedssid.cisco_client_mfp",
-                "Cisco client management frame protection", &cisco_client_mfp);
+        dot11r_mobility_id =
+            RegisterDynamicField("dot11.advertisedssid.dot11r_mobility", 
+                    "advertised dot11r mobility support", &dot11r_mobility);
+        dot11r_mobility_domain_id_id =
+            RegisterDynamicField("dot11.advertisedssid.dot11r_mobility_domain_id", 
+                    "advertised dot11r mobility domain id", &dot11r_mobility_domain_id);
+
+        dot11e_qbss_id =
+            RegisterDynamicField("dot11.advertisedssid.dot11e_qbss", 
+                    "SSID advertises 802.11e QBSS", &dot11e_qbss);
+        dot11e_qbss_stations_id =
+            RegisterDynamicField("dot11.advertisedssid.dot11e_qbss_stations", 
+                    "802.11e QBSS station count", &dot11e_qbss_stations);
+        dot11e_qbss_channel_load_id =
+            RegisterDynamicField("dot11.advertisedssid.dot11e_channel_utilization_perc", 
+                    "802.11e QBSS reported channel utilization, as percentage", 
+                    &dot11e_qbss_channel_load);
+
+        ccx_txpower_id =
+            RegisterDynamicField("dot11.advertisedssid.ccx_txpower",
+                    "Cisco CCX advertised TX power (dBm)", &ccx_txpower);
+
+        cisco_client_mfp_id =
+            RegisterDynamicField("dot11.advertisedssid.cisco_client_mfp",
+                    "Cisco client management frame protection", &cisco_client_mfp);
 
         RegisterField("dot11.advertisedssid.ie_tag_list",
                 "802.11 IE tag list in beacon", &ie_tag_list);
@@ -1021,17 +1036,24 @@ protected:
 
     // 802.11r mobility/fast roaming advertisements
     std::shared_ptr<TrackerElementUInt8> dot11r_mobility;
+    int dot11r_mobility_id;
     std::shared_ptr<TrackerElementUInt16> dot11r_mobility_domain_id;
+    int dot11r_mobility_domain_id_id;
 
     // 802.11e QBSS
     std::shared_ptr<TrackerElementUInt8> dot11e_qbss;
+    int dot11e_qbss_id;
     std::shared_ptr<TrackerElementUInt16> dot11e_qbss_stations;
+    int dot11e_qbss_stations_id;
     std::shared_ptr<TrackerElementDouble> dot11e_qbss_channel_load;
+    int dot11e_qbss_channel_load_id;
 
     // Cisco CCX
     std::shared_ptr<TrackerElementUInt8> ccx_txpower;
+    int ccx_txpower_id;
     // Cisco frame protection
     std::shared_ptr<TrackerElementUInt8> cisco_client_mfp;
+    int cisco_client_mfp_id;
 
     // IE tags present, and order
     std::shared_ptr<TrackerElementVectorDouble> ie_tag_list;
@@ -1332,20 +1354,19 @@ public:
     __Proxy(last_beacon_timestamp, uint64_t, time_t, 
             time_t, last_beacon_timestamp);
 
-    __Proxy(wps_m3_count, uint64_t, uint64_t, uint64_t, wps_m3_count);
-    __ProxyIncDec(wps_m3_count, uint64_t, uint64_t, wps_m3_count);
+    __ProxyDynamic(wps_m3_count, uint64_t, uint64_t, uint64_t, wps_m3_count, wps_m3_count_id);
+    __ProxyDynamic(wps_m3_last, uint64_t, uint64_t, uint64_t, wps_m3_last, wps_m3_last_id);
 
-    __Proxy(wps_m3_last, uint64_t, uint64_t, uint64_t, wps_m3_last);
-
-    __ProxyTrackable(wpa_key_vec, TrackerElementVector, wpa_key_vec);
+    __ProxyDynamicTrackable(wpa_key_vec, TrackerElementVector, wpa_key_vec, wpa_key_vec_id);
     std::shared_ptr<dot11_tracked_eapol> create_eapol_packet() {
         return std::make_shared<dot11_tracked_eapol>(wpa_key_entry_id);
     }
 
     __Proxy(wpa_present_handshake, uint8_t, uint8_t, uint8_t, wpa_present_handshake);
 
-    __ProxyTrackable(wpa_nonce_vec, TrackerElementVector, wpa_nonce_vec);
-    __ProxyTrackable(wpa_anonce_vec, TrackerElementVector, wpa_anonce_vec);
+    __ProxyDynamicTrackable(wpa_nonce_vec, TrackerElementVector, wpa_nonce_vec, wpa_nonce_vec_id);
+    __ProxyDynamicTrackable(wpa_anonce_vec, TrackerElementVector, wpa_anonce_vec, 
+            wpa_anonce_vec_id);
     std::shared_ptr<dot11_tracked_nonce> create_tracked_nonce() {
         return std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id);
     }
@@ -1366,13 +1387,19 @@ public:
         set_num_associated_clients(associated_client_map->size());
     }
 
-    __Proxy(min_tx_power, uint8_t, unsigned int, unsigned int, min_tx_power);
-    __Proxy(max_tx_power, uint8_t, unsigned int, unsigned int, max_tx_power);
-    __ProxyTrackable(supported_channels, TrackerElementVectorDouble, supported_channels);
+    __ProxyDynamic(min_tx_power, uint8_t, unsigned int, unsigned int, min_tx_power, 
+            min_tx_power_id);
+    __ProxyDynamic(max_tx_power, uint8_t, unsigned int, unsigned int, max_tx_power,
+            max_tx_power_id);
+    __ProxyDynamicTrackable(supported_channels, TrackerElementVectorDouble, supported_channels,
+            supported_channels_id);
 
-    __Proxy(link_measurement_capable, uint8_t, bool, bool, link_measurement_capable);
-    __Proxy(neighbor_report_capable, uint8_t, bool, bool, neighbor_report_capable);
-    __ProxyTrackable(extended_capabilities_list, TrackerElementVectorString, extended_capabilities_list);
+    __ProxyDynamic(link_measurement_capable, uint8_t, bool, bool, link_measurement_capable,
+            link_measurement_capable_id);
+    __ProxyDynamic(neighbor_report_capable, uint8_t, bool, bool, neighbor_report_capable,
+            neighbor_report_capable_id);
+    __ProxyDynamicTrackable(extended_capabilities_list, TrackerElementVectorString, 
+            extended_capabilities_list, extended_capabilities_list_id);
 
     __Proxy(beacon_fingerprint, uint32_t, uint32_t, uint32_t, beacon_fingerprint);
     __Proxy(probe_fingerprint, uint32_t, uint32_t, uint32_t, probe_fingerprint);
@@ -1454,19 +1481,27 @@ protected:
                 "unix timestamp of last beacon frame", 
                 &last_beacon_timestamp);
 
-        RegisterField("dot11.device.wps_m3_count", "WPS M3 message count", &wps_m3_count);
-        RegisterField("dot11.device.wps_m3_last", "WPS M3 last message", &wps_m3_last);
+        wps_m3_count_id =
+            RegisterDynamicField("dot11.device.wps_m3_count", "WPS M3 message count", 
+                    &wps_m3_count);
+        wps_m3_last_id =
+            RegisterDynamicField("dot11.device.wps_m3_last", "WPS M3 last message", &wps_m3_last);
 
-        RegisterField("dot11.device.wpa_handshake_list", "WPA handshakes", &wpa_key_vec);
+        wpa_key_vec_id =
+            RegisterDynamicField("dot11.device.wpa_handshake_list", "WPA handshakes", &wpa_key_vec);
 
         wpa_key_entry_id =
             RegisterField("dot11.eapol.key",
                     TrackerElementFactory<dot11_tracked_eapol>(),
                     "WPA handshake key");
 
-        RegisterField("dot11.device.wpa_nonce_list", "Previous WPA Nonces", &wpa_nonce_vec);
+        wpa_nonce_vec_id =
+            RegisterDynamicField("dot11.device.wpa_nonce_list", "Previous WPA Nonces", 
+                    &wpa_nonce_vec);
 
-        RegisterField("dot11.device.wpa_anonce_list", "Previous WPA ANonces", &wpa_anonce_vec);
+        wpa_anonce_vec_id =
+            RegisterDynamicField("dot11.device.wpa_anonce_list", "Previous WPA ANonces", 
+                    &wpa_anonce_vec);
 
         RegisterField("dot11.device.wpa_present_handshake", 
                 "handshake sequences seen (bitmask)", &wpa_present_handshake);
@@ -1476,18 +1511,26 @@ protected:
                     TrackerElementFactory<dot11_tracked_nonce>(),
                     "WPA nonce exchange");
 
-        RegisterField("dot11.device.min_tx_power", "Minimum advertised TX power", &min_tx_power);
-        RegisterField("dot11.device.max_tx_power", "Maximum advertised TX power", &max_tx_power);
-
-        RegisterField("dot11.device.supported_channels", "Advertised supported channels", 
-                &supported_channels);
-
-        RegisterField("dot11.device.link_measurement_capable", 
-                "Advertised link measurement client capability", &link_measurement_capable);
-        RegisterField("dot11.device.neighbor_report_capable",
-                "Advertised neighbor report capability", &neighbor_report_capable);
-        RegisterField("dot11.device.extended_capabilities", 
-                "Advertised extended capabilities list", &extended_capabilities_list);
+        min_tx_power_id =
+            RegisterDynamicField("dot11.device.min_tx_power", "Minimum advertised TX power", 
+                    &min_tx_power);
+        max_tx_power_id =
+            RegisterDynamicField("dot11.device.max_tx_power", "Maximum advertised TX power", 
+                    &max_tx_power);
+
+        supported_channels_id =
+            RegisterDynamicField("dot11.device.supported_channels", "Advertised supported channels", 
+                    &supported_channels);
+
+        link_measurement_capable_id =
+            RegisterDynamicField("dot11.device.link_measurement_capable", 
+                    "Advertised link measurement client capability", &link_measurement_capable);
+        neighbor_report_capable_id =
+            RegisterDynamicField("dot11.device.neighbor_report_capable",
+                    "Advertised neighbor report capability", &neighbor_report_capable);
+        extended_capabilities_list_id =
+            RegisterDynamicField("dot11.device.extended_capabilities", 
+                    "Advertised extended capabilities list", &extended_capabilities_list);
 
         RegisterField("dot11.device.beacon_fingerprint", "Beacon fingerprint", &beacon_fingerprint);
         RegisterField("dot11.device.probe_fingerprint", "Probe (Client->AP) fingerprint", &probe_fingerprint);
@@ -1525,25 +1568,31 @@ protected:
             // We don't have to deal with the client map because it's a map of
             // simplistic types
 
-            for (auto k = wpa_key_vec->begin(); k != wpa_key_vec->end(); ++k) {
-                auto eap =
-                    std::make_shared<dot11_tracked_eapol>(wpa_key_entry_id, 
-                            std::static_pointer_cast<TrackerElementMap>(*k));
-                *k = eap;
+            if (wpa_key_vec != nullptr) {
+                for (auto k = wpa_key_vec->begin(); k != wpa_key_vec->end(); ++k) {
+                    auto eap =
+                        std::make_shared<dot11_tracked_eapol>(wpa_key_entry_id, 
+                                std::static_pointer_cast<TrackerElementMap>(*k));
+                    *k = eap;
+                }
             }
 
-            for (auto k = wpa_nonce_vec->begin(); k != wpa_nonce_vec->end(); ++k) {
-                auto nonce =
-                    std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id, 
-                            std::static_pointer_cast<TrackerElementMap>(*k));
-                *k = nonce;
+            if (wpa_nonce_vec != nullptr) {
+                for (auto k = wpa_nonce_vec->begin(); k != wpa_nonce_vec->end(); ++k) {
+                    auto nonce =
+                        std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id, 
+                                std::static_pointer_cast<TrackerElementMap>(*k));
+                    *k = nonce;
+                }
             }
 
-            for (auto k = wpa_anonce_vec->begin(); k != wpa_anonce_vec->end(); ++k) {
-                auto anonce =
-                    std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id, 
-                            std::static_pointer_cast<TrackerElementMap>(*k));
-                *k = anonce;
+            if (wpa_anonce_vec != nullptr) {
+                for (auto k = wpa_anonce_vec->begin(); k != wpa_anonce_vec->end(); ++k) {
+                    auto anonce =
+                        std::make_shared<dot11_tracked_nonce>(wpa_nonce_entry_id, 
+                                std::static_pointer_cast<TrackerElementMap>(*k));
+                    *k = anonce;
+                }
             }
         }
     }
@@ -1592,12 +1641,17 @@ protected:
     std::shared_ptr<TrackerElementUInt64> last_beacon_timestamp;
 
     std::shared_ptr<TrackerElementUInt64> wps_m3_count;
+    int wps_m3_count_id;
     std::shared_ptr<TrackerElementUInt64> wps_m3_last;
+    int wps_m3_last_id;
 
     std::shared_ptr<TrackerElementVector> wpa_key_vec;
+    int wpa_key_vec_id;
     int wpa_key_entry_id;
     std::shared_ptr<TrackerElementVector> wpa_nonce_vec;
+    int wpa_nonce_vec_id;
     std::shared_ptr<TrackerElementVector> wpa_anonce_vec;
+    int wpa_anonce_vec_id;
     std::shared_ptr<TrackerElementUInt8> wpa_present_handshake;
     int wpa_nonce_entry_id;
 
@@ -1607,14 +1661,20 @@ protected:
 
     // Advertised in association requests but device-centric
     std::shared_ptr<TrackerElementUInt8> min_tx_power;
+    int min_tx_power_id;
     std::shared_ptr<TrackerElementUInt8> max_tx_power;
+    int max_tx_power_id;
 
     std::shared_ptr<TrackerElementVectorDouble> supported_channels;
+    int supported_channels_id;
 
     std::shared_ptr<TrackerElementUInt8> link_measurement_capable;
+    int link_measurement_capable_id;
     std::shared_ptr<TrackerElementUInt8> neighbor_report_capable;
+    int neighbor_report_capable_id;
 
     std::shared_ptr<TrackerElementVectorString> extended_capabilities_list;
+    int extended_capabilities_list_id;
 
     std::shared_ptr<TrackerElementUInt32> beacon_fingerprint;
     std::shared_ptr<TrackerElementUInt32> probe_fingerprint;
@@ -1726,6 +1786,17 @@ public:
     virtual void LoadPhyStorage(SharedTrackerElement in_storage,
             SharedTrackerElement in_device) override;
 
+    // Trim the SSID and client maps when the memory budget is exceeded
+    virtual void ShrinkDevice(std::shared_ptr<kis_tracked_device_base> in_device) override;
+
+    // Index devices by the SSIDs they advertise
+    virtual void DeviceIndexKeys(std::shared_ptr<kis_tracked_device_base> in_device,
+            std::vector<std::pair<std::string, std::string>>& in_keys) override;
+
+    // Merge the SSIDs, clients, and handshakes seen while a device was being restored
+    virtual void MergeRestoredDevice(std::shared_ptr<kis_tracked_device_base> in_device,
+            std::shared_ptr<kis_tracked_device_base> in_pending) override;
+
     // Convert a frequency in KHz to an IEEE 80211 channel name; MAY THROW AN EXCEPTION
     // if this cannot be converted or is an invalid frequency
     static const std::string KhzToChannel(const double in_khz);
@@ -1741,6 +1812,10 @@ protected:
     size_t recent_packet_checksums_sz;
     unsigned int recent_packet_checksum_pos;
 
+    // Number of most recent SSID and client records kept per device when the memory
+    // budget is exceeded
+    unsigned int budget_keep_entries;
+
     // Handle advertised SSIDs
     void HandleSSID(std::shared_ptr<kis_tracked_device_base> basedev, 
             std::shared_ptr<dot11_tracked_device> dot11dev,
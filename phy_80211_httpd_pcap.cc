@@ -69,7 +69,7 @@ bool Phy_80211_Httpd_Pcap::Httpd_VerifyPath(const char *path, const char *method
         // Does it exist?
         device_key targetkey(dot11phy->FetchPhynameHash(), dmac);
 
-        if (devicetracker->FetchDevice(targetkey) != NULL)
+        if (devicetracker->device_key_known(targetkey))
             return true;
     }
 
@@ -53,6 +53,7 @@ Kis_Bluetooth_Phy::Kis_Bluetooth_Phy(GlobalRegistry *in_globalreg, int in_phyid)
         entrytracker->RegisterField("bluetooth.device", 
                 TrackerElementFactory<bluetooth_tracked_device>(),
                 "Bluetooth device");
+    device_record_ids.push_back(bluetooth_device_entry_id);
 
     packetchain->RegisterHandler(&CommonClassifierBluetooth, this, CHAINPOS_CLASSIFIER, -100);
     packetchain->RegisterHandler(&PacketTrackerBluetooth, this, CHAINPOS_TRACKER, -100);
@@ -141,6 +142,9 @@ int Kis_Bluetooth_Phy::PacketTrackerBluetooth(CHAINCALL_PARMS) {
         basedev->insert(btdev);
     }
 
+    // Every packet updates the bluetooth record
+    basedev->mark_phy_dirty();
+
     basedev->bitset_basic_type_set(KIS_DEVICE_BASICTYPE_PEER);
 
     if (btpi->type == 0)
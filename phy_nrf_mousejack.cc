@@ -52,6 +52,7 @@ Kis_Mousejack_Phy::Kis_Mousejack_Phy(GlobalRegistry *in_globalreg, int in_phyid)
         entrytracker->RegisterField("nrfmousejack.device",
                 TrackerElementFactory<mousejack_tracked_device>(),
                 "NRF Mousejack device");
+    device_record_ids.push_back(mousejack_device_entry_id);
 
     pack_comp_common = packetchain->RegisterPacketComponent("COMMON");
 	pack_comp_linkframe = packetchain->RegisterPacketComponent("LINKFRAME");
@@ -176,6 +177,7 @@ int Kis_Mousejack_Phy::CommonClassifierMousejack(CHAINCALL_PARMS) {
                 common->source.Mac2String());
         nrf = std::make_shared<mousejack_tracked_device>(mphy->mousejack_device_entry_id);
         device->insert(nrf);
+        device->mark_phy_dirty();
     }
 
     return 1;
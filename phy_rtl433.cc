@@ -50,6 +50,7 @@ Kis_RTL433_Phy::Kis_RTL433_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("rtl433.device", 
                 TrackerElementFactory<TrackerElementMap>(),
                 "rtl_433 device");
+    device_record_ids.push_back(rtl433_holder_id);
 
     rtl433_common_id =
         Globalreg::globalreg->entrytracker->RegisterField("rtl433.device.common",
@@ -213,10 +214,20 @@ bool Kis_RTL433_Phy::json_to_rtl(Json::Value json, kis_packet *packet) {
     if (rtlholder == NULL) {
         rtlholder =
             std::make_shared<TrackerElementMap>(rtl433_holder_id);
+
+        // Reserve a slot for each sensor record so adding one later doesn't move the
+        // others while the device is being read
+        for (auto rid : {rtl433_common_id, rtl433_thermometer_id, rtl433_weatherstation_id,
+                rtl433_tpms_id, rtl433_switch_id, rtl433_lightning_id})
+            rtlholder->insert(rid, SharedTrackerElement());
+
         basedev->insert(rtlholder);
         newrtl = true;
     }
 
+    // Every report updates the sensor records
+    basedev->mark_phy_dirty();
+
     auto commondev =
         rtlholder->get_sub_as<rtl433_tracked_common>(rtl433_common_id);
 
@@ -50,6 +50,7 @@ Kis_RTLADSB_Phy::Kis_RTLADSB_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("rtladsb.device", 
                 TrackerElementFactory<TrackerElementMap>(),
                 "rtl_adsb device");
+    device_record_ids.push_back(rtladsb_holder_id);
 
     rtladsb_common_id =
         Globalreg::globalreg->entrytracker->RegisterField("rtladsb.device.common",
@@ -194,10 +195,19 @@ bool Kis_RTLADSB_Phy::json_to_rtl(Json::Value json, kis_packet *packet) {
     if (rtlholder == NULL) {
         rtlholder =
             std::make_shared<TrackerElementMap>(rtladsb_holder_id);
+
+        // Reserve a slot for each sensor record so adding one later doesn't move the
+        // others while the device is being read
+        for (auto rid : {rtladsb_common_id, rtladsb_adsb_id})
+            rtlholder->insert(rid, SharedTrackerElement());
+
         basedev->insert(rtlholder);
         newrtl = true;
     }
 
+    // Every report updates the sensor records
+    basedev->mark_phy_dirty();
+
     auto commondev =
         rtlholder->get_sub_as<rtladsb_tracked_common>(rtladsb_common_id);
 
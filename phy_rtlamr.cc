@@ -50,6 +50,7 @@ Kis_RTLAMR_Phy::Kis_RTLAMR_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("rtlamr.device", 
                 TrackerElementFactory<TrackerElementMap>(),
                 "rtl_amr device");
+    device_record_ids.push_back(rtlamr_holder_id);
 
     rtlamr_common_id =
         Globalreg::globalreg->entrytracker->RegisterField("rtlamr.device.common",
@@ -190,10 +191,19 @@ bool Kis_RTLAMR_Phy::json_to_rtl(Json::Value json, kis_packet *packet) {
     if (rtlholder == NULL) {
         rtlholder =
             std::make_shared<TrackerElementMap>(rtlamr_holder_id);
+
+        // Reserve a slot for each sensor record so adding one later doesn't move the
+        // others while the device is being read
+        for (auto rid : {rtlamr_common_id, rtlamr_powermeter_id})
+            rtlholder->insert(rid, SharedTrackerElement());
+
         basedev->insert(rtlholder);
         newrtl = true;
     }
 
+    // Every report updates the sensor records
+    basedev->mark_phy_dirty();
+
     auto commondev =
         rtlholder->get_sub_as<rtlamr_tracked_common>(rtlamr_common_id);
 
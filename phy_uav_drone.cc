@@ -99,6 +99,11 @@ Kis_UAV_Phy::Kis_UAV_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("uav.device",
                 TrackerElementFactory<uav_tracked_device>(),
                 "UAV device");
+    device_record_ids.push_back(uav_device_id);
+
+    // UAV records are attached to the 802.11 devices carrying DroneID and matching
+    // fingerprints
+    foreign_record_ids.push_back(std::make_pair("IEEE802.11", uav_device_id));
 
     manuf_match_vec =
         std::make_shared<TrackerElementVector>();
@@ -200,6 +205,9 @@ int Kis_UAV_Phy::CommonClassifier(CHAINCALL_PARMS) {
                         uavdev->set_uav_manufacturer("DJI");
                         uavdev->set_uav_model("Mavic (Broken firmware)");
                         uavdev->set_uav_match_type("DroneID");
+
+                        // The UAV record doesn't report its own changes to delta clients
+                        basedev->mark_phy_dirty();
                     }
 
                 } 
@@ -242,6 +250,8 @@ int Kis_UAV_Phy::CommonClassifier(CHAINCALL_PARMS) {
                         auto homeloc = uavdev->get_home_location();
                         homeloc->set(flightinfo->home_lat(), flightinfo->home_lon());
                     }
+
+                    basedev->mark_phy_dirty();
                 } 
                
                 auto flightpurpose = dot11info->droneid->flight_purpose_record();
@@ -260,6 +270,8 @@ int Kis_UAV_Phy::CommonClassifier(CHAINCALL_PARMS) {
 
                     if (uavdev->get_uav_manufacturer() == "")
                         uavdev->set_uav_manufacturer("DJI/DroneID");
+
+                    basedev->mark_phy_dirty();
                 } 
             } catch (const std::exception& e) {
                 fprintf(stderr, "debug - unable to parse droneid frame - %s\n", e.what());
@@ -290,6 +302,8 @@ int Kis_UAV_Phy::CommonClassifier(CHAINCALL_PARMS) {
 
                     uavdev->set_uav_match_type("UAV Fingerprint");
 
+                    basedev->mark_phy_dirty();
+
                     break;
                 }
             }
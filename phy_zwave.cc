@@ -48,6 +48,7 @@ Kis_Zwave_Phy::Kis_Zwave_Phy(GlobalRegistry *in_globalreg, int in_phyid) :
         Globalreg::globalreg->entrytracker->RegisterField("zwave.device",
                 TrackerElementFactory<zwave_tracked_device>(),
                 "Z-Wave device");
+    device_record_ids.push_back(zwave_device_id);
 
     zwave_manuf = Globalreg::globalreg->manufdb->MakeManuf("Z-Wave");
 
@@ -202,6 +203,8 @@ bool Kis_Zwave_Phy::json_to_record(Json::Value json) {
     }
 
     if (newzdev) {
+        basedev->mark_phy_dirty();
+
         zdev->set_homeid(homeid);
         zdev->set_deviceid(devid);
     }
@@ -57,6 +57,41 @@ public:
     virtual void LoadPhyStorage(SharedTrackerElement in_storage __attribute__((unused)), 
             SharedTrackerElement in_device __attribute__((unused))) { }
 
+    // Called by the devicetracker when the memory budget is exceeded, after the device
+    // has dropped its optional common data.  Phys may discard or trim optional 
+    // phy-specific records (such as historical lists) in the device.  The device is 
+    // locked by the caller.
+    virtual void ShrinkDevice(std::shared_ptr<kis_tracked_device_base> in_device __attribute__((unused))) { }
+
+    // Called by the devicetracker when it refreshes the secondary indices of a device.
+    // Phys may append (attribute, value) keys for their own records, such as SSIDs, so
+    // that devices can be looked up by them.  The device is locked by the caller.
+    virtual void DeviceIndexKeys(std::shared_ptr<kis_tracked_device_base> in_device __attribute__((unused)),
+            std::vector<std::pair<std::string, std::string>>& in_keys __attribute__((unused))) { }
+
+    // Called by the devicetracker when a device is restored from the cold store while a
+    // record created by newer packets stood in for it, after the common data has been 
+    // merged.  Phys should fold their records in in_pending into the matching records
+    // of in_device; records in_device lacks entirely have already been moved over.  
+    // in_pending is locked by the caller and discarded after; in_device is not yet
+    // visible to anything else.
+    virtual void MergeRestoredDevice(std::shared_ptr<kis_tracked_device_base> in_device __attribute__((unused)),
+            std::shared_ptr<kis_tracked_device_base> in_pending __attribute__((unused))) { }
+
+    // Ids of the records this phy inserts into its devices; new devices of this phy 
+    // get an empty slot for each so that adding the record later doesn't move the 
+    // other fields of a device which may be being serialized
+    const std::vector<int>& FetchDeviceRecordIds() {
+        return device_record_ids;
+    }
+
+    // Ids of the records this phy inserts into devices of other phys, with the name of
+    // the phy, such as UAV records added to 802.11 devices; devices of the other phy 
+    // get an empty slot for each as well
+    const std::vector<std::pair<std::string, int>>& FetchForeignRecordIds() {
+        return foreign_record_ids;
+    }
+
 protected:
     void SetPhyName(std::string in_phyname) {
         phyname = in_phyname;
@@ -66,6 +101,9 @@ protected:
     std::string phyname;
     uint32_t phyname_hash;
 	int phyid;
+
+    std::vector<int> device_record_ids;
+    std::vector<std::pair<std::string, int>> foreign_record_ids;
 };
 
 #endif
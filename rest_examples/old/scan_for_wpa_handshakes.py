@@ -60,11 +60,14 @@ while 1:
 
 
         if 'dot11.device' in d:
-            if len(d['dot11.device']['dot11.device.wpa_handshake_list']):
+            # The handshake list is omitted until a device has seen a handshake
+            handshakes = d['dot11.device'].get('dot11.device.wpa_handshake_list', [])
+
+            if len(handshakes):
 
                 print d['kismet.device.base.macaddr'].split("/")[0],
                 print d['dot11.device']['dot11.device.last_beaconed_ssid'],
-                print "{} WPA EAPOL packets".format(len(d['dot11.device']['dot11.device.wpa_handshake_list'])),
+                print "{} WPA EAPOL packets".format(len(handshakes)),
 
                 if ((d['dot11.device']['dot11.device.wpa_present_handshake'] & 0x06) == 0x06 or
                         (d['dot11.device']['dot11.device.wpa_present_handshake'] & 0x0C) == 0x0C):
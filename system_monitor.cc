@@ -35,6 +35,7 @@
 #include "globalregistry.h"
 #include "json_adapter.h"
 #include "kis_databaselogfile.h"
+#include "messagebus.h"
 #include "system_monitor.h"
 #include "util.h"
 #include "version.h"
@@ -62,6 +63,12 @@ Systemmonitor::Systemmonitor() :
     // Link the RRD out of the devicetracker
     status->insert(devicetracker->get_packets_rrd());
 
+    // Link the memory budget accounting out of the devicetracker
+    status->insert(devicetracker->get_memory_budget());
+
+    // Link the cold storage accounting out of the devicetracker
+    status->insert(devicetracker->get_cold_storage());
+
     // Set the startup time
     status->set_timestamp_start_sec(time(0));
 
@@ -178,6 +185,22 @@ void tracked_system_status::register_fields() {
             "system startup timestamp, seconds", &timestamp_start_sec);
     RegisterField("kismet.system.memory.rss", "memory RSS in kbytes", &memory);
     RegisterField("kismet.system.devices.count", "number of devices in devicetracker", &devices);
+    RegisterField("kismet.system.devices.id_slots", 
+            "number of device ID slots in devicetracker", &device_id_slots);
+    RegisterField("kismet.system.devices.id_holes", 
+            "number of unused device ID slots left by removed devices", &device_id_holes);
+    RegisterField("kismet.system.devices.id_hole_ratio", 
+            "ratio of unused device ID slots to devices", &device_id_hole_ratio);
+    RegisterField("kismet.system.devices.restoring", 
+            "stored devices are being restored", &devices_restoring);
+    RegisterField("kismet.system.devices.restore_total", 
+            "number of stored devices to restore", &devices_restore_total);
+    RegisterField("kismet.system.devices.restore_loaded", 
+            "number of stored devices processed so far", &devices_restore_loaded);
+    RegisterField("kismet.system.messagebus.queue_depth", 
+            "messages waiting to be delivered to message clients", &messagebus_queue_depth);
+    RegisterField("kismet.system.messagebus.dropped", 
+            "messages dropped because the message queue was full", &messagebus_dropped);
     RegisterField("kismet.system.user", "user Kismet is running as", &username);
     RegisterField("kismet.system.version", "Kismet version string", &server_version);
     RegisterField("kismet.system.git", "Git commit string", &server_git);
@@ -203,6 +226,18 @@ int Systemmonitor::timetracker_event(int eventid) {
     status->set_devices(num_devices);
     status->get_devices_rrd()->add_sample(num_devices, time(0));
 
+    auto id_holes = devicetracker->FetchNumDeviceHoles();
+    status->set_device_id_slots(devicetracker->FetchNumDeviceSlots());
+    status->set_device_id_holes(id_holes);
+    status->set_device_id_hole_ratio(num_devices > 0 ? (double) id_holes / num_devices : 0);
+
+    status->set_devices_restoring(devicetracker->FetchDevicesRestoring());
+    status->set_devices_restore_total(devicetracker->FetchRestoreTotal());
+    status->set_devices_restore_loaded(devicetracker->FetchRestoreLoaded());
+
+    status->set_messagebus_queue_depth(Globalreg::globalreg->messagebus->FetchQueueDepth());
+    status->set_messagebus_dropped(Globalreg::globalreg->messagebus->FetchDropped());
+
 #ifdef SYS_LINUX
     // Grab the memory from /proc
     std::string procline;
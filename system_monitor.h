@@ -78,6 +78,15 @@ public:
 
     __Proxy(memory, uint64_t, uint64_t, uint64_t, memory);
     __Proxy(devices, uint64_t, uint64_t, uint64_t, devices);
+    __Proxy(device_id_slots, uint64_t, uint64_t, uint64_t, device_id_slots);
+    __Proxy(device_id_holes, uint64_t, uint64_t, uint64_t, device_id_holes);
+    __Proxy(device_id_hole_ratio, double, double, double, device_id_hole_ratio);
+    __Proxy(devices_restoring, uint8_t, bool, bool, devices_restoring);
+    __Proxy(devices_restore_total, uint64_t, uint64_t, uint64_t, devices_restore_total);
+    __Proxy(devices_restore_loaded, uint64_t, uint64_t, uint64_t, devices_restore_loaded);
+
+    __Proxy(messagebus_queue_depth, uint64_t, uint64_t, uint64_t, messagebus_queue_depth);
+    __Proxy(messagebus_dropped, uint64_t, uint64_t, uint64_t, messagebus_dropped);
 
     __Proxy(username, std::string, std::string, std::string, username);
     __Proxy(server_version, std::string, std::string, std::string, server_version);
@@ -123,6 +132,14 @@ protected:
 
     std::shared_ptr<kis_tracked_rrd<kis_tracked_rrd_extreme_aggregator>> memory_rrd;
     std::shared_ptr<TrackerElementUInt64> devices;
+    std::shared_ptr<TrackerElementUInt64> device_id_slots;
+    std::shared_ptr<TrackerElementUInt64> device_id_holes;
+    std::shared_ptr<TrackerElementDouble> device_id_hole_ratio;
+    std::shared_ptr<TrackerElementUInt8> devices_restoring;
+    std::shared_ptr<TrackerElementUInt64> devices_restore_total;
+    std::shared_ptr<TrackerElementUInt64> devices_restore_loaded;
+    std::shared_ptr<TrackerElementUInt64> messagebus_queue_depth;
+    std::shared_ptr<TrackerElementUInt64> messagebus_dropped;
     std::shared_ptr<kis_tracked_rrd<kis_tracked_rrd_extreme_aggregator> > devices_rrd;
 
     std::shared_ptr<TrackerElementStringMap> sensors_fans;
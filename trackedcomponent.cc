@@ -35,33 +35,92 @@ int tracker_component::RegisterField(const std::string& in_name,
     int id = 
         Globalreg::globalreg->entrytracker->RegisterField(in_name, std::move(in_builder), in_desc);
 
-    if (in_dest != NULL) {
-        auto rf = std::unique_ptr<registered_field>(new registered_field(id, in_dest));
-        registered_fields.push_back(std::move(rf));
-    }
+    if (in_dest != NULL)
+        registered_fields.push_back(registered_field(id, in_dest));
 
     return id;
 }
 
 void tracker_component::reserve_fields(std::shared_ptr<TrackerElementMap> e) {
-    for (unsigned int i = 0; i < registered_fields.size(); i++) {
-        auto& rf = registered_fields[i];
-
-        if (rf->assign != nullptr) {
-            if (rf->dynamic) {
-                // If the variable is dynamic set the assignment container to null so that
-                // proxydynamictrackable can fill it in;
-                *(rf->assign) = nullptr;
-                insert(rf->id, std::shared_ptr<TrackerElement>());
+    map.reserve(map.size() + registered_fields.size());
+
+    // Fields which aren't imported or already built are built together at the end, so
+    // that the simple ones share one allocation; each is the index of the field to
+    // build and the destination to assign it to
+    std::vector<int> build_ids;
+    std::vector<std::pair<size_t, SharedTrackerElement *>> build_assign;
+
+    for (auto& rf : registered_fields) {
+        if (rf.assign != nullptr) {
+            if (rf.dynamic) {
+                // If the variable is dynamic, only adopt it if the imported element
+                // populated it, rebuilt as the registered type; otherwise set the 
+                // assignment container to null so that proxydynamic can fill it in on 
+                // first write
+                SharedTrackerElement r;
+
+                if (e != nullptr && e->get_type() == TrackerType::TrackerMap && 
+                        rf.adopt != nullptr)
+                    r = (*rf.adopt)(rf.id, e->get_sub(rf.id));
+
+                *(rf.assign) = r;
+
+                if (r != nullptr)
+                    insert(r);
+                else
+                    insert(rf.id, std::shared_ptr<TrackerElement>());
             } else {
-                // otherwise generate a variable for the destination
-                *(rf->assign) = import_or_new(e, rf->id);
+                // otherwise adopt an imported or existing variable for the destination,
+                // or build one
+                auto r = import_or_existing(e, rf.id);
+
+                if (r != nullptr) {
+                    *(rf.assign) = r;
+                    continue;
+                }
+
+                auto bi = std::find(build_ids.begin(), build_ids.end(), rf.id);
+
+                if (bi == build_ids.end()) 
+                    bi = build_ids.insert(build_ids.end(), rf.id);
+
+                build_assign.push_back(std::make_pair(bi - build_ids.begin(), rf.assign));
             }
         }
     }
+
+    if (build_ids.size() != 0) {
+        auto built = Globalreg::globalreg->entrytracker->GetSharedInstances(build_ids);
+
+        for (auto b : built)
+            insert(b);
+
+        for (auto a : build_assign)
+            *(a.second) = built[a.first];
+    }
+
+    // Release the registration list; subclasses re-register their fields before
+    // reserving them again
+    std::vector<registered_field>().swap(registered_fields);
 }
 
 SharedTrackerElement tracker_component::import_or_new(std::shared_ptr<TrackerElementMap> e, int i) {
+    auto r = import_or_existing(e, i);
+
+    if (r != nullptr)
+        return r;
+
+    // Build it
+    r = Globalreg::globalreg->entrytracker->GetSharedInstance(i);
+
+    // Add it to our tracked map object
+    insert(r);
+
+    return r;
+}
+
+SharedTrackerElement tracker_component::import_or_existing(std::shared_ptr<TrackerElementMap> e, 
+        int i) {
     SharedTrackerElement r;
 
     // Find the value of any known fields in the importer element; only try
@@ -86,13 +145,7 @@ SharedTrackerElement tracker_component::import_or_new(std::shared_ptr<TrackerEle
     if (existing != end() && existing->second != nullptr)
         return existing->second;
 
-    // Build it
-    r = Globalreg::globalreg->entrytracker->GetSharedInstance(i);
-
-    // Add it to our tracked map object
-    insert(r);
-
-    return r;
+    return nullptr;
 }
 
 SharedTrackerElement tracker_component::get_child_path(const std::string& in_path) {
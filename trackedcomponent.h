@@ -31,6 +31,8 @@
 #include <map>
 
 #include <memory>
+#include <typeinfo>
+#include <type_traits>
 
 #include "globalregistry.h"
 #include "trackedelement.h"
@@ -72,6 +74,7 @@ class tracker_component : public TrackerElementMap {
     } \
     virtual void set_##name(const itype& in) { \
         SetTrackerValue<ptype>(cvar, static_cast<ptype>(in)); \
+        mark_field_dirty(cvar->get_id()); \
     }
 
 // Ugly macro for standard proxy access but with an additional mutex; this should
@@ -88,6 +91,25 @@ class tracker_component : public TrackerElementMap {
     virtual void set_##name(const itype& in) { \
         local_locker l(mvar); \
         SetTrackerValue<ptype>(cvar, static_cast<ptype>(in)); \
+        mark_field_dirty(cvar->get_id()); \
+    }
+
+// Proxy, as __Proxy, which only sets the value, and marks it changed, when the new 
+// value differs from the current one; <lambda> is called only when the value changes
+// and should be of the form [](itype) -> void
+#define __ProxyChangedL(name, ptype, itype, rtype, cvar, lambda) \
+    virtual SharedTrackerElement get_tracker_##name() const { \
+        return (std::shared_ptr<TrackerElement>) cvar; \
+    } \
+    virtual rtype get_##name() const { \
+        return (rtype) GetTrackerValue<ptype>(cvar); \
+    } \
+    virtual void set_##name(const itype& in) { \
+        if (GetTrackerValue<ptype>(cvar) == static_cast<ptype>(in)) \
+            return; \
+        SetTrackerValue<ptype>(cvar, static_cast<ptype>(in)); \
+        mark_field_dirty(cvar->get_id()); \
+        lambda(in); \
     }
 
 // Ugly trackercomponent macro for proxying trackerelement values
@@ -108,31 +130,33 @@ class tracker_component : public TrackerElementMap {
     } \
     virtual bool set_##name(const itype& in) { \
         cvar->set((ptype) in); \
+        mark_field_dirty(cvar->get_id()); \
         return lambda(in); \
     } \
     virtual void set_only_##name(const itype& in) { \
         cvar->set((ptype) in); \
+        mark_field_dirty(cvar->get_id()); \
     }
 
-// Proxy, connected to a dynamic element.  Getting or setting the dynamic element
-// creates it. 
+// Proxy, connected to a dynamic element.  Setting the dynamic element, or fetching
+// it via get_tracker_, creates it; getting the value of an element which has never 
+// been set returns the default value without creating it.  Dynamic elements which
+// are never set are omitted from serialization.
 #define __ProxyDynamic(name, ptype, itype, rtype, cvar, id) \
     virtual SharedTrackerElement get_tracker_##name() { \
         if (cvar == nullptr) { \
             using ttype = std::remove_pointer<decltype(cvar.get())>::type; \
             cvar = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<ttype>(id); \
-            if (cvar != nullptr) \
+            if (cvar != nullptr) { \
                 insert(cvar); \
+                mark_field_dirty(id); \
+            } \
         } \
         return cvar; \
     } \
     virtual rtype get_##name() { \
-        if (cvar == nullptr) { \
-            using ttype = std::remove_pointer<decltype(cvar.get())>::type; \
-            cvar = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<ttype>(id); \
-            if (cvar != nullptr) \
-                insert(cvar); \
-        } \
+        if (cvar == nullptr) \
+            return {}; \
         return (rtype) GetTrackerValue<ptype>(cvar); \
     } \
     virtual void set_##name(const itype& in) { \
@@ -143,6 +167,7 @@ class tracker_component : public TrackerElementMap {
                 insert(cvar); \
         } \
         cvar->set((ptype) in); \
+        mark_field_dirty(id); \
     } \
     virtual void set_only_##name(const itype& in) { \
         if (cvar == nullptr) { \
@@ -152,30 +177,29 @@ class tracker_component : public TrackerElementMap {
                 insert(cvar); \
         } \
         cvar->set((ptype) in); \
+        mark_field_dirty(id); \
     } \
     virtual bool has_##name() const { \
         return cvar != nullptr; \
     }
 
-// Proxy, connected to a dynamic element.  Getting or setting the dynamic element
-// creates it.  The lamda function is called after setting.
+// Proxy, connected to a dynamic element, as __ProxyDynamic.  The lamda function is 
+// called after setting.
 #define __ProxyDynamicL(name, ptype, itype, rtype, cvar, id, lambda) \
     virtual SharedTrackerElement get_tracker_##name() { \
         if (cvar == nullptr) { \
             using ttype = std::remove_pointer<decltype(cvar.get())>::type; \
             cvar = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<ttype>(id); \
-            if (cvar != nullptr) \
+            if (cvar != nullptr) { \
                 insert(cvar); \
+                mark_field_dirty(id); \
+            } \
         } \
         return cvar; \
     } \
     virtual rtype get_##name() { \
-        if (cvar == nullptr) { \
-            using ttype = std::remove_pointer<decltype(cvar.get())>::type; \
-            cvar = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<ttype>(id); \
-            if (cvar != nullptr) \
-                insert(cvar); \
-        } \
+        if (cvar == nullptr) \
+            return {}; \
         return (rtype) GetTrackerValue<ptype>(cvar); \
     } \
     virtual bool set_##name(const itype& in) { \
@@ -186,6 +210,7 @@ class tracker_component : public TrackerElementMap {
                 insert(cvar); \
         } \
         cvar->set((ptype) in); \
+        mark_field_dirty(id); \
         return lambda(in); \
     } \
     virtual void set_only_##name(const itype& in) { \
@@ -196,6 +221,7 @@ class tracker_component : public TrackerElementMap {
                 insert(cvar); \
         } \
         cvar->set((ptype) in); \
+        mark_field_dirty(id); \
     } \
     virtual bool has_##name() const { \
         return cvar != nullptr; \
@@ -212,6 +238,7 @@ class tracker_component : public TrackerElementMap {
 #define __ProxySet(name, ptype, stype, cvar) \
     virtual void set_##name(const stype& in) { \
         SetTrackerValue<ptype>(cvar, in); \
+        mark_field_dirty(cvar->get_id()); \
     } 
 
 // Proxy a split public/private get/set function; This is even funkier than the 
@@ -224,6 +251,7 @@ class tracker_component : public TrackerElementMap {
     protected: \
     virtual void set_int_##name(const itype& in) { \
         cvar->set((ptype) in); \
+        mark_field_dirty(cvar->get_id()); \
     } \
     public:
 
@@ -231,37 +259,50 @@ class tracker_component : public TrackerElementMap {
 #define __ProxyIncDec(name, ptype, rtype, cvar) \
     virtual void inc_##name() { \
         (*cvar) += 1; \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual void inc_##name(rtype i) { \
         (*cvar) += (ptype) i; \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual void dec_##name() { \
         (*cvar) -= 1; \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual void dec_##name(rtype i) { \
         (*cvar) -= (ptype) i; \
+        mark_field_dirty(cvar->get_id()); \
     }
 
 // Proxy add/subtract
 #define __ProxyAddSub(name, ptype, itype, cvar) \
     virtual void add_##name(itype i) { \
         (*cvar) += (ptype) i; \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual void sub_##name(itype i) { \
         (*cvar) -= (ptype) i; \
+        mark_field_dirty(cvar->get_id()); \
     }
 
-// Proxy sub-trackable (name, trackable type, class variable)
+// Proxy sub-trackable (name, trackable type, class variable).  Clearing the element
+// leaves an empty slot in the map rather than erasing it, so that the other fields
+// don't move.
 #define __ProxyTrackable(name, ttype, cvar) \
     virtual std::shared_ptr<ttype> get_##name() { \
         return cvar; \
     } \
     virtual void set_##name(std::shared_ptr<ttype> in) { \
-        if (cvar != NULL) \
-            erase(cvar); \
+        if (cvar != NULL) { \
+            mark_field_dirty(cvar->get_id()); \
+            if (in == NULL || in->get_id() != cvar->get_id()) \
+                insert(cvar->get_id(), SharedTrackerElement()); \
+        } \
         cvar = in; \
-        if (in != NULL) \
+        if (in != NULL) { \
             insert(cvar); \
+            mark_field_dirty(cvar->get_id()); \
+        } \
     }  \
     virtual SharedTrackerElement get_tracker_##name() { \
         return std::static_pointer_cast<TrackerElement>(cvar); \
@@ -298,24 +339,28 @@ class tracker_component : public TrackerElementMap {
 
 
 // Proxy dynamic trackable (value in class may be null and is dynamically
-// built)
+// built).  Like other dynamic fields, the element is replaced in its slot in the
+// map, and clearing it leaves the slot empty.
 #define __ProxyDynamicTrackable(name, ttype, cvar, id) \
     virtual std::shared_ptr<ttype> get_##name() { \
         if (cvar == NULL) { \
             cvar = Globalreg::globalreg->entrytracker->GetSharedInstanceAs<ttype>(id); \
-            if (cvar != NULL) \
+            if (cvar != NULL) { \
                 insert(cvar); \
+                mark_field_dirty(id); \
+            } \
         } \
         return cvar; \
     } \
     virtual void set_tracker_##name(std::shared_ptr<ttype> in) { \
-        if (cvar != nullptr) \
-            erase(cvar); \
         cvar = in; \
         if (cvar != nullptr) { \
             cvar->set_id(id); \
             insert(std::static_pointer_cast<TrackerElement>(cvar)); \
+        } else { \
+            insert(id, SharedTrackerElement()); \
         } \
+        mark_field_dirty(id); \
     } \
     virtual SharedTrackerElement get_tracker_##name() { \
         return std::static_pointer_cast<TrackerElement>(cvar); \
@@ -328,9 +373,11 @@ class tracker_component : public TrackerElementMap {
 #define __ProxyBitset(name, dtype, cvar) \
     virtual void bitset_##name(dtype bs) { \
         (*cvar) |= bs; \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual void bitclear_##name(dtype bs) { \
         (*cvar) &= ~(bs); \
+        mark_field_dirty(cvar->get_id()); \
     } \
     virtual dtype bitcheck_##name(dtype bs) { \
         return (dtype) (GetTrackerValue<dtype>(cvar) & bs); \
@@ -375,6 +422,16 @@ public:
     SharedTrackerElement get_child_path(const std::string& in_path);
     SharedTrackerElement get_child_path(const std::vector<std::string>& in_path);
 
+    // Called by the proxy setters whenever a field of this component changes; components
+    // which track their own changes (such as devices) override it.  Changes made directly
+    // to nested components have to be reported by the caller.
+    virtual void mark_field_dirty(int in_id __attribute__((unused))) { }
+
+    void mark_field_dirty(const SharedTrackerElement& in_elem) {
+        if (in_elem != nullptr)
+            mark_field_dirty(in_elem->get_id());
+    }
+
 protected:
     // Register a field via the entrytracker, using standard entrytracker build methods.
     // This field will be automatically assigned or created during the reservefields 
@@ -412,14 +469,45 @@ protected:
             Globalreg::globalreg->entrytracker->RegisterField(in_name, 
                     TrackerElementFactory<build_type>(), in_desc);
 
-        auto rf = std::unique_ptr<registered_field>(new registered_field(id, 
-                    reinterpret_cast<SharedTrackerElement *>(in_dest), 
-                    true));
-        registered_fields.push_back(std::move(rf));
+        registered_fields.push_back(registered_field(id, 
+                    reinterpret_cast<SharedTrackerElement *>(in_dest), true,
+                    &adopt_dynamic_field<build_type>));
 
         return id;
     }
 
+    // Convert an imported element into the registered type of a dynamic field.  Storage
+    // loaders only produce generic maps for complex components, so those are rebuilt
+    // through the component's importing constructor; any other element is adopted only
+    // if it is already the registered type, and is otherwise discarded.
+    template<typename T>
+    static SharedTrackerElement adopt_dynamic_field(int in_id, SharedTrackerElement in_elem) {
+        if (in_elem == nullptr)
+            return nullptr;
+
+        if (typeid(*in_elem) == typeid(T))
+            return in_elem;
+
+        return rebuild_dynamic_field<T>(in_id, in_elem, 
+                std::integral_constant<bool, std::is_base_of<tracker_component, T>::value &&
+                    std::is_constructible<T, int, std::shared_ptr<TrackerElementMap>>::value>());
+    }
+
+    template<typename T>
+    static SharedTrackerElement rebuild_dynamic_field(int in_id, SharedTrackerElement in_elem,
+            std::true_type) {
+        if (in_elem->get_type() != TrackerType::TrackerMap)
+            return nullptr;
+
+        return std::make_shared<T>(in_id, std::static_pointer_cast<TrackerElementMap>(in_elem));
+    }
+
+    template<typename T>
+    static SharedTrackerElement rebuild_dynamic_field(int in_id __attribute__((unused)), 
+            SharedTrackerElement in_elem __attribute__((unused)), std::false_type) {
+        return nullptr;
+    }
+
     // Register field types and get a field ID.  Called during record creation, prior to 
     // assigning an existing trackerelement tree or creating a new one
     virtual void register_fields() { }
@@ -429,18 +517,26 @@ protected:
     // When populating from an existing structure, bind each field to this instance so
     //  that we can track usage and delete() appropriately.
     // Populate automatically based on the fields we have reserved, subclasses can 
-    // override if they really need to do something special
+    // override if they really need to do something special.
+    //
+    // The registered field list is only needed until the fields are reserved, and
+    // is released afterwards so it doesn't take up space in every live component.
     virtual void reserve_fields(std::shared_ptr<TrackerElementMap> e);
 
     // Inherit from an existing element or assign a new one.
     // Add imported or new field to our map for use tracking.
     virtual SharedTrackerElement import_or_new(std::shared_ptr<TrackerElementMap> e, int i);
 
+    // Inherit from an existing element, adding it to our map, or return null if the 
+    // field needs to be built
+    SharedTrackerElement import_or_existing(std::shared_ptr<TrackerElementMap> e, int i);
+
     class registered_field {
         public:
             registered_field(int id, SharedTrackerElement *assign) { 
                 this->id = id; 
                 this->assign = assign;
+                this->adopt = nullptr;
 
                 if (assign == nullptr)
                     this->dynamic = true;
@@ -448,7 +544,8 @@ protected:
                     this->dynamic = false;
             }
 
-            registered_field(int id, SharedTrackerElement *assign, bool dynamic) {
+            registered_field(int id, SharedTrackerElement *assign, bool dynamic,
+                    SharedTrackerElement (*adopt)(int, SharedTrackerElement) = nullptr) {
                 if (assign == nullptr && dynamic)
                     throw std::runtime_error("attempted to assign a dynamic field to "
                             "a null destination");
@@ -456,14 +553,18 @@ protected:
                 this->id = id;
                 this->assign = assign;
                 this->dynamic = dynamic;
+                this->adopt = adopt;
             }
 
             int id;
             bool dynamic;
             SharedTrackerElement *assign;
+
+            // Converts an imported element to the type of a dynamic field
+            SharedTrackerElement (*adopt)(int, SharedTrackerElement);
     };
 
-    std::vector<std::unique_ptr<registered_field>> registered_fields;
+    std::vector<registered_field> registered_fields;
 };
 
 
@@ -18,6 +18,8 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <set>
 #include <vector>
 #include <stdexcept>
 
@@ -645,6 +647,7 @@ TrackerElementSummary::TrackerElementSummary(const SharedElementSummary& in_c) {
     parent_element = in_c->parent_element;
     resolved_path = in_c->resolved_path;
     rename = in_c->rename;
+    projection = in_c->projection;
 }
 
 TrackerElementSummary::TrackerElementSummary(const std::string& in_path, 
@@ -1115,6 +1118,196 @@ std::shared_ptr<TrackerElement> SummarizeSingleTrackerElement(SharedTrackerEleme
     return ret_elem;
 }
 
+TrackerElementProjection::TrackerElementProjection(const std::vector<SharedElementSummary>& in_summarization) :
+    summarization {in_summarization} {
+
+    auto entrytracker = Globalreg::globalreg->entrytracker;
+
+    unsigned int fn = 0;
+
+    for (const auto& si : summarization) {
+        fn++;
+
+        if (si->resolved_path.size() == 0)
+            continue;
+
+        auto s = slot{};
+
+        s.path = si->resolved_path;
+        s.summary = std::make_shared<TrackerElementSummary>(si->resolved_path, si->rename);
+        s.summarized = si->rename.length() != 0 || si->resolved_path.size() > 1;
+
+        // Build the placeholder the same way summarization does when a field is missing
+        auto placeholder = 
+            entrytracker->RegisterAndGetField("unknown" + IntToString(fn),
+                    TrackerElementFactory<TrackerElementInt8>(), "unallocated field");
+        std::static_pointer_cast<TrackerElementInt8>(placeholder)->set(0);
+
+        int lastid = si->resolved_path[si->resolved_path.size() - 1];
+
+        if (si->rename.length() != 0)
+            placeholder->set_local_name(si->rename);
+        else if (lastid < 0)
+            placeholder->set_local_name("unknown" + IntToString(fn));
+        else
+            placeholder->set_local_name(entrytracker->GetFieldName(lastid));
+
+        s.placeholder = placeholder;
+
+        // Slots are ordered by the id they'll be keyed as in a summarized map; a path
+        // which didn't resolve can only ever be the placeholder
+        if (std::any_of(s.path.begin(), s.path.end(), [](int p) { return p < 0; }))
+            s.id = placeholder->get_id();
+        else
+            s.id = lastid;
+
+        slots.push_back(s);
+    }
+
+    std::stable_sort(slots.begin(), slots.end(), 
+            [](const slot& a, const slot& b) -> bool {
+                return a.id < b.id;
+            });
+
+    // A summarized map only holds one of each field, the last one requested
+    for (auto i = slots.begin(); i != slots.end(); ) {
+        auto n = std::next(i, 1);
+
+        if (n != slots.end() && n->id == i->id)
+            i = slots.erase(i);
+        else
+            i = n;
+    }
+
+    // Placeholders may have just been registered, so take the generation last
+    generation = entrytracker->GetFieldGeneration();
+}
+
+SharedTrackerElement TrackerElementProjection::resolve(const slot& in_slot, 
+        const SharedTrackerElement& in_elem) const {
+    auto e = in_elem;
+
+    for (auto p : in_slot.path) {
+        if (p < 0 || e->get_type() != TrackerType::TrackerMap)
+            return in_slot.placeholder;
+
+        e = std::static_pointer_cast<TrackerElementMap>(e)->get_sub(p);
+
+        if (e == nullptr)
+            return in_slot.placeholder;
+    }
+
+    return e;
+}
+
+void TrackerElementProjection::enter(const slot& in_slot, const SharedTrackerElement& in_elem,
+        const SharedTrackerElement& in_resolved) const {
+    if (in_resolved == in_slot.placeholder || in_slot.path.size() < 2)
+        return;
+
+    auto e = in_elem;
+
+    for (size_t p = 0; p < in_slot.path.size() - 1; p++) {
+        e = std::static_pointer_cast<TrackerElementMap>(e)->get_sub(in_slot.path[p]);
+        e->pre_serialize();
+    }
+}
+
+void TrackerElementProjection::leave(const slot& in_slot, const SharedTrackerElement& in_elem,
+        const SharedTrackerElement& in_resolved) const {
+    if (in_resolved == in_slot.placeholder || in_slot.path.size() < 2)
+        return;
+
+    auto e = in_elem;
+
+    for (size_t p = 0; p < in_slot.path.size() - 1; p++) {
+        e = std::static_pointer_cast<TrackerElementMap>(e)->get_sub(in_slot.path[p]);
+        e->post_serialize();
+    }
+}
+
+void TrackerElementProjection::mark(std::shared_ptr<TrackerElementVector> in_vec,
+        std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) {
+    if (summarization.size() == 0)
+        return;
+
+    auto marker = std::make_shared<TrackerElementSummary>(std::vector<int>{});
+    marker->projection = shared_from_this();
+    (*rename_map)[in_vec] = marker;
+}
+
+SharedTrackerElement TrackerElementProjection::apply(SharedTrackerElement in,
+        std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) {
+
+    if (in->get_type() == TrackerType::TrackerVector) {
+        auto inv = std::static_pointer_cast<TrackerElementVector>(in);
+        auto ret = std::make_shared<TrackerElementVector>();
+
+        ret->set(inv->begin(), inv->end());
+        mark(ret, rename_map);
+
+        return ret;
+    }
+
+    return summarize(in, rename_map);
+}
+
+SharedTrackerElement TrackerElementProjection::summarize(SharedTrackerElement in,
+        std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) const {
+
+    if (summarization.size() == 0)
+        return in;
+
+    in->pre_serialize();
+
+    auto ret_elem = std::make_shared<TrackerElementMap>();
+
+    summarize_into(in, ret_elem, rename_map, nullptr);
+
+    in->post_serialize();
+
+    return ret_elem;
+}
+
+void TrackerElementProjection::summarize_into(SharedTrackerElement in, 
+        std::shared_ptr<TrackerElementMap> out,
+        std::shared_ptr<TrackerElementSerializer::rename_map> rename_map,
+        const std::function<bool (int)>& in_filter) const {
+
+    for (const auto& s : slots) {
+        if (in_filter != nullptr && (s.path[0] < 0 || !in_filter(s.path[0])))
+            continue;
+
+        auto f = resolve(s, in);
+
+        if (s.summarized) {
+            auto sum = std::make_shared<TrackerElementSummary>(s.summary);
+            sum->parent_element = in;
+            (*rename_map)[f] = sum;
+        }
+
+        out->insert(f);
+    }
+}
+
+void TrackerElementProjection::expand(std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) {
+    auto marked = std::vector<std::pair<SharedTrackerElement, SharedElementSummary>>{};
+
+    for (const auto& i : *rename_map) {
+        if (i.second->projection != nullptr)
+            marked.push_back(i);
+    }
+
+    for (const auto& m : marked) {
+        rename_map->erase(m.first);
+
+        for (auto& e : *std::static_pointer_cast<TrackerElementVector>(m.first)) {
+            if (e != nullptr)
+                e = m.second->projection->summarize(e, rename_map);
+        }
+    }
+}
+
 bool SortTrackerElementLess(const std::shared_ptr<TrackerElement> lhs, 
         const std::shared_ptr<TrackerElement> rhs) {
 
@@ -1221,3 +1414,336 @@ bool FastSortTrackerElementLess(const std::shared_ptr<TrackerElement> lhs,
     return false;
 }
 
+
+// Approximate per-allocation cost of an element held by a shared_ptr; the control 
+// block is allocated alongside the element by make_shared, or alongside the block of
+// scalar fields of a component
+static const size_t tracked_alloc_overhead = 32;
+
+// Approximate cost of a node in a std::map based container, in addition to the value
+static const size_t tracked_map_node_overhead = 32;
+
+static size_t estimate_string_size(const std::string& s) {
+    // Short strings are stored inline
+    if (s.capacity() <= 15)
+        return 0;
+
+    return s.capacity() + 1;
+}
+
+template<typename T>
+static size_t estimate_tree_map_size(const std::shared_ptr<TrackerElement>& e) {
+    auto m = std::static_pointer_cast<T>(e);
+    size_t sz = sizeof(T) + tracked_alloc_overhead +
+        m->size() * (sizeof(typename T::pair) + tracked_map_node_overhead);
+
+    for (auto i : *m)
+        sz += EstimateTrackerElementSize(i.second);
+
+    return sz;
+}
+
+// Estimate an element, charging the cost of its allocation only if it has one of its
+// own; the scalar fields of a component share a single block allocation
+static size_t estimate_element_size(const std::shared_ptr<TrackerElement>& e,
+        bool in_own_alloc) {
+    if (e == nullptr)
+        return 0;
+
+    size_t alloc_overhead = in_own_alloc ? tracked_alloc_overhead : 0;
+
+    switch (e->get_type()) {
+        case TrackerType::TrackerString:
+            return sizeof(TrackerElementString) + alloc_overhead +
+                estimate_string_size(std::static_pointer_cast<TrackerElementString>(e)->get());
+        case TrackerType::TrackerByteArray:
+            return sizeof(TrackerElementByteArray) + alloc_overhead +
+                estimate_string_size(std::static_pointer_cast<TrackerElementByteArray>(e)->get());
+        case TrackerType::TrackerInt8:
+        case TrackerType::TrackerUInt8:
+        case TrackerType::TrackerInt16:
+        case TrackerType::TrackerUInt16:
+        case TrackerType::TrackerInt32:
+        case TrackerType::TrackerUInt32:
+        case TrackerType::TrackerInt64:
+        case TrackerType::TrackerUInt64:
+        case TrackerType::TrackerFloat:
+        case TrackerType::TrackerDouble:
+            return sizeof(TrackerElementUInt64) + alloc_overhead;
+        case TrackerType::TrackerMac:
+            return sizeof(TrackerElementMacAddr) + alloc_overhead;
+        case TrackerType::TrackerUuid:
+            return sizeof(TrackerElementUUID) + alloc_overhead;
+        case TrackerType::TrackerKey:
+            return sizeof(TrackerElementDeviceKey) + alloc_overhead;
+        case TrackerType::TrackerVector: {
+            auto v = std::static_pointer_cast<TrackerElementVector>(e);
+            size_t sz = sizeof(TrackerElementVector) + alloc_overhead +
+                v->get().capacity() * sizeof(std::shared_ptr<TrackerElement>);
+
+            for (auto i : *v)
+                sz += EstimateTrackerElementSize(i);
+
+            return sz;
+        }
+        case TrackerType::TrackerMap: {
+            // Components are larger than a bare map by a class pointer per field, which
+            // we approximate as one pointer per entry
+            auto m = std::static_pointer_cast<TrackerElementMap>(e);
+            size_t sz = sizeof(TrackerElementMap) + alloc_overhead +
+                m->size() * (sizeof(TrackerElementMap::pair) + 
+                        sizeof(std::shared_ptr<TrackerElement>));
+
+            // Fields sharing ownership share an allocation; charge it to the first
+            std::set<std::shared_ptr<TrackerElement>,
+                std::owner_less<std::shared_ptr<TrackerElement>>> allocs;
+
+            for (auto i : *m) {
+                if (i.second == nullptr)
+                    continue;
+
+                sz += estimate_element_size(i.second, allocs.insert(i.second).second);
+            }
+
+            return sz;
+        }
+        case TrackerType::TrackerIntMap:
+            return estimate_tree_map_size<TrackerElementIntMap>(e);
+        case TrackerType::TrackerMacMap:
+            return estimate_tree_map_size<TrackerElementMacMap>(e);
+        case TrackerType::TrackerStringMap:
+            return estimate_tree_map_size<TrackerElementStringMap>(e);
+        case TrackerType::TrackerDoubleMap:
+            return estimate_tree_map_size<TrackerElementDoubleMap>(e);
+        case TrackerType::TrackerKeyMap:
+            return estimate_tree_map_size<TrackerElementDeviceKeyMap>(e);
+        case TrackerType::TrackerHashkeyMap:
+            return estimate_tree_map_size<TrackerElementHashkeyMap>(e);
+        case TrackerType::TrackerVectorDouble:
+            return sizeof(TrackerElementVectorDouble) + alloc_overhead +
+                std::static_pointer_cast<TrackerElementVectorDouble>(e)->get().capacity() * 
+                sizeof(double);
+        case TrackerType::TrackerDoubleMapDouble:
+            return sizeof(TrackerElementDoubleMapDouble) + alloc_overhead +
+                std::static_pointer_cast<TrackerElementDoubleMapDouble>(e)->size() *
+                (sizeof(TrackerElementDoubleMapDouble::pair) + tracked_map_node_overhead);
+        case TrackerType::TrackerVectorString: {
+            auto v = std::static_pointer_cast<TrackerElementVectorString>(e);
+            size_t sz = sizeof(TrackerElementVectorString) + alloc_overhead +
+                v->get().capacity() * sizeof(std::string);
+
+            for (auto i : *v)
+                sz += estimate_string_size(i);
+
+            return sz;
+        }
+    }
+
+    return 0;
+}
+
+size_t EstimateTrackerElementSize(const std::shared_ptr<TrackerElement>& e) {
+    return estimate_element_size(e, true);
+}
+
+// FNV-1a over the type, field id, and value of every element in a tree
+class tracker_element_digest {
+public:
+    tracker_element_digest() :
+        hash {14695981039346656037ULL} { }
+
+    uint64_t get() const {
+        return hash;
+    }
+
+    void put(const void *data, size_t len) {
+        auto bytes = static_cast<const uint8_t *>(data);
+
+        for (size_t i = 0; i < len; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    template<typename T>
+    void put_value(const T& v) {
+        put(&v, sizeof(T));
+    }
+
+    void put_value(const std::string& s) {
+        put_value(s.length());
+        put(s.data(), s.length());
+    }
+
+    void put_value(const mac_addr& m) {
+        put_value(m.longmac);
+        put_value(m.longmask);
+    }
+
+    void put_value(const device_key& k) {
+        put_value(k.get_spkey());
+        put_value(k.get_dkey());
+    }
+
+    void put_value(const uuid& u) {
+        put(u.uuid_block, sizeof(u.uuid_block));
+    }
+
+protected:
+    uint64_t hash;
+};
+
+// Hold an element in its serialization state (such as the device locks) while it
+// is digested
+class digest_scope {
+public:
+    digest_scope(const std::shared_ptr<TrackerElement>& e) :
+        elem {e} {
+        elem->pre_serialize();
+    }
+
+    ~digest_scope() {
+        elem->post_serialize();
+    }
+
+protected:
+    const std::shared_ptr<TrackerElement>& elem;
+};
+
+static void digest_tracker_element(tracker_element_digest& d, 
+        const std::shared_ptr<TrackerElement>& e);
+
+template<typename T>
+static void digest_keyed_map(tracker_element_digest& d, const std::shared_ptr<TrackerElement>& e) {
+    auto m = std::static_pointer_cast<T>(e);
+
+    d.put_value(m->size());
+
+    for (auto i : *m) {
+        d.put_value(i.first);
+        digest_tracker_element(d, i.second);
+    }
+}
+
+static void digest_tracker_element(tracker_element_digest& d, 
+        const std::shared_ptr<TrackerElement>& e) {
+    if (e == nullptr) {
+        d.put_value(static_cast<uint8_t>(0xFF));
+        return;
+    }
+
+    digest_scope s(e);
+
+    d.put_value(static_cast<uint8_t>(e->get_type()));
+    d.put_value(e->get_id());
+
+    switch (e->get_type()) {
+        case TrackerType::TrackerString:
+            d.put_value(std::static_pointer_cast<TrackerElementString>(e)->get());
+            break;
+        case TrackerType::TrackerByteArray:
+            d.put_value(std::static_pointer_cast<TrackerElementByteArray>(e)->get());
+            break;
+        case TrackerType::TrackerInt8:
+            d.put_value(GetTrackerValue<int8_t>(e));
+            break;
+        case TrackerType::TrackerUInt8:
+            d.put_value(GetTrackerValue<uint8_t>(e));
+            break;
+        case TrackerType::TrackerInt16:
+            d.put_value(GetTrackerValue<int16_t>(e));
+            break;
+        case TrackerType::TrackerUInt16:
+            d.put_value(GetTrackerValue<uint16_t>(e));
+            break;
+        case TrackerType::TrackerInt32:
+            d.put_value(GetTrackerValue<int32_t>(e));
+            break;
+        case TrackerType::TrackerUInt32:
+            d.put_value(GetTrackerValue<uint32_t>(e));
+            break;
+        case TrackerType::TrackerInt64:
+            d.put_value(GetTrackerValue<int64_t>(e));
+            break;
+        case TrackerType::TrackerUInt64:
+            d.put_value(GetTrackerValue<uint64_t>(e));
+            break;
+        case TrackerType::TrackerFloat:
+            d.put_value(GetTrackerValue<float>(e));
+            break;
+        case TrackerType::TrackerDouble:
+            d.put_value(GetTrackerValue<double>(e));
+            break;
+        case TrackerType::TrackerMac:
+            d.put_value(GetTrackerValue<mac_addr>(e));
+            break;
+        case TrackerType::TrackerUuid:
+            d.put_value(GetTrackerValue<uuid>(e));
+            break;
+        case TrackerType::TrackerKey:
+            d.put_value(GetTrackerValue<device_key>(e));
+            break;
+        case TrackerType::TrackerVector: {
+            auto v = std::static_pointer_cast<TrackerElementVector>(e);
+            d.put_value(v->size());
+            for (auto i : *v)
+                digest_tracker_element(d, i);
+            break;
+        }
+        case TrackerType::TrackerVectorDouble: {
+            auto v = std::static_pointer_cast<TrackerElementVectorDouble>(e);
+            d.put_value(v->size());
+            for (auto i : *v)
+                d.put_value(i);
+            break;
+        }
+        case TrackerType::TrackerVectorString: {
+            auto v = std::static_pointer_cast<TrackerElementVectorString>(e);
+            d.put_value(v->size());
+            for (auto i : *v)
+                d.put_value(i);
+            break;
+        }
+        case TrackerType::TrackerMap: {
+            // Map children carry their field id, so the key is implied
+            auto m = std::static_pointer_cast<TrackerElementMap>(e);
+            d.put_value(m->size());
+            for (auto i : *m)
+                digest_tracker_element(d, i.second);
+            break;
+        }
+        case TrackerType::TrackerIntMap:
+            digest_keyed_map<TrackerElementIntMap>(d, e);
+            break;
+        case TrackerType::TrackerMacMap:
+            digest_keyed_map<TrackerElementMacMap>(d, e);
+            break;
+        case TrackerType::TrackerStringMap:
+            digest_keyed_map<TrackerElementStringMap>(d, e);
+            break;
+        case TrackerType::TrackerDoubleMap:
+            digest_keyed_map<TrackerElementDoubleMap>(d, e);
+            break;
+        case TrackerType::TrackerKeyMap:
+            digest_keyed_map<TrackerElementDeviceKeyMap>(d, e);
+            break;
+        case TrackerType::TrackerHashkeyMap:
+            digest_keyed_map<TrackerElementHashkeyMap>(d, e);
+            break;
+        case TrackerType::TrackerDoubleMapDouble: {
+            auto m = std::static_pointer_cast<TrackerElementDoubleMapDouble>(e);
+            d.put_value(m->size());
+            for (auto i : *m) {
+                d.put_value(i.first);
+                d.put_value(i.second);
+            }
+            break;
+        }
+    }
+}
+
+uint64_t DigestTrackerElement(const std::shared_ptr<TrackerElement>& e) {
+    tracker_element_digest d;
+    digest_tracker_element(d, e);
+    return d.get();
+}
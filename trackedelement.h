@@ -30,10 +30,14 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <new>
+#include <typeinfo>
+#include <cstddef>
 
 #include "fmt.h"
 
 #include "kis_mutex.h"
+#include "kis_flat_map.h"
 #include "macaddr.h"
 #include "uuid.h"
 
@@ -62,6 +66,7 @@ public:
     friend bool operator ==(const device_key& x, const device_key& y);
     friend std::ostream& operator<<(std::ostream& os, const device_key& k);
     friend std::istream& operator>>(std::istream& is, device_key& k);
+    friend struct std::hash<device_key>;
 
     device_key();
 
@@ -87,6 +92,10 @@ public:
 
     bool get_error() { return error; }
 
+    // Raw key components, for serializers which format the key directly
+    uint64_t get_spkey() const { return spkey; }
+    uint64_t get_dkey() const { return dkey; }
+
 protected:
     uint64_t spkey, dkey;
     bool error;
@@ -97,6 +106,16 @@ bool operator ==(const device_key& x, const device_key& y);
 std::ostream& operator<<(std::ostream& os, const device_key& k);
 std::istream& operator>>(std::istream& is, device_key& k);
 
+namespace std {
+    template<> struct hash<device_key> {
+        size_t operator()(const device_key& k) const {
+            // spkey is shared by every device from the same server and phy, so mix it
+            // in rather than letting it dominate the dkey bits
+            return (size_t) (k.dkey ^ (k.spkey * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+}
+
 // Types of fields we can track and automatically resolve
 // Statically assigned type numbers which MUST NOT CHANGE as things go forwards for 
 // binary/fast serialization, new types must be added to the end of the list
@@ -177,6 +196,28 @@ public:
         type(t),
         tracked_id(id) { }
 
+    TrackerElement(const TrackerElement& e) :
+        type(e.type),
+        tracked_id(e.tracked_id) {
+        if (e.local_name != nullptr)
+            local_name.reset(new std::string(*e.local_name));
+    }
+
+    TrackerElement& operator=(const TrackerElement& e) {
+        type = e.type;
+        tracked_id = e.tracked_id;
+
+        if (e.local_name != nullptr)
+            local_name.reset(new std::string(*e.local_name));
+        else
+            local_name.reset();
+
+        return *this;
+    }
+
+    TrackerElement(TrackerElement&&) = default;
+    TrackerElement& operator=(TrackerElement&&) = default;
+
     virtual ~TrackerElement() { };
 
     // Factory-style for easily making more of the same if we're subclassed
@@ -188,6 +229,18 @@ public:
         return nullptr;
     }
 
+    // Elements which can be built in place, packed with the other fields of a tracked
+    // component into one allocation, return their size and construct an element of 
+    // their type in in_mem; other elements return 0 and are allocated on their own
+    virtual size_t inline_size() const {
+        return 0;
+    }
+
+    virtual TrackerElement *clone_inline(void *in_mem __attribute__((unused)), 
+            int in_id __attribute__((unused))) {
+        return nullptr;
+    }
+
     // Called prior to serialization output
     virtual void pre_serialize() { }
 
@@ -221,11 +274,21 @@ public:
     }
 
     void set_local_name(const std::string& in_name) {
-        local_name = in_name;
+        if (in_name.length() == 0)
+            local_name.reset();
+        else
+            local_name.reset(new std::string(in_name));
     }
 
     std::string get_local_name() {
-        return local_name;
+        if (local_name == nullptr)
+            return "";
+
+        return *local_name;
+    }
+
+    bool has_local_name() const {
+        return local_name != nullptr;
     }
 
     void set_type(TrackerType type);
@@ -266,8 +329,57 @@ protected:
     TrackerType type;
     int tracked_id;
 
-    // Overridden name for this instance only
-    std::string local_name;
+    // Overridden name for this instance only; almost never set, so only allocated
+    // when it is
+    std::unique_ptr<std::string> local_name;
+};
+
+// Build elements of a concrete type in place; subclasses which don't declare their 
+// own are allocated on their own rather than built as their parent type
+#define __TrackerElementInline(this_t) \
+    virtual size_t inline_size() const override { \
+        if (typeid(*this) != typeid(this_t)) \
+            return 0; \
+        return sizeof(this_t); \
+    } \
+    virtual TrackerElement *clone_inline(void *in_mem, int in_id) override { \
+        return new (in_mem) this_t(in_id); \
+    }
+
+// A block of elements built in place in a single allocation.  Elements are handed out
+// as shared pointers which share ownership of the whole block, so the block lives as
+// long as any of its elements.
+class tracker_element_block {
+public:
+    tracker_element_block(size_t in_size, size_t in_num) :
+        storage{new char[in_size]},
+        used{0} {
+        elements.reserve(in_num);
+    }
+
+    ~tracker_element_block() {
+        for (auto e = elements.rbegin(); e != elements.rend(); ++e)
+            (*e)->~TrackerElement();
+    }
+
+    // Space taken by an element in the block, keeping every element aligned
+    static size_t slot_size(size_t in_size) {
+        return (in_size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    }
+
+    // Build an element of the type of in_builder in the next free slot; the block must 
+    // have been sized for it
+    TrackerElement *emplace(TrackerElement *in_builder, int in_id) {
+        auto e = in_builder->clone_inline(storage.get() + used, in_id);
+        used += slot_size(in_builder->inline_size());
+        elements.push_back(e);
+        return e;
+    }
+
+protected:
+    std::unique_ptr<char[]> storage;
+    size_t used;
+    std::vector<TrackerElement *> elements;
 };
 
 // Generator function for making various elements
@@ -372,6 +484,8 @@ public:
         return std::move(dup);
     }
 
+    __TrackerElementInline(TrackerElementString)
+
     using TrackerElementCoreScalar<std::string>::less_than;
     inline bool less_than(const TrackerElementString& rhs) const;
 
@@ -416,6 +530,8 @@ public:
         return std::move(dup);
     }
 
+    __TrackerElementInline(TrackerElementByteArray)
+
     template<typename T>
     void set(const T& v) {
         value = std::string(v);
@@ -485,6 +601,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementDeviceKey)
 };
 
 class TrackerElementUUID : public TrackerElementCoreScalar<uuid> {
@@ -518,6 +636,8 @@ public:
         return std::move(dup);
     }
 
+    __TrackerElementInline(TrackerElementUUID)
+
 };
 
 class TrackerElementMacAddr : public TrackerElementCoreScalar<mac_addr> {
@@ -554,6 +674,8 @@ public:
         return std::move(dup);
     }
 
+    __TrackerElementInline(TrackerElementMacAddr)
+
 };
 
 // Simplify numeric conversion w/ an interstitial scalar-like that holds all 
@@ -793,6 +915,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementUInt8)
 };
 
 class TrackerElementInt8 : public TrackerElementCoreNumeric<int8_t> {
@@ -830,6 +954,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementInt8)
 };
 
 class TrackerElementUInt16 : public TrackerElementCoreNumeric<uint16_t> {
@@ -867,6 +993,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementUInt16)
 };
 
 class TrackerElementInt16 : public TrackerElementCoreNumeric<int16_t> {
@@ -904,6 +1032,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementInt16)
 };
 
 class TrackerElementUInt32 : public TrackerElementCoreNumeric<uint32_t> {
@@ -941,6 +1071,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementUInt32)
 };
 
 class TrackerElementInt32 : public TrackerElementCoreNumeric<int32_t> {
@@ -978,6 +1110,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementInt32)
 };
 
 class TrackerElementUInt64 : public TrackerElementCoreNumeric<uint64_t> {
@@ -1015,6 +1149,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementUInt64)
 };
 
 class TrackerElementInt64 : public TrackerElementCoreNumeric<int64_t> {
@@ -1052,6 +1188,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementInt64)
 };
 
 class TrackerElementFloat : public TrackerElementCoreNumeric<float> {
@@ -1089,6 +1227,8 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementFloat)
 };
 
 class TrackerElementDouble : public TrackerElementCoreNumeric<double> {
@@ -1126,14 +1266,17 @@ public:
         auto dup = std::unique_ptr<this_t>(new this_t(in_id));
         return std::move(dup);
     }
+
+    __TrackerElementInline(TrackerElementDouble)
 };
 
 
-// Superclass for generic access to maps via multiple key structures
-template <typename K, typename V>
+// Superclass for generic access to maps via multiple key structures; M is the
+// underlying container, which must provide the std::map interface used here
+template <typename K, typename V, typename M = std::map<K, V>>
 class TrackerElementCoreMap : public TrackerElement {
 public:
-    using map_t = std::map<K, V>;
+    using map_t = M;
     using iterator = typename map_t::iterator;
     using const_iterator = typename map_t::const_iterator;
     using pair = std::pair<K, V>;
@@ -1243,14 +1386,20 @@ protected:
     map_t map;
 };
 
-// Dictionary / map-by-id
-class TrackerElementMap : public TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>> {
+// Dictionary / map-by-id.  These back every tracked component, so they use a flat
+// map to avoid a tree node allocation per field.  Inserting a new id moves the other
+// fields; maps which are read while they change should reserve a slot for each id 
+// they may hold, with insert(id, nullptr), and replace the value in place.
+class TrackerElementMap : public TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>,
+    kis_flat_map<int, std::shared_ptr<TrackerElement>>> {
 public:
     TrackerElementMap() :
-        TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>>(TrackerType::TrackerMap) { }
+        TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>,
+            kis_flat_map<int, std::shared_ptr<TrackerElement>>>(TrackerType::TrackerMap) { }
 
     TrackerElementMap(int id) :
-        TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>>(TrackerType::TrackerMap, id) { }
+        TrackerElementCoreMap<int, std::shared_ptr<TrackerElement>,
+            kis_flat_map<int, std::shared_ptr<TrackerElement>>>(TrackerType::TrackerMap, id) { }
 
     static TrackerType static_type() {
         return TrackerType::TrackerMap;
@@ -1774,6 +1923,8 @@ template<> void SetTrackerValue(const SharedTrackerElement& e, const device_key&
 class TrackerElementSummary;
 using SharedElementSummary =  std::shared_ptr<TrackerElementSummary>;
 
+class TrackerElementProjection;
+
 // Element simplification record for summarizing and simplifying records
 class TrackerElementSummary {
 public:
@@ -1795,6 +1946,10 @@ public:
     std::vector<int> resolved_path;
     std::string rename;
 
+    // Set on the rename record of a vector marked by a projection; each element of the
+    // vector is serialized through the projection
+    std::shared_ptr<TrackerElementProjection> projection;
+
 protected:
     void parse_path(const std::vector<std::string>& in_path, const std::string& in_rename);
 };
@@ -1813,6 +1968,13 @@ public:
     virtual void serialize(SharedTrackerElement in_elem, 
             std::ostream &stream, std::shared_ptr<rename_map> name_map) = 0;
 
+    // Serializers which walk projected vectors themselves return true; vectors marked
+    // by a projection are expanded into summarized copies before being handed to any
+    // other serializer
+    virtual bool projects() const {
+        return false;
+    }
+
     // Fields extracted from a summary path need to preserialize their parent
     // paths or updates may not happen in the expected fashion, serializers should
     // call this when necessary
@@ -1822,6 +1984,87 @@ protected:
     kis_recursive_timed_mutex mutex;
 };
 
+// A 'fields' summarization compiled once against the registered fields.  Paths are
+// resolved up front, the slots are put in the order the summarized map would hold
+// them, and the placeholders for fields an element doesn't have are built once 
+// instead of per element.
+//
+// A projection can summarize elements the same way SummarizeTrackerElement does, but
+// the point is to not: a vector marked with the projection is serialized by walking
+// the slots directly against each element, so projecting a device list costs no
+// per-device maps, summary copies, or rename records.
+class TrackerElementProjection : public std::enable_shared_from_this<TrackerElementProjection> {
+public:
+    TrackerElementProjection(const std::vector<SharedElementSummary>& in_summarization);
+
+    struct slot {
+        // Resolved path, and the field id it ends in (or the placeholder id, if 
+        // the path could not be resolved)
+        std::vector<int> path;
+        int id;
+
+        // Shared summary record holding the rename; summarized slots (renamed, or 
+        // more than one deep) have rename records when summarized
+        SharedElementSummary summary;
+        bool summarized;
+
+        // Reported when the path does not exist in an element
+        SharedTrackerElement placeholder;
+    };
+
+    const std::vector<slot>& get_slots() const {
+        return slots;
+    }
+
+    // Original summarization records, in request order
+    const std::vector<SharedElementSummary>& get_summarization() const {
+        return summarization;
+    }
+
+    // Field generation this projection was resolved against
+    uint64_t get_generation() const {
+        return generation;
+    }
+
+    // Find the element for a slot, or the placeholder if it does not exist
+    SharedTrackerElement resolve(const slot& in_slot, const SharedTrackerElement& in_elem) const;
+
+    // Pre- and post-serialize the intermediate elements of a resolved slot path, 
+    // the same as the path of a summarized field
+    void enter(const slot& in_slot, const SharedTrackerElement& in_elem, 
+            const SharedTrackerElement& in_resolved) const;
+    void leave(const slot& in_slot, const SharedTrackerElement& in_elem,
+            const SharedTrackerElement& in_resolved) const;
+
+    // Mark a vector owned by the caller so that each element is projected when serialized
+    void mark(std::shared_ptr<TrackerElementVector> in_vec,
+            std::shared_ptr<TrackerElementSerializer::rename_map> rename_map);
+
+    // Project an element; vectors are copied and marked, anything else is summarized
+    SharedTrackerElement apply(SharedTrackerElement in, 
+            std::shared_ptr<TrackerElementSerializer::rename_map> rename_map);
+
+    // Summarize a single element, the same as SummarizeSingleTrackerElement
+    SharedTrackerElement summarize(SharedTrackerElement in,
+            std::shared_ptr<TrackerElementSerializer::rename_map> rename_map) const;
+
+    // Summarize the fields of an element into an existing map, keeping only the slots
+    // whose path starts at a field accepted by the filter, such as the fields of a 
+    // device which changed; the element must already be locked for serializing
+    void summarize_into(SharedTrackerElement in, std::shared_ptr<TrackerElementMap> out,
+            std::shared_ptr<TrackerElementSerializer::rename_map> rename_map,
+            const std::function<bool (int)>& in_filter) const;
+
+    // Replace the contents of every vector marked in a rename map with summarized 
+    // elements, for serializers which do not walk projections
+    static void expand(std::shared_ptr<TrackerElementSerializer::rename_map> rename_map);
+
+protected:
+    std::vector<SharedElementSummary> summarization;
+    std::vector<slot> slots;
+    uint64_t generation;
+};
+
 // Get an element using path semantics
 // Full std::string path
 SharedTrackerElement GetTrackerElementPath(const std::string& in_path, SharedTrackerElement elem);
@@ -1871,4 +2114,14 @@ bool SortTrackerElementLess(const std::shared_ptr<TrackerElement> lhs,
 bool FastSortTrackerElementLess(const std::shared_ptr<TrackerElement> lhs, 
         const std::shared_ptr<TrackerElement> rhs) noexcept;
 
+// Estimate the memory used by an element and everything beneath it, in bytes.  This
+// is an approximation based on the element types and container sizes, used for memory
+// accounting; it does not account for allocator overhead or shared children.
+size_t EstimateTrackerElementSize(const std::shared_ptr<TrackerElement>& e);
+
+// Digest the type, field, and value of an element and everything beneath it.  The
+// digest changes whenever the serialized form of the element would, so it can be used
+// as a cheap change check (such as an HTTP entity tag) without serializing the tree.
+uint64_t DigestTrackerElement(const std::shared_ptr<TrackerElement>& e);
+
 #endif
@@ -143,6 +143,54 @@ void kis_tracked_location::add_loc(double in_lat, double in_lon, double in_alt,
         set_fix(fix);
     }
 
+    expand_bounds(in_lat, in_lon, in_alt, fix);
+
+    // Append to averaged location
+    (*avg_lat) += (int64_t) (in_lat * precision_multiplier);
+    (*avg_lon) += (int64_t) (in_lon * precision_multiplier);
+    (*num_avg) += 1;
+
+    if (fix > 2) {
+        (*avg_alt) += (int64_t) (in_alt * precision_multiplier);
+        (*num_alt_avg) += 1;
+    }
+
+    update_average();
+}
+
+void kis_tracked_location::merge(std::shared_ptr<kis_tracked_location> in_loc) {
+    if (in_loc == nullptr || !in_loc->get_valid() || in_loc->get_num_agg() == 0)
+        return;
+
+    set_valid(1);
+
+    if (in_loc->get_fix() > get_fix()) {
+        set_fix(in_loc->get_fix());
+    }
+
+    // Altitude is only recorded in the bounds with a 3d fix
+    auto in_min = in_loc->get_min_loc();
+    auto in_max = in_loc->get_max_loc();
+
+    if (in_min != nullptr)
+        expand_bounds(in_min->get_lat(), in_min->get_lon(), in_min->get_alt(),
+                in_min->get_alt() != 0 ? 3 : 2);
+
+    if (in_max != nullptr)
+        expand_bounds(in_max->get_lat(), in_max->get_lon(), in_max->get_alt(),
+                in_max->get_alt() != 0 ? 3 : 2);
+
+    (*avg_lat) += in_loc->get_agg_lat();
+    (*avg_lon) += in_loc->get_agg_lon();
+    (*avg_alt) += in_loc->get_agg_alt();
+    (*num_avg) += in_loc->get_num_agg();
+    (*num_alt_avg) += in_loc->get_num_alt_agg();
+
+    update_average();
+}
+
+void kis_tracked_location::expand_bounds(double in_lat, double in_lon, double in_alt,
+        unsigned int fix) {
     if (min_loc == nullptr) {
         min_loc = std::make_shared<kis_tracked_location_triplet>(min_loc_id);
         insert(min_loc);
@@ -153,11 +201,6 @@ void kis_tracked_location::add_loc(double in_lat, double in_lon, double in_alt,
         insert(max_loc);
     }
 
-    if (avg_loc == nullptr) {
-        avg_loc = std::make_shared<kis_tracked_location_triplet>(avg_loc_id);
-        insert(avg_loc);
-    }
-
     if (in_lat < min_loc->get_lat() || min_loc->get_lat() == 0) {
         min_loc->set_lat(in_lat);
     }
@@ -183,15 +226,12 @@ void kis_tracked_location::add_loc(double in_lat, double in_lon, double in_alt,
             max_loc->set_alt(in_alt);
         }
     }
+}
 
-    // Append to averaged location
-    (*avg_lat) += (int64_t) (in_lat * precision_multiplier);
-    (*avg_lon) += (int64_t) (in_lon * precision_multiplier);
-    (*num_avg) += 1;
-
-    if (fix > 2) {
-        (*avg_alt) += (int64_t) (in_alt * precision_multiplier);
-        (*num_alt_avg) += 1;
+void kis_tracked_location::update_average() {
+    if (avg_loc == nullptr) {
+        avg_loc = std::make_shared<kis_tracked_location_triplet>(avg_loc_id);
+        insert(avg_loc);
     }
 
     double calc_lat, calc_lon, calc_alt;
@@ -120,6 +120,9 @@ public:
 
     void add_loc(double in_lat, double in_lon, double in_alt, unsigned int fix);
 
+    // Fold in the bounds and average of another location record
+    void merge(std::shared_ptr<kis_tracked_location> in_loc);
+
     __Proxy(valid, uint8_t, bool, bool, loc_valid);
     __Proxy(fix, uint8_t, unsigned int, unsigned int, loc_fix);
 
@@ -136,6 +139,9 @@ public:
 protected:
     virtual void register_fields() override;
 
+    void expand_bounds(double in_lat, double in_lon, double in_alt, unsigned int fix);
+    void update_average();
+
     // We save the IDs here because we dynamically generate them
     std::shared_ptr<kis_tracked_location_triplet> min_loc, max_loc, avg_loc;
     int min_loc_id, max_loc_id, avg_loc_id;